@@ -45,13 +45,39 @@ JSValue pomelo_qjs_runtime_compile_module(
 );
 
 
-/// @brief Evaluate a module
+/// @brief Evaluate a module, then run the loop until it is empty. It blocks
+/// the calling thread.
 int pomelo_qjs_runtime_evaluate_module(
     pomelo_qjs_runtime_t * runtime,
     JSValue module_val
 );
 
 
+/// @brief Evaluate a module without running the loop. The loop is driven by
+/// pomelo_qjs_runtime_run or pomelo_qjs_runtime_poll later.
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_runtime_evaluate(
+    pomelo_qjs_runtime_t * runtime,
+    JSValue module_val
+);
+
+
+/// @brief Run the loop until it is empty or the runtime is stopped
+void pomelo_qjs_runtime_run(pomelo_qjs_runtime_t * runtime);
+
+
+/// @brief Poll the loop once without blocking, then execute the pending jobs
+/// until the budget is exhausted. It is called by hosts which own the frame
+/// loop, e.g. once per frame.
+/// @param budget_us The time budget of jobs in microseconds. At least one
+/// pending job is executed. Zero to execute all pending jobs.
+/// @return Returns 1 if the runtime still has work, or 0 if it is done
+int pomelo_qjs_runtime_poll(
+    pomelo_qjs_runtime_t * runtime,
+    uint64_t budget_us
+);
+
+
 #ifdef __cplusplus
 }
 #endif
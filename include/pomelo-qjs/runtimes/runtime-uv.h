@@ -1,11 +1,20 @@
 #ifndef POMELO_QJS_RUNTIME_UV_H
 #define POMELO_QJS_RUNTIME_UV_H
+#include <uv.h>
 #include "pomelo-qjs/runtime.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/// @brief The callback of posted work. It is called on the loop thread of
+/// runtime.
+typedef void (*pomelo_qjs_runtime_post_callback)(
+    pomelo_qjs_runtime_t * runtime,
+    void * data
+);
+
+
 /// @brief Option to create runtime with uv
 typedef struct pomelo_qjs_runtime_uv_options_s pomelo_qjs_runtime_uv_options_t;
 
@@ -13,6 +22,11 @@ typedef struct pomelo_qjs_runtime_uv_options_s pomelo_qjs_runtime_uv_options_t;
 struct pomelo_qjs_runtime_uv_options_s {
     /// @brief Allocator
     pomelo_allocator_t * allocator;
+
+    /// @brief The loop of caller. Optional. The runtime uses its own loop if
+    /// it is NULL. A caller-owned loop must outlive the runtime, and it is
+    /// usually driven by pomelo_qjs_runtime_poll.
+    uv_loop_t * uv_loop;
 };
 
 
@@ -27,6 +41,28 @@ pomelo_qjs_runtime_t * pomelo_qjs_runtime_uv_create(
 void pomelo_qjs_runtime_uv_destroy(pomelo_qjs_runtime_t * runtime);
 
 
+/// @brief Post work to an uv runtime. It is safe to call from any thread
+/// while the runtime is alive. Posted callbacks are called in order on the
+/// loop thread, pending ones are called before the runtime is destroyed.
+/// Posts which race with the destruction fail.
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_runtime_post(
+    pomelo_qjs_runtime_t * runtime,
+    pomelo_qjs_runtime_post_callback callback,
+    void * data
+);
+
+
+/// @brief Deliver an event to the `onExternalEvent` hook of scripts of an uv
+/// runtime. It must be called on the loop thread, usually from posted work.
+/// The event is not consumed.
+/// @return Returns 0 on success, or -1 if there is no hook or it throws
+int pomelo_qjs_runtime_emit_external_event(
+    pomelo_qjs_runtime_t * runtime,
+    JSValue event
+);
+
+
 #ifdef __cplusplus
 }
 #endif
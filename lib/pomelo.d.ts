@@ -175,6 +175,235 @@ export interface RTT {
 }
 
 
+/**
+ * The options of sending a message
+ */
+export interface SendOptions {
+    /**
+     * The maximum age of message in milliseconds. When the session reaches
+     * the `maxInFlight` limit of its socket, the message waits in the binding
+     * queue and it is dropped if it becomes older than this value before
+     * being sent. The promise of a dropped message resolves to zero.
+     *
+     * On framed sockets (see `SocketOptions`), the message also carries its
+     * remaining age, and the receiving binding drops it if it arrives later
+     * than that compared to the fastest recent messages of the session. This
+     * does not apply to acknowledged messages nor to channels with
+     * redundancy or FEC. Messages handed to the socket are never recalled on
+     * the sender, so native retransmissions of reliable channels still
+     * happen. Both sides count their drops in `expiredMessages`.
+     */
+    maxAge?: number;
+
+    /**
+     * Complete the message when the peer acknowledges it, instead of when it
+     * is handed to the socket. The promise resolves to 1 on acknowledgement
+     * and rejects if the session disconnects first. It requires a reliable
+     * channel and a framed socket (see `SocketOptions`), and the receiving
+     * binding replies the acknowledgement automatically. Acknowledgements of
+     * the messages received in one loop iteration are replied together.
+     */
+    ack?: boolean;
+}
+
+
+/**
+ * The binding options of a channel
+ */
+export interface ChannelOptions {
+    /**
+     * The number of previous messages which are carried by every message of
+     * this channel (0 - 8). Received duplicates are dropped, so that
+     * `onReceived` is called once per message. It is intended for unreliable
+     * channels. Only messages of 256 bytes or smaller are repeated, and
+     * broadcast messages are never repeated.
+     */
+    redundancy?: number;
+
+    /**
+     * The number of messages of a FEC group (2 - 16). After every group, a
+     * parity message is sent and the receiver is able to rebuild any single
+     * lost message of the group before delivering it. It is intended for
+     * unreliable channels and cannot be combined with redundancy. Only
+     * messages of 512 bytes or smaller are protected, and broadcast messages
+     * are never protected.
+     */
+    fec?: number;
+}
+
+
+/**
+ * The options of socket
+ */
+export interface SocketOptions {
+    /**
+     * Frame every message of the socket even if no channel enables a binding
+     * feature. It is required by snapshot buffers. Both peers must use the
+     * same value.
+     */
+    framed?: boolean;
+
+    /**
+     * The binding options of channels, indexed by channel. Enabling any
+     * binding feature adds a two-byte frame header to every message of the
+     * socket, so both peers must use the same options.
+     */
+    channels?: ChannelOptions[];
+
+    /**
+     * The default inbound rate limit of sessions. Received messages exceeding
+     * the limit are dropped before they reach JS. On framed sockets, only
+     * user messages are limited, after they are decoded. Binding frames such
+     * as acknowledgements and FEC parity are never dropped, and dropped
+     * messages are never acknowledged.
+     */
+    rateLimit?: RateLimit;
+
+    /**
+     * The maximum number of messages of a session which are handed to the
+     * socket but not completed yet. Once it is reached, messages with
+     * `maxAge` wait in the binding queue, and any later message of the
+     * session waits behind them to keep the sending order. Zero or missing
+     * values mean unlimited.
+     */
+    maxInFlight?: number;
+}
+
+
+/**
+ * Inbound rate limit of a session. Both limits allow bursts of up to one
+ * second. A message larger than `bytesPerSecond` is still allowed once the
+ * byte budget is full, and later messages wait until it is paid back.
+ * Zero or missing values mean unlimited.
+ */
+export interface RateLimit {
+    /**
+     * The maximum number of received messages per second
+     */
+    messagesPerSecond?: number;
+
+    /**
+     * The maximum number of received bytes per second
+     */
+    bytesPerSecond?: number;
+}
+
+
+/**
+ * Admission policy of new connections. Connections arriving while any
+ * threshold is reached are denied before `onConnected` is called.
+ * Zero or missing values mean unlimited.
+ */
+export interface AdmissionPolicy {
+    /**
+     * The maximum number of connected sessions of socket
+     */
+    maxSessions?: number;
+
+    /**
+     * The maximum event loop lag in milliseconds
+     */
+    maxLoopLagMs?: number;
+
+    /**
+     * The maximum number of uncompleted sends of all sockets
+     */
+    maxPendingSends?: number;
+}
+
+
+/**
+ * Listen options of socket
+ */
+export interface ListenOptions {
+    /**
+     * The number of event loops of the server. Each extra loop runs on its
+     * own thread with its own runtime, which evaluates the same entry module.
+     * Every shard must listen with the same value.
+     *
+     * Sharding is not transparent: the server does not share one port.
+     * Shard K listens on the base port plus K and only admits clients whose
+     * ID maps to K, so the ports [port, port + shards) must be reachable and
+     * connect tokens must carry the address returned by
+     * `Token.shardAddress`. Clients of tokens with the base address are
+     * denied by every shard but shard 0.
+     */
+    shards?: number;
+
+    /**
+     * Listen as the shard of this process when the standalone host runs with
+     * `--processes N`. Child K then listens on the base port plus K, like
+     * shard K of `shards: N`. It is ignored when the process is not
+     * supervised. Default is false.
+     *
+     * Processes never share one port through `SO_REUSEPORT`: the native
+     * platform creates and binds the UDP sockets, and it has no option to
+     * reuse ports. Connect tokens must carry the per-shard addresses.
+     */
+    supervised?: boolean;
+}
+
+
+/**
+ * Per-session metric exported by `Socket.exportSessionMetrics`.
+ * - rttMean, rttVariance: Round trip time in milliseconds
+ * - messagesIn, bytesIn: Received messages and bytes
+ * - messagesOut, bytesOut: Messages and bytes handed to the native session,
+ *   including internal frames
+ * - lost: Messages detected as lost by redundant channels
+ * - queueDepth: Messages being sent or waiting in the binding
+ */
+export type SessionMetric =
+    "rttMean" |
+    "rttVariance" |
+    "messagesIn" |
+    "bytesIn" |
+    "messagesOut" |
+    "bytesOut" |
+    "lost" |
+    "queueDepth";
+
+
+/**
+ * Handler of routed messages. The message cursor is already past the opcode.
+ */
+export type RouteHandler = (session: Session, message: Message) => void;
+
+
+/**
+ * Options of a route
+ */
+export interface RouteOptions {
+    /**
+     * Only route messages of this channel. Channel routes take precedence
+     * over routes of all channels, and require a framed socket.
+     */
+    channel?: number;
+}
+
+
+/**
+ * Options of a session pipe
+ */
+export interface PipeOptions {
+    /**
+     * The channel of forwarded messages. By default, messages keep their
+     * channel on framed sockets and use channel 0 otherwise.
+     */
+    channel?: number;
+
+    /**
+     * The first forwarded byte of messages. Default is 0.
+     */
+    offset?: number;
+
+    /**
+     * The maximum number of forwarded bytes. Default is the rest of messages.
+     */
+    length?: number;
+}
+
+
 /**
  * The specific channel of a session
  */
@@ -187,10 +416,11 @@ export interface Channel {
     /**
      * Send message by specific channel
      * @param message The message to send
+     * @param options The sending options
      * @returns Returns a promise which will resolve to a number value
      * indicating the number of sent messages.
      */
-    send(message: Message): Promise<number>;
+    send(message: Message, options?: SendOptions): Promise<number>;
 }
 
 
@@ -203,6 +433,18 @@ export interface Session {
      */
     readonly id: bigint;
 
+    /**
+     * The session ID as a number. Throws a RangeError if the ID is not a safe
+     * integer, use `id` for such IDs.
+     */
+    readonly idNumber: number;
+
+    /**
+     * The dense index of session in its socket, or -1 after disconnecting.
+     * Indices of disconnected sessions are reused by new sessions.
+     */
+    readonly index: number;
+
     /**
      * The channels of session
      */
@@ -217,10 +459,53 @@ export interface Session {
      * Send message to the peer connected by this session
      * @param channelIndex The channel to send
      * @param message The message to send
+     * @param options The sending options
+     * @returns Returns a promise which will resolve to a number value
+     * indicating the number of sent messages.
+     */
+    send(
+        channelIndex: number,
+        message: Message,
+        options?: SendOptions
+    ): Promise<number>;
+
+    /**
+     * Send several messages to the peer in one call. The whole batch is
+     * validated before any message is sent.
+     * @param channelIndices The channel of each message
+     * @param messages The messages to send
+     * @returns Returns a promise which will resolve to the total number of
+     * sent messages after every message of batch completes.
+     */
+    sendMany(
+        channelIndices: number[],
+        messages: Message[]
+    ): Promise<number>;
+
+    /**
+     * Send a message which supersedes the older messages of the same key.
+     * Keys are scoped by channel. At most one message per key is handed to
+     * the native socket at a time. A newer message replaces the one which is
+     * still waiting, and the promise of the replaced message resolves to
+     * zero. A message which has been handed to the socket is not superseded,
+     * so reliable channels still retransmit it until it is delivered.
+     *
+     * On framed sockets (see `SocketOptions`), a message of reliable channel
+     * keeps its key busy until the peer acknowledges it, and its promise
+     * resolves to 1 then. Updates made during retransmissions collapse into
+     * the latest one instead of being retransmitted too. Otherwise the key
+     * is released once the message is handed to the socket.
+     * @param channelIndex The channel to send
+     * @param key The key of message, an integer in [0, 2^32)
+     * @param message The message to send
      * @returns Returns a promise which will resolve to a number value
      * indicating the number of sent messages.
      */
-    send(channelIndex: number, message: Message): Promise<number>;
+    sendLatest(
+        channelIndex: number,
+        key: number,
+        message: Message
+    ): Promise<number>;
 
     /**
      * Set mode for specific channel of a session
@@ -248,6 +533,32 @@ export interface Session {
      * Get the round trip time information of session
      */
     rtt(): RTT;
+
+    /**
+     * The mean round trip time in milliseconds
+     */
+    readonly rttMs: number;
+
+    /**
+     * Override the inbound rate limit of socket for this session.
+     * Pass null to use the rate limit of socket again.
+     */
+    setRateLimit(limit: RateLimit | null): void;
+
+    /**
+     * Forward every received message of this session to the targets natively,
+     * without calling `onReceived` or routes. Whole messages are forwarded by
+     * reference. Piping to an existing target replaces its options.
+     * Disconnected targets are dropped automatically.
+     * @param target A session or a group of sessions of the same socket
+     */
+    pipeTo(target: Session | Session[], options?: PipeOptions): void;
+
+    /**
+     * Stop forwarding messages to the targets, or to all targets if none is
+     * given. Messages are delivered to JS again once no target is left.
+     */
+    unpipe(target?: Session | Session[]): void;
 }
 
 
@@ -489,6 +800,36 @@ export interface Statistic {
          * The number of binding channels
          */
         channels: number;
+
+        /**
+         * The number of messages dropped because of their max age
+         */
+        expiredMessages: number;
+
+        /**
+         * The number of keyed messages replaced by newer ones
+         */
+        supersededMessages: number;
+
+        /**
+         * The number of lost messages rebuilt from FEC parity
+         */
+        fecRecoveredMessages: number;
+
+        /**
+         * The number of received messages dropped by rate limits
+         */
+        rateLimitedMessages: number;
+
+        /**
+         * The number of received messages dropped for unknown opcodes
+         */
+        unroutedMessages: number;
+
+        /**
+         * The number of connections denied by admission policies
+         */
+        rejectedConnections: number;
     }
 }
 
@@ -497,12 +838,197 @@ export interface Statistic {
  * The socket.
  * Passing listener of socket is not so convinient
  */
+/**
+ * Jitter buffer of snapshot stream. Every snapshot message starts with its
+ * uint32 tick. The playout delay adapts to the measured jitter.
+ */
+export class SnapshotBuffer {
+    /**
+     * Create new snapshot buffer
+     * @param tickInterval The duration of a tick in milliseconds
+     * @param capacity The number of snapshots to keep (2 - 1024), default 32
+     */
+    constructor(tickInterval: number, capacity?: number);
+
+    /**
+     * The current playout delay in milliseconds
+     */
+    readonly delay: number;
+
+    /**
+     * The smoothed jitter of arrivals in milliseconds
+     */
+    readonly jitter: number;
+
+    /**
+     * Feed the buffer directly from a channel of session. Messages of the
+     * channel are pushed to this buffer instead of calling `onReceived`.
+     * The socket must be framed (see `SocketOptions.framed`). The buffer is
+     * detached automatically when the session is disconnected.
+     * @param session The session
+     * @param channelIndex The channel index
+     */
+    attach(session: Session, channelIndex: number): void;
+
+    /**
+     * Stop feeding the buffer from the attached channel
+     */
+    detach(): void;
+
+    /**
+     * Push a snapshot message manually
+     * @param message The snapshot message
+     */
+    push(message: Message): void;
+
+    /**
+     * Pick the pair of snapshots to interpolate at current render time. The
+     * snapshots are written to the given messages, which can be reused
+     * across frames.
+     * @param from The message to receive the earlier snapshot
+     * @param to The message to receive the later snapshot
+     * @returns The interpolation alpha in [0, 1], or -1 if the buffer is empty
+     */
+    sample(from: Message, to: Message): number;
+
+    /**
+     * Remove all snapshots and reset the timing estimation
+     */
+    clear(): void;
+}
+
+
+/**
+ * Element type of session table column
+ */
+export type ColumnType = "float32" | "int32" | "uint8";
+
+
+/**
+ * Struct-of-arrays store of per-session attributes. Every column is a typed
+ * array indexed by `session.index`. Rows are zeroed when their sessions
+ * disconnect. Sessions whose index is not less than the capacity have no row.
+ */
+export class SessionTable {
+    /**
+     * Create new session table
+     * @param socket The socket which owns the sessions
+     * @param capacity The number of rows
+     */
+    constructor(socket: Socket, capacity: number);
+
+    /**
+     * The number of rows
+     */
+    readonly capacity: number;
+
+    /**
+     * Get or create a zeroed column. The same typed array is returned for the
+     * same name. A column whose buffer is detached, e.g. by
+     * `ArrayBuffer.prototype.transfer`, is no longer cleared.
+     */
+    column(name: string, type: "float32"): Float32Array;
+    column(name: string, type: "int32"): Int32Array;
+    column(name: string, type: "uint8"): Uint8Array;
+
+    /**
+     * Zero a row of all columns
+     */
+    clearRow(index: number): void;
+}
+
+
+/**
+ * Options of a lockstep aggregator
+ */
+export interface LockstepOptions {
+    /**
+     * The maximum time in milliseconds to wait for missing inputs after the
+     * first input of a tick has arrived
+     */
+    timeoutMs: number;
+
+    /**
+     * The channel of inputs and frames. Default is 0. Only messages of this
+     * channel are captured as inputs.
+     */
+    channel?: number;
+
+    /**
+     * The maximum size of an input in bytes (tick excluded). Default is 64.
+     */
+    inputCapacity?: number;
+
+    /**
+     * The first collected tick. Default is 0.
+     */
+    startTick?: number;
+}
+
+
+/**
+ * Native lockstep input aggregator of a group of sessions (up to 32).
+ * Members send `[uint32 tick][input]` messages, which are captured natively
+ * instead of reaching `onReceived`. Once all members have sent the input of
+ * the current tick, or the timeout has elapsed, all members receive one frame:
+ * `[uint32 tick][uint8 count]` followed by `[uint8 slot][uint16 size][input]`
+ * for every received input. Late inputs are dropped.
+ */
+export class LockstepAggregator {
+    constructor(options: LockstepOptions);
+
+    /**
+     * Add a session of socket to the group. All members must belong to the
+     * same framed socket, other messages of members keep reaching
+     * `onReceived`. Disconnected sessions are removed automatically.
+     * @returns Returns the slot of member in frames
+     */
+    add(session: Session): number;
+
+    /**
+     * Remove a session from the group
+     */
+    remove(session: Session): void;
+
+    /**
+     * Emit the frame of current tick immediately
+     */
+    flush(): void;
+
+    /**
+     * The tick which is being collected
+     */
+    readonly tick: number;
+
+    /**
+     * The number of members
+     */
+    readonly size: number;
+
+    /**
+     * The number of emitted frames
+     */
+    readonly emittedFrames: number;
+
+    /**
+     * The number of dropped late, early, duplicated or malformed inputs
+     */
+    readonly droppedInputs: number;
+
+    /**
+     * The number of inputs which were missing from their frames
+     */
+    readonly missingInputs: number;
+}
+
+
 export class Socket {
     /**
      * Create new socket
      * @param channelModes Initial channel modes
+     * @param options The socket options
      */
-    constructor(channelModes: ChannelMode[]);
+    constructor(channelModes: ChannelMode[], options?: SocketOptions);
 
     /**
      * Set the socket listener
@@ -516,6 +1042,7 @@ export class Socket {
      * @param protocolID The protocol ID
      * @param maxClients The maximum number of clients
      * @param address The bind address
+     * @param options The listen options
      * @returns Returns a promise which will resolve if socket starts listening
      * successfully, or reject on error.
      */
@@ -523,7 +1050,8 @@ export class Socket {
         privateKey: Uint8Array,
         protocolID: number | bigint,
         maxClients: number,
-        address: string
+        address: string,
+        options?: ListenOptions
     ): Promise<void>;
 
     /**
@@ -554,10 +1082,110 @@ export class Socket {
         recipients: Session[]
     ): Promise<number>;
 
+    /**
+     * Send a distinct slice of one buffer to each session in a single call.
+     * Slice `i` (`buffer[offsets[i], offsets[i] + lengths[i])`) is sent to
+     * `sessions[i]`. Messages are sent without completion promises.
+     * @param channelIndex The sending channel index
+     * @param sessions List of recipients
+     * @param buffer The buffer holding all payloads
+     * @param offsets The payload offsets, indexed by recipient
+     * @param lengths The payload lengths, indexed by recipient
+     * @returns Returns the number of enqueued messages. Disconnected
+     * sessions are skipped.
+     */
+    sendScatter(
+        channelIndex: number,
+        sessions: Session[],
+        buffer: ArrayBuffer | Uint8Array,
+        offsets: Uint32Array,
+        lengths: Uint32Array
+    ): number;
+
     /**
      * Get synchronized socket time
      */
     time(): bigint;
+
+    /**
+     * Get socket time in milliseconds
+     */
+    timeMs(): number;
+
+    /**
+     * Get synchronized socket time in milliseconds. On clients, this is the
+     * estimated server time. The returned value never goes backward until
+     * the socket connects again, possibly to another server.
+     */
+    serverTime(): number;
+
+    /**
+     * Route received messages by their leading uint8 opcode. Once any route
+     * is registered, routed messages no longer reach `onReceived` and
+     * messages with unknown opcodes are dropped natively.
+     * Pass null as handler to remove the route.
+     */
+    route(
+        opcode: number,
+        handler: RouteHandler | null,
+        options?: RouteOptions
+    ): void;
+
+    /**
+     * The number of connected sessions
+     */
+    readonly sessionCount: number;
+
+    /**
+     * Find a connected session by its ID
+     * @param id The session ID
+     * @returns Returns the session or undefined if not found
+     */
+    getSession(id: bigint | number): Session | undefined;
+
+    /**
+     * Call the callback for every connected session. Sessions connected or
+     * disconnected by the callback do not affect the iteration.
+     */
+    forEachSession(callback: (session: Session) => void): void;
+
+    /**
+     * Disconnect all connected sessions, or only the ones accepted by filter
+     * @returns Returns the number of disconnected sessions
+     */
+    disconnectAll(filter?: (session: Session) => boolean): number;
+
+    /**
+     * Write metrics of all connected sessions into a Float64Array in one
+     * pass. The metrics of a session are written at row `session.index`,
+     * i.e. `target[session.index * fields.length + field]`. Sessions whose
+     * row is out of target are skipped.
+     * @param target The output array
+     * @param fields The metrics of each row, all metrics by default (in the
+     * declaration order of SessionMetric)
+     * @returns Returns the number of exported sessions
+     */
+    exportSessionMetrics(
+        target: Float64Array,
+        fields?: SessionMetric[]
+    ): number;
+
+    /**
+     * Set the admission policy of new connections. It only applies while the
+     * socket is listening. Denied connections are counted by
+     * `Statistic.binding.rejectedConnections`. Stopping the socket clears
+     * the policy, set it again after listening again.
+     * Pass null to admit all connections.
+     * @throws RangeError if a threshold is out of range. Counts must be
+     * integers up to 2^32 - 1, and the loop lag must be at most one day.
+     */
+    setAdmissionPolicy(policy: AdmissionPolicy | null): void;
+
+    /**
+     * The current event loop lag in milliseconds. It is only measured while
+     * the admission policy limits the loop lag, otherwise it is zero.
+     */
+    readonly loopLagMs: number;
 }
 
 
@@ -599,6 +1227,20 @@ export namespace Token {
      */
     function randomBuffer(length: number | bigint): Uint8Array;
 
+    /**
+     * Get the address of the shard which serves a client. Issuers of connect
+     * tokens for sharded servers must use it, since every shard listens on
+     * its own port (see `ListenOptions.shards`).
+     * @param address The base address of sharded server
+     * @param shards The number of shards
+     * @param clientID The client ID
+     */
+    function shardAddress(
+        address: string,
+        shards: number,
+        clientID: number | bigint
+    ): string;
+
     /**
      * The number of bytes of pomelo keys
      */
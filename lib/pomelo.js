@@ -13,5 +13,8 @@ export const Message = pomelo.Message;
 export const Socket = pomelo.Socket;
 export const Plugin = pomelo.Plugin;
 export const Token = pomelo.Token;
+export const SnapshotBuffer = pomelo.SnapshotBuffer;
+export const SessionTable = pomelo.SessionTable;
+export const LockstepAggregator = pomelo.LockstepAggregator;
 export const Platform = pomelo.Platform;
 export const statistic = pomelo.statistic;
@@ -0,0 +1,233 @@
+#include <assert.h>
+#include "admission.h"
+#include "context.h"
+
+/// Weight of new lag samples which are lower than the current loop lag
+#define ADMISSION_LAG_DECAY 0.2
+
+/// The maximum value of count thresholds
+#define ADMISSION_MAX_COUNT 4294967295.0
+
+/// The maximum loop lag threshold in milliseconds (one day)
+#define ADMISSION_MAX_LOOP_LAG 86400000.0
+
+
+/// @brief Timer entry of loop lag probe
+static void admission_probe(pomelo_qjs_admission_t * admission) {
+    assert(admission != NULL);
+    uint64_t now = pomelo_platform_hrtime(admission->context->platform);
+    double elapsed = (double) (now - admission->probe_time) / 1000000.0;
+    admission->probe_time = now;
+
+    double lag = elapsed - POMELO_QJS_ADMISSION_PROBE_INTERVAL_MS;
+    if (lag < 0) lag = 0;
+
+    // Rise immediately, fall slowly
+    if (lag > admission->loop_lag) {
+        admission->loop_lag = lag;
+    } else {
+        double delta = lag - admission->loop_lag;
+        admission->loop_lag += delta * ADMISSION_LAG_DECAY;
+    }
+}
+
+
+/// @brief Stop the loop lag probe
+static void admission_stop_probe(pomelo_qjs_admission_t * admission) {
+    if (!admission->probing) return;
+    pomelo_platform_timer_stop(
+        admission->context->platform,
+        &admission->probe_handle
+    );
+    admission->probing = false;
+    admission->loop_lag = 0;
+}
+
+
+/// @brief Parse a threshold property in the range [0, max]. Count
+/// thresholds must be integers.
+static int admission_parse_threshold(
+    JSContext * ctx,
+    JSValue value,
+    const char * name,
+    double max,
+    bool integer,
+    double * threshold
+) {
+    *threshold = 0;
+    JSValue js_threshold = JS_GetPropertyStr(ctx, value, name);
+    if (JS_IsUndefined(js_threshold)) return 0;
+
+    int ret = JS_ToFloat64(ctx, threshold, js_threshold);
+    JS_FreeValue(ctx, js_threshold);
+    if (ret != 0) return -1;
+
+    // This also rejects NaN and infinities. The range check makes the
+    // integer cast defined.
+    double parsed = *threshold;
+    if (
+        !(parsed >= 0 && parsed <= max) ||
+        (integer && (double) (uint64_t) parsed != parsed)
+    ) {
+        *threshold = 0;
+        JS_ThrowRangeError(
+            ctx,
+            integer
+                ? "%s must be an integer between 0 and %.0f"
+                : "%s must be a number between 0 and %.0f",
+            name,
+            max
+        );
+        return -1;
+    }
+    return 0;
+}
+
+
+void pomelo_qjs_admission_init(
+    pomelo_qjs_admission_t * admission,
+    pomelo_qjs_context_t * context
+) {
+    assert(admission != NULL);
+    admission->enabled = false;
+    admission->max_sessions = 0;
+    admission->max_loop_lag = 0;
+    admission->max_pending_sends = 0;
+    admission->context = context;
+    admission->probing = false;
+    admission->probe_time = 0;
+    admission->loop_lag = 0;
+}
+
+
+void pomelo_qjs_admission_cleanup(pomelo_qjs_admission_t * admission) {
+    assert(admission != NULL);
+    if (!admission->context) return;
+
+    admission_stop_probe(admission);
+    admission->enabled = false;
+}
+
+
+int pomelo_qjs_admission_configure(
+    pomelo_qjs_admission_t * admission,
+    JSValue value
+) {
+    assert(admission != NULL);
+    assert(admission->context != NULL);
+    JSContext * ctx = admission->context->ctx;
+
+    if (JS_IsUndefined(value) || JS_IsNull(value)) {
+        pomelo_qjs_admission_cleanup(admission);
+        return 0;
+    }
+
+    if (!JS_IsObject(value)) {
+        JS_ThrowTypeError(ctx, "Admission policy must be an object");
+        return -1;
+    }
+
+    double max_sessions = 0;
+    double max_loop_lag = 0;
+    double max_pending_sends = 0;
+    if (
+        admission_parse_threshold(
+            ctx,
+            value,
+            "maxSessions",
+            ADMISSION_MAX_COUNT,
+            true,
+            &max_sessions
+        ) < 0 ||
+        admission_parse_threshold(
+            ctx,
+            value,
+            "maxLoopLagMs",
+            ADMISSION_MAX_LOOP_LAG,
+            false,
+            &max_loop_lag
+        ) < 0 ||
+        admission_parse_threshold(
+            ctx,
+            value,
+            "maxPendingSends",
+            ADMISSION_MAX_COUNT,
+            true,
+            &max_pending_sends
+        ) < 0
+    ) {
+        return -1;
+    }
+
+    admission->enabled = true;
+    admission->max_sessions = (size_t) max_sessions;
+    admission->max_loop_lag = max_loop_lag;
+    admission->max_pending_sends = (size_t) max_pending_sends;
+
+    // The loop lag is only probed when it is limited
+    if (max_loop_lag > 0 && !admission->probing) {
+        pomelo_qjs_context_t * context = admission->context;
+        admission->probe_time = pomelo_platform_hrtime(context->platform);
+        admission->loop_lag = 0;
+        int ret = pomelo_platform_timer_start(
+            context->platform,
+            (pomelo_platform_timer_entry) admission_probe,
+            POMELO_QJS_ADMISSION_PROBE_INTERVAL_MS, // timeout
+            POMELO_QJS_ADMISSION_PROBE_INTERVAL_MS, // repeat
+            admission,
+            &admission->probe_handle
+        );
+        if (ret < 0) {
+            admission->enabled = false;
+            JS_ThrowInternalError(ctx, "Failed to start loop lag probe");
+            return -1;
+        }
+        admission->probing = true;
+    } else if (max_loop_lag == 0) {
+        admission_stop_probe(admission);
+    }
+
+    return 0;
+}
+
+
+double pomelo_qjs_admission_loop_lag(pomelo_qjs_admission_t * admission) {
+    assert(admission != NULL);
+    if (!admission->probing) return 0;
+
+    // A blocked loop delays the probe, so count the overdue time as well
+    uint64_t now = pomelo_platform_hrtime(admission->context->platform);
+    double overdue = (double) (now - admission->probe_time) / 1000000.0 -
+        POMELO_QJS_ADMISSION_PROBE_INTERVAL_MS;
+    return (overdue > admission->loop_lag) ? overdue : admission->loop_lag;
+}
+
+
+bool pomelo_qjs_admission_check(
+    pomelo_qjs_admission_t * admission,
+    size_t nsessions
+) {
+    assert(admission != NULL);
+    if (!admission->enabled) return true;
+
+    if (admission->max_sessions > 0 && nsessions >= admission->max_sessions) {
+        return false;
+    }
+
+    if (
+        admission->max_pending_sends > 0 &&
+        pomelo_pool_in_use(admission->context->pool_send_info) >=
+            admission->max_pending_sends
+    ) {
+        return false;
+    }
+
+    if (
+        admission->max_loop_lag > 0 &&
+        pomelo_qjs_admission_loop_lag(admission) > admission->max_loop_lag
+    ) {
+        return false;
+    }
+
+    return true;
+}
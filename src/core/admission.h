@@ -0,0 +1,89 @@
+#ifndef POMELO_QUICKJS_ADMISSION_SRC_H
+#define POMELO_QUICKJS_ADMISSION_SRC_H
+#include "quickjs.h"
+#include "pomelo/platform.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/// @brief The interval of loop lag probe in milliseconds
+#define POMELO_QJS_ADMISSION_PROBE_INTERVAL_MS 50
+
+
+/// @brief The admission policy of new connections
+typedef struct pomelo_qjs_admission_s pomelo_qjs_admission_t;
+
+
+struct pomelo_qjs_admission_s {
+    /// @brief Whether the policy is enabled
+    bool enabled;
+
+    /// @brief The maximum number of connected sessions. Zero means unlimited.
+    size_t max_sessions;
+
+    /// @brief The maximum loop lag in milliseconds. Zero means unlimited.
+    double max_loop_lag;
+
+    /// @brief The maximum number of uncompleted sends of context. Zero means
+    /// unlimited.
+    size_t max_pending_sends;
+
+    /// @brief The context
+    pomelo_qjs_context_t * context;
+
+    /// @brief Whether the loop lag probe is running
+    bool probing;
+
+    /// @brief The timer handle of loop lag probe
+    pomelo_platform_handle_t probe_handle;
+
+    /// @brief The time of last probe (hrtime in nanoseconds)
+    uint64_t probe_time;
+
+    /// @brief The smoothed loop lag in milliseconds
+    double loop_lag;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the admission policy
+void pomelo_qjs_admission_init(
+    pomelo_qjs_admission_t * admission,
+    pomelo_qjs_context_t * context
+);
+
+
+/// @brief Disable the admission policy and stop the loop lag probe
+void pomelo_qjs_admission_cleanup(pomelo_qjs_admission_t * admission);
+
+
+/// @brief Parse and apply the admission policy from JS value. Null or
+/// undefined value disables the policy.
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_admission_configure(
+    pomelo_qjs_admission_t * admission,
+    JSValue value
+);
+
+
+/// @brief Get the current loop lag in milliseconds
+double pomelo_qjs_admission_loop_lag(pomelo_qjs_admission_t * admission);
+
+
+/// @brief Check if a new connection is admitted
+/// @param nsessions The number of connected sessions
+bool pomelo_qjs_admission_check(
+    pomelo_qjs_admission_t * admission,
+    size_t nsessions
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_ADMISSION_SRC_H
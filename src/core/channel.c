@@ -2,13 +2,14 @@
 #include "context.h"
 #include "channel.h"
 #include "message.h"
+#include "session.h"
 
 #define countof(x) (sizeof(x) / sizeof((x)[0]))
 
 // JS Channels are managed by native side
 
 static JSCFunctionListEntry channel_funcs[] = {
-    JS_CFUNC_DEF("send", 1, pomelo_qjs_channel_send),
+    JS_CFUNC_DEF("send", 2, pomelo_qjs_channel_send),
     JS_CGETSET_DEF(
         "mode",
         pomelo_qjs_channel_get_mode,
@@ -53,9 +54,12 @@ int pomelo_qjs_init_channel_module(JSContext * ctx, JSModuleDef * m) {
 
 JSValue pomelo_qjs_channel_new(
     pomelo_qjs_context_t * context,
-    pomelo_channel_t * channel
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_channel_t * channel,
+    size_t index
 ) {
     assert(context != NULL);
+    assert(qjs_session != NULL);
     assert(channel != NULL);
     JSContext * ctx = context->ctx;
 
@@ -82,6 +86,8 @@ JSValue pomelo_qjs_channel_new(
 
     qjs_channel->channel = channel;
     qjs_channel->thiz = JS_DupValue(ctx, js_channel);
+    qjs_channel->qjs_session = qjs_session;
+    qjs_channel->index = index;
     pomelo_channel_set_extra(channel, qjs_channel);
 
     return js_channel;
@@ -96,6 +102,8 @@ int pomelo_qjs_channel_init(
     assert(context != NULL);
     qjs_channel->context = context;
     qjs_channel->thiz = JS_NULL;
+    qjs_channel->qjs_session = NULL;
+    qjs_channel->index = 0;
     return 0;
 }
 
@@ -107,6 +115,7 @@ void pomelo_qjs_channel_cleanup(pomelo_qjs_channel_t * qjs_channel) {
         pomelo_channel_set_extra(qjs_channel->channel, NULL);
         qjs_channel->channel = NULL;
     }
+    qjs_channel->qjs_session = NULL;
 
     // Delete the reference
     if (!JS_IsNull(qjs_channel->thiz)) {
@@ -216,6 +225,23 @@ JSValue pomelo_qjs_channel_send(
         return JS_ThrowTypeError(ctx, "send: Message expected");
     }
 
+    pomelo_qjs_session_t * qjs_session = qjs_channel->qjs_session;
+    if (!qjs_session || !qjs_session->session) {
+        return JS_ThrowTypeError(ctx, "send: Invalid native session");
+    }
+
+    // Get the options
+    pomelo_qjs_send_options_t options;
+    JSValue js_options = (argc > 1) ? argv[1] : JS_UNDEFINED;
+    if (pomelo_qjs_send_options_parse(ctx, js_options, &options) < 0) {
+        return JS_EXCEPTION;
+    }
+    if (pomelo_qjs_session_check_send_options(
+        ctx, qjs_session, qjs_channel->index, &options
+    ) < 0) {
+        return JS_EXCEPTION;
+    }
+
     // Create new promise
     pomelo_qjs_send_info_t * send_info =
         pomelo_qjs_context_acquire_send_info(context);
@@ -229,7 +255,14 @@ JSValue pomelo_qjs_channel_send(
         return promise;
     }
 
-    // Send the message
-    pomelo_channel_send(qjs_channel->channel, qjs_message->message, send_info);
+    send_info->channel_index = qjs_channel->index;
+    send_info->ack = options.ack;
+    if (options.max_age > 0) {
+        send_info->deadline = pomelo_platform_hrtime(context->platform) +
+            options.max_age * 1000000ULL;
+    }
+
+    // Send the message through the owner session
+    pomelo_qjs_session_dispatch(qjs_session, send_info);
     return promise;
 }
@@ -17,6 +17,12 @@ struct pomelo_qjs_channel_s {
 
     /// @brief The this of channel
     JSValue thiz;
+
+    /// @brief The session which owns this channel
+    pomelo_qjs_session_t * qjs_session;
+
+    /// @brief The index of channel in session
+    size_t index;
 };
 
 
@@ -31,7 +37,9 @@ int pomelo_qjs_init_channel_module(JSContext * ctx, JSModuleDef * m);
 /// @brief Create new JS channel. Return null on failure
 JSValue pomelo_qjs_channel_new(
     pomelo_qjs_context_t * context,
-    pomelo_channel_t * channel
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_channel_t * channel,
+    size_t index
 );
 
 
@@ -65,7 +73,7 @@ JSValue pomelo_qjs_channel_set_mode(
 JSValue pomelo_qjs_channel_get_mode(JSContext * ctx, JSValue thiz);
 
 
-/// @brief Message.send()
+/// @brief Channel.send(message: Message, options?: SendOptions)
 JSValue pomelo_qjs_channel_send(
     JSContext * ctx, JSValue thiz, int argc, JSValue * argv
 );
@@ -11,6 +11,15 @@ extern "C" {
 #endif
 
 
+/// @brief Spawn the loops of shards [1, nshards) which run the entry module
+/// of the runtime of context
+/// @return Returns 0 on success or -1 on failure
+typedef int (*pomelo_qjs_context_spawn_shards_callback)(
+    pomelo_qjs_context_t * context,
+    size_t nshards
+);
+
+
 /// @brief Opaque type for context
 typedef enum pomelo_qjs_context_opaque_type {
     POMELO_QJS_CONTEXT_OPAQUE_TYPE_LOGGER,
@@ -49,6 +58,15 @@ struct pomelo_qjs_context_s {
     /// @brief The class of message
     JSClassID class_message_id;
 
+    /// @brief The class of snapshot buffer
+    JSClassID class_snapshot_buffer_id;
+
+    /// @brief The class of session table
+    JSClassID class_session_table_id;
+
+    /// @brief The class of lockstep aggregator
+    JSClassID class_lockstep_id;
+
     /// @brief Pool of sockets
     pomelo_pool_t * pool_socket;
 
@@ -87,6 +105,38 @@ struct pomelo_qjs_context_s {
     /// @brief Whether the temporary buffer is acquired
     bool tmp_buffer_acquired;
 
+    /* Sharding */
+
+    /// @brief The shard of this context
+    size_t shard_index;
+
+    /// @brief The number of shards. Zero if the context is not sharded.
+    size_t shard_count;
+
+    /// @brief The shard spawner of runtime. NULL if the runtime does not
+    /// support sharding.
+    pomelo_qjs_context_spawn_shards_callback spawn_shards;
+
+    /* Statistic */
+
+    /// @brief The number of messages dropped because of their max age
+    uint64_t expired_messages;
+
+    /// @brief The number of keyed messages replaced by newer ones
+    uint64_t superseded_messages;
+
+    /// @brief The number of messages rebuilt from FEC parity
+    uint64_t fec_recovered_messages;
+
+    /// @brief The number of received messages dropped by rate limits
+    uint64_t rate_limited_messages;
+
+    /// @brief The number of received messages dropped by the router
+    uint64_t unrouted_messages;
+
+    /// @brief The number of connections denied by admission policies
+    uint64_t rejected_connections;
+
     /// @brief Opaque data
     void * opaques[POMELO_QJS_CONTEXT_OPAQUE_TYPE_COUNT];
 };
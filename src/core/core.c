@@ -4,6 +4,9 @@
 #include "message.h"
 #include "session.h"
 #include "socket.h"
+#include "snapshot.h"
+#include "table.h"
+#include "lockstep.h"
 #include "token.h"
 #include "plugin.h"
 #include "enums.h"
@@ -25,6 +28,9 @@ static int js_pomelo_init(JSContext * ctx, JSModuleDef * m) {
     if (pomelo_qjs_init_token_module(ctx, m) < 0) return -1;
     if (pomelo_qjs_init_plugin_module(ctx, m) < 0) return -1;
     if (pomelo_qjs_init_socket_module(ctx, m) < 0) return -1;
+    if (pomelo_qjs_init_snapshot_module(ctx, m) < 0) return -1;
+    if (pomelo_qjs_init_table_module(ctx, m) < 0) return -1;
+    if (pomelo_qjs_init_lockstep_module(ctx, m) < 0) return -1;
 
     // Initialize enums
     if (pomelo_qjs_init_enums(ctx, m) < 0) return -1;
@@ -44,6 +50,9 @@ JSModuleDef * js_init_module_pomelo(JSContext * ctx, const char * name) {
     JS_AddModuleExport(ctx, m, "Message");
     JS_AddModuleExport(ctx, m, "Token");
     JS_AddModuleExport(ctx, m, "Plugin");
+    JS_AddModuleExport(ctx, m, "SnapshotBuffer");
+    JS_AddModuleExport(ctx, m, "SessionTable");
+    JS_AddModuleExport(ctx, m, "LockstepAggregator");
     JS_AddModuleExport(ctx, m, "ChannelMode");
     JS_AddModuleExport(ctx, m, "ConnectResult");
     JS_AddModuleExport(ctx, m, "statistic");
@@ -0,0 +1,1125 @@
+#include <assert.h>
+#include <string.h>
+#include "context.h"
+#include "frame.h"
+#include "socket.h"
+#include "session.h"
+
+
+pomelo_qjs_frame_channel_t * pomelo_qjs_frame_get_channel(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index
+) {
+    assert(qjs_session != NULL);
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    if (!qjs_socket || channel_index >= qjs_socket->nchannels) return NULL;
+
+    if (!qjs_session->frame_channels) {
+        size_t nchannels = qjs_socket->nchannels;
+        pomelo_qjs_frame_channel_t * channels = pomelo_allocator_malloc(
+            qjs_session->context->allocator,
+            nchannels * sizeof(pomelo_qjs_frame_channel_t)
+        );
+        if (!channels) return NULL;
+
+        memset(channels, 0, nchannels * sizeof(pomelo_qjs_frame_channel_t));
+        qjs_session->frame_channels = channels;
+        qjs_session->nframe_channels = nchannels;
+    }
+
+    return qjs_session->frame_channels + channel_index;
+}
+
+
+int pomelo_qjs_frame_peek_payload(
+    pomelo_message_t * message,
+    uint8_t * buffer,
+    size_t size
+) {
+    if (size == 0) return 0;
+
+    // Reading the whole size fails without consuming anything if the message
+    // has been partly read.
+    if (pomelo_message_read_buffer(message, buffer, size) < 0) return -1;
+
+    // Rewind the message by writing the same payload back
+    pomelo_message_reset(message);
+    return pomelo_message_write_buffer(message, buffer, size);
+}
+
+
+/// @brief Count the sequences which are leaving the window without being
+/// received. Sequences before the first received one are not counted.
+static uint64_t frame_count_lost(
+    pomelo_qjs_frame_channel_t * channel,
+    uint32_t diff
+) {
+    uint64_t lost = 0;
+    uint32_t window = POMELO_QJS_FRAME_SEQUENCE_WINDOW;
+    uint32_t first = (diff < window) ? (window - diff) : 0;
+    for (uint32_t back = first; back < window; back++) {
+        uint32_t sequence = channel->received_sequence - back;
+        if ((int32_t) (sequence - channel->first_sequence) < 0) break;
+        if (!(channel->received_mask & (((uint64_t) 1) << back))) lost++;
+    }
+
+    // Skipped sequences which are out of the new window
+    if (diff > window) lost += diff - window;
+    return lost;
+}
+
+
+/// @brief Check and mark the received sequence.
+/// @return Returns true if the sequence has not been received before.
+static bool frame_accept_sequence(
+    pomelo_qjs_frame_channel_t * channel,
+    uint32_t sequence
+) {
+    assert(channel != NULL);
+    if (!channel->received_any) {
+        channel->received_any = true;
+        channel->first_sequence = sequence;
+        channel->received_sequence = sequence;
+        channel->received_mask = 1;
+        return true;
+    }
+
+    int32_t diff = (int32_t) (sequence - channel->received_sequence);
+    if (diff > 0) {
+        // Newer sequence, slide the window
+        channel->lost_count += frame_count_lost(channel, (uint32_t) diff);
+        channel->received_mask = (diff < POMELO_QJS_FRAME_SEQUENCE_WINDOW)
+            ? (channel->received_mask << diff)
+            : 0;
+        channel->received_mask |= 1;
+        channel->received_sequence = sequence;
+        return true;
+    }
+
+    uint32_t back = (uint32_t) (-(int64_t) diff);
+    if (back >= POMELO_QJS_FRAME_SEQUENCE_WINDOW) {
+        return false; // Too old
+    }
+
+    uint64_t bit = ((uint64_t) 1) << back;
+    if (channel->received_mask & bit) return false; // Duplicated
+
+    channel->received_mask |= bit;
+    return true;
+}
+
+
+/// @brief Write the frame header
+static int frame_write_header(
+    pomelo_message_t * frame,
+    pomelo_qjs_frame_type type,
+    size_t channel_index
+) {
+    int ret = pomelo_message_write_uint8(frame, (uint8_t) type);
+    if (ret < 0) return ret;
+    return pomelo_message_write_uint8(frame, (uint8_t) channel_index);
+}
+
+
+/// @brief Write the redundant frame body.
+/// @param capacity The capacity of history ring
+/// @param max_count The maximum number of previous payloads to carry
+static int frame_write_redundant(
+    pomelo_message_t * frame,
+    pomelo_qjs_frame_channel_t * channel,
+    size_t capacity,
+    size_t max_count,
+    uint32_t sequence,
+    const uint8_t * payload,
+    size_t size
+) {
+    // Number of previous payloads which will be carried
+    size_t count = channel->history_size;
+    if (count > max_count) count = max_count;
+    size_t skip = channel->history_size - count;
+
+    int ret = pomelo_message_write_uint8(frame, (uint8_t) (count + 1));
+    for (size_t i = 0; i < count && ret == 0; i++) {
+        size_t index = (channel->history_head + skip + i) % capacity;
+        pomelo_qjs_frame_payload_t * entry = channel->history + index;
+        ret = pomelo_message_write_uint32(frame, entry->sequence);
+        if (ret == 0) {
+            ret = pomelo_message_write_uint16(frame, (uint16_t) entry->size);
+        }
+        if (ret == 0 && entry->size > 0) {
+            ret = pomelo_message_write_buffer(frame, entry->data, entry->size);
+        }
+    }
+
+    // The current payload is always the last one
+    if (ret == 0) ret = pomelo_message_write_uint32(frame, sequence);
+    if (ret == 0) ret = pomelo_message_write_uint16(frame, (uint16_t) size);
+    if (ret == 0 && size > 0) {
+        ret = pomelo_message_write_buffer(frame, payload, size);
+    }
+    return ret;
+}
+
+
+/// @brief XOR the payload into the parity buffer
+static void frame_xor_payload(
+    uint8_t * parity,
+    const uint8_t * payload,
+    size_t size
+) {
+    for (size_t i = 0; i < size; i++) {
+        parity[i] ^= payload[i];
+    }
+}
+
+
+/// @brief Write the timed data frame. The remaining age is taken now, so the
+/// time waited in the binding queue is included.
+static int frame_write_timed_data(
+    pomelo_qjs_context_t * context,
+    pomelo_message_t * frame,
+    size_t channel_index,
+    uint64_t deadline,
+    const uint8_t * payload,
+    size_t size
+) {
+    uint64_t now = pomelo_platform_hrtime(context->platform);
+    uint64_t remaining = (deadline > now) ? (deadline - now) / 1000000ULL : 0;
+    if (remaining > UINT32_MAX) {
+        remaining = UINT32_MAX;
+    }
+
+    int ret = frame_write_header(
+        frame, POMELO_QJS_FRAME_TYPE_TIMED_DATA, channel_index
+    );
+    if (ret == 0) {
+        ret = pomelo_message_write_uint32(frame, (uint32_t) (now / 1000000ULL));
+    }
+    if (ret == 0) {
+        ret = pomelo_message_write_uint32(frame, (uint32_t) remaining);
+    }
+    if (ret == 0 && size > 0) {
+        ret = pomelo_message_write_buffer(frame, payload, size);
+    }
+    return ret;
+}
+
+
+/// @brief Write the FEC data frame and accumulate the payload into the parity
+/// of current group
+static int frame_write_fec_data(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_message_t * frame,
+    pomelo_qjs_frame_channel_t * channel,
+    size_t channel_index,
+    const uint8_t * payload,
+    size_t size
+) {
+    if (!channel->fec_parity) {
+        channel->fec_parity = pomelo_allocator_malloc(
+            qjs_session->context->allocator,
+            POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY
+        );
+        if (!channel->fec_parity) return -1;
+        memset(channel->fec_parity, 0, POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY);
+    }
+
+    int ret = frame_write_header(
+        frame, POMELO_QJS_FRAME_TYPE_FEC_DATA, channel_index
+    );
+    if (ret == 0) ret = pomelo_message_write_uint32(frame, channel->fec_group);
+    if (ret == 0) {
+        ret = pomelo_message_write_uint8(frame, (uint8_t) channel->fec_count);
+    }
+    if (ret == 0 && size > 0) {
+        ret = pomelo_message_write_buffer(frame, payload, size);
+    }
+    if (ret < 0) return ret;
+
+    frame_xor_payload(channel->fec_parity, payload, size);
+    channel->fec_size_parity ^= (uint16_t) size;
+    if (size > channel->fec_parity_size) {
+        channel->fec_parity_size = size;
+    }
+    channel->fec_count++;
+    return 0;
+}
+
+
+/// @brief Reset the incoming FEC group
+static void frame_reset_fec_received(
+    pomelo_qjs_frame_channel_t * channel,
+    uint32_t group
+) {
+    channel->fec_receiving = true;
+    channel->fec_received_group = group;
+    channel->fec_received_mask = 0;
+    channel->fec_received_size_parity = 0;
+    if (channel->fec_received_parity) {
+        memset(
+            channel->fec_received_parity,
+            0,
+            POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY
+        );
+    }
+}
+
+
+/// @brief Remember the sent payload for the next redundant frames
+static void frame_remember_payload(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_frame_channel_t * channel,
+    size_t redundancy,
+    uint32_t sequence,
+    const uint8_t * payload,
+    size_t size
+) {
+    if (size > POMELO_QJS_FRAME_REDUNDANT_PAYLOAD_CAPACITY) return;
+
+    if (!channel->history) {
+        channel->history = pomelo_allocator_malloc(
+            qjs_session->context->allocator,
+            redundancy * sizeof(pomelo_qjs_frame_payload_t)
+        );
+        if (!channel->history) return; // Failed to allocate history
+        channel->history_size = 0;
+        channel->history_head = 0;
+    }
+
+    size_t index;
+    if (channel->history_size < redundancy) {
+        index = (channel->history_head + channel->history_size) % redundancy;
+        channel->history_size++;
+    } else {
+        // Replace the oldest payload
+        index = channel->history_head;
+        channel->history_head = (channel->history_head + 1) % redundancy;
+    }
+
+    pomelo_qjs_frame_payload_t * entry = channel->history + index;
+    entry->sequence = sequence;
+    entry->size = size;
+    if (size > 0) memcpy(entry->data, payload, size);
+}
+
+
+/// @brief Get an optional uint32 property. The output is untouched if the
+/// property is undefined.
+static int frame_get_uint32_option(
+    JSContext * ctx,
+    JSValue options,
+    const char * name,
+    uint32_t * value
+) {
+    JSValue js_value = JS_GetPropertyStr(ctx, options, name);
+    if (JS_IsUndefined(js_value)) return 0;
+
+    int ret = JS_IsNumber(js_value) ? JS_ToUint32(ctx, value, js_value) : -1;
+    JS_FreeValue(ctx, js_value);
+    if (ret != 0) {
+        JS_ThrowTypeError(ctx, "Channel option %s must be a number", name);
+        return -1;
+    }
+    return 0;
+}
+
+
+int pomelo_qjs_frame_parse_socket_options(
+    JSContext * ctx,
+    JSValue value,
+    size_t nchannels,
+    pomelo_qjs_channel_options_t * channel_options,
+    bool * framed
+) {
+    assert(ctx != NULL);
+    assert(channel_options != NULL);
+    assert(framed != NULL);
+
+    memset(channel_options, 0, nchannels * sizeof(*channel_options));
+    *framed = false;
+    if (JS_IsUndefined(value) || JS_IsNull(value)) return 0;
+
+    if (!JS_IsObject(value)) {
+        JS_ThrowTypeError(ctx, "Socket options must be an object");
+        return -1;
+    }
+
+    // Framing can be enabled without any channel feature, e.g. for snapshot
+    // buffers
+    JSValue js_framed = JS_GetPropertyStr(ctx, value, "framed");
+    int framed_ret = JS_IsUndefined(js_framed) ? 0 : JS_ToBool(ctx, js_framed);
+    JS_FreeValue(ctx, js_framed);
+    if (framed_ret < 0) return -1;
+    if (framed_ret > 0) *framed = true;
+
+    JSValue js_channels = JS_GetPropertyStr(ctx, value, "channels");
+    if (JS_IsUndefined(js_channels) || JS_IsNull(js_channels)) return 0;
+
+    if (!JS_IsArray(js_channels)) {
+        JS_FreeValue(ctx, js_channels);
+        JS_ThrowTypeError(ctx, "Channel options must be an array");
+        return -1;
+    }
+
+    int64_t length = 0;
+    if (JS_GetLength(ctx, js_channels, &length) != 0) {
+        JS_FreeValue(ctx, js_channels);
+        return -1;
+    }
+    if (length > (int64_t) nchannels) {
+        JS_FreeValue(ctx, js_channels);
+        JS_ThrowTypeError(ctx, "Too many channel options");
+        return -1;
+    }
+
+    for (int64_t i = 0; i < length; i++) {
+        JSValue js_options = JS_GetPropertyInt64(ctx, js_channels, i);
+        if (JS_IsUndefined(js_options) || JS_IsNull(js_options)) continue;
+
+        uint32_t redundancy = 0;
+        uint32_t fec = 0;
+        int ret = frame_get_uint32_option(
+            ctx, js_options, "redundancy", &redundancy
+        );
+        if (ret == 0) {
+            ret = frame_get_uint32_option(ctx, js_options, "fec", &fec);
+        }
+        JS_FreeValue(ctx, js_options);
+
+        if (ret == 0 && redundancy > POMELO_QJS_FRAME_MAX_REDUNDANCY) {
+            JS_ThrowTypeError(ctx, "Invalid channel redundancy");
+            ret = -1;
+        }
+        if (ret == 0 && (fec == 1 || fec > POMELO_QJS_FRAME_MAX_FEC_GROUP_SIZE)) {
+            JS_ThrowTypeError(ctx, "Invalid channel FEC group size");
+            ret = -1;
+        }
+        if (ret == 0 && redundancy > 0 && fec > 0) {
+            JS_ThrowTypeError(ctx, "Redundancy and FEC cannot be combined");
+            ret = -1;
+        }
+        if (ret < 0) {
+            JS_FreeValue(ctx, js_channels);
+            return -1;
+        }
+
+        channel_options[i].redundancy = redundancy;
+        channel_options[i].fec = fec;
+        if (redundancy > 0 || fec > 0) *framed = true;
+    }
+
+    JS_FreeValue(ctx, js_channels);
+    return 0;
+}
+
+
+pomelo_message_t * pomelo_qjs_frame_encode(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message,
+    pomelo_qjs_send_info_t * send_info
+) {
+    assert(qjs_socket != NULL);
+    assert(message != NULL);
+    if (channel_index >= qjs_socket->nchannels) return NULL;
+    bool ack = send_info && send_info->ack;
+
+    pomelo_qjs_context_t * context = qjs_socket->context;
+    pomelo_qjs_channel_options_t * options =
+        qjs_socket->channel_options + channel_index;
+
+    // Redundant and FEC frames are only built for a single session
+    pomelo_qjs_frame_channel_t * channel = NULL;
+    if ((options->redundancy > 0 || options->fec > 0) && qjs_session && !ack) {
+        channel = pomelo_qjs_frame_get_channel(qjs_session, channel_index);
+    }
+
+    pomelo_message_t * frame =
+        pomelo_context_acquire_message(context->context);
+    if (!frame) return NULL;
+
+    size_t size = pomelo_message_size(message);
+    uint8_t * payload =
+        pomelo_qjs_context_prepare_temp_buffer(context, size > 0 ? size : 1);
+    if (!payload) {
+        pomelo_message_unref(frame);
+        return NULL;
+    }
+
+    int ret = pomelo_qjs_frame_peek_payload(message, payload, size);
+    if (ret == 0 && channel && options->redundancy > 0) {
+        if (size > UINT16_MAX) {
+            channel = NULL; // Too large to be carried by a redundant frame
+        }
+    } else if (ret == 0 && ack) {
+        ret = frame_write_header(
+            frame, POMELO_QJS_FRAME_TYPE_ACK_DATA, channel_index
+        );
+        if (ret == 0) {
+            ret = pomelo_message_write_uint32(frame, send_info->ack_id);
+        }
+        if (ret == 0 && size > 0) {
+            ret = pomelo_message_write_buffer(frame, payload, size);
+        }
+    } else if (ret == 0 && channel && options->fec > 0) {
+        if (size > POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY) {
+            channel = NULL; // Too large to be protected
+        }
+    }
+
+    if (ret == 0 && channel && options->redundancy > 0) {
+        size_t redundancy = options->redundancy;
+        uint32_t sequence = channel->next_sequence++;
+        ret = frame_write_header(
+            frame, POMELO_QJS_FRAME_TYPE_REDUNDANT, channel_index
+        );
+        if (ret == 0) {
+            ret = frame_write_redundant(
+                frame, channel, redundancy, redundancy, sequence, payload, size
+            );
+        }
+        if (ret < 0) {
+            // The frame is full, only carry the current payload
+            pomelo_message_reset(frame);
+            ret = frame_write_header(
+                frame, POMELO_QJS_FRAME_TYPE_REDUNDANT, channel_index
+            );
+            if (ret == 0) {
+                ret = frame_write_redundant(
+                    frame, channel, redundancy, 0, sequence, payload, size
+                );
+            }
+        }
+        if (ret == 0) {
+            frame_remember_payload(
+                qjs_session, channel, redundancy, sequence, payload, size
+            );
+        }
+    } else if (ret == 0 && channel && options->fec > 0) {
+        ret = frame_write_fec_data(
+            qjs_session, frame, channel, channel_index, payload, size
+        );
+    } else if (ret == 0 && send_info && send_info->deadline > 0) {
+        ret = frame_write_timed_data(
+            context, frame, channel_index, send_info->deadline, payload, size
+        );
+    } else if (ret == 0) {
+        ret = frame_write_header(
+            frame, POMELO_QJS_FRAME_TYPE_DATA, channel_index
+        );
+        if (ret == 0 && size > 0) {
+            ret = pomelo_message_write_buffer(frame, payload, size);
+        }
+    }
+
+    pomelo_qjs_context_release_temp_buffer(context, payload);
+    if (ret < 0) {
+        pomelo_message_unref(frame);
+        return NULL;
+    }
+
+    return frame;
+}
+
+
+void pomelo_qjs_frame_flush(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index
+) {
+    assert(qjs_session != NULL);
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    if (!qjs_session->session || !qjs_socket) return;
+    if (!qjs_session->frame_channels) return;
+    if (channel_index >= qjs_session->nframe_channels) return;
+
+    size_t group_size = qjs_socket->channel_options[channel_index].fec;
+    pomelo_qjs_frame_channel_t * channel =
+        qjs_session->frame_channels + channel_index;
+    if (group_size == 0 || channel->fec_count < group_size) return;
+
+    pomelo_qjs_context_t * context = qjs_session->context;
+    pomelo_message_t * parity =
+        pomelo_context_acquire_message(context->context);
+    if (parity) {
+        int ret = frame_write_header(
+            parity, POMELO_QJS_FRAME_TYPE_FEC_PARITY, channel_index
+        );
+        if (ret == 0) {
+            ret = pomelo_message_write_uint32(parity, channel->fec_group);
+        }
+        if (ret == 0) {
+            ret = pomelo_message_write_uint8(parity, (uint8_t) group_size);
+        }
+        if (ret == 0) {
+            ret = pomelo_message_write_uint16(parity, channel->fec_size_parity);
+        }
+        if (ret == 0 && channel->fec_parity_size > 0) {
+            ret = pomelo_message_write_buffer(
+                parity, channel->fec_parity, channel->fec_parity_size
+            );
+        }
+
+        // Parity frames are sent like the data frames of group
+        if (ret == 0) {
+            pomelo_qjs_session_send_internal(
+                qjs_session, channel_index, parity
+            );
+        }
+        pomelo_message_unref(parity);
+    }
+
+    // Start the next group
+    channel->fec_group++;
+    channel->fec_count = 0;
+    channel->fec_size_parity = 0;
+    channel->fec_parity_size = 0;
+    if (channel->fec_parity) {
+        memset(channel->fec_parity, 0, POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY);
+    }
+}
+
+
+/// @brief Deliver a received message of channel. The message is pushed to the
+/// attached snapshot buffer if there is. Only these user messages consume
+/// the inbound rate limit, binding frames never do.
+/// @return Returns false if the message is dropped by the rate limit
+static bool frame_deliver(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    // Drop flooding messages before any JS value is created
+    if (!pomelo_qjs_session_check_rate_limit(qjs_session, message)) {
+        return false;
+    }
+
+    if (
+        qjs_session->frame_channels &&
+        channel_index < qjs_session->nframe_channels
+    ) {
+        pomelo_qjs_snapshot_buffer_t * buffer =
+            qjs_session->frame_channels[channel_index].snapshot_buffer;
+        if (buffer) {
+            pomelo_qjs_snapshot_buffer_push(buffer, message);
+            return true;
+        }
+    }
+
+    pomelo_qjs_socket_deliver(
+        qjs_socket,
+        qjs_session,
+        channel_index,
+        message
+    );
+    return true;
+}
+
+
+/// @brief Deliver a payload in temporary buffer as a new message. The
+/// temporary buffer is released before calling JS.
+static void frame_deliver_temp_payload(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    uint8_t * payload,
+    size_t size
+) {
+    pomelo_qjs_context_t * context = qjs_socket->context;
+    pomelo_message_t * delivered =
+        pomelo_context_acquire_message(context->context);
+
+    int ret = 0;
+    if (delivered && size > 0) {
+        ret = pomelo_message_write_buffer(delivered, payload, size);
+    }
+    pomelo_qjs_context_release_temp_buffer(context, payload);
+    if (!delivered) return;
+
+    if (ret == 0) {
+        frame_deliver(qjs_socket, qjs_session, channel_index, delivered);
+    }
+    pomelo_message_unref(delivered);
+}
+
+
+/// @brief Drop the consumed frame header of received message, so that the
+/// message only contains the payload.
+/// @param payload Output the payload in temporary buffer, it must be released
+/// by the caller. Optional.
+/// @return Returns the payload size or -1 on failure
+static int64_t frame_strip_header(
+    pomelo_qjs_context_t * context,
+    pomelo_message_t * message,
+    size_t consumed,
+    uint8_t ** payload
+) {
+    size_t total = pomelo_message_size(message);
+    if (total < consumed) return -1;
+
+    size_t size = total - consumed;
+    uint8_t * buffer = pomelo_qjs_context_prepare_temp_buffer(context, size + 1);
+    if (!buffer) return -1;
+
+    // Read the rest of message, then keep it as the only content. Empty
+    // payloads still drop the header.
+    int ret = (size > 0)
+        ? pomelo_message_read_buffer(message, buffer, size)
+        : 0;
+    if (ret == 0) {
+        pomelo_message_reset(message);
+        if (size > 0) {
+            ret = pomelo_message_write_buffer(message, buffer, size);
+        }
+    }
+
+    if (ret < 0 || !payload) {
+        pomelo_qjs_context_release_temp_buffer(context, buffer);
+    } else {
+        *payload = buffer;
+    }
+    return (ret < 0) ? -1 : (int64_t) size;
+}
+
+
+/// @brief Decode the body of redundant frame
+static void frame_decode_redundant(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    pomelo_qjs_frame_channel_t * channel =
+        pomelo_qjs_frame_get_channel(qjs_session, channel_index);
+    if (!channel) return;
+
+    uint8_t count = 0;
+    if (pomelo_message_read_uint8(message, &count) < 0) return;
+
+    pomelo_qjs_context_t * context = qjs_socket->context;
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t sequence = 0;
+        uint16_t size = 0;
+        if (
+            pomelo_message_read_uint32(message, &sequence) < 0 ||
+            pomelo_message_read_uint16(message, &size) < 0
+        ) {
+            return; // Malformed frame
+        }
+
+        uint8_t * payload =
+            pomelo_qjs_context_prepare_temp_buffer(context, size + 1);
+        if (!payload) return;
+
+        int ret = (size > 0)
+            ? pomelo_message_read_buffer(message, payload, size)
+            : 0;
+        if (ret < 0) {
+            pomelo_qjs_context_release_temp_buffer(context, payload);
+            return; // Malformed frame
+        }
+
+        if (!frame_accept_sequence(channel, sequence)) {
+            pomelo_qjs_context_release_temp_buffer(context, payload);
+            continue; // Already delivered
+        }
+
+        frame_deliver_temp_payload(
+            qjs_socket, qjs_session, channel_index, payload, size
+        );
+
+        // The session may be disconnected by the callback
+        if (!qjs_session->session) return;
+    }
+}
+
+
+/// @brief Decode the body of FEC data frame
+static void frame_decode_fec_data(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    pomelo_qjs_frame_channel_t * channel =
+        pomelo_qjs_frame_get_channel(qjs_session, channel_index);
+    if (!channel) return;
+
+    uint32_t group = 0;
+    uint8_t index = 0;
+    if (
+        pomelo_message_read_uint32(message, &group) < 0 ||
+        pomelo_message_read_uint8(message, &index) < 0 ||
+        index >= POMELO_QJS_FRAME_MAX_FEC_GROUP_SIZE
+    ) {
+        return; // Malformed frame
+    }
+
+    pomelo_qjs_context_t * context = qjs_socket->context;
+    if (!channel->fec_received_parity) {
+        channel->fec_received_parity = pomelo_allocator_malloc(
+            context->allocator,
+            POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY
+        );
+        if (channel->fec_received_parity) {
+            frame_reset_fec_received(channel, group);
+        }
+    }
+
+    if (
+        !channel->fec_receiving ||
+        (int32_t) (group - channel->fec_received_group) > 0
+    ) {
+        frame_reset_fec_received(channel, group);
+    }
+
+    uint8_t * payload = NULL;
+    int64_t size = frame_strip_header(
+        context, message, POMELO_QJS_FRAME_FEC_DATA_HEADER_SIZE, &payload
+    );
+    if (size < 0) return; // Malformed frame
+
+    uint32_t bit = ((uint32_t) 1) << index;
+    if (
+        channel->fec_receiving &&
+        group == channel->fec_received_group &&
+        (channel->fec_received_mask & bit)
+    ) {
+        // Already delivered, e.g. rebuilt from the parity before it arrived
+        pomelo_qjs_context_release_temp_buffer(context, payload);
+        return;
+    }
+
+    // Only the payload of current group is accumulated
+    if (
+        channel->fec_received_parity &&
+        group == channel->fec_received_group &&
+        !(channel->fec_received_mask & bit) &&
+        size <= POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY
+    ) {
+        frame_xor_payload(
+            channel->fec_received_parity, payload, (size_t) size
+        );
+        channel->fec_received_size_parity ^= (uint16_t) size;
+        channel->fec_received_mask |= bit;
+    }
+    pomelo_qjs_context_release_temp_buffer(context, payload);
+
+    frame_deliver(qjs_socket, qjs_session, channel_index, message);
+}
+
+
+/// @brief Decode the body of FEC parity frame and rebuild the lost message
+static void frame_decode_fec_parity(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    pomelo_qjs_frame_channel_t * channel =
+        pomelo_qjs_frame_get_channel(qjs_session, channel_index);
+    if (!channel) return;
+
+    uint32_t group = 0;
+    uint8_t group_size = 0;
+    uint16_t size_parity = 0;
+    if (
+        pomelo_message_read_uint32(message, &group) < 0 ||
+        pomelo_message_read_uint8(message, &group_size) < 0 ||
+        pomelo_message_read_uint16(message, &size_parity) < 0 ||
+        group_size > POMELO_QJS_FRAME_MAX_FEC_GROUP_SIZE
+    ) {
+        return; // Malformed frame
+    }
+
+    if (
+        !channel->fec_receiving ||
+        !channel->fec_received_parity ||
+        group != channel->fec_received_group
+    ) {
+        return; // Nothing of this group is received
+    }
+
+    // Exactly one message of the group must be lost
+    uint32_t full_mask = (((uint32_t) 1) << group_size) - 1;
+    uint32_t lost_mask = full_mask & ~channel->fec_received_mask;
+    if (lost_mask == 0 || (lost_mask & (lost_mask - 1)) != 0) return;
+
+    pomelo_qjs_context_t * context = qjs_socket->context;
+    uint8_t * payload = NULL;
+    int64_t parity_size = frame_strip_header(
+        context, message, POMELO_QJS_FRAME_FEC_PARITY_HEADER_SIZE, &payload
+    );
+    if (parity_size < 0) return; // Malformed frame
+
+    size_t size = size_parity ^ channel->fec_received_size_parity;
+    if (
+        parity_size > POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY ||
+        size > (size_t) parity_size
+    ) {
+        pomelo_qjs_context_release_temp_buffer(context, payload);
+        return; // Malformed frame
+    }
+
+    // The lost payload is the XOR of parity and the received payloads
+    frame_xor_payload(
+        payload, channel->fec_received_parity, (size_t) parity_size
+    );
+    channel->fec_received_mask = full_mask;
+    context->fec_recovered_messages++;
+
+    frame_deliver_temp_payload(
+        qjs_socket, qjs_session, channel_index, payload, size
+    );
+}
+
+
+int pomelo_qjs_frame_send_acks(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    const uint32_t * ack_ids,
+    size_t count
+) {
+    assert(qjs_session != NULL);
+    assert(ack_ids != NULL);
+    pomelo_qjs_context_t * context = qjs_session->context;
+
+    while (count > 0) {
+        size_t batch = (count > POMELO_QJS_FRAME_MAX_ACKS)
+            ? POMELO_QJS_FRAME_MAX_ACKS
+            : count;
+
+        pomelo_message_t * reply =
+            pomelo_context_acquire_message(context->context);
+        if (!reply) return -1;
+
+        int ret = frame_write_header(
+            reply, POMELO_QJS_FRAME_TYPE_ACK, channel_index
+        );
+        if (ret == 0) ret = pomelo_message_write_uint8(reply, (uint8_t) batch);
+        for (size_t i = 0; i < batch && ret == 0; i++) {
+            ret = pomelo_message_write_uint32(reply, ack_ids[i]);
+        }
+
+        if (ret == 0) {
+            ret = pomelo_qjs_session_send_internal(
+                qjs_session, channel_index, reply
+            );
+        }
+        pomelo_message_unref(reply);
+        if (ret < 0) return -1;
+
+        ack_ids += batch;
+        count -= batch;
+    }
+    return 0;
+}
+
+
+/// @brief Measure the delay of a timed frame against the lowest delay of
+/// recent timed frames of session, then update the lowest delay.
+/// @return Returns true if the frame arrives later than its remaining age
+static bool frame_check_late(
+    pomelo_qjs_session_t * qjs_session,
+    uint32_t sent_time,
+    uint32_t max_age
+) {
+    uint64_t now = pomelo_platform_hrtime(qjs_session->context->platform);
+    uint32_t delay = (uint32_t) (now / 1000000ULL) - sent_time;
+    if (!qjs_session->delay_sampled) {
+        qjs_session->delay_sampled = true;
+        qjs_session->delay_base = delay;
+        qjs_session->delay_window_min = delay;
+        qjs_session->delay_window_start = now;
+        return false;
+    }
+
+    // Delays wrap around with the clocks, compare them by differences
+    if ((int32_t) (delay - qjs_session->delay_window_min) < 0) {
+        qjs_session->delay_window_min = delay;
+    }
+    if ((int32_t) (delay - qjs_session->delay_base) < 0) {
+        qjs_session->delay_base = delay;
+    }
+    if (
+        now - qjs_session->delay_window_start >=
+        POMELO_QJS_FRAME_DELAY_WINDOW_NS
+    ) {
+        qjs_session->delay_base = qjs_session->delay_window_min;
+        qjs_session->delay_window_min = delay;
+        qjs_session->delay_window_start = now;
+    }
+
+    return (uint32_t) (delay - qjs_session->delay_base) > max_age;
+}
+
+
+/// @brief Decode the timed data frame
+static void frame_decode_timed_data(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    uint32_t sent_time = 0;
+    uint32_t max_age = 0;
+    if (
+        pomelo_message_read_uint32(message, &sent_time) < 0 ||
+        pomelo_message_read_uint32(message, &max_age) < 0
+    ) {
+        return; // Malformed frame
+    }
+
+    if (frame_check_late(qjs_session, sent_time, max_age)) {
+        // Stale message, drop it before copying its payload
+        qjs_socket->context->expired_messages++;
+        return;
+    }
+
+    if (frame_strip_header(
+        qjs_socket->context,
+        message,
+        POMELO_QJS_FRAME_TIMED_DATA_HEADER_SIZE,
+        NULL
+    ) < 0) {
+        return; // Malformed frame
+    }
+    frame_deliver(qjs_socket, qjs_session, channel_index, message);
+}
+
+
+/// @brief Decode the acknowledged data frame
+static void frame_decode_ack_data(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    uint32_t ack_id = 0;
+    if (pomelo_message_read_uint32(message, &ack_id) < 0) return;
+    if (frame_strip_header(
+        qjs_socket->context,
+        message,
+        POMELO_QJS_FRAME_ACK_DATA_HEADER_SIZE,
+        NULL
+    ) < 0) {
+        return; // Malformed frame
+    }
+
+    // Messages dropped by the rate limit are never acknowledged
+    if (!frame_deliver(qjs_socket, qjs_session, channel_index, message)) {
+        return;
+    }
+
+    // The session may be disconnected by the callback
+    if (qjs_session->session) {
+        pomelo_qjs_session_reply_ack(qjs_session, channel_index, ack_id);
+    }
+}
+
+
+void pomelo_qjs_frame_decode(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_message_t * message
+) {
+    assert(qjs_socket != NULL);
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+
+    uint8_t type = 0;
+    uint8_t channel_index = 0;
+    if (
+        pomelo_message_read_uint8(message, &type) < 0 ||
+        pomelo_message_read_uint8(message, &channel_index) < 0 ||
+        channel_index >= qjs_socket->nchannels
+    ) {
+        return; // Malformed frame
+    }
+
+    switch (type) {
+        case POMELO_QJS_FRAME_TYPE_DATA:
+            if (frame_strip_header(
+                qjs_socket->context,
+                message,
+                POMELO_QJS_FRAME_HEADER_SIZE,
+                NULL
+            ) < 0) {
+                return; // Malformed frame
+            }
+            frame_deliver(qjs_socket, qjs_session, channel_index, message);
+            break;
+
+        case POMELO_QJS_FRAME_TYPE_REDUNDANT:
+            frame_decode_redundant(
+                qjs_socket, qjs_session, channel_index, message
+            );
+            break;
+
+        case POMELO_QJS_FRAME_TYPE_FEC_DATA:
+            frame_decode_fec_data(
+                qjs_socket, qjs_session, channel_index, message
+            );
+            break;
+
+        case POMELO_QJS_FRAME_TYPE_FEC_PARITY:
+            frame_decode_fec_parity(
+                qjs_socket, qjs_session, channel_index, message
+            );
+            break;
+
+        case POMELO_QJS_FRAME_TYPE_ACK_DATA:
+            frame_decode_ack_data(
+                qjs_socket, qjs_session, channel_index, message
+            );
+            break;
+
+        case POMELO_QJS_FRAME_TYPE_TIMED_DATA:
+            frame_decode_timed_data(
+                qjs_socket, qjs_session, channel_index, message
+            );
+            break;
+
+        case POMELO_QJS_FRAME_TYPE_ACK: {
+            uint8_t count = 0;
+            if (pomelo_message_read_uint8(message, &count) < 0) return;
+            for (uint8_t i = 0; i < count; i++) {
+                uint32_t ack_id = 0;
+                if (pomelo_message_read_uint32(message, &ack_id) < 0) return;
+                pomelo_qjs_session_on_ack(qjs_session, ack_id);
+            }
+            break;
+        }
+
+        default:
+            break; // Unknown frame
+    }
+}
+
+
+void pomelo_qjs_frame_cleanup_session(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    if (!qjs_session->frame_channels) return;
+
+    pomelo_allocator_t * allocator = qjs_session->context->allocator;
+    for (size_t i = 0; i < qjs_session->nframe_channels; i++) {
+        pomelo_qjs_frame_channel_t * channel = qjs_session->frame_channels + i;
+        if (channel->snapshot_buffer) {
+            pomelo_qjs_snapshot_buffer_detach(channel->snapshot_buffer);
+        }
+        if (channel->history) {
+            pomelo_allocator_free(allocator, channel->history);
+        }
+        if (channel->fec_parity) {
+            pomelo_allocator_free(allocator, channel->fec_parity);
+        }
+        if (channel->fec_received_parity) {
+            pomelo_allocator_free(allocator, channel->fec_received_parity);
+        }
+    }
+
+    pomelo_allocator_free(allocator, qjs_session->frame_channels);
+    qjs_session->frame_channels = NULL;
+    qjs_session->nframe_channels = 0;
+}
@@ -0,0 +1,307 @@
+#ifndef POMELO_QUICKJS_FRAME_SRC_H
+#define POMELO_QUICKJS_FRAME_SRC_H
+#include "quickjs.h"
+#include "pomelo/api.h"
+#include "core.h"
+#include "snapshot.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binding framing.
+ *
+ * When any channel of a socket enables a binding feature (e.g. redundancy),
+ * every message of that socket is prefixed with a small frame header:
+ *
+ *   [uint8 frame type][uint8 channel index][frame body]
+ *
+ * FEC channels group every K messages. After the last message of a group, a
+ * parity frame holding the XOR of the group is sent, so the receiver is able
+ * to rebuild any single lost message of the group.
+ *
+ * Acknowledged messages carry an ack ID. The receiving binding collects the
+ * IDs of delivered messages and replies them together in ack frames in the
+ * next loop iteration.
+ *
+ * Messages with a max age carry their sending time and remaining age. The
+ * clocks of peers are unrelated, so the receiver measures the delay against
+ * the lowest delay of recent timed frames and drops messages which arrive
+ * later than their remaining age.
+ *
+ * Both peers must be created with the same channel options.
+ */
+
+
+/// @brief The size of frame header
+#define POMELO_QJS_FRAME_HEADER_SIZE 2
+
+
+/// @brief The size of FEC data frame header (group and index included)
+#define POMELO_QJS_FRAME_FEC_DATA_HEADER_SIZE (POMELO_QJS_FRAME_HEADER_SIZE + 5)
+
+
+/// @brief The size of FEC parity frame header (group, group size and XOR of
+/// payload sizes included)
+#define POMELO_QJS_FRAME_FEC_PARITY_HEADER_SIZE                                \
+    (POMELO_QJS_FRAME_HEADER_SIZE + 7)
+
+
+/// @brief The size of acknowledged data frame header (ack ID included)
+#define POMELO_QJS_FRAME_ACK_DATA_HEADER_SIZE (POMELO_QJS_FRAME_HEADER_SIZE + 4)
+
+
+/// @brief The size of timed data frame header (sending time and remaining
+/// age included)
+#define POMELO_QJS_FRAME_TIMED_DATA_HEADER_SIZE                                \
+    (POMELO_QJS_FRAME_HEADER_SIZE + 8)
+
+
+/// @brief The duration of a window of the lowest delay of timed frames in
+/// nanoseconds. The lowest delay of the last two windows is the baseline, so
+/// that it follows the drift of clocks.
+#define POMELO_QJS_FRAME_DELAY_WINDOW_NS 10000000000ULL
+
+
+/// @brief The maximum number of ack IDs carried by an ack frame
+#define POMELO_QJS_FRAME_MAX_ACKS 255
+
+
+/// @brief The maximum number of previous messages carried by a redundant
+/// frame
+#define POMELO_QJS_FRAME_MAX_REDUNDANCY 8
+
+
+/// @brief The maximum payload size of a message which is kept for redundant
+/// frames. Larger messages are still sent, but never repeated.
+#define POMELO_QJS_FRAME_REDUNDANT_PAYLOAD_CAPACITY 256
+
+
+/// @brief The maximum number of messages in a FEC group
+#define POMELO_QJS_FRAME_MAX_FEC_GROUP_SIZE 16
+
+
+/// @brief The maximum payload size of a message which is protected by FEC.
+/// Larger messages are sent without protection.
+#define POMELO_QJS_FRAME_FEC_PAYLOAD_CAPACITY 512
+
+
+/// @brief The size of window for detecting duplicated sequences
+#define POMELO_QJS_FRAME_SEQUENCE_WINDOW 64
+
+
+/// @brief The frame types
+typedef enum pomelo_qjs_frame_type {
+    /// @brief A single message
+    POMELO_QJS_FRAME_TYPE_DATA,
+
+    /// @brief A message with the previous messages of channel
+    POMELO_QJS_FRAME_TYPE_REDUNDANT,
+
+    /// @brief A message of FEC group
+    POMELO_QJS_FRAME_TYPE_FEC_DATA,
+
+    /// @brief The parity of FEC group
+    POMELO_QJS_FRAME_TYPE_FEC_PARITY,
+
+    /// @brief A message which must be acknowledged by the receiver
+    POMELO_QJS_FRAME_TYPE_ACK_DATA,
+
+    /// @brief The acknowledgements of received messages
+    POMELO_QJS_FRAME_TYPE_ACK,
+
+    /// @brief A message which is dropped by the receiver if it arrives late
+    POMELO_QJS_FRAME_TYPE_TIMED_DATA,
+
+    /// @brief The number of frame types
+    POMELO_QJS_FRAME_TYPE_COUNT
+} pomelo_qjs_frame_type;
+
+
+/// @brief The binding options of a channel
+typedef struct pomelo_qjs_channel_options_s pomelo_qjs_channel_options_t;
+
+/// @brief A payload which is kept for redundant frames
+typedef struct pomelo_qjs_frame_payload_s pomelo_qjs_frame_payload_t;
+
+/// @brief The framing state of a channel of session
+typedef struct pomelo_qjs_frame_channel_s pomelo_qjs_frame_channel_t;
+
+
+struct pomelo_qjs_channel_options_s {
+    /// @brief The number of previous messages carried by each message
+    size_t redundancy;
+
+    /// @brief The number of messages of a FEC group. Zero to disable FEC.
+    size_t fec;
+};
+
+
+struct pomelo_qjs_frame_payload_s {
+    /// @brief The sequence of payload
+    uint32_t sequence;
+
+    /// @brief The size of payload
+    size_t size;
+
+    /// @brief The payload data
+    uint8_t data[POMELO_QJS_FRAME_REDUNDANT_PAYLOAD_CAPACITY];
+};
+
+
+struct pomelo_qjs_frame_channel_s {
+    /* Sender */
+
+    /// @brief The next outgoing sequence
+    uint32_t next_sequence;
+
+    /// @brief The ring of recently sent payloads. It is created on demand.
+    pomelo_qjs_frame_payload_t * history;
+
+    /// @brief The number of payloads in history
+    size_t history_size;
+
+    /// @brief The index of the oldest payload in history
+    size_t history_head;
+
+    /// @brief The current outgoing FEC group
+    uint32_t fec_group;
+
+    /// @brief The number of sent messages of current FEC group
+    size_t fec_count;
+
+    /// @brief The XOR of payload sizes of current outgoing FEC group
+    uint16_t fec_size_parity;
+
+    /// @brief The largest payload size of current outgoing FEC group
+    size_t fec_parity_size;
+
+    /// @brief The XOR of payloads of current outgoing FEC group. It is created
+    /// on demand.
+    uint8_t * fec_parity;
+
+    /* Receiver */
+
+    /// @brief Whether any sequence has been received
+    bool received_any;
+
+    /// @brief The latest received sequence
+    uint32_t received_sequence;
+
+    /// @brief The bitmask of received sequences. Bit N is set if sequence
+    /// (received_sequence - N) has been received.
+    uint64_t received_mask;
+
+    /// @brief The first received sequence
+    uint32_t first_sequence;
+
+    /// @brief The number of sequences which left the window without being
+    /// received
+    uint64_t lost_count;
+
+    /// @brief Whether any FEC group has been received
+    bool fec_receiving;
+
+    /// @brief The current incoming FEC group
+    uint32_t fec_received_group;
+
+    /// @brief The bitmask of received messages of current incoming FEC group
+    uint32_t fec_received_mask;
+
+    /// @brief The XOR of received payload sizes of current incoming FEC group
+    uint16_t fec_received_size_parity;
+
+    /// @brief The XOR of received payloads of current incoming FEC group. It
+    /// is created on demand.
+    uint8_t * fec_received_parity;
+
+    /// @brief The attached snapshot buffer. Messages of this channel are pushed
+    /// to the buffer instead of being delivered to the listener.
+    pomelo_qjs_snapshot_buffer_t * snapshot_buffer;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Parse the socket options and fill the channel options.
+/// @param framed Output whether framing is required by the options
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_frame_parse_socket_options(
+    JSContext * ctx,
+    JSValue value,
+    size_t nchannels,
+    pomelo_qjs_channel_options_t * channel_options,
+    bool * framed
+);
+
+
+/// @brief Get the framing state of a channel of session. The states are
+/// created on demand. Return NULL on failure.
+pomelo_qjs_frame_channel_t * pomelo_qjs_frame_get_channel(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index
+);
+
+
+/// @brief Encode a message into a new framed message.
+/// @param qjs_session The destination session, or NULL for broadcasting
+/// @param send_info The send info of message. Optional.
+/// @return Returns new message (the caller owns one reference) or NULL on
+/// failure
+pomelo_message_t * pomelo_qjs_frame_encode(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message,
+    pomelo_qjs_send_info_t * send_info
+);
+
+
+/// @brief Send the pending parity frame of channel of session if the FEC
+/// group is complete
+void pomelo_qjs_frame_flush(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index
+);
+
+
+/// @brief Send ack frames which carry the ack IDs of received messages
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_frame_send_acks(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    const uint32_t * ack_ids,
+    size_t count
+);
+
+
+/// @brief Decode a framed message and deliver the contained messages
+void pomelo_qjs_frame_decode(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_message_t * message
+);
+
+
+/// @brief Copy the whole payload of an unread message to buffer. The message
+/// is rewound by writing the payload back, so its content and read position
+/// are unchanged afterwards. It must not be shared with a sending message.
+/// A partly read message cannot be peeked and is left untouched.
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_frame_peek_payload(
+    pomelo_message_t * message,
+    uint8_t * buffer,
+    size_t size
+);
+
+
+/// @brief Release the framing states of session
+void pomelo_qjs_frame_cleanup_session(pomelo_qjs_session_t * qjs_session);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_FRAME_SRC_H
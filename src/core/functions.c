@@ -208,6 +208,42 @@ JSValue pomelo_qjs_context_statistic(
         "channels",
         JS_NewUint32(ctx, (uint32_t) pomelo_pool_in_use(context->pool_channel))
     );
+    JS_SetPropertyStr(
+        ctx,
+        js_binding,
+        "expiredMessages",
+        JS_NewInt64(ctx, (int64_t) context->expired_messages)
+    );
+    JS_SetPropertyStr(
+        ctx,
+        js_binding,
+        "supersededMessages",
+        JS_NewInt64(ctx, (int64_t) context->superseded_messages)
+    );
+    JS_SetPropertyStr(
+        ctx,
+        js_binding,
+        "fecRecoveredMessages",
+        JS_NewInt64(ctx, (int64_t) context->fec_recovered_messages)
+    );
+    JS_SetPropertyStr(
+        ctx,
+        js_binding,
+        "rateLimitedMessages",
+        JS_NewInt64(ctx, (int64_t) context->rate_limited_messages)
+    );
+    JS_SetPropertyStr(
+        ctx,
+        js_binding,
+        "unroutedMessages",
+        JS_NewInt64(ctx, (int64_t) context->unrouted_messages)
+    );
+    JS_SetPropertyStr(
+        ctx,
+        js_binding,
+        "rejectedConnections",
+        JS_NewInt64(ctx, (int64_t) context->rejected_connections)
+    );
     JS_SetPropertyStr(ctx, js_statistic, "binding", js_binding);
 
     // Platform statistic
@@ -0,0 +1,132 @@
+#include <assert.h>
+#include "limiter.h"
+
+
+/// @brief Refill the tokens of bucket
+static double limiter_refill(
+    double tokens,
+    double rate,
+    double elapsed
+) {
+    tokens += rate * elapsed;
+    return (tokens > rate) ? rate : tokens;
+}
+
+
+/// @brief Parse a rate property
+static int rate_limit_parse_rate(
+    JSContext * ctx,
+    JSValue value,
+    const char * name,
+    double * rate
+) {
+    JSValue js_rate = JS_GetPropertyStr(ctx, value, name);
+    if (JS_IsUndefined(js_rate)) {
+        *rate = 0;
+        return 0;
+    }
+
+    int ret = JS_ToFloat64(ctx, rate, js_rate);
+    JS_FreeValue(ctx, js_rate);
+    if (ret != 0 || !(*rate >= 0)) {
+        JS_ThrowTypeError(ctx, "%s must be a non-negative number", name);
+        return -1;
+    }
+    return 0;
+}
+
+
+int pomelo_qjs_rate_limit_parse(
+    JSContext * ctx,
+    JSValue value,
+    pomelo_qjs_rate_limit_t * limit
+) {
+    assert(ctx != NULL);
+    assert(limit != NULL);
+
+    limit->messages_per_second = 0;
+    limit->bytes_per_second = 0;
+    if (JS_IsUndefined(value) || JS_IsNull(value)) return 0;
+
+    if (!JS_IsObject(value)) {
+        JS_ThrowTypeError(ctx, "Rate limit must be an object");
+        return -1;
+    }
+
+    if (rate_limit_parse_rate(
+        ctx, value, "messagesPerSecond", &limit->messages_per_second
+    ) < 0) {
+        return -1;
+    }
+
+    return rate_limit_parse_rate(
+        ctx, value, "bytesPerSecond", &limit->bytes_per_second
+    );
+}
+
+
+bool pomelo_qjs_rate_limit_enabled(pomelo_qjs_rate_limit_t * limit) {
+    assert(limit != NULL);
+    return limit->messages_per_second > 0 || limit->bytes_per_second > 0;
+}
+
+
+void pomelo_qjs_limiter_reset(pomelo_qjs_limiter_t * limiter) {
+    assert(limiter != NULL);
+    limiter->started = false;
+    limiter->time = 0;
+    limiter->message_tokens = 0;
+    limiter->byte_tokens = 0;
+}
+
+
+bool pomelo_qjs_limiter_consume(
+    pomelo_qjs_limiter_t * limiter,
+    pomelo_qjs_rate_limit_t * limit,
+    uint64_t now,
+    size_t bytes
+) {
+    assert(limiter != NULL);
+    assert(limit != NULL);
+
+    if (!limiter->started) {
+        // Start with full buckets
+        limiter->started = true;
+        limiter->time = now;
+        limiter->message_tokens = limit->messages_per_second;
+        limiter->byte_tokens = limit->bytes_per_second;
+    } else if (now > limiter->time) {
+        double elapsed = (double) (now - limiter->time) / 1000000000.0;
+        limiter->time = now;
+        limiter->message_tokens = limiter_refill(
+            limiter->message_tokens, limit->messages_per_second, elapsed
+        );
+        limiter->byte_tokens = limiter_refill(
+            limiter->byte_tokens, limit->bytes_per_second, elapsed
+        );
+    }
+
+    // A message larger than a bucket is still allowed when the bucket is
+    // full. The tokens go negative, so later messages wait until they are
+    // paid back.
+    bool check_messages = limit->messages_per_second > 0;
+    bool check_bytes = limit->bytes_per_second > 0;
+    if (
+        check_messages &&
+        limiter->message_tokens < 1.0 &&
+        limiter->message_tokens < limit->messages_per_second
+    ) {
+        return false;
+    }
+    if (
+        check_bytes &&
+        limiter->byte_tokens < (double) bytes &&
+        limiter->byte_tokens < limit->bytes_per_second
+    ) {
+        return false;
+    }
+
+    if (check_messages) limiter->message_tokens -= 1.0;
+    if (check_bytes) limiter->byte_tokens -= (double) bytes;
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef POMELO_QUICKJS_LIMITER_SRC_H
+#define POMELO_QUICKJS_LIMITER_SRC_H
+#include "quickjs.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/// @brief The inbound rate limit
+typedef struct pomelo_qjs_rate_limit_s pomelo_qjs_rate_limit_t;
+
+/// @brief The token bucket of inbound messages
+typedef struct pomelo_qjs_limiter_s pomelo_qjs_limiter_t;
+
+
+struct pomelo_qjs_rate_limit_s {
+    /// @brief The maximum number of messages per second. Zero means unlimited.
+    double messages_per_second;
+
+    /// @brief The maximum number of bytes per second. Zero means unlimited.
+    double bytes_per_second;
+};
+
+
+struct pomelo_qjs_limiter_s {
+    /// @brief Whether the bucket has been started
+    bool started;
+
+    /// @brief The last refilling time (hrtime in nanoseconds)
+    uint64_t time;
+
+    /// @brief The available message tokens
+    double message_tokens;
+
+    /// @brief The available byte tokens
+    double byte_tokens;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Parse the rate limit from JS value. Undefined or null value means
+/// unlimited.
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_rate_limit_parse(
+    JSContext * ctx,
+    JSValue value,
+    pomelo_qjs_rate_limit_t * limit
+);
+
+
+/// @brief Check if the rate limit is enabled
+bool pomelo_qjs_rate_limit_enabled(pomelo_qjs_rate_limit_t * limit);
+
+
+/// @brief Reset the token bucket
+void pomelo_qjs_limiter_reset(pomelo_qjs_limiter_t * limiter);
+
+
+/// @brief Consume tokens of a message. The bucket holds up to one second of
+/// the limit. A message larger than one second of bytes is allowed when the
+/// byte bucket is full, and the following messages pay the debt back.
+/// @return Returns true if the message is allowed
+bool pomelo_qjs_limiter_consume(
+    pomelo_qjs_limiter_t * limiter,
+    pomelo_qjs_rate_limit_t * limit,
+    uint64_t now,
+    size_t bytes
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_LIMITER_SRC_H
@@ -0,0 +1,674 @@
+#include <assert.h>
+#include <string.h>
+#include "context.h"
+#include "lockstep.h"
+#include "session.h"
+#include "socket.h"
+#include "frame.h"
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+/// The size of frame header (tick and count)
+#define LOCKSTEP_FRAME_HEADER_SIZE 5
+
+/// The size of input header in frame (slot and size)
+#define LOCKSTEP_INPUT_HEADER_SIZE 3
+
+/// Get the row of tick in window
+#define LOCKSTEP_ROW(tick) ((tick) % POMELO_QJS_LOCKSTEP_WINDOW)
+
+
+static JSCFunctionListEntry lockstep_funcs[] = {
+    JS_CFUNC_DEF("add", 1, pomelo_qjs_lockstep_add_js),
+    JS_CFUNC_DEF("remove", 1, pomelo_qjs_lockstep_remove_js),
+    JS_CFUNC_DEF("flush", 0, pomelo_qjs_lockstep_flush),
+    JS_CGETSET_DEF("tick", pomelo_qjs_lockstep_get_tick, NULL),
+    JS_CGETSET_DEF("size", pomelo_qjs_lockstep_get_size, NULL),
+    JS_CGETSET_DEF(
+        "emittedFrames", pomelo_qjs_lockstep_get_emitted_frames, NULL
+    ),
+    JS_CGETSET_DEF(
+        "droppedInputs", pomelo_qjs_lockstep_get_dropped_inputs, NULL
+    ),
+    JS_CGETSET_DEF(
+        "missingInputs", pomelo_qjs_lockstep_get_missing_inputs, NULL
+    ),
+};
+
+
+int pomelo_qjs_init_lockstep_module(JSContext * ctx, JSModuleDef * m) {
+    assert(ctx != NULL);
+    assert(m != NULL);
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    // Generate new class ID
+    JSClassID class_id = 0;
+    if (JS_NewClassID(context->rt, &class_id) < 0) {
+        return -1;
+    }
+    context->class_lockstep_id = class_id;
+
+    // Register the class
+    JSClassDef class_def = {
+        .class_name = "LockstepAggregator",
+        .finalizer = pomelo_qjs_lockstep_finalizer
+    };
+    if (JS_NewClass(context->rt, class_id, &class_def) < 0) {
+        return -1;
+    }
+
+    // Create prototype for class
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(
+        ctx, proto, lockstep_funcs, countof(lockstep_funcs)
+    );
+
+    JSValue lockstep_class = JS_NewCFunction2(
+        ctx,
+        pomelo_qjs_lockstep_constructor,
+        "LockstepAggregator",
+        /* argc = */ 1,
+        JS_CFUNC_constructor,
+        0
+    );
+    JS_SetConstructor(ctx, lockstep_class, proto);
+
+    // Set the class prototype
+    JS_SetClassProto(ctx, class_id, proto);
+    JS_SetModuleExport(ctx, m, "LockstepAggregator", lockstep_class);
+    return 0;
+}
+
+
+/// @brief Get the size of buffered input
+static int32_t * lockstep_size(
+    pomelo_qjs_lockstep_t * lockstep,
+    uint32_t tick,
+    size_t slot
+) {
+    return lockstep->sizes +
+        LOCKSTEP_ROW(tick) * POMELO_QJS_LOCKSTEP_MAX_MEMBERS + slot;
+}
+
+
+/// @brief Get the data of buffered input
+static uint8_t * lockstep_input(
+    pomelo_qjs_lockstep_t * lockstep,
+    uint32_t tick,
+    size_t slot
+) {
+    size_t index = LOCKSTEP_ROW(tick) * POMELO_QJS_LOCKSTEP_MAX_MEMBERS + slot;
+    return lockstep->inputs + index * lockstep->input_capacity;
+}
+
+
+/// @brief Forget the buffered inputs of a slot
+static void lockstep_clear_slot(pomelo_qjs_lockstep_t * lockstep, size_t slot) {
+    for (uint32_t row = 0; row < POMELO_QJS_LOCKSTEP_WINDOW; row++) {
+        *lockstep_size(lockstep, row, slot) = -1;
+    }
+}
+
+
+/// @brief Stop the timeout timer
+static void lockstep_stop_timer(pomelo_qjs_lockstep_t * lockstep) {
+    if (!lockstep->timing) return;
+    pomelo_platform_timer_stop(
+        lockstep->context->platform,
+        &lockstep->timer_handle
+    );
+    lockstep->timing = false;
+}
+
+
+static void lockstep_on_timeout(pomelo_qjs_lockstep_t * lockstep);
+
+
+/// @brief Start the timeout timer of current tick if it is not running
+static void lockstep_start_timer(pomelo_qjs_lockstep_t * lockstep) {
+    if (lockstep->timing) return;
+    int ret = pomelo_platform_timer_start(
+        lockstep->context->platform,
+        (pomelo_platform_timer_entry) lockstep_on_timeout,
+        lockstep->timeout_ms, // timeout
+        lockstep->timeout_ms, // repeat
+        lockstep,
+        &lockstep->timer_handle
+    );
+    lockstep->timing = (ret == 0);
+}
+
+
+/// @brief Check the inputs of current tick
+/// @param any Output whether any input has been received
+/// @return Returns true if every member has sent its input
+static bool lockstep_check_tick(pomelo_qjs_lockstep_t * lockstep, bool * any) {
+    bool complete = true;
+    *any = false;
+    for (size_t slot = 0; slot < POMELO_QJS_LOCKSTEP_MAX_MEMBERS; slot++) {
+        if (!lockstep->members[slot]) continue;
+        if (*lockstep_size(lockstep, lockstep->tick, slot) < 0) {
+            complete = false;
+        } else {
+            *any = true;
+        }
+    }
+    return complete && *any;
+}
+
+
+/// @brief Build the frame of current tick. Return NULL on failure.
+static pomelo_message_t * lockstep_build_frame(
+    pomelo_qjs_lockstep_t * lockstep
+) {
+    pomelo_qjs_context_t * context = lockstep->context;
+    pomelo_message_t * frame =
+        pomelo_context_acquire_message(context->context);
+    if (!frame) return NULL;
+
+    uint32_t tick = lockstep->tick;
+    uint8_t count = 0;
+    for (size_t slot = 0; slot < POMELO_QJS_LOCKSTEP_MAX_MEMBERS; slot++) {
+        if (!lockstep->members[slot]) continue;
+        if (*lockstep_size(lockstep, tick, slot) < 0) {
+            lockstep->missing_inputs++;
+        } else {
+            count++;
+        }
+    }
+
+    int ret = pomelo_message_write_uint32(frame, tick);
+    if (ret == 0) ret = pomelo_message_write_uint8(frame, count);
+
+    for (size_t slot = 0; slot < POMELO_QJS_LOCKSTEP_MAX_MEMBERS; slot++) {
+        if (ret < 0) break;
+        if (!lockstep->members[slot]) continue;
+
+        int32_t size = *lockstep_size(lockstep, tick, slot);
+        if (size < 0) continue;
+
+        ret = pomelo_message_write_uint8(frame, (uint8_t) slot);
+        if (ret == 0) ret = pomelo_message_write_uint16(frame, (uint16_t) size);
+        if (ret == 0 && size > 0) {
+            ret = pomelo_message_write_buffer(
+                frame, lockstep_input(lockstep, tick, slot), (size_t) size
+            );
+        }
+    }
+
+    if (ret < 0) {
+        pomelo_message_unref(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+
+/// @brief Broadcast the frame of current tick to all members
+static void lockstep_send_frame(
+    pomelo_qjs_lockstep_t * lockstep,
+    pomelo_message_t * frame
+) {
+    pomelo_session_t * sessions[POMELO_QJS_LOCKSTEP_MAX_MEMBERS];
+    size_t nsessions = 0;
+    pomelo_qjs_socket_t * qjs_socket = NULL;
+    for (size_t slot = 0; slot < POMELO_QJS_LOCKSTEP_MAX_MEMBERS; slot++) {
+        pomelo_qjs_session_t * member = lockstep->members[slot];
+        if (!member || !member->session) continue;
+        qjs_socket = member->qjs_socket;
+        sessions[nsessions++] = member->session;
+    }
+    if (nsessions == 0 || !qjs_socket || !qjs_socket->context) return;
+
+    if (qjs_socket->framed) {
+        // Frames are encoded once for all members
+        frame = pomelo_qjs_frame_encode(
+            qjs_socket, NULL, lockstep->channel_index, frame, NULL
+        );
+        if (!frame) return;
+    } else {
+        pomelo_message_ref(frame);
+    }
+
+    for (size_t i = 0; i < nsessions; i++) {
+        pomelo_qjs_session_count_sent(
+            pomelo_session_get_extra(sessions[i]), frame
+        );
+    }
+
+    // No send info, the result callback ignores this message
+    pomelo_socket_send(
+        qjs_socket->socket,
+        lockstep->channel_index,
+        frame,
+        sessions,
+        nsessions,
+        NULL
+    );
+    pomelo_message_unref(frame);
+}
+
+
+/// @brief Emit the frame of current tick and advance to the next tick.
+/// Following ticks are emitted as well if they are complete.
+static void lockstep_emit(pomelo_qjs_lockstep_t * lockstep) {
+    lockstep_stop_timer(lockstep);
+
+    bool any = false;
+    for (size_t i = 0; i < POMELO_QJS_LOCKSTEP_WINDOW; i++) {
+        pomelo_message_t * frame = lockstep_build_frame(lockstep);
+        if (frame) {
+            lockstep_send_frame(lockstep, frame);
+            pomelo_message_unref(frame);
+        }
+        lockstep->emitted_frames++;
+
+        // Forget the row, it is reused by a future tick
+        for (size_t slot = 0; slot < POMELO_QJS_LOCKSTEP_MAX_MEMBERS; slot++) {
+            *lockstep_size(lockstep, lockstep->tick, slot) = -1;
+        }
+        lockstep->tick++;
+
+        if (!lockstep_check_tick(lockstep, &any)) break;
+    }
+
+    // Early inputs of the new tick start its timeout
+    if (any) lockstep_start_timer(lockstep);
+}
+
+
+/// @brief Timer entry of the tick timeout
+static void lockstep_on_timeout(pomelo_qjs_lockstep_t * lockstep) {
+    assert(lockstep != NULL);
+    lockstep_emit(lockstep);
+}
+
+
+/// @brief Find the slot of member. Return -1 if not found.
+static int lockstep_find_slot(
+    pomelo_qjs_lockstep_t * lockstep,
+    pomelo_qjs_session_t * qjs_session
+) {
+    for (int slot = 0; slot < POMELO_QJS_LOCKSTEP_MAX_MEMBERS; slot++) {
+        if (lockstep->members[slot] == qjs_session) return slot;
+    }
+    return -1;
+}
+
+
+bool pomelo_qjs_lockstep_capture(
+    pomelo_qjs_lockstep_t * lockstep,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    assert(lockstep != NULL);
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+
+    // Members belong to framed sockets, so the channel is always known
+    if (channel_index != lockstep->channel_index) return false;
+
+    int slot = lockstep_find_slot(lockstep, qjs_session);
+    if (slot < 0) return false;
+
+    size_t size = pomelo_message_size(message);
+    uint32_t tick = 0;
+    if (
+        size < sizeof(uint32_t) ||
+        size - sizeof(uint32_t) > lockstep->input_capacity ||
+        pomelo_message_read_uint32(message, &tick) < 0
+    ) {
+        lockstep->dropped_inputs++; // Malformed input
+        return true;
+    }
+
+    uint32_t ahead = tick - lockstep->tick;
+    if ((int32_t) ahead < 0 || ahead >= POMELO_QJS_LOCKSTEP_WINDOW) {
+        lockstep->dropped_inputs++; // Late or too early
+        return true;
+    }
+
+    int32_t * input_size = lockstep_size(lockstep, tick, slot);
+    if (*input_size >= 0) {
+        lockstep->dropped_inputs++; // The first input of a tick is kept
+        return true;
+    }
+
+    size -= sizeof(uint32_t);
+    uint8_t * input = lockstep_input(lockstep, tick, slot);
+    if (size > 0 && pomelo_message_read_buffer(message, input, size) < 0) {
+        lockstep->dropped_inputs++;
+        return true;
+    }
+    *input_size = (int32_t) size;
+
+    if (ahead > 0) return true; // Buffered for a future tick
+
+    bool any = false;
+    if (lockstep_check_tick(lockstep, &any)) {
+        lockstep_emit(lockstep);
+    } else {
+        lockstep_start_timer(lockstep);
+    }
+    return true;
+}
+
+
+void pomelo_qjs_lockstep_remove(
+    pomelo_qjs_lockstep_t * lockstep,
+    pomelo_qjs_session_t * qjs_session
+) {
+    assert(lockstep != NULL);
+    assert(qjs_session != NULL);
+
+    int slot = lockstep_find_slot(lockstep, qjs_session);
+    if (slot < 0) return;
+
+    lockstep->members[slot] = NULL;
+    lockstep->nmembers--;
+    lockstep_clear_slot(lockstep, slot);
+    qjs_session->lockstep = NULL;
+
+    // Remaining members are not waited for the removed one until timeout
+    if (lockstep->nmembers == 0) lockstep_stop_timer(lockstep);
+
+    // Release the reference of the removed member. It may be the last one,
+    // which finalizes the aggregator.
+    JS_FreeValue(lockstep->context->ctx, lockstep->thiz);
+}
+
+
+JSValue pomelo_qjs_lockstep_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) new_target;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    if (argc < 1 || !JS_IsObject(argv[0])) {
+        return JS_ThrowTypeError(ctx, "Missing options");
+    }
+
+    uint32_t channel_index = 0;
+    uint32_t timeout_ms = 0;
+    uint32_t input_capacity = POMELO_QJS_LOCKSTEP_DEFAULT_INPUT_CAPACITY;
+    uint32_t start_tick = 0;
+
+    JSValue js_value = JS_GetPropertyStr(ctx, argv[0], "timeoutMs");
+    int ret = JS_ToUint32(ctx, &timeout_ms, js_value);
+    JS_FreeValue(ctx, js_value);
+    if (ret != 0 || timeout_ms == 0) {
+        return JS_ThrowTypeError(ctx, "timeoutMs must be a positive number");
+    }
+
+    js_value = JS_GetPropertyStr(ctx, argv[0], "channel");
+    if (!JS_IsUndefined(js_value)) {
+        ret = JS_ToUint32(ctx, &channel_index, js_value);
+        if (ret != 0 || channel_index >= POMELO_MAX_CHANNELS) {
+            JS_FreeValue(ctx, js_value);
+            return JS_ThrowTypeError(ctx, "Invalid channel index");
+        }
+    }
+    JS_FreeValue(ctx, js_value);
+
+    js_value = JS_GetPropertyStr(ctx, argv[0], "inputCapacity");
+    if (!JS_IsUndefined(js_value)) {
+        ret = JS_ToUint32(ctx, &input_capacity, js_value);
+        if (
+            ret != 0 ||
+            input_capacity > POMELO_QJS_LOCKSTEP_MAX_INPUT_CAPACITY
+        ) {
+            JS_FreeValue(ctx, js_value);
+            return JS_ThrowTypeError(ctx, "Invalid input capacity");
+        }
+    }
+    JS_FreeValue(ctx, js_value);
+
+    js_value = JS_GetPropertyStr(ctx, argv[0], "startTick");
+    if (!JS_IsUndefined(js_value)) {
+        ret = JS_ToUint32(ctx, &start_tick, js_value);
+        if (ret != 0) {
+            JS_FreeValue(ctx, js_value);
+            return JS_ThrowTypeError(ctx, "startTick must be a number");
+        }
+    }
+    JS_FreeValue(ctx, js_value);
+
+    // Create new js aggregator object
+    JSValue thiz = JS_NewObjectClass(ctx, context->class_lockstep_id);
+    if (JS_IsException(thiz)) return thiz;
+
+    pomelo_qjs_lockstep_t * lockstep = pomelo_allocator_malloc_t(
+        context->allocator, pomelo_qjs_lockstep_t
+    );
+    if (!lockstep) {
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to allocate aggregator");
+    }
+    memset(lockstep, 0, sizeof(pomelo_qjs_lockstep_t));
+
+    size_t ninputs =
+        POMELO_QJS_LOCKSTEP_WINDOW * POMELO_QJS_LOCKSTEP_MAX_MEMBERS;
+    lockstep->sizes = pomelo_allocator_malloc(
+        context->allocator, ninputs * sizeof(int32_t)
+    );
+    lockstep->inputs = (input_capacity > 0)
+        ? pomelo_allocator_malloc(context->allocator, ninputs * input_capacity)
+        : NULL;
+    if (!lockstep->sizes || (input_capacity > 0 && !lockstep->inputs)) {
+        if (lockstep->sizes) {
+            pomelo_allocator_free(context->allocator, lockstep->sizes);
+        }
+        if (lockstep->inputs) {
+            pomelo_allocator_free(context->allocator, lockstep->inputs);
+        }
+        pomelo_allocator_free(context->allocator, lockstep);
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to allocate aggregator");
+    }
+    for (size_t i = 0; i < ninputs; i++) {
+        lockstep->sizes[i] = -1;
+    }
+
+    lockstep->context = context;
+    lockstep->thiz = thiz; // Weak reference
+    lockstep->channel_index = channel_index;
+    lockstep->timeout_ms = timeout_ms;
+    lockstep->input_capacity = input_capacity;
+    lockstep->tick = start_tick;
+
+    JS_SetOpaque(thiz, lockstep);
+    return thiz;
+}
+
+
+void pomelo_qjs_lockstep_finalizer(JSRuntime * rt, JSValue val) {
+    assert(rt != NULL);
+    pomelo_qjs_context_t * context = JS_GetRuntimeOpaque(rt);
+    if (!context) return;
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(val, context->class_lockstep_id);
+    if (!lockstep) return;
+
+    // Aggregators are referenced by their members, they are never finalized
+    // while having members. The references are visible to the GC through the
+    // mark function of sessions.
+    lockstep_stop_timer(lockstep);
+    pomelo_allocator_free(context->allocator, lockstep->sizes);
+    if (lockstep->inputs) {
+        pomelo_allocator_free(context->allocator, lockstep->inputs);
+    }
+    pomelo_allocator_free(context->allocator, lockstep);
+}
+
+
+JSValue pomelo_qjs_lockstep_add_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing session");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(argv[0], context->class_session_id);
+    if (!qjs_session || !qjs_session->session || !qjs_session->qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    int slot = lockstep_find_slot(lockstep, qjs_session);
+    if (slot >= 0) return JS_NewInt32(ctx, slot); // Already a member
+
+    if (qjs_session->lockstep) {
+        return JS_ThrowTypeError(ctx, "Session already has an aggregator");
+    }
+
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    if (!qjs_socket->framed) {
+        return JS_ThrowTypeError(ctx, "Aggregator requires a framed socket");
+    }
+    if (lockstep->channel_index >= qjs_socket->nchannels) {
+        return JS_ThrowTypeError(ctx, "Invalid channel index");
+    }
+
+    for (size_t i = 0; i < POMELO_QJS_LOCKSTEP_MAX_MEMBERS; i++) {
+        pomelo_qjs_session_t * member = lockstep->members[i];
+        if (member && member->qjs_socket != qjs_socket) {
+            return JS_ThrowTypeError(
+                ctx, "Members must belong to the same socket"
+            );
+        }
+    }
+
+    slot = lockstep_find_slot(lockstep, NULL);
+    if (slot < 0) return JS_ThrowTypeError(ctx, "Aggregator is full");
+
+    // Every member holds the aggregator until it is removed
+    JS_DupValue(ctx, thiz);
+    lockstep_clear_slot(lockstep, slot);
+    lockstep->members[slot] = qjs_session;
+    lockstep->nmembers++;
+    qjs_session->lockstep = lockstep;
+    return JS_NewInt32(ctx, slot);
+}
+
+
+JSValue pomelo_qjs_lockstep_remove_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing session");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(argv[0], context->class_session_id);
+    if (!qjs_session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    pomelo_qjs_lockstep_remove(lockstep, qjs_session);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_lockstep_flush(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) argc;
+    (void) argv;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    if (lockstep->nmembers > 0) {
+        lockstep_emit(lockstep);
+    }
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_lockstep_get_tick(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    return JS_NewUint32(ctx, lockstep->tick);
+}
+
+
+JSValue pomelo_qjs_lockstep_get_size(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    return JS_NewInt64(ctx, (int64_t) lockstep->nmembers);
+}
+
+
+JSValue pomelo_qjs_lockstep_get_emitted_frames(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    return JS_NewInt64(ctx, (int64_t) lockstep->emitted_frames);
+}
+
+
+JSValue pomelo_qjs_lockstep_get_dropped_inputs(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    return JS_NewInt64(ctx, (int64_t) lockstep->dropped_inputs);
+}
+
+
+JSValue pomelo_qjs_lockstep_get_missing_inputs(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_lockstep_t * lockstep =
+        JS_GetOpaque(thiz, context->class_lockstep_id);
+    if (!lockstep) return JS_ThrowTypeError(ctx, "Invalid aggregator");
+
+    return JS_NewInt64(ctx, (int64_t) lockstep->missing_inputs);
+}
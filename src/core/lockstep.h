@@ -0,0 +1,183 @@
+#ifndef POMELO_QUICKJS_LOCKSTEP_SRC_H
+#define POMELO_QUICKJS_LOCKSTEP_SRC_H
+#include "quickjs.h"
+#include "pomelo/api.h"
+#include "pomelo/platform.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Lockstep input aggregator.
+ *
+ * Member sessions send one input per tick:
+ *
+ *   [uint32 tick][input]
+ *
+ * Inputs are captured natively on the aggregator channel. Aggregators require
+ * framed sockets, since unframed messages do not carry their channel and
+ * every message would be taken as an input. Once every member has sent the
+ * input of the current tick, or the
+ * timeout since the first input of that tick has elapsed, the inputs are
+ * combined into one frame and broadcast to all members with one send:
+ *
+ *   [uint32 tick][uint8 count]([uint8 slot][uint16 size][input]) * count
+ *
+ * Members without input are omitted from the frame. Inputs of passed ticks or
+ * too far ahead are dropped.
+ */
+
+
+/// @brief The maximum number of members of an aggregator
+#define POMELO_QJS_LOCKSTEP_MAX_MEMBERS 32
+
+
+/// @brief The number of ticks which are buffered ahead of the current one
+#define POMELO_QJS_LOCKSTEP_WINDOW 16
+
+
+/// @brief The default capacity of an input in bytes
+#define POMELO_QJS_LOCKSTEP_DEFAULT_INPUT_CAPACITY 64
+
+
+/// @brief The maximum capacity of an input in bytes
+#define POMELO_QJS_LOCKSTEP_MAX_INPUT_CAPACITY 1024
+
+
+/// @brief The lockstep input aggregator
+typedef struct pomelo_qjs_lockstep_s pomelo_qjs_lockstep_t;
+
+
+struct pomelo_qjs_lockstep_s {
+    /// @brief The context
+    pomelo_qjs_context_t * context;
+
+    /// @brief The this of aggregator, a weak reference. Every member holds its
+    /// own strong reference, which is marked by the GC mark of sessions.
+    JSValue thiz;
+
+    /// @brief The channel of inputs and frames
+    size_t channel_index;
+
+    /// @brief The timeout of a tick in milliseconds
+    uint64_t timeout_ms;
+
+    /// @brief The capacity of an input in bytes
+    size_t input_capacity;
+
+    /// @brief The member sessions, indexed by slot
+    pomelo_qjs_session_t * members[POMELO_QJS_LOCKSTEP_MAX_MEMBERS];
+
+    /// @brief The number of members
+    size_t nmembers;
+
+    /// @brief The tick which is being collected
+    uint32_t tick;
+
+    /// @brief The sizes of buffered inputs, indexed by (tick, slot).
+    /// Negative for missing inputs.
+    int32_t * sizes;
+
+    /// @brief The buffered inputs, indexed by (tick, slot)
+    uint8_t * inputs;
+
+    /// @brief Whether the timeout timer is running
+    bool timing;
+
+    /// @brief The timeout timer
+    pomelo_platform_handle_t timer_handle;
+
+    /// @brief The number of emitted frames
+    uint64_t emitted_frames;
+
+    /// @brief The number of dropped late, early or malformed inputs
+    uint64_t dropped_inputs;
+
+    /// @brief The number of inputs which missed their frames
+    uint64_t missing_inputs;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the lockstep module
+int pomelo_qjs_init_lockstep_module(JSContext * ctx, JSModuleDef * m);
+
+
+/// @brief Capture a received message of member session.
+/// @return Returns true if the message is consumed by the aggregator
+bool pomelo_qjs_lockstep_capture(
+    pomelo_qjs_lockstep_t * lockstep,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+);
+
+
+/// @brief Remove a member session from aggregator
+void pomelo_qjs_lockstep_remove(
+    pomelo_qjs_lockstep_t * lockstep,
+    pomelo_qjs_session_t * qjs_session
+);
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+
+/// @brief LockstepAggregator.constructor(options: LockstepOptions)
+JSValue pomelo_qjs_lockstep_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+);
+
+
+/// @brief Finalizer of lockstep aggregator
+void pomelo_qjs_lockstep_finalizer(JSRuntime * rt, JSValue val);
+
+
+/// @brief LockstepAggregator.add(session: Session): number
+JSValue pomelo_qjs_lockstep_add_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief LockstepAggregator.remove(session: Session): void
+JSValue pomelo_qjs_lockstep_remove_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief LockstepAggregator.flush(): void
+JSValue pomelo_qjs_lockstep_flush(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief readonly LockstepAggregator.tick: number
+JSValue pomelo_qjs_lockstep_get_tick(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly LockstepAggregator.size: number
+JSValue pomelo_qjs_lockstep_get_size(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly LockstepAggregator.emittedFrames: number
+JSValue pomelo_qjs_lockstep_get_emitted_frames(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly LockstepAggregator.droppedInputs: number
+JSValue pomelo_qjs_lockstep_get_dropped_inputs(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly LockstepAggregator.missingInputs: number
+JSValue pomelo_qjs_lockstep_get_missing_inputs(JSContext * ctx, JSValue thiz);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_LOCKSTEP_SRC_H
@@ -143,6 +143,32 @@ void pomelo_qjs_message_cleanup(pomelo_qjs_message_t * qjs_message) {
 }
 
 
+/// @brief Reset all fields of send info to their defaults
+static void send_info_reset(
+    pomelo_qjs_send_info_t * send_info,
+    pomelo_qjs_context_t * context
+) {
+    send_info->context = context;
+    send_info->message = NULL;
+    send_info->js_message = JS_NULL;
+    send_info->promise_funcs[0] = JS_NULL;
+    send_info->promise_funcs[1] = JS_NULL;
+    send_info->qjs_session = NULL;
+    send_info->channel_index = 0;
+    send_info->deadline = 0;
+    send_info->keyed = false;
+    send_info->key = 0;
+    send_info->ack = false;
+    send_info->ack_id = 0;
+    send_info->ack_registered = false;
+    send_info->ack_sent = false;
+    send_info->ack_received = false;
+    send_info->batch_remaining = 0;
+    send_info->batch_send_count = 0;
+    send_info->internal = false;
+}
+
+
 JSValue pomelo_qjs_send_info_init(
     pomelo_qjs_send_info_t * send_info,
     pomelo_qjs_context_t * context,
@@ -152,7 +178,7 @@ JSValue pomelo_qjs_send_info_init(
     assert(context != NULL);
     assert(qjs_message != NULL);
 
-    send_info->context = context;
+    send_info_reset(send_info, context);
     send_info->message = qjs_message->message;
     send_info->js_message = JS_DupValue(context->ctx, qjs_message->thiz);
     pomelo_message_ref(qjs_message->message);
@@ -162,6 +188,41 @@ JSValue pomelo_qjs_send_info_init(
 }
 
 
+JSValue pomelo_qjs_send_info_init_batch(
+    pomelo_qjs_send_info_t * send_info,
+    pomelo_qjs_context_t * context,
+    JSValue js_messages,
+    size_t count
+) {
+    assert(send_info != NULL);
+    assert(context != NULL);
+
+    // Native messages are held by their sendings
+    send_info_reset(send_info, context);
+    send_info->batch_remaining = count;
+
+    // Keep the JS messages alive until the whole batch completes
+    send_info->js_message = JS_DupValue(context->ctx, js_messages);
+    return JS_NewPromiseCapability(context->ctx, send_info->promise_funcs);
+}
+
+
+void pomelo_qjs_send_info_init_internal(
+    pomelo_qjs_send_info_t * send_info,
+    pomelo_qjs_context_t * context,
+    pomelo_message_t * message
+) {
+    assert(send_info != NULL);
+    assert(context != NULL);
+    assert(message != NULL);
+
+    send_info_reset(send_info, context);
+    send_info->message = message;
+    send_info->internal = true;
+    pomelo_message_ref(message);
+}
+
+
 void pomelo_qjs_send_info_finalize(pomelo_qjs_send_info_t * send_info) {
     assert(send_info != NULL);
 
@@ -189,6 +250,94 @@ void pomelo_qjs_send_info_finalize(pomelo_qjs_send_info_t * send_info) {
 }
 
 
+void pomelo_qjs_send_info_resolve(
+    pomelo_qjs_send_info_t * send_info,
+    size_t send_count
+) {
+    assert(send_info != NULL);
+    JSContext * ctx = send_info->context->ctx;
+    if (send_info->internal) {
+        // Binding frames have no promise
+        pomelo_qjs_send_info_finalize(send_info);
+        return;
+    }
+
+    JSValue count = JS_NewUint32(ctx, (uint32_t) send_count);
+    JSValue ret = JS_Call(ctx, send_info->promise_funcs[0], JS_NULL, 1, &count);
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, count);
+
+    pomelo_qjs_send_info_finalize(send_info);
+}
+
+
+void pomelo_qjs_send_info_reject(
+    pomelo_qjs_send_info_t * send_info,
+    const char * reason
+) {
+    assert(send_info != NULL);
+    assert(reason != NULL);
+    JSContext * ctx = send_info->context->ctx;
+
+    JSValue error = JS_NewError(ctx);
+    JS_DefinePropertyValueStr(
+        ctx,
+        error,
+        "message",
+        JS_NewString(ctx, reason),
+        JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE
+    );
+    JSValue ret = JS_Call(ctx, send_info->promise_funcs[1], JS_NULL, 1, &error);
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, error);
+
+    pomelo_qjs_send_info_finalize(send_info);
+}
+
+
+int pomelo_qjs_send_options_parse(
+    JSContext * ctx,
+    JSValue value,
+    pomelo_qjs_send_options_t * options
+) {
+    assert(ctx != NULL);
+    assert(options != NULL);
+
+    options->max_age = 0;
+    options->ack = false;
+    if (JS_IsUndefined(value) || JS_IsNull(value)) {
+        return 0; // Default options
+    }
+
+    if (!JS_IsObject(value)) {
+        JS_ThrowTypeError(ctx, "Send options must be an object");
+        return -1;
+    }
+
+    // Parse maxAge
+    JSValue max_age = JS_GetPropertyStr(ctx, value, "maxAge");
+    if (!JS_IsUndefined(max_age)) {
+        double temp = 0;
+        if (JS_ToFloat64(ctx, &temp, max_age) != 0 || temp < 0) {
+            JS_FreeValue(ctx, max_age);
+            JS_ThrowTypeError(ctx, "maxAge must be a non-negative number");
+            return -1;
+        }
+        options->max_age = (uint64_t) temp;
+    }
+    JS_FreeValue(ctx, max_age);
+
+    // Parse ack
+    JSValue ack = JS_GetPropertyStr(ctx, value, "ack");
+    int ack_ret = JS_IsUndefined(ack) ? 0 : JS_ToBool(ctx, ack);
+    JS_FreeValue(ctx, ack);
+    if (ack_ret < 0) return -1;
+    options->ack = (ack_ret > 0);
+
+    return 0;
+}
+
+
 /*----------------------------------------------------------------------------*/
 /*                               Private APIs                                 */
 /*----------------------------------------------------------------------------*/
@@ -3,6 +3,7 @@
 #include "quickjs.h"
 #include "pomelo/api.h"
 #include "core.h"
+#include "utils/list.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,6 +21,20 @@ struct pomelo_qjs_message_s {
 };
 
 
+/// @brief The send options
+typedef struct pomelo_qjs_send_options_s pomelo_qjs_send_options_t;
+
+
+struct pomelo_qjs_send_options_s {
+    /// @brief The maximum age of message in milliseconds. Zero means that the
+    /// message never expires.
+    uint64_t max_age;
+
+    /// @brief Whether the message completes when the peer acknowledges it
+    bool ack;
+};
+
+
 struct pomelo_qjs_send_info_s {
     /// @brief The context
     pomelo_qjs_context_t * context;
@@ -32,6 +47,48 @@ struct pomelo_qjs_send_info_s {
 
     /// @brief The promise functions
     JSValue promise_funcs[2];
+
+    /// @brief The sending session. NULL if the message is broadcasted.
+    pomelo_qjs_session_t * qjs_session;
+
+    /// @brief The channel index
+    size_t channel_index;
+
+    /// @brief The deadline of message (hrtime in nanoseconds). Zero if the
+    /// message never expires.
+    uint64_t deadline;
+
+    /// @brief Whether the message is sent by key (latest-only)
+    bool keyed;
+
+    /// @brief The key of message
+    uint32_t key;
+
+    /// @brief Whether the message completes when the peer acknowledges it
+    bool ack;
+
+    /// @brief The acknowledgement ID of message
+    uint32_t ack_id;
+
+    /// @brief Whether the message is in the acknowledgement slots of session
+    bool ack_registered;
+
+    /// @brief Whether the send result of message has been received
+    bool ack_sent;
+
+    /// @brief Whether the acknowledgement of peer has been received
+    bool ack_received;
+
+    /// @brief The number of uncompleted messages of batch. Zero if the send
+    /// info is not shared by a batch.
+    size_t batch_remaining;
+
+    /// @brief The accumulated number of sent messages of batch
+    size_t batch_send_count;
+
+    /// @brief Whether the message is a frame of binding. Internal send infos
+    /// have no promise.
+    bool internal;
 };
 
 
@@ -69,10 +126,53 @@ JSValue pomelo_qjs_send_info_init(
 );
 
 
+/// @brief Initialize the send info which is shared by a batch of messages.
+/// Return new promise for the send info
+JSValue pomelo_qjs_send_info_init_batch(
+    pomelo_qjs_send_info_t * send_info,
+    pomelo_qjs_context_t * context,
+    JSValue js_messages,
+    size_t count
+);
+
+
+/// @brief Initialize the send info of a binding frame. The send info has no
+/// promise and it is finalized when the frame completes.
+void pomelo_qjs_send_info_init_internal(
+    pomelo_qjs_send_info_t * send_info,
+    pomelo_qjs_context_t * context,
+    pomelo_message_t * message
+);
+
+
 /// @brief Finalize the send info
 void pomelo_qjs_send_info_finalize(pomelo_qjs_send_info_t * send_info);
 
 
+/// @brief Resolve the promise of send info with the number of sent messages
+/// and finalize it. Internal send infos are only finalized.
+void pomelo_qjs_send_info_resolve(
+    pomelo_qjs_send_info_t * send_info,
+    size_t send_count
+);
+
+
+/// @brief Reject the promise of send info with an error and finalize it
+void pomelo_qjs_send_info_reject(
+    pomelo_qjs_send_info_t * send_info,
+    const char * reason
+);
+
+
+/// @brief Parse the send options from JS value. Undefined value is accepted.
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_send_options_parse(
+    JSContext * ctx,
+    JSValue value,
+    pomelo_qjs_send_options_t * options
+);
+
+
 /*----------------------------------------------------------------------------*/
 /*                               Private APIs                                 */
 /*----------------------------------------------------------------------------*/
@@ -0,0 +1,278 @@
+#include <assert.h>
+#include "pipe.h"
+#include "context.h"
+#include "session.h"
+#include "socket.h"
+#include "frame.h"
+
+
+/// @brief The initial capacity of pipe targets
+#define PIPE_INITIAL_CAPACITY 4
+
+
+/// @brief Parse an optional unsigned property of pipe options
+static int pipe_parse_uint(
+    JSContext * ctx,
+    JSValue value,
+    const char * name,
+    size_t * output
+) {
+    JSValue js_value = JS_GetPropertyStr(ctx, value, name);
+    if (JS_IsUndefined(js_value)) return 0;
+
+    uint32_t result = 0;
+    int ret = JS_ToUint32(ctx, &result, js_value);
+    JS_FreeValue(ctx, js_value);
+    if (ret != 0) {
+        JS_ThrowTypeError(ctx, "%s must be a number", name);
+        return -1;
+    }
+
+    *output = result;
+    return 0;
+}
+
+
+/// @brief Check if the target only forwards a byte range of messages
+static bool pipe_target_ranged(pomelo_qjs_pipe_target_t * target) {
+    return target->offset != 0 || target->length != SIZE_MAX;
+}
+
+
+/// @brief Forward a byte range of the copied payload to target session
+static int pipe_forward_range(
+    pomelo_qjs_session_t * target_session,
+    pomelo_qjs_pipe_target_t * target,
+    size_t channel_index,
+    const uint8_t * payload,
+    size_t size
+) {
+    pomelo_qjs_context_t * context = target_session->context;
+    if (target->offset >= size) return 0; // Nothing to forward
+
+    size_t length = size - target->offset;
+    if (length > target->length) {
+        length = target->length;
+    }
+
+    pomelo_message_t * slice =
+        pomelo_context_acquire_message(context->context);
+    if (!slice) return -1;
+
+    int ret = pomelo_message_write_buffer(
+        slice, payload + target->offset, length
+    );
+    if (ret == 0) {
+        ret = pomelo_qjs_session_send_detached(
+            target_session, channel_index, slice
+        );
+    }
+    pomelo_message_unref(slice);
+    return ret;
+}
+
+
+void pomelo_qjs_pipe_init(pomelo_qjs_pipe_t * pipe) {
+    assert(pipe != NULL);
+    pipe->targets = NULL;
+    pipe->ntargets = 0;
+    pipe->capacity = 0;
+}
+
+
+void pomelo_qjs_pipe_cleanup(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_pipe_t * pipe
+) {
+    assert(context != NULL);
+    assert(pipe != NULL);
+
+    if (pipe->targets) {
+        pomelo_allocator_free(context->allocator, pipe->targets);
+        pipe->targets = NULL;
+    }
+    pipe->ntargets = 0;
+    pipe->capacity = 0;
+}
+
+
+int pomelo_qjs_pipe_parse_options(
+    JSContext * ctx,
+    JSValue value,
+    size_t nchannels,
+    pomelo_qjs_pipe_target_t * target
+) {
+    assert(ctx != NULL);
+    assert(target != NULL);
+
+    target->channel_index = POMELO_QJS_PIPE_SAME_CHANNEL;
+    target->offset = 0;
+    target->length = SIZE_MAX;
+    if (JS_IsUndefined(value) || JS_IsNull(value)) return 0;
+
+    if (!JS_IsObject(value)) {
+        JS_ThrowTypeError(ctx, "Pipe options must be an object");
+        return -1;
+    }
+
+    if (
+        pipe_parse_uint(ctx, value, "channel", &target->channel_index) < 0 ||
+        pipe_parse_uint(ctx, value, "offset", &target->offset) < 0 ||
+        pipe_parse_uint(ctx, value, "length", &target->length) < 0
+    ) {
+        return -1;
+    }
+
+    if (
+        target->channel_index != POMELO_QJS_PIPE_SAME_CHANNEL &&
+        target->channel_index >= nchannels
+    ) {
+        JS_ThrowTypeError(ctx, "Invalid channel index");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int pomelo_qjs_pipe_add(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_pipe_t * pipe,
+    pomelo_qjs_pipe_target_t * target
+) {
+    assert(context != NULL);
+    assert(pipe != NULL);
+    assert(target != NULL);
+
+    for (size_t i = 0; i < pipe->ntargets; i++) {
+        if (pipe->targets[i].client_id == target->client_id) {
+            pipe->targets[i] = *target; // Replace the options
+            return 0;
+        }
+    }
+
+    if (pipe->ntargets == pipe->capacity) {
+        size_t capacity = (pipe->capacity > 0)
+            ? (pipe->capacity * 2)
+            : PIPE_INITIAL_CAPACITY;
+        pomelo_qjs_pipe_target_t * targets = pomelo_allocator_realloc(
+            context->allocator,
+            pipe->targets,
+            capacity * sizeof(pomelo_qjs_pipe_target_t)
+        );
+        if (!targets) return -1;
+        pipe->targets = targets;
+        pipe->capacity = capacity;
+    }
+
+    pipe->targets[pipe->ntargets++] = *target;
+    return 0;
+}
+
+
+void pomelo_qjs_pipe_remove(pomelo_qjs_pipe_t * pipe, int64_t client_id) {
+    assert(pipe != NULL);
+    for (size_t i = 0; i < pipe->ntargets; i++) {
+        if (pipe->targets[i].client_id != client_id) continue;
+
+        // The order of targets does not matter
+        pipe->targets[i] = pipe->targets[--pipe->ntargets];
+        return;
+    }
+}
+
+
+bool pomelo_qjs_pipe_forward(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+
+    pomelo_qjs_pipe_t * pipe = &qjs_session->pipe;
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    if (pipe->ntargets == 0 || !qjs_socket) return false;
+
+    if (channel_index >= qjs_socket->nchannels) {
+        channel_index = 0; // Unknown channel
+    }
+
+    // Byte ranges are sliced from a payload copy. The copy is made once,
+    // before any whole forward, into a buffer owned by the pipe. The
+    // temporary buffer of context is needed by framing while sending.
+    pomelo_qjs_context_t * context = qjs_session->context;
+    uint8_t * payload = NULL;
+    size_t size = 0;
+    pomelo_message_t * whole = message;
+    for (size_t i = 0; i < pipe->ntargets; i++) {
+        if (!pipe_target_ranged(pipe->targets + i)) continue;
+
+        size = pomelo_message_size(message);
+        payload = pomelo_allocator_malloc(
+            context->allocator, (size > 0) ? size : 1
+        );
+        if (
+            payload &&
+            size > 0 &&
+            pomelo_message_read_buffer(message, payload, size) < 0
+        ) {
+            // Nothing has been read, whole forwards still use the message
+            pomelo_allocator_free(context->allocator, payload);
+            payload = NULL;
+        }
+
+        // The received message has been read, so whole forwards share a
+        // new message with the same payload
+        if (payload) whole = NULL;
+        break;
+    }
+
+    size_t i = 0;
+    while (i < pipe->ntargets) {
+        pomelo_qjs_pipe_target_t * target = pipe->targets + i;
+        pomelo_qjs_session_t * target_session = pomelo_qjs_registry_get(
+            &qjs_socket->registry,
+            target->client_id
+        );
+        if (!target_session) {
+            // The target has disconnected
+            pipe->targets[i] = pipe->targets[--pipe->ntargets];
+            continue;
+        }
+        i++;
+
+        size_t target_channel =
+            (target->channel_index == POMELO_QJS_PIPE_SAME_CHANNEL)
+                ? channel_index
+                : target->channel_index;
+
+        if (pipe_target_ranged(target)) {
+            if (!payload) continue; // Failed to copy the payload
+            pipe_forward_range(
+                target_session, target, target_channel, payload, size
+            );
+            continue;
+        }
+
+        if (!whole && payload) {
+            whole = pomelo_context_acquire_message(context->context);
+            if (
+                whole &&
+                size > 0 &&
+                pomelo_message_write_buffer(whole, payload, size) < 0
+            ) {
+                pomelo_message_unref(whole);
+                whole = NULL;
+            }
+        }
+        if (!whole) continue; // Failed to copy the message
+
+        pomelo_qjs_session_send_detached(target_session, target_channel, whole);
+    }
+
+    if (payload) pomelo_allocator_free(context->allocator, payload);
+    if (whole && whole != message) pomelo_message_unref(whole);
+
+    return true;
+}
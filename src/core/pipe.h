@@ -0,0 +1,115 @@
+#ifndef POMELO_QUICKJS_PIPE_SRC_H
+#define POMELO_QUICKJS_PIPE_SRC_H
+#include "quickjs.h"
+#include "pomelo/api.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Session relay.
+ *
+ * A piped session forwards its received messages to the target sessions of
+ * the same socket without entering JS. Whole messages are forwarded by
+ * reference, byte ranges are copied into new messages. If any target takes a
+ * byte range, the payload is copied once into a buffer owned by the pipe, and
+ * whole targets share one copy. Piped messages are not routed nor delivered
+ * to the listener.
+ *
+ * Targets are kept by client ID, so disconnected targets are dropped on the
+ * next forwarded message.
+ */
+
+
+/// @brief The channel index of targets which keep the channel of received
+/// messages. Messages of unknown channels are forwarded through channel 0.
+#define POMELO_QJS_PIPE_SAME_CHANNEL SIZE_MAX
+
+
+/// @brief The target of pipe
+typedef struct pomelo_qjs_pipe_target_s pomelo_qjs_pipe_target_t;
+
+/// @brief The relay of session
+typedef struct pomelo_qjs_pipe_s pomelo_qjs_pipe_t;
+
+
+struct pomelo_qjs_pipe_target_s {
+    /// @brief The client ID of target session
+    int64_t client_id;
+
+    /// @brief The channel index of forwarded messages
+    size_t channel_index;
+
+    /// @brief The first forwarded byte of messages
+    size_t offset;
+
+    /// @brief The maximum number of forwarded bytes. SIZE_MAX for the rest of
+    /// messages.
+    size_t length;
+};
+
+
+struct pomelo_qjs_pipe_s {
+    /// @brief The targets. It is created on demand.
+    pomelo_qjs_pipe_target_t * targets;
+
+    /// @brief The number of targets
+    size_t ntargets;
+
+    /// @brief The capacity of targets
+    size_t capacity;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the pipe
+void pomelo_qjs_pipe_init(pomelo_qjs_pipe_t * pipe);
+
+
+/// @brief Release all targets of pipe
+void pomelo_qjs_pipe_cleanup(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_pipe_t * pipe
+);
+
+
+/// @brief Parse the pipe options
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_pipe_parse_options(
+    JSContext * ctx,
+    JSValue value,
+    size_t nchannels,
+    pomelo_qjs_pipe_target_t * target
+);
+
+
+/// @brief Add a target to pipe, or replace the options of an existing one
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_pipe_add(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_pipe_t * pipe,
+    pomelo_qjs_pipe_target_t * target
+);
+
+
+/// @brief Remove a target from pipe
+void pomelo_qjs_pipe_remove(pomelo_qjs_pipe_t * pipe, int64_t client_id);
+
+
+/// @brief Forward a received message of session to its targets.
+/// @return Returns true if the session is piped and the message is consumed
+bool pomelo_qjs_pipe_forward(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_PIPE_SRC_H
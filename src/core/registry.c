@@ -0,0 +1,254 @@
+#include <assert.h>
+#include <string.h>
+#include "registry.h"
+#include "context.h"
+#include "session.h"
+
+
+/// @brief Hash a client ID (splitmix64 finalizer)
+static size_t registry_hash(int64_t client_id) {
+    uint64_t x = (uint64_t) client_id;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (size_t) x;
+}
+
+
+/// @brief Find the index of entry of client ID, or the empty entry where it
+/// would be inserted
+static size_t registry_probe(
+    pomelo_qjs_registry_entry_t * entries,
+    size_t capacity,
+    int64_t client_id
+) {
+    size_t mask = capacity - 1;
+    size_t index = registry_hash(client_id) & mask;
+    while (
+        entries[index].qjs_session &&
+        entries[index].client_id != client_id
+    ) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+
+/// @brief Grow the entries of registry
+static int registry_grow(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry
+) {
+    size_t capacity = registry->capacity
+        ? registry->capacity * 2
+        : POMELO_QJS_REGISTRY_INITIAL_CAPACITY;
+
+    pomelo_qjs_registry_entry_t * entries = pomelo_allocator_malloc(
+        context->allocator,
+        capacity * sizeof(pomelo_qjs_registry_entry_t)
+    );
+    if (!entries) return -1;
+    memset(entries, 0, capacity * sizeof(pomelo_qjs_registry_entry_t));
+
+    // Rehash the registered sessions
+    pomelo_qjs_registry_entry_t * old_entries = registry->entries;
+    for (size_t i = 0; i < registry->capacity; i++) {
+        pomelo_qjs_registry_entry_t * entry = old_entries + i;
+        if (!entry->qjs_session) continue;
+        entries[registry_probe(entries, capacity, entry->client_id)] = *entry;
+    }
+
+    if (old_entries) {
+        pomelo_allocator_free(context->allocator, old_entries);
+    }
+    registry->entries = entries;
+    registry->capacity = capacity;
+    return 0;
+}
+
+
+/// @brief Assign the smallest available index to session
+static void registry_acquire_index(
+    pomelo_qjs_registry_t * registry,
+    pomelo_qjs_session_t * qjs_session
+) {
+    if (registry->nfree_indices > 0) {
+        qjs_session->index = registry->free_indices[--registry->nfree_indices];
+        return;
+    }
+    qjs_session->index = registry->next_index++;
+}
+
+
+/// @brief Release the index of session
+static void registry_release_index(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry,
+    pomelo_qjs_session_t * qjs_session
+) {
+    int32_t index = qjs_session->index;
+    qjs_session->index = -1;
+    if (index < 0) return;
+
+    if (registry->nfree_indices == registry->free_indices_capacity) {
+        size_t capacity = registry->free_indices_capacity
+            ? registry->free_indices_capacity * 2
+            : POMELO_QJS_REGISTRY_INITIAL_CAPACITY;
+        int32_t * free_indices = pomelo_allocator_malloc(
+            context->allocator,
+            capacity * sizeof(int32_t)
+        );
+        if (!free_indices) return; // The index is lost
+
+        if (registry->free_indices) {
+            memcpy(
+                free_indices,
+                registry->free_indices,
+                registry->nfree_indices * sizeof(int32_t)
+            );
+            pomelo_allocator_free(context->allocator, registry->free_indices);
+        }
+        registry->free_indices = free_indices;
+        registry->free_indices_capacity = capacity;
+    }
+    registry->free_indices[registry->nfree_indices++] = index;
+}
+
+
+void pomelo_qjs_registry_init(pomelo_qjs_registry_t * registry) {
+    assert(registry != NULL);
+    registry->entries = NULL;
+    registry->capacity = 0;
+    registry->size = 0;
+    registry->next_index = 0;
+    registry->free_indices = NULL;
+    registry->nfree_indices = 0;
+    registry->free_indices_capacity = 0;
+}
+
+
+void pomelo_qjs_registry_cleanup(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry
+) {
+    assert(context != NULL);
+    assert(registry != NULL);
+
+    if (registry->entries) {
+        pomelo_allocator_free(context->allocator, registry->entries);
+        registry->entries = NULL;
+    }
+    registry->capacity = 0;
+    registry->size = 0;
+
+    if (registry->free_indices) {
+        pomelo_allocator_free(context->allocator, registry->free_indices);
+        registry->free_indices = NULL;
+    }
+    registry->next_index = 0;
+    registry->nfree_indices = 0;
+    registry->free_indices_capacity = 0;
+}
+
+
+int pomelo_qjs_registry_add(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry,
+    int64_t client_id,
+    pomelo_qjs_session_t * qjs_session
+) {
+    assert(context != NULL);
+    assert(registry != NULL);
+    assert(qjs_session != NULL);
+
+    // Keep the load factor under 3/4
+    if ((registry->size + 1) * 4 > registry->capacity * 3) {
+        if (registry_grow(context, registry) < 0) return -1;
+    }
+
+    size_t index =
+        registry_probe(registry->entries, registry->capacity, client_id);
+    pomelo_qjs_registry_entry_t * entry = registry->entries + index;
+    if (!entry->qjs_session) {
+        registry->size++;
+    } else if (entry->qjs_session != qjs_session) {
+        registry_release_index(context, registry, entry->qjs_session);
+    }
+    if (entry->qjs_session != qjs_session) {
+        registry_acquire_index(registry, qjs_session);
+    }
+    entry->client_id = client_id;
+    entry->qjs_session = qjs_session;
+    return 0;
+}
+
+
+int32_t pomelo_qjs_registry_remove(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry,
+    int64_t client_id,
+    pomelo_qjs_session_t * qjs_session
+) {
+    assert(context != NULL);
+    assert(registry != NULL);
+    assert(qjs_session != NULL);
+    if (registry->size == 0) return -1;
+
+    pomelo_qjs_registry_entry_t * entries = registry->entries;
+    size_t mask = registry->capacity - 1;
+    size_t index = registry_probe(entries, registry->capacity, client_id);
+    if (entries[index].qjs_session != qjs_session) return -1; // Not registered
+
+    entries[index].qjs_session = NULL;
+    registry->size--;
+
+    int32_t session_index = qjs_session->index;
+    registry_release_index(context, registry, qjs_session);
+
+    // Shift the following entries back to keep probing sequences unbroken
+    size_t hole = index;
+    size_t next = (hole + 1) & mask;
+    while (entries[next].qjs_session) {
+        size_t home = registry_hash(entries[next].client_id) & mask;
+        // Move the entry if its home is not in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            entries[hole] = entries[next];
+            entries[next].qjs_session = NULL;
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    return session_index;
+}
+
+
+pomelo_qjs_session_t * pomelo_qjs_registry_get(
+    pomelo_qjs_registry_t * registry,
+    int64_t client_id
+) {
+    assert(registry != NULL);
+    if (registry->size == 0) return NULL;
+
+    size_t index =
+        registry_probe(registry->entries, registry->capacity, client_id);
+    return registry->entries[index].qjs_session;
+}
+
+
+size_t pomelo_qjs_registry_collect(
+    pomelo_qjs_registry_t * registry,
+    pomelo_qjs_session_t ** sessions
+) {
+    assert(registry != NULL);
+    assert(sessions != NULL);
+
+    size_t count = 0;
+    for (size_t i = 0; i < registry->capacity; i++) {
+        pomelo_qjs_session_t * qjs_session = registry->entries[i].qjs_session;
+        if (qjs_session) sessions[count++] = qjs_session;
+    }
+    return count;
+}
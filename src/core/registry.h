@@ -0,0 +1,112 @@
+#ifndef POMELO_QUICKJS_REGISTRY_SRC_H
+#define POMELO_QUICKJS_REGISTRY_SRC_H
+#include "quickjs.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/// @brief The initial capacity of registry
+#define POMELO_QJS_REGISTRY_INITIAL_CAPACITY 16
+
+
+/// @brief An entry of session registry
+typedef struct pomelo_qjs_registry_entry_s pomelo_qjs_registry_entry_t;
+
+/// @brief The registry of connected sessions of socket, keyed by client ID.
+/// It is an open addressing hash table with linear probing. The registry also
+/// assigns dense indices to sessions, indices of removed sessions are reused.
+typedef struct pomelo_qjs_registry_s pomelo_qjs_registry_t;
+
+
+struct pomelo_qjs_registry_entry_s {
+    /// @brief The client ID of session
+    int64_t client_id;
+
+    /// @brief The session. NULL if the entry is empty.
+    pomelo_qjs_session_t * qjs_session;
+};
+
+
+struct pomelo_qjs_registry_s {
+    /// @brief The entries. It is created on demand.
+    pomelo_qjs_registry_entry_t * entries;
+
+    /// @brief The number of entries, always a power of two
+    size_t capacity;
+
+    /// @brief The number of registered sessions
+    size_t size;
+
+    /// @brief The next never used session index
+    int32_t next_index;
+
+    /// @brief The released session indices. It is created on demand.
+    int32_t * free_indices;
+
+    /// @brief The number of released session indices
+    size_t nfree_indices;
+
+    /// @brief The capacity of released session indices
+    size_t free_indices_capacity;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the registry
+void pomelo_qjs_registry_init(pomelo_qjs_registry_t * registry);
+
+
+/// @brief Release the entries of registry
+void pomelo_qjs_registry_cleanup(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry
+);
+
+
+/// @brief Register a session and assign its index. An existing session with
+/// the same client ID is replaced.
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_registry_add(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry,
+    int64_t client_id,
+    pomelo_qjs_session_t * qjs_session
+);
+
+
+/// @brief Unregister a session and release its index. Nothing happens if the
+/// client ID is registered by another session.
+/// @return Returns the released index, or -1 if the session is not registered
+int32_t pomelo_qjs_registry_remove(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_registry_t * registry,
+    int64_t client_id,
+    pomelo_qjs_session_t * qjs_session
+);
+
+
+/// @brief Find the session by client ID. Return NULL if not found.
+pomelo_qjs_session_t * pomelo_qjs_registry_get(
+    pomelo_qjs_registry_t * registry,
+    int64_t client_id
+);
+
+
+/// @brief Copy the registered sessions to an array.
+/// @param sessions Output array of at least registry->size sessions
+/// @return Returns the number of copied sessions
+size_t pomelo_qjs_registry_collect(
+    pomelo_qjs_registry_t * registry,
+    pomelo_qjs_session_t ** sessions
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_REGISTRY_SRC_H
@@ -0,0 +1,134 @@
+#include <assert.h>
+#include "router.h"
+#include "context.h"
+#include "message.h"
+#include "session.h"
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+
+void pomelo_qjs_router_init(pomelo_qjs_router_t * router) {
+    assert(router != NULL);
+    router->nroutes = 0;
+    for (size_t i = 0; i < countof(router->tables); i++) {
+        router->tables[i] = NULL;
+    }
+}
+
+
+void pomelo_qjs_router_cleanup(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_router_t * router
+) {
+    assert(context != NULL);
+    assert(router != NULL);
+
+    for (size_t i = 0; i < countof(router->tables); i++) {
+        JSValue * table = router->tables[i];
+        if (!table) continue;
+
+        for (size_t opcode = 0; opcode < POMELO_QJS_ROUTER_NOPCODES; opcode++) {
+            JS_FreeValue(context->ctx, table[opcode]);
+        }
+        pomelo_allocator_free(context->allocator, table);
+        router->tables[i] = NULL;
+    }
+    router->nroutes = 0;
+}
+
+
+int pomelo_qjs_router_set(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_router_t * router,
+    size_t channel_index,
+    uint8_t opcode,
+    JSValue handler
+) {
+    assert(context != NULL);
+    assert(router != NULL);
+    assert(channel_index < countof(router->tables));
+
+    JSContext * ctx = context->ctx;
+    bool removing = !JS_IsFunction(ctx, handler);
+    JSValue * table = router->tables[channel_index];
+    if (!table) {
+        if (removing) return 0; // Nothing to remove
+
+        table = pomelo_allocator_malloc(
+            context->allocator,
+            POMELO_QJS_ROUTER_NOPCODES * sizeof(JSValue)
+        );
+        if (!table) return -1;
+
+        for (size_t i = 0; i < POMELO_QJS_ROUTER_NOPCODES; i++) {
+            table[i] = JS_NULL;
+        }
+        router->tables[channel_index] = table;
+    }
+
+    if (!JS_IsNull(table[opcode])) {
+        JS_FreeValue(ctx, table[opcode]);
+        table[opcode] = JS_NULL;
+        router->nroutes--;
+    }
+
+    if (!removing) {
+        table[opcode] = JS_DupValue(ctx, handler);
+        router->nroutes++;
+    }
+    return 0;
+}
+
+
+bool pomelo_qjs_router_enabled(pomelo_qjs_router_t * router) {
+    assert(router != NULL);
+    return router->nroutes > 0;
+}
+
+
+void pomelo_qjs_router_dispatch(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_router_t * router,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    assert(context != NULL);
+    assert(router != NULL);
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+
+    uint8_t opcode = 0;
+    if (pomelo_message_read_uint8(message, &opcode) < 0) {
+        context->unrouted_messages++;
+        return; // Empty message
+    }
+
+    // Look up the channel table first, then the table of all channels
+    JSValue handler = JS_NULL;
+    if (channel_index < POMELO_QJS_ROUTER_ANY_CHANNEL) {
+        JSValue * table = router->tables[channel_index];
+        if (table) handler = table[opcode];
+    }
+    if (JS_IsNull(handler)) {
+        JSValue * table = router->tables[POMELO_QJS_ROUTER_ANY_CHANNEL];
+        if (table) handler = table[opcode];
+    }
+    if (JS_IsNull(handler)) {
+        context->unrouted_messages++;
+        return; // Unknown opcode
+    }
+
+    JSContext * ctx = context->ctx;
+    JSValue js_session = pomelo_qjs_session_wrap(qjs_session);
+    if (JS_IsException(js_session)) return;
+
+    // Keep the handler alive, it may unregister itself
+    handler = JS_DupValue(ctx, handler);
+    JSValue js_message = pomelo_qjs_message_new(context, message);
+    JSValue args[] = { js_session, js_message };
+    JSValue ret = JS_Call(ctx, handler, JS_UNDEFINED, countof(args), args);
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, js_message);
+    JS_FreeValue(ctx, handler);
+}
@@ -0,0 +1,91 @@
+#ifndef POMELO_QUICKJS_ROUTER_SRC_H
+#define POMELO_QUICKJS_ROUTER_SRC_H
+#include "quickjs.h"
+#include "pomelo/api.h"
+#include "pomelo/constants.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Opcode router.
+ *
+ * Once any route is registered, the leading uint8 of every received message
+ * is read as its opcode and the message is passed to the handler of that
+ * opcode with the cursor already past the opcode. Routes of a specific channel
+ * take precedence over routes of all channels. Messages with unknown opcodes
+ * are dropped without entering JS.
+ */
+
+
+/// @brief The number of opcodes of a route table
+#define POMELO_QJS_ROUTER_NOPCODES 256
+
+
+/// @brief The channel index of messages whose channel is unknown, and the
+/// table index of routes for all channels
+#define POMELO_QJS_ROUTER_ANY_CHANNEL POMELO_MAX_CHANNELS
+
+
+/// @brief The opcode router of socket
+typedef struct pomelo_qjs_router_s pomelo_qjs_router_t;
+
+
+struct pomelo_qjs_router_s {
+    /// @brief The number of registered routes
+    size_t nroutes;
+
+    /// @brief The route tables of channels, followed by the table of all
+    /// channels. Tables are created on demand.
+    JSValue * tables[POMELO_MAX_CHANNELS + 1];
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the router
+void pomelo_qjs_router_init(pomelo_qjs_router_t * router);
+
+
+/// @brief Release all routes of router
+void pomelo_qjs_router_cleanup(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_router_t * router
+);
+
+
+/// @brief Set or remove (if handler is not a function) the route of opcode.
+/// @param channel_index The channel index, or POMELO_QJS_ROUTER_ANY_CHANNEL
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_router_set(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_router_t * router,
+    size_t channel_index,
+    uint8_t opcode,
+    JSValue handler
+);
+
+
+/// @brief Check if the router has any route
+bool pomelo_qjs_router_enabled(pomelo_qjs_router_t * router);
+
+
+/// @brief Read the opcode of received message and call its handler
+/// @param channel_index The channel index of message, or
+/// POMELO_QJS_ROUTER_ANY_CHANNEL if it is unknown
+void pomelo_qjs_router_dispatch(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_router_t * router,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_ROUTER_SRC_H
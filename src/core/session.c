@@ -1,21 +1,35 @@
 #include <assert.h>
+#include <string.h>
 #include "context.h"
 #include "session.h"
 #include "message.h"
 #include "channel.h"
+#include "socket.h"
+#include "frame.h"
 
 #define countof(x) (sizeof(x) / sizeof((x)[0]))
 
+/// The largest integer which is exactly representable by a JS number
+#define SESSION_MAX_SAFE_INTEGER ((1LL << 53) - 1)
+
 // JS Sessions are managed by native side
 
 
 static JSCFunctionListEntry session_funcs[] = {
-    JS_CFUNC_DEF("send", 2, pomelo_qjs_session_send),
+    JS_CFUNC_DEF("send", 3, pomelo_qjs_session_send),
+    JS_CFUNC_DEF("sendLatest", 3, pomelo_qjs_session_send_latest),
+    JS_CFUNC_DEF("sendMany", 2, pomelo_qjs_session_send_many),
     JS_CGETSET_DEF("id", pomelo_qjs_session_get_id, NULL),
+    JS_CGETSET_DEF("idNumber", pomelo_qjs_session_get_id_number, NULL),
+    JS_CGETSET_DEF("rttMs", pomelo_qjs_session_get_rtt_ms, NULL),
+    JS_CGETSET_DEF("index", pomelo_qjs_session_get_index, NULL),
     JS_CFUNC_DEF("disconnect", 0, pomelo_qjs_session_disconnect),
     JS_CFUNC_DEF("setChannelMode", 2, pomelo_qjs_session_set_channel_mode),
     JS_CFUNC_DEF("getChannelMode", 1, pomelo_qjs_session_get_channel_mode),
     JS_CFUNC_DEF("rtt", 0, pomelo_qjs_session_rtt),
+    JS_CFUNC_DEF("setRateLimit", 1, pomelo_qjs_session_set_rate_limit),
+    JS_CFUNC_DEF("pipeTo", 2, pomelo_qjs_session_pipe_to),
+    JS_CFUNC_DEF("unpipe", 1, pomelo_qjs_session_unpipe),
     JS_CGETSET_DEF("channels", pomelo_qjs_session_get_channels, NULL)
 };
 
@@ -34,7 +48,10 @@ int pomelo_qjs_init_session_module(JSContext * ctx, JSModuleDef * m) {
     context->class_session_id = class_id;
 
     // Register the class
-    JSClassDef class_def = { .class_name = "Session" };
+    JSClassDef class_def = {
+        .class_name = "Session",
+        .gc_mark = pomelo_qjs_session_gc_mark
+    };
     if (JS_NewClass(context->rt, class_id, &class_def) < 0) {
         return -1;
     }
@@ -48,101 +65,1246 @@ int pomelo_qjs_init_session_module(JSContext * ctx, JSModuleDef * m) {
     // Set the class prototype
     JS_SetClassProto(ctx, class_id, proto);
 
-    // No exports
+    // No exports
+    return 0;
+}
+
+
+pomelo_qjs_session_t * pomelo_qjs_session_create(
+    pomelo_qjs_context_t * context,
+    pomelo_session_t * session
+) {
+    assert(context != NULL);
+    assert(session != NULL);
+
+    // Acquire new QJS session
+    pomelo_qjs_session_t * qjs_session =
+        pomelo_qjs_context_acquire_session(context);
+    if (!qjs_session) return NULL;
+
+    // Set the session
+    qjs_session->session = session;
+    qjs_session->qjs_socket =
+        pomelo_socket_get_extra(pomelo_session_get_socket(session));
+    qjs_session->client_id = pomelo_session_get_client_id(session);
+    pomelo_session_set_extra(session, qjs_session);
+
+    // Register the session to its socket. Unregistered sessions could never
+    // be found, so they are not created at all.
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    if (
+        qjs_socket &&
+        pomelo_qjs_socket_register_session(qjs_socket, qjs_session) < 0
+    ) {
+        pomelo_qjs_context_release_session(context, qjs_session);
+        return NULL;
+    }
+
+    return qjs_session;
+}
+
+
+JSValue pomelo_qjs_session_wrap(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    if (!JS_IsNull(qjs_session->thiz)) return qjs_session->thiz;
+
+    pomelo_qjs_context_t * context = qjs_session->context;
+    JSContext * ctx = context->ctx;
+
+    // Create new JS session
+    JSValue js_session = JS_NewObjectClass(ctx, context->class_session_id);
+    if (JS_IsException(js_session)) {
+        return js_session; // Failed to create new js session
+    }
+
+    // Set the QJS session to JS session
+    if (JS_SetOpaque(js_session, qjs_session) < 0) {
+        JS_FreeValue(ctx, js_session);
+        return JS_EXCEPTION;
+    }
+
+    // The session holds the only reference until it is cleaned up
+    qjs_session->thiz = js_session;
+    return js_session;
+}
+
+
+int pomelo_qjs_session_init(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_context_t * context
+) {
+    assert(qjs_session != NULL);
+    assert(context != NULL);
+
+    qjs_session->context = context;
+    qjs_session->thiz = JS_NULL;
+    qjs_session->channels = JS_NULL;
+    qjs_session->sending_count = 0;
+    qjs_session->pending_queue = NULL;
+    qjs_session->keyed_slots = NULL;
+    qjs_session->nkeyed_slots = 0;
+    qjs_session->keyed_slots_capacity = 0;
+    qjs_session->qjs_socket = NULL;
+    qjs_session->client_id = 0;
+    qjs_session->js_id = JS_NULL;
+    qjs_session->index = -1;
+    qjs_session->frame_channels = NULL;
+    qjs_session->nframe_channels = 0;
+    qjs_session->next_ack_id = 0;
+    qjs_session->ack_slots = NULL;
+    qjs_session->ack_slots_capacity = 0;
+    qjs_session->ack_base = 0;
+    qjs_session->ack_replies = NULL;
+    qjs_session->nack_replies = 0;
+    qjs_session->ack_replies_capacity = 0;
+    qjs_session->ack_reply_channel = 0;
+    qjs_session->ack_timing = false;
+    qjs_session->delay_sampled = false;
+    qjs_session->delay_base = 0;
+    qjs_session->delay_window_min = 0;
+    qjs_session->delay_window_start = 0;
+    qjs_session->rate_limit_overridden = false;
+    qjs_session->rate_limit.messages_per_second = 0;
+    qjs_session->rate_limit.bytes_per_second = 0;
+    pomelo_qjs_limiter_reset(&qjs_session->limiter);
+    pomelo_qjs_pipe_init(&qjs_session->pipe);
+    qjs_session->lockstep = NULL;
+    qjs_session->messages_received = 0;
+    qjs_session->bytes_received = 0;
+    qjs_session->messages_sent = 0;
+    qjs_session->bytes_sent = 0;
+
+    return 0;
+}
+
+
+/// @brief Find the keyed slot of session. Return NULL if not found
+static pomelo_qjs_keyed_slot_t * session_find_keyed_slot(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    uint32_t key
+) {
+    assert(qjs_session != NULL);
+    for (size_t i = 0; i < qjs_session->nkeyed_slots; i++) {
+        pomelo_qjs_keyed_slot_t * slot = qjs_session->keyed_slots + i;
+        if (slot->key == key && slot->channel_index == channel_index) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+
+/// @brief Find or create the keyed slot of session. Return NULL on failure
+static pomelo_qjs_keyed_slot_t * session_acquire_keyed_slot(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    uint32_t key
+) {
+    assert(qjs_session != NULL);
+    pomelo_qjs_keyed_slot_t * slot =
+        session_find_keyed_slot(qjs_session, channel_index, key);
+    if (slot) return slot;
+
+    if (qjs_session->nkeyed_slots == qjs_session->keyed_slots_capacity) {
+        size_t capacity = qjs_session->keyed_slots_capacity * 2;
+        if (capacity == 0) capacity = 4;
+
+        pomelo_qjs_keyed_slot_t * slots = pomelo_allocator_realloc(
+            qjs_session->context->allocator,
+            qjs_session->keyed_slots,
+            capacity * sizeof(pomelo_qjs_keyed_slot_t)
+        );
+        if (!slots) return NULL; // Failed to grow the slots
+
+        qjs_session->keyed_slots = slots;
+        qjs_session->keyed_slots_capacity = capacity;
+    }
+
+    slot = qjs_session->keyed_slots + qjs_session->nkeyed_slots;
+    qjs_session->nkeyed_slots++;
+
+    slot->channel_index = channel_index;
+    slot->key = key;
+    slot->sending = false;
+    slot->pending = NULL;
+    return slot;
+}
+
+
+/// @brief Remove a settled keyed slot of session
+static void session_remove_keyed_slot(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_keyed_slot_t * slot
+) {
+    assert(qjs_session != NULL);
+    assert(slot != NULL);
+    assert(qjs_session->nkeyed_slots > 0);
+
+    // Move the last slot into the removed one
+    qjs_session->nkeyed_slots--;
+    pomelo_qjs_keyed_slot_t * last =
+        qjs_session->keyed_slots + qjs_session->nkeyed_slots;
+    if (slot != last) {
+        *slot = *last;
+    }
+}
+
+
+/// @brief Assign the ack ID of message and put it into the acknowledgement
+/// slots. The message does not wait for the acknowledgement if it fails to
+/// be registered.
+static void session_register_ack(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+    uint32_t ack_id = qjs_session->next_ack_id++;
+    send_info->ack_id = ack_id;
+
+    // Every waiting ID is in [ack_base, next_ack_id), so a capacity larger
+    // than this window never maps two waiting IDs to the same slot.
+    size_t window = (size_t) (qjs_session->next_ack_id - qjs_session->ack_base);
+    size_t capacity = qjs_session->ack_slots_capacity;
+    if (window > capacity) {
+        size_t new_capacity = (capacity > 0) ? capacity : 16;
+        while (new_capacity < window) new_capacity *= 2;
+
+        pomelo_allocator_t * allocator = qjs_session->context->allocator;
+        pomelo_qjs_send_info_t ** slots = pomelo_allocator_malloc(
+            allocator, new_capacity * sizeof(pomelo_qjs_send_info_t *)
+        );
+        if (!slots) return; // Complete with the send result instead
+        memset(slots, 0, new_capacity * sizeof(pomelo_qjs_send_info_t *));
+
+        for (size_t i = 0; i < capacity; i++) {
+            pomelo_qjs_send_info_t * waiting = qjs_session->ack_slots[i];
+            if (!waiting) continue;
+            slots[waiting->ack_id & (new_capacity - 1)] = waiting;
+        }
+        if (qjs_session->ack_slots) {
+            pomelo_allocator_free(allocator, qjs_session->ack_slots);
+        }
+        qjs_session->ack_slots = slots;
+        qjs_session->ack_slots_capacity = new_capacity;
+        capacity = new_capacity;
+    }
+
+    qjs_session->ack_slots[ack_id & (capacity - 1)] = send_info;
+    send_info->ack_registered = true;
+}
+
+
+/// @brief Remove a message from the acknowledgement slots
+static void session_unregister_ack(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+    if (!send_info->ack_registered) return;
+
+    size_t mask = qjs_session->ack_slots_capacity - 1;
+    qjs_session->ack_slots[send_info->ack_id & mask] = NULL;
+    send_info->ack_registered = false;
+
+    // Skip the completed IDs, so that the window stays small
+    while (
+        qjs_session->ack_base != qjs_session->next_ack_id &&
+        !qjs_session->ack_slots[qjs_session->ack_base & mask]
+    ) {
+        qjs_session->ack_base++;
+    }
+}
+
+
+/// @brief Find the message waiting for an acknowledgement
+static pomelo_qjs_send_info_t * session_find_ack(
+    pomelo_qjs_session_t * qjs_session,
+    uint32_t ack_id
+) {
+    assert(qjs_session != NULL);
+    if (!qjs_session->ack_slots) return NULL;
+
+    size_t mask = qjs_session->ack_slots_capacity - 1;
+    pomelo_qjs_send_info_t * send_info = qjs_session->ack_slots[ack_id & mask];
+    return (send_info && send_info->ack_id == ack_id) ? send_info : NULL;
+}
+
+
+/// @brief Reject all messages which are waiting for acknowledgements. The
+/// messages which have not got their send results are rejected later by
+/// their send results.
+static void session_reject_acks(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    for (size_t i = 0; i < qjs_session->ack_slots_capacity; i++) {
+        pomelo_qjs_send_info_t * send_info = qjs_session->ack_slots[i];
+        if (!send_info) continue;
+
+        qjs_session->ack_slots[i] = NULL;
+        send_info->ack_registered = false;
+        if (send_info->ack_sent) {
+            pomelo_qjs_send_info_reject(send_info, "Session disconnected");
+        }
+    }
+    qjs_session->ack_base = qjs_session->next_ack_id;
+}
+
+
+/// @brief Stop the ack timer and forget the ack IDs to reply
+static void session_stop_ack_replies(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    qjs_session->nack_replies = 0;
+    if (!qjs_session->ack_timing) return;
+
+    pomelo_platform_timer_stop(
+        qjs_session->context->platform,
+        &qjs_session->ack_timer
+    );
+    qjs_session->ack_timing = false;
+}
+
+
+/// @brief Send the ack IDs which have been received since the last replies
+static void session_on_ack_timer(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    size_t count = qjs_session->nack_replies;
+    session_stop_ack_replies(qjs_session);
+    if (!qjs_session->session || count == 0) return;
+
+    pomelo_qjs_frame_send_acks(
+        qjs_session,
+        qjs_session->ack_reply_channel,
+        qjs_session->ack_replies,
+        count
+    );
+}
+
+
+/// @brief Drop all keyed messages which are waiting
+static void session_drop_keyed_pending(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    for (size_t i = 0; i < qjs_session->nkeyed_slots; i++) {
+        pomelo_qjs_keyed_slot_t * slot = qjs_session->keyed_slots + i;
+        pomelo_qjs_send_info_t * pending = slot->pending;
+        if (!pending) continue;
+
+        slot->pending = NULL;
+        pomelo_qjs_send_info_resolve(pending, 0);
+    }
+}
+
+
+/// @brief Drop all queued messages of session
+static void session_drop_pending(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    if (!qjs_session->pending_queue) return;
+
+    pomelo_qjs_send_info_t * send_info = NULL;
+    while (pomelo_list_pop_front(qjs_session->pending_queue, &send_info) == 0) {
+        pomelo_qjs_send_info_resolve(send_info, 0);
+    }
+}
+
+
+/// @brief Hand the message to native session
+static void session_send_impl(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+
+    // The sending slot must be taken before sending, the result callback may
+    // be called immediately.
+    qjs_session->sending_count++;
+
+    pomelo_message_t * message = send_info->message;
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    bool framed = qjs_socket && qjs_socket->framed;
+    if (send_info->ack) {
+        session_register_ack(qjs_session, send_info);
+    }
+    if (framed) {
+        message = pomelo_qjs_frame_encode(
+            qjs_socket, qjs_session, send_info->channel_index, message, send_info
+        );
+        if (!message) {
+            // Failed to frame the message, complete it as not sent
+            session_unregister_ack(qjs_session, send_info);
+            pomelo_qjs_session_on_sent(qjs_session, send_info);
+            pomelo_qjs_send_info_resolve(send_info, 0);
+            return;
+        }
+    }
+
+    size_t channel_index = send_info->channel_index;
+    pomelo_qjs_session_count_sent(qjs_session, message);
+    pomelo_session_send(
+        qjs_session->session,
+        channel_index,
+        message,
+        send_info
+    );
+
+    // The send info may be finalized here
+    if (framed) {
+        pomelo_message_unref(message);
+        pomelo_qjs_frame_flush(qjs_session, channel_index);
+    }
+}
+
+
+/// @brief Hand a message of batch to native session
+static void session_send_batch_message(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+
+    assert(message != NULL);
+
+    qjs_session->sending_count++;
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    bool framed = qjs_socket && qjs_socket->framed;
+    if (framed) {
+        message = pomelo_qjs_frame_encode(
+            qjs_socket, qjs_session, channel_index, message, send_info
+        );
+        if (!message) {
+            pomelo_qjs_session_on_batch_sent(qjs_session, send_info, 0);
+            return;
+        }
+    }
+
+    pomelo_qjs_session_count_sent(qjs_session, message);
+    pomelo_session_send(
+        qjs_session->session,
+        channel_index,
+        message,
+        send_info
+    );
+
+    if (framed) {
+        pomelo_message_unref(message);
+        pomelo_qjs_frame_flush(qjs_session, channel_index);
+    }
+}
+
+
+/// @brief Check whether the session has an available sending slot
+static bool session_has_sending_slot(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    size_t max_in_flight = qjs_socket ? qjs_socket->max_in_flight : 0;
+    return max_in_flight == 0 || qjs_session->sending_count < max_in_flight;
+}
+
+
+/// @brief Send queued messages while there are available sending slots
+static void session_process_pending(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    pomelo_list_t * queue = qjs_session->pending_queue;
+    if (!queue) return;
+
+    pomelo_qjs_context_t * context = qjs_session->context;
+    uint64_t now = pomelo_platform_hrtime(context->platform);
+
+    pomelo_qjs_send_info_t * send_info = NULL;
+    while (
+        session_has_sending_slot(qjs_session) &&
+        pomelo_list_pop_front(queue, &send_info) == 0
+    ) {
+        if (send_info->deadline > 0 && send_info->deadline <= now) {
+            // Stale message, drop it
+            context->expired_messages++;
+            pomelo_qjs_send_info_resolve(send_info, 0);
+            continue;
+        }
+
+        session_send_impl(qjs_session, send_info);
+    }
+}
+
+
+/// @brief Complete a keyed message. The latest message of its key is sent
+/// next, or the slot of key is released if there is none.
+static void session_settle_keyed(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+    pomelo_qjs_keyed_slot_t * slot = session_find_keyed_slot(
+        qjs_session, send_info->channel_index, send_info->key
+    );
+    if (!slot) return;
+
+    pomelo_qjs_send_info_t * pending = slot->pending;
+    if (pending) {
+        slot->pending = NULL;
+        pomelo_qjs_session_dispatch(qjs_session, pending);
+    } else {
+        // The key has settled, release its slot
+        session_remove_keyed_slot(qjs_session, slot);
+    }
+}
+
+
+void pomelo_qjs_session_cleanup(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    assert(qjs_session->context != NULL);
+
+    JSContext * ctx = qjs_session->context->ctx;
+
+    // Unset the native session
+    if (qjs_session->session) {
+        pomelo_session_set_extra(qjs_session->session, NULL);
+        qjs_session->session = NULL;
+    }
+
+    // Delete the reference of thiz
+    JS_FreeValue(ctx, qjs_session->thiz);
+    qjs_session->thiz = JS_NULL;
+
+    // Delete the reference of channels
+    JS_FreeValue(ctx, qjs_session->channels);
+    qjs_session->channels = JS_NULL;
+
+    // Delete the cached ID
+    JS_FreeValue(ctx, qjs_session->js_id);
+    qjs_session->js_id = JS_NULL;
+
+    // Drop the queued messages
+    if (qjs_session->pending_queue) {
+        session_drop_pending(qjs_session);
+        pomelo_list_destroy(qjs_session->pending_queue);
+        qjs_session->pending_queue = NULL;
+    }
+    qjs_session->sending_count = 0;
+
+    // Drop the keyed messages
+    if (qjs_session->keyed_slots) {
+        session_drop_keyed_pending(qjs_session);
+        pomelo_allocator_free(
+            qjs_session->context->allocator,
+            qjs_session->keyed_slots
+        );
+        qjs_session->keyed_slots = NULL;
+    }
+    qjs_session->nkeyed_slots = 0;
+    qjs_session->keyed_slots_capacity = 0;
+
+    // Reject the messages waiting for acknowledgements
+    if (qjs_session->ack_slots) {
+        session_reject_acks(qjs_session);
+        pomelo_allocator_free(
+            qjs_session->context->allocator,
+            qjs_session->ack_slots
+        );
+        qjs_session->ack_slots = NULL;
+    }
+    qjs_session->ack_slots_capacity = 0;
+    qjs_session->next_ack_id = 0;
+    qjs_session->ack_base = 0;
+
+    // Forget the acknowledgements to reply
+    session_stop_ack_replies(qjs_session);
+    if (qjs_session->ack_replies) {
+        pomelo_allocator_free(
+            qjs_session->context->allocator,
+            qjs_session->ack_replies
+        );
+        qjs_session->ack_replies = NULL;
+    }
+    qjs_session->ack_replies_capacity = 0;
+
+    // Forget the delays of timed frames, the next peer has another clock
+    qjs_session->delay_sampled = false;
+
+    // Reset the inbound rate limit
+    qjs_session->rate_limit_overridden = false;
+    pomelo_qjs_limiter_reset(&qjs_session->limiter);
+
+    // Stop relaying
+    pomelo_qjs_pipe_cleanup(qjs_session->context, &qjs_session->pipe);
+
+    // Leave the lockstep aggregator
+    if (qjs_session->lockstep) {
+        pomelo_qjs_lockstep_remove(qjs_session->lockstep, qjs_session);
+    }
+
+    // Release the framing states
+    pomelo_qjs_frame_cleanup_session(qjs_session);
+    qjs_session->qjs_socket = NULL;
+}
+
+
+void pomelo_qjs_session_dispatch(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+    send_info->qjs_session = qjs_session;
+
+    // Messages behind the queued ones wait in the queue too, so that the
+    // sending order is kept.
+    bool queued = qjs_session->pending_queue &&
+        qjs_session->pending_queue->size > 0;
+    if (
+        queued ||
+        (send_info->deadline > 0 && !session_has_sending_slot(qjs_session))
+    ) {
+        // No sending slot, wait in the queue
+        if (!qjs_session->pending_queue) {
+            pomelo_list_options_t list_options = {
+                .allocator = qjs_session->context->allocator,
+                .element_size = sizeof(pomelo_qjs_send_info_t *)
+            };
+            qjs_session->pending_queue = pomelo_list_create(&list_options);
+        }
+
+        if (
+            qjs_session->pending_queue &&
+            pomelo_list_push_back(qjs_session->pending_queue, send_info)
+        ) {
+            return; // Queued
+        }
+        // Failed to queue, just send it
+    }
+
+    session_send_impl(qjs_session, send_info);
+}
+
+
+void pomelo_qjs_session_on_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+    assert(qjs_session->sending_count > 0);
+    qjs_session->sending_count--;
+
+    if (!qjs_session->session) {
+        // The native session has been cleaned up, release the session after
+        // the last sending message completes.
+        if (qjs_session->sending_count == 0) {
+            pomelo_qjs_context_release_session(
+                qjs_session->context,
+                qjs_session
+            );
+        }
+        return;
+    }
+
+    if (send_info->keyed && !send_info->ack) {
+        session_settle_keyed(qjs_session, send_info);
+    }
+
+    session_process_pending(qjs_session);
+}
+
+
+int pomelo_qjs_session_check_send_options(
+    JSContext * ctx,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_qjs_send_options_t * options
+) {
+    assert(ctx != NULL);
+    assert(qjs_session != NULL);
+    assert(options != NULL);
+    if (!options->ack) return 0;
+
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    if (!qjs_socket || !qjs_socket->framed) {
+        JS_ThrowTypeError(ctx, "Acknowledged sends require a framed socket");
+        return -1;
+    }
+
+    pomelo_channel_mode mode = pomelo_session_get_channel_mode(
+        qjs_session->session, channel_index
+    );
+    if (mode != POMELO_CHANNEL_MODE_RELIABLE) {
+        JS_ThrowTypeError(ctx, "Acknowledged sends require a reliable channel");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void pomelo_qjs_session_on_ack_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info,
+    size_t send_count
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+    bool attached = (qjs_session->session != NULL);
+    send_info->ack_sent = true;
+
+    // Keep waiting if the message has been sent and the peer has not
+    // acknowledged it yet
+    bool waiting = send_info->ack_registered && attached &&
+        send_count > 0 && !send_info->ack_received;
+    if (!waiting) {
+        session_unregister_ack(qjs_session, send_info);
+    }
+
+    // Release the sending slot, the session may be released here
+    pomelo_qjs_session_on_sent(qjs_session, send_info);
+    if (waiting) return; // Wait for the acknowledgement
+
+    if (attached && send_info->keyed) {
+        session_settle_keyed(qjs_session, send_info);
+    }
+
+    if (!attached) {
+        pomelo_qjs_send_info_reject(send_info, "Session disconnected");
+    } else if (send_info->ack_received) {
+        // The acknowledgement arrived before the send result
+        pomelo_qjs_send_info_resolve(send_info, 1);
+    } else {
+        // Not sent, or failed to wait for the acknowledgement
+        pomelo_qjs_send_info_resolve(send_info, send_count);
+    }
+}
+
+
+void pomelo_qjs_session_on_ack(
+    pomelo_qjs_session_t * qjs_session,
+    uint32_t ack_id
+) {
+    assert(qjs_session != NULL);
+    pomelo_qjs_send_info_t * send_info =
+        session_find_ack(qjs_session, ack_id);
+    if (!send_info) return; // Unknown or duplicated acknowledgement
+
+    if (!send_info->ack_sent) {
+        // Complete it with the send result
+        send_info->ack_received = true;
+        return;
+    }
+
+    session_unregister_ack(qjs_session, send_info);
+    if (send_info->keyed) {
+        session_settle_keyed(qjs_session, send_info);
+    }
+    pomelo_qjs_send_info_resolve(send_info, 1);
+}
+
+
+void pomelo_qjs_session_reply_ack(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    uint32_t ack_id
+) {
+    assert(qjs_session != NULL);
+    if (qjs_session->nack_replies == qjs_session->ack_replies_capacity) {
+        size_t capacity = qjs_session->ack_replies_capacity * 2;
+        if (capacity == 0) capacity = 16;
+
+        uint32_t * replies = pomelo_allocator_realloc(
+            qjs_session->context->allocator,
+            qjs_session->ack_replies,
+            capacity * sizeof(uint32_t)
+        );
+        if (!replies) {
+            // Reply this one alone instead of losing it
+            pomelo_qjs_frame_send_acks(qjs_session, channel_index, &ack_id, 1);
+            return;
+        }
+
+        qjs_session->ack_replies = replies;
+        qjs_session->ack_replies_capacity = capacity;
+    }
+
+    if (qjs_session->nack_replies == 0) {
+        qjs_session->ack_reply_channel = channel_index;
+    }
+    qjs_session->ack_replies[qjs_session->nack_replies++] = ack_id;
+    if (qjs_session->ack_timing) return;
+
+    // Reply in the next loop iteration, together with the other messages
+    // received in this one
+    int ret = pomelo_platform_timer_start(
+        qjs_session->context->platform,
+        (pomelo_platform_timer_entry) session_on_ack_timer,
+        0, // timeout
+        0, // repeat
+        qjs_session,
+        &qjs_session->ack_timer
+    );
+    qjs_session->ack_timing = (ret == 0);
+    if (ret < 0) {
+        // Reply immediately instead
+        session_on_ack_timer(qjs_session);
+    }
+}
+
+
+void pomelo_qjs_session_on_batch_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info,
+    size_t send_count
+) {
+    assert(qjs_session != NULL);
+    assert(send_info != NULL);
+    assert(send_info->batch_remaining > 0);
+
+    // The session may be released here
+    pomelo_qjs_session_on_sent(qjs_session, send_info);
+
+    send_info->batch_send_count += send_count;
+    send_info->batch_remaining--;
+    if (send_info->batch_remaining == 0) {
+        pomelo_qjs_send_info_resolve(send_info, send_info->batch_send_count);
+    }
+}
+
+
+int pomelo_qjs_session_send_detached(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+    if (!qjs_session->session) return -1;
+
+    if (
+        qjs_session->pending_queue &&
+        qjs_session->pending_queue->size > 0
+    ) {
+        // Keep the sending order, wait behind the queued messages
+        pomelo_qjs_context_t * context = qjs_session->context;
+        pomelo_qjs_send_info_t * send_info =
+            pomelo_qjs_context_acquire_send_info(context);
+        if (!send_info) return -1;
+
+        pomelo_qjs_send_info_init_internal(send_info, context, message);
+        send_info->channel_index = channel_index;
+        pomelo_qjs_session_dispatch(qjs_session, send_info);
+        return 0;
+    }
+
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    bool framed = qjs_socket && qjs_socket->framed;
+    if (framed) {
+        message = pomelo_qjs_frame_encode(
+            qjs_socket, qjs_session, channel_index, message, NULL
+        );
+        if (!message) return -1;
+    }
+
+    // No send info, the result callback ignores this message
+    pomelo_qjs_session_count_sent(qjs_session, message);
+    int ret = pomelo_session_send(
+        qjs_session->session,
+        channel_index,
+        message,
+        NULL
+    );
+
+    if (framed) {
+        pomelo_message_unref(message);
+        pomelo_qjs_frame_flush(qjs_session, channel_index);
+    }
+    return ret;
+}
+
+
+int pomelo_qjs_session_send_internal(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * frame
+) {
+    assert(qjs_session != NULL);
+    assert(frame != NULL);
+    if (!qjs_session->session) return -1;
+
+    pomelo_qjs_context_t * context = qjs_session->context;
+    pomelo_qjs_send_info_t * send_info =
+        pomelo_qjs_context_acquire_send_info(context);
+    if (!send_info) return -1;
+
+    pomelo_qjs_send_info_init_internal(send_info, context, frame);
+    send_info->qjs_session = qjs_session;
+    send_info->channel_index = channel_index;
+
+    // The sending slot must be taken before sending, the result callback may
+    // be called immediately.
+    qjs_session->sending_count++;
+    pomelo_qjs_session_count_sent(qjs_session, frame);
+    return pomelo_session_send(
+        qjs_session->session,
+        channel_index,
+        frame,
+        send_info
+    );
+}
+
+
+void pomelo_qjs_session_count_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_message_t * message
+) {
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+    qjs_session->messages_sent++;
+    qjs_session->bytes_sent += pomelo_message_size(message);
+}
+
+
+uint64_t pomelo_qjs_session_lost_count(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    uint64_t lost = 0;
+    for (size_t i = 0; i < qjs_session->nframe_channels; i++) {
+        lost += qjs_session->frame_channels[i].lost_count;
+    }
+    return lost;
+}
+
+
+size_t pomelo_qjs_session_queue_depth(pomelo_qjs_session_t * qjs_session) {
+    assert(qjs_session != NULL);
+    size_t depth = qjs_session->sending_count;
+    if (qjs_session->pending_queue) {
+        depth += qjs_session->pending_queue->size;
+    }
+    for (size_t i = 0; i < qjs_session->nkeyed_slots; i++) {
+        if (qjs_session->keyed_slots[i].pending) depth++;
+    }
+    return depth;
+}
+
+
+bool pomelo_qjs_session_check_rate_limit(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_message_t * message
+) {
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+
+    pomelo_qjs_rate_limit_t * limit = &qjs_session->rate_limit;
+    if (!qjs_session->rate_limit_overridden) {
+        if (!qjs_session->qjs_socket) return true;
+        limit = &qjs_session->qjs_socket->rate_limit;
+    }
+    if (!pomelo_qjs_rate_limit_enabled(limit)) return true;
+
+    pomelo_qjs_context_t * context = qjs_session->context;
+    uint64_t now = pomelo_platform_hrtime(context->platform);
+    if (!pomelo_qjs_limiter_consume(
+        &qjs_session->limiter,
+        limit,
+        now,
+        pomelo_message_size(message)
+    )) {
+        context->rate_limited_messages++;
+        return false;
+    }
+    return true;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*                            Implementation APIs                             */
+/*----------------------------------------------------------------------------*/
+
+void pomelo_session_on_cleanup(pomelo_session_t * session) {
+    assert(session != NULL);
+
+    pomelo_qjs_session_t * qjs_session = pomelo_session_get_extra(session);
+    if (!qjs_session) return; // The session may not be created
+
+    pomelo_qjs_socket_t * qjs_socket =
+        pomelo_socket_get_extra(pomelo_session_get_socket(session));
+    if (qjs_socket) {
+        pomelo_qjs_socket_unregister_session(qjs_socket, qjs_session);
+    }
+
+    // Queued messages will never be sent
+    session_drop_pending(qjs_session);
+    session_drop_keyed_pending(qjs_session);
+    session_reject_acks(qjs_session);
+    session_stop_ack_replies(qjs_session);
+
+    if (qjs_session->sending_count > 0) {
+        // Sending messages are still referencing this session. Detach the
+        // native session and release it later.
+        pomelo_session_set_extra(session, NULL);
+        qjs_session->session = NULL;
+        return;
+    }
+
+    pomelo_qjs_context_release_session(qjs_session->context, qjs_session);
+}
+
+
+JSValue pomelo_qjs_session_send(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session || !qjs_session->session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    if (argc < 2) {
+        return JS_ThrowTypeError(ctx, "Missing arguments"); 
+    }
+
+    // Get the channel index
+    int channel_index = 0;
+    if (JS_ToInt32(ctx, &channel_index, argv[0]) < 0) {
+        return JS_ThrowTypeError(ctx, "Invalid channelIndex");
+    }
+
+    // Get the message from the second argument
+    pomelo_qjs_message_t * qjs_message =
+        JS_GetOpaque(argv[1], context->class_message_id);
+    if (!qjs_message || !qjs_message->message) {
+        return JS_ThrowTypeError(ctx, "Invalid native message");
+    }
+
+    // Get the options from the third argument
+    pomelo_qjs_send_options_t options;
+    JSValue js_options = (argc > 2) ? argv[2] : JS_UNDEFINED;
+    if (pomelo_qjs_send_options_parse(ctx, js_options, &options) < 0) {
+        return JS_EXCEPTION;
+    }
+    if (pomelo_qjs_session_check_send_options(
+        ctx, qjs_session, (size_t) channel_index, &options
+    ) < 0) {
+        return JS_EXCEPTION;
+    }
+
+    // Acquire new send info
+    pomelo_qjs_send_info_t * send_info =
+        pomelo_qjs_context_acquire_send_info(context);
+    if (!send_info) {
+        return JS_ThrowTypeError(ctx, "Failed to acquire send info");
+    }
+
+    // Initialize the send info
+    JSValue promise =
+        pomelo_qjs_send_info_init(send_info, context, qjs_message);
+    if (JS_IsException(promise)) {
+        pomelo_qjs_context_release_send_info(context, send_info);
+        return promise;
+    }
+
+    send_info->channel_index = (size_t) channel_index;
+    send_info->ack = options.ack;
+    if (options.max_age > 0) {
+        send_info->deadline = pomelo_platform_hrtime(context->platform) +
+            options.max_age * 1000000ULL;
+    }
+
+    // Send the message
+    pomelo_qjs_session_dispatch(qjs_session, send_info);
+    return promise;
+}
+
+
+/// @brief Read and validate an element of batch. The native message is
+/// ref'ed on success.
+/// @return Returns 0 on success, or -1 with a pending exception
+static int session_snapshot_batch_entry(
+    pomelo_qjs_session_t * qjs_session,
+    JSValue * argv,
+    int64_t index,
+    size_t * channel_index,
+    pomelo_message_t ** message
+) {
+    pomelo_qjs_context_t * context = qjs_session->context;
+    JSContext * ctx = context->ctx;
+
+    JSValue js_channel_index = JS_GetPropertyInt64(ctx, argv[0], index);
+    uint32_t value = 0;
+    int ret = JS_ToUint32(ctx, &value, js_channel_index);
+    JS_FreeValue(ctx, js_channel_index);
+
+    // The session may be disconnected by user code
+    size_t nchannels = qjs_session->session
+        ? pomelo_socket_get_nchannels(
+            pomelo_session_get_socket(qjs_session->session)
+        )
+        : 0;
+    if (ret != 0 || value >= nchannels) {
+        JS_ThrowTypeError(ctx, "Invalid channel index at %d", (int) index);
+        return -1;
+    }
+
+    JSValue js_message = JS_GetPropertyInt64(ctx, argv[1], index);
+    pomelo_qjs_message_t * qjs_message =
+        JS_GetOpaque(js_message, context->class_message_id);
+    JS_FreeValue(ctx, js_message);
+    if (!qjs_message || !qjs_message->message) {
+        JS_ThrowTypeError(ctx, "Invalid native message at %d", (int) index);
+        return -1;
+    }
+
+    *channel_index = value;
+    *message = qjs_message->message;
+    pomelo_message_ref(qjs_message->message);
     return 0;
 }
 
 
-JSValue pomelo_qjs_session_new(
-    pomelo_qjs_context_t * context,
-    pomelo_session_t * session
+/// @brief Send a validated batch. No user code runs here.
+/// @return Returns the promise of batch
+static JSValue session_send_batch(
+    pomelo_qjs_session_t * qjs_session,
+    JSValue js_messages,
+    size_t count,
+    size_t * channel_indices,
+    pomelo_message_t ** messages
 ) {
-    assert(context != NULL);
-    assert(session != NULL);
+    pomelo_qjs_context_t * context = qjs_session->context;
     JSContext * ctx = context->ctx;
 
-    // Create new JS session
-    JSValue js_session = JS_NewObjectClass(ctx, context->class_session_id);
-    if (JS_IsException(js_session)) {
-        return js_session; // Failed to create new js session   
+    // Acquire new send info, it is shared by all messages of batch
+    pomelo_qjs_send_info_t * send_info =
+        pomelo_qjs_context_acquire_send_info(context);
+    if (!send_info) {
+        return JS_ThrowTypeError(ctx, "Failed to acquire send info");
     }
-    
-    // Acquire new QJS session
-    pomelo_qjs_session_t * qjs_session =
-        pomelo_qjs_context_acquire_session(context);
-    if (!qjs_session) {
-        JS_FreeValue(ctx, js_session);
-        return JS_EXCEPTION; // Failed to acquire new qjs session
+
+    JSValue promise = pomelo_qjs_send_info_init_batch(
+        send_info, context, js_messages, count
+    );
+    if (JS_IsException(promise)) {
+        pomelo_qjs_context_release_send_info(context, send_info);
+        return promise;
     }
+    send_info->qjs_session = qjs_session;
 
-    // Set the QJS session to JS session
-    if (JS_SetOpaque(js_session, qjs_session) < 0) {
-        JS_FreeValue(ctx, js_session);
-        pomelo_qjs_context_release_session(context, qjs_session);
-        return JS_EXCEPTION;
+    if (count == 0) {
+        pomelo_qjs_send_info_resolve(send_info, 0);
+        return promise;
     }
 
-    // Set the session
-    qjs_session->session = session;
-    qjs_session->thiz = JS_DupValue(ctx, js_session);
-    pomelo_session_set_extra(session, qjs_session);
+    for (size_t i = 0; i < count; i++) {
+        // The send info may be finalized after the last message
+        session_send_batch_message(
+            qjs_session, send_info, channel_indices[i], messages[i]
+        );
+    }
 
-    return js_session;
+    return promise;
 }
 
 
-int pomelo_qjs_session_init(
-    pomelo_qjs_session_t * qjs_session,
-    pomelo_qjs_context_t * context
+JSValue pomelo_qjs_session_send_many(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
 ) {
-    assert(qjs_session != NULL);
-    assert(context != NULL);
-
-    qjs_session->context = context;
-    qjs_session->thiz = JS_NULL;
-    qjs_session->channels = JS_NULL;
-
-    return 0;
-}
-
+    assert(ctx != NULL);
 
-void pomelo_qjs_session_cleanup(pomelo_qjs_session_t * qjs_session) {
-    assert(qjs_session != NULL);
-    assert(qjs_session->context != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
 
-    JSContext * ctx = qjs_session->context->ctx;
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session || !qjs_session->session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
 
-    // Unset the native session
-    if (qjs_session->session) {
-        pomelo_session_set_extra(qjs_session->session, NULL);
-        qjs_session->session = NULL;
+    if (argc < 2) {
+        return JS_ThrowTypeError(ctx, "Missing arguments");
     }
 
-    // Delete the reference of thiz
-    JS_FreeValue(ctx, qjs_session->thiz);
-    qjs_session->thiz = JS_NULL;
+    if (!JS_IsArray(argv[0]) || !JS_IsArray(argv[1])) {
+        return JS_ThrowTypeError(
+            ctx, "Channel indices and messages must be arrays"
+        );
+    }
 
-    // Delete the reference of channels
-    JS_FreeValue(ctx, qjs_session->channels);
-    qjs_session->channels = JS_NULL;
-}
+    int64_t count = 0;
+    int64_t nchannel_indices = 0;
+    if (
+        JS_GetLength(ctx, argv[1], &count) != 0 ||
+        JS_GetLength(ctx, argv[0], &nchannel_indices) != 0
+    ) {
+        return JS_EXCEPTION;
+    }
+    if (nchannel_indices != count) {
+        return JS_ThrowTypeError(
+            ctx, "Channel indices and messages must have the same length"
+        );
+    }
 
+    if (count == 0) {
+        return session_send_batch(qjs_session, argv[1], 0, NULL, NULL);
+    }
 
-/*----------------------------------------------------------------------------*/
-/*                            Implementation APIs                             */
-/*----------------------------------------------------------------------------*/
+    // Snapshot the whole batch before sending anything. Getters may run
+    // user code, so every element is read once and its native message is
+    // held until it is sent.
+    pomelo_allocator_t * allocator = context->allocator;
+    size_t * channel_indices = pomelo_allocator_malloc(
+        allocator, (size_t) count * sizeof(size_t)
+    );
+    pomelo_message_t ** messages = pomelo_allocator_malloc(
+        allocator, (size_t) count * sizeof(pomelo_message_t *)
+    );
+    if (!channel_indices || !messages) {
+        if (channel_indices) pomelo_allocator_free(allocator, channel_indices);
+        if (messages) pomelo_allocator_free(allocator, messages);
+        return JS_ThrowTypeError(ctx, "Failed to allocate batch");
+    }
 
-void pomelo_session_on_cleanup(pomelo_session_t * session) {
-    assert(session != NULL);
+    int64_t nmessages = 0;
+    for (; nmessages < count; nmessages++) {
+        int ret = session_snapshot_batch_entry(
+            qjs_session,
+            argv,
+            nmessages,
+            &channel_indices[nmessages],
+            &messages[nmessages]
+        );
+        if (ret < 0) break;
+    }
 
-    pomelo_qjs_session_t * qjs_session = pomelo_session_get_extra(session);
-    if (!qjs_session) return; // The session may not be created
+    JSValue promise = JS_EXCEPTION;
+    if (nmessages == count) {
+        if (qjs_session->session) {
+            promise = session_send_batch(
+                qjs_session,
+                argv[1],
+                (size_t) count,
+                channel_indices,
+                messages
+            );
+        } else {
+            // The session has been disconnected by user code
+            JS_ThrowTypeError(ctx, "Invalid native session");
+        }
+    }
 
-    pomelo_qjs_context_release_session(qjs_session->context, qjs_session);
+    for (int64_t i = 0; i < nmessages; i++) {
+        pomelo_message_unref(messages[i]);
+    }
+    pomelo_allocator_free(allocator, channel_indices);
+    pomelo_allocator_free(allocator, messages);
+    return promise;
 }
 
 
-JSValue pomelo_qjs_session_send(
+JSValue pomelo_qjs_session_send_latest(
     JSContext * ctx, JSValue thiz, int argc, JSValue * argv
 ) {
     assert(ctx != NULL);
@@ -156,27 +1318,54 @@ JSValue pomelo_qjs_session_send(
         return JS_ThrowTypeError(ctx, "Invalid native session");
     }
 
-    if (argc < 2) {
-        return JS_ThrowTypeError(ctx, "Missing arguments"); 
+    if (argc < 3) {
+        return JS_ThrowTypeError(ctx, "Missing arguments");
     }
 
-    // Get the channel index
+    // Get the channel index. Keys are scoped by channel.
     int channel_index = 0;
-    if (JS_ToInt32(ctx, &channel_index, argv[0]) < 0) {
+    size_t nchannels = pomelo_socket_get_nchannels(
+        pomelo_session_get_socket(qjs_session->session)
+    );
+    if (
+        JS_ToInt32(ctx, &channel_index, argv[0]) < 0 ||
+        channel_index < 0 ||
+        (size_t) channel_index >= nchannels
+    ) {
         return JS_ThrowTypeError(ctx, "Invalid channelIndex");
     }
 
-    // Get the message from the second argument
+    // Get the key, it must be an integer in [0, 2^32)
+    double js_key = 0;
+    if (
+        !JS_IsNumber(argv[1]) ||
+        JS_ToFloat64(ctx, &js_key, argv[1]) < 0 ||
+        !(js_key >= 0 && js_key <= UINT32_MAX) ||
+        js_key != (double) (uint32_t) js_key
+    ) {
+        return JS_ThrowTypeError(ctx, "Invalid key");
+    }
+    uint32_t key = (uint32_t) js_key;
+
+    // Get the message
     pomelo_qjs_message_t * qjs_message =
-        JS_GetOpaque(argv[1], context->class_message_id);
+        JS_GetOpaque(argv[2], context->class_message_id);
     if (!qjs_message || !qjs_message->message) {
         return JS_ThrowTypeError(ctx, "Invalid native message");
     }
 
+    pomelo_qjs_keyed_slot_t * slot = session_acquire_keyed_slot(
+        qjs_session, (size_t) channel_index, key
+    );
+    if (!slot) {
+        return JS_ThrowInternalError(ctx, "Failed to acquire keyed slot");
+    }
+
     // Acquire new send info
     pomelo_qjs_send_info_t * send_info =
         pomelo_qjs_context_acquire_send_info(context);
     if (!send_info) {
+        if (!slot->sending) session_remove_keyed_slot(qjs_session, slot);
         return JS_ThrowTypeError(ctx, "Failed to acquire send info");
     }
 
@@ -185,17 +1374,40 @@ JSValue pomelo_qjs_session_send(
         pomelo_qjs_send_info_init(send_info, context, qjs_message);
     if (JS_IsException(promise)) {
         pomelo_qjs_context_release_send_info(context, send_info);
+        if (!slot->sending) session_remove_keyed_slot(qjs_session, slot);
         return promise;
     }
 
-    // Send the message
-    pomelo_session_send(
-        qjs_session->session,
-        (size_t) channel_index,
-        qjs_message->message,
-        send_info
-    );
-    
+    send_info->qjs_session = qjs_session;
+    send_info->channel_index = (size_t) channel_index;
+    send_info->keyed = true;
+    send_info->key = key;
+
+    // On framed sockets, the key stays busy until the peer acknowledges the
+    // message of reliable channels. Newer messages replace each other while
+    // the native session retransmits, instead of following it.
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    send_info->ack = qjs_socket && qjs_socket->framed &&
+        pomelo_session_get_channel_mode(
+            qjs_session->session, (size_t) channel_index
+        ) == POMELO_CHANNEL_MODE_RELIABLE;
+
+    if (!slot->sending) {
+        // No message of this key is being sent. It still waits behind the
+        // queued messages.
+        slot->sending = true;
+        pomelo_qjs_session_dispatch(qjs_session, send_info);
+        return promise;
+    }
+
+    // Replace the older waiting message
+    pomelo_qjs_send_info_t * superseded = slot->pending;
+    slot->pending = send_info;
+    if (superseded) {
+        context->superseded_messages++;
+        pomelo_qjs_send_info_resolve(superseded, 0);
+    }
+
     return promise;
 }
 
@@ -212,8 +1424,74 @@ JSValue pomelo_qjs_session_get_id(JSContext * ctx, JSValue thiz) {
         return JS_ThrowTypeError(ctx, "Invalid native session");
     }
 
-    int64_t client_id = pomelo_session_get_client_id(qjs_session->session);
-    return JS_NewBigInt64(ctx, client_id);
+    // The ID never changes, create its value once
+    if (JS_IsNull(qjs_session->js_id)) {
+        qjs_session->js_id = JS_NewBigInt64(ctx, qjs_session->client_id);
+    }
+    return JS_DupValue(ctx, qjs_session->js_id);
+}
+
+
+JSValue pomelo_qjs_session_get_id_number(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session || !qjs_session->session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    // Numbers are only exact in the safe integer range
+    int64_t client_id = qjs_session->client_id;
+    if (
+        client_id > SESSION_MAX_SAFE_INTEGER ||
+        client_id < -SESSION_MAX_SAFE_INTEGER
+    ) {
+        return JS_ThrowRangeError(
+            ctx, "Session ID is not a safe integer, use id instead"
+        );
+    }
+    return JS_NewInt64(ctx, client_id);
+}
+
+
+JSValue pomelo_qjs_session_get_rtt_ms(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session || !qjs_session->session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    pomelo_rtt_t rtt;
+    if (pomelo_session_get_rtt(qjs_session->session, &rtt) < 0) {
+        return JS_ThrowTypeError(ctx, "Failed to get RTT");
+    }
+
+    return JS_NewFloat64(ctx, (double) rtt.mean / 1000000.0);
+}
+
+
+JSValue pomelo_qjs_session_get_index(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    return JS_NewInt32(ctx, qjs_session->index);
 }
 
 
@@ -339,6 +1617,190 @@ JSValue pomelo_qjs_session_rtt(
 }
 
 
+JSValue pomelo_qjs_session_set_rate_limit(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session || !qjs_session->session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    if (argc < 1 || JS_IsNull(argv[0]) || JS_IsUndefined(argv[0])) {
+        // Fall back to the rate limit of socket
+        qjs_session->rate_limit_overridden = false;
+        pomelo_qjs_limiter_reset(&qjs_session->limiter);
+        return JS_UNDEFINED;
+    }
+
+    pomelo_qjs_rate_limit_t rate_limit;
+    if (pomelo_qjs_rate_limit_parse(ctx, argv[0], &rate_limit) < 0) {
+        return JS_EXCEPTION;
+    }
+
+    qjs_session->rate_limit_overridden = true;
+    qjs_session->rate_limit = rate_limit;
+    pomelo_qjs_limiter_reset(&qjs_session->limiter);
+    return JS_UNDEFINED;
+}
+
+
+/// @brief Get the target session of pipe. The target must be a connected
+/// session of the same socket.
+static pomelo_qjs_session_t * session_get_pipe_target(
+    JSContext * ctx,
+    pomelo_qjs_session_t * qjs_session,
+    JSValue value
+) {
+    pomelo_qjs_context_t * context = qjs_session->context;
+    pomelo_qjs_session_t * target =
+        JS_GetOpaque(value, context->class_session_id);
+    if (!target || !target->session) {
+        JS_ThrowTypeError(ctx, "Invalid target session");
+        return NULL;
+    }
+    if (target->qjs_socket != qjs_session->qjs_socket) {
+        JS_ThrowTypeError(ctx, "Target session belongs to another socket");
+        return NULL;
+    }
+    return target;
+}
+
+
+JSValue pomelo_qjs_session_pipe_to(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session || !qjs_session->session || !qjs_session->qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    if (argc < 1) {
+        return JS_ThrowTypeError(ctx, "Target is required");
+    }
+
+    pomelo_qjs_pipe_target_t options;
+    int ret = pomelo_qjs_pipe_parse_options(
+        ctx,
+        (argc > 1) ? argv[1] : JS_UNDEFINED,
+        qjs_session->qjs_socket->nchannels,
+        &options
+    );
+    if (ret < 0) return JS_EXCEPTION;
+
+    // Single target
+    if (!JS_IsArray(argv[0])) {
+        pomelo_qjs_session_t * target =
+            session_get_pipe_target(ctx, qjs_session, argv[0]);
+        if (!target) return JS_EXCEPTION;
+
+        options.client_id = target->client_id;
+        if (pomelo_qjs_pipe_add(context, &qjs_session->pipe, &options) < 0) {
+            return JS_ThrowInternalError(ctx, "Failed to add pipe target");
+        }
+        return JS_UNDEFINED;
+    }
+
+    // Group of targets, validate all of them before piping
+    int64_t count = 0;
+    if (JS_GetLength(ctx, argv[0], &count) != 0) return JS_EXCEPTION;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int64_t i = 0; i < count; i++) {
+            JSValue js_target = JS_GetPropertyInt64(ctx, argv[0], i);
+            pomelo_qjs_session_t * target =
+                session_get_pipe_target(ctx, qjs_session, js_target);
+            JS_FreeValue(ctx, js_target);
+            if (!target) return JS_EXCEPTION;
+            if (pass == 0) continue;
+
+            options.client_id = target->client_id;
+            ret = pomelo_qjs_pipe_add(context, &qjs_session->pipe, &options);
+            if (ret < 0) {
+                return JS_ThrowInternalError(ctx, "Failed to add pipe target");
+            }
+        }
+    }
+
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_session_unpipe(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(thiz, context->class_session_id);
+    if (!qjs_session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    pomelo_qjs_pipe_t * pipe = &qjs_session->pipe;
+    if (argc < 1 || JS_IsUndefined(argv[0]) || JS_IsNull(argv[0])) {
+        pipe->ntargets = 0; // Remove all targets
+        return JS_UNDEFINED;
+    }
+
+    // Disconnected targets have already been dropped, so they are skipped
+    if (!JS_IsArray(argv[0])) {
+        pomelo_qjs_session_t * target =
+            JS_GetOpaque(argv[0], context->class_session_id);
+        if (target) {
+            pomelo_qjs_pipe_remove(pipe, target->client_id);
+        }
+        return JS_UNDEFINED;
+    }
+
+    int64_t count = 0;
+    if (JS_GetLength(ctx, argv[0], &count) != 0) return JS_EXCEPTION;
+
+    for (int64_t i = 0; i < count; i++) {
+        JSValue js_target = JS_GetPropertyInt64(ctx, argv[0], i);
+        pomelo_qjs_session_t * target =
+            JS_GetOpaque(js_target, context->class_session_id);
+        JS_FreeValue(ctx, js_target);
+        if (target) {
+            pomelo_qjs_pipe_remove(pipe, target->client_id);
+        }
+    }
+
+    return JS_UNDEFINED;
+}
+
+
+void pomelo_qjs_session_gc_mark(
+    JSRuntime * rt,
+    JSValue val,
+    JS_MarkFunc * mark_func
+) {
+    assert(rt != NULL);
+    pomelo_qjs_context_t * context = JS_GetRuntimeOpaque(rt);
+    if (!context) return;
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(val, context->class_session_id);
+    if (!qjs_session) return;
+
+    // The reference of member to its lockstep aggregator
+    if (qjs_session->lockstep) {
+        JS_MarkValue(rt, qjs_session->lockstep->thiz, mark_func);
+    }
+}
+
+
 JSValue pomelo_qjs_session_get_channels(JSContext * ctx, JSValue thiz) {
     assert(ctx != NULL);
     pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
@@ -366,7 +1828,8 @@ JSValue pomelo_qjs_session_get_channels(JSContext * ctx, JSValue thiz) {
     for (size_t i = 0; i < nchannels; i++) {
         pomelo_channel_t * channel = pomelo_session_get_channel(session, i);
         assert(channel != NULL);
-        JSValue js_channel = pomelo_qjs_channel_new(context, channel);
+        JSValue js_channel =
+            pomelo_qjs_channel_new(context, qjs_session, channel, i);
         if (JS_IsException(js_channel)) {
             return js_channel;
         }
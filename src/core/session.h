@@ -3,11 +3,36 @@
 #include "quickjs.h"
 #include "pomelo/api.h"
 #include "core.h"
+#include "utils/list.h"
+#include "frame.h"
+#include "message.h"
+#include "limiter.h"
+#include "pipe.h"
+#include "lockstep.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/// @brief The keyed sending slot of session
+typedef struct pomelo_qjs_keyed_slot_s pomelo_qjs_keyed_slot_t;
+
+
+struct pomelo_qjs_keyed_slot_s {
+    /// @brief The channel index of key
+    size_t channel_index;
+
+    /// @brief The key
+    uint32_t key;
+
+    /// @brief Whether a message of this key is being sent
+    bool sending;
+
+    /// @brief The latest message of this key which waits for the sending one
+    pomelo_qjs_send_info_t * pending;
+};
+
+
 struct pomelo_qjs_session_s {
     /// @brief The context
     pomelo_qjs_context_t * context;
@@ -15,11 +40,121 @@ struct pomelo_qjs_session_s {
     /// @brief The session
     pomelo_session_t * session;
 
+    /// @brief The socket which owns this session
+    pomelo_qjs_socket_t * qjs_socket;
+
+    /// @brief The client ID of session
+    int64_t client_id;
+
+    /// @brief The cached JS value of client ID. It is created on demand.
+    JSValue js_id;
+
+    /// @brief The dense index of session in its socket. It is -1 if the
+    /// session is not registered.
+    int32_t index;
+
     /// @brief The this of session
     JSValue thiz;
 
     /// @brief The array of channels
     JSValue channels;
+
+    /// @brief The number of sending messages which have not completed yet
+    size_t sending_count;
+
+    /// @brief Queue of send info waiting for sending slots.
+    /// It is created on demand.
+    pomelo_list_t * pending_queue;
+
+    /// @brief The keyed sending slots. A slot only lives while a message of
+    /// its key is being sent.
+    pomelo_qjs_keyed_slot_t * keyed_slots;
+
+    /// @brief The number of keyed sending slots
+    size_t nkeyed_slots;
+
+    /// @brief The capacity of keyed sending slots
+    size_t keyed_slots_capacity;
+
+    /// @brief The framing states of channels. It is created on demand.
+    pomelo_qjs_frame_channel_t * frame_channels;
+
+    /// @brief The number of framing states
+    size_t nframe_channels;
+
+    /// @brief The next acknowledgement ID
+    uint32_t next_ack_id;
+
+    /// @brief Messages waiting for acknowledgements, indexed by their ack IDs
+    /// modulo capacity. It is created on demand.
+    pomelo_qjs_send_info_t ** ack_slots;
+
+    /// @brief The capacity of acknowledgement slots (power of two)
+    size_t ack_slots_capacity;
+
+    /// @brief The oldest ack ID which may still be waiting
+    uint32_t ack_base;
+
+    /// @brief The received ack IDs which have not been replied yet. They are
+    /// replied together by the ack timer. It is created on demand.
+    uint32_t * ack_replies;
+
+    /// @brief The number of ack IDs to reply
+    size_t nack_replies;
+
+    /// @brief The capacity of ack replies
+    size_t ack_replies_capacity;
+
+    /// @brief The channel of ack replies
+    size_t ack_reply_channel;
+
+    /// @brief Whether the ack timer is running
+    bool ack_timing;
+
+    /// @brief The timer which replies the received ack IDs
+    pomelo_platform_handle_t ack_timer;
+
+    /// @brief Whether any timed frame has been received
+    bool delay_sampled;
+
+    /// @brief The lowest delay of timed frames of the last two windows, in
+    /// milliseconds of the peer clock modulo 2^32
+    uint32_t delay_base;
+
+    /// @brief The lowest delay of timed frames of current window
+    uint32_t delay_window_min;
+
+    /// @brief The start of current delay window (hrtime in nanoseconds)
+    uint64_t delay_window_start;
+
+    /// @brief Whether the session overrides the rate limit of socket
+    bool rate_limit_overridden;
+
+    /// @brief The overriding inbound rate limit
+    pomelo_qjs_rate_limit_t rate_limit;
+
+    /// @brief The inbound token bucket
+    pomelo_qjs_limiter_t limiter;
+
+    /// @brief The relay of received messages
+    pomelo_qjs_pipe_t pipe;
+
+    /// @brief The lockstep aggregator which this session is a member of
+    pomelo_qjs_lockstep_t * lockstep;
+
+    /* Metrics */
+
+    /// @brief The number of received messages
+    uint64_t messages_received;
+
+    /// @brief The number of received bytes
+    uint64_t bytes_received;
+
+    /// @brief The number of messages handed to native session
+    uint64_t messages_sent;
+
+    /// @brief The number of bytes handed to native session
+    uint64_t bytes_sent;
 };
 
 
@@ -31,13 +166,20 @@ struct pomelo_qjs_session_s {
 int pomelo_qjs_init_session_module(JSContext * ctx, JSModuleDef * m);
 
 
-/// @brief Create new JS session
-JSValue pomelo_qjs_session_new(
+/// @brief Create new session for native session. The JS session is not
+/// created until it is needed. Return NULL on failure.
+pomelo_qjs_session_t * pomelo_qjs_session_create(
     pomelo_qjs_context_t * context,
     pomelo_session_t * session
 );
 
 
+/// @brief Get the JS session, create it on the first call.
+/// @return Returns the JS session (a borrowed reference) or JS_EXCEPTION on
+/// failure
+JSValue pomelo_qjs_session_wrap(pomelo_qjs_session_t * qjs_session);
+
+
 /// @brief Initialize the session
 int pomelo_qjs_session_init(
     pomelo_qjs_session_t * qjs_session,
@@ -49,21 +191,153 @@ int pomelo_qjs_session_init(
 void pomelo_qjs_session_cleanup(pomelo_qjs_session_t * qjs_session);
 
 
+/// @brief Send a message through the session.
+/// The message is queued in binding if it has a deadline and the session has
+/// no available sending slot, or if other messages are already queued.
+void pomelo_qjs_session_dispatch(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+);
+
+
+/// @brief Handle the completion of a sending message of session.
+/// Expired queued messages are dropped, then the next ones are sent.
+void pomelo_qjs_session_on_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info
+);
+
+
+/// @brief Check the send options against the session and channel.
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_session_check_send_options(
+    JSContext * ctx,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_qjs_send_options_t * options
+);
+
+
+/// @brief Handle the send result of an acknowledged message. The message keeps
+/// waiting for the acknowledgement of peer if it has been sent.
+void pomelo_qjs_session_on_ack_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info,
+    size_t send_count
+);
+
+
+/// @brief Handle an acknowledgement from peer. An acknowledgement which
+/// arrives before the send result of its message is recorded, and the
+/// message completes with its send result.
+void pomelo_qjs_session_on_ack(
+    pomelo_qjs_session_t * qjs_session,
+    uint32_t ack_id
+);
+
+
+/// @brief Reply the acknowledgement of a received message. Replies are sent
+/// together in the next loop iteration.
+void pomelo_qjs_session_reply_ack(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    uint32_t ack_id
+);
+
+
+/// @brief Handle the completion of a message of batch. The batch completes
+/// after its last message completes.
+void pomelo_qjs_session_on_batch_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_qjs_send_info_t * send_info,
+    size_t send_count
+);
+
+
+/// @brief Send a message through the session without completion. The message
+/// bypasses the sending slots, but it waits behind the queued messages of
+/// session to keep the sending order.
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_session_send_detached(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+);
+
+
+/// @brief Send a binding frame through the session. Like messages of JS, the
+/// frame takes a sending slot until it completes, but it has no promise.
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_session_send_internal(
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * frame
+);
+
+
+/// @brief Count a message which is handed to native session
+void pomelo_qjs_session_count_sent(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_message_t * message
+);
+
+
+/// @brief Get the number of lost messages detected by framing
+uint64_t pomelo_qjs_session_lost_count(pomelo_qjs_session_t * qjs_session);
+
+
+/// @brief Get the number of messages waiting in binding or being sent
+size_t pomelo_qjs_session_queue_depth(pomelo_qjs_session_t * qjs_session);
+
+
+/// @brief Consume the inbound rate limit of session for a received message.
+/// Dropped messages are counted by context.
+/// @return Returns true if the message is allowed
+bool pomelo_qjs_session_check_rate_limit(
+    pomelo_qjs_session_t * qjs_session,
+    pomelo_message_t * message
+);
+
+
 /*----------------------------------------------------------------------------*/
 /*                               Private APIs                                 */
 /*----------------------------------------------------------------------------*/
 
 
-/// @brief send(channelIndex: number, message: Message): boolean
+/// @brief send(channelIndex: number, message: Message, options?: SendOptions)
 JSValue pomelo_qjs_session_send(
     JSContext * ctx, JSValue thiz, int argc, JSValue * argv
 );
 
 
-/// @brief readonly Session.id: number
+/// @brief sendLatest(channelIndex: number, key: number, message: Message)
+JSValue pomelo_qjs_session_send_latest(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief sendMany(channelIndices: number[], messages: Message[])
+JSValue pomelo_qjs_session_send_many(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief readonly Session.id: bigint
 JSValue pomelo_qjs_session_get_id(JSContext * ctx, JSValue thiz);
 
 
+/// @brief readonly Session.idNumber: number
+JSValue pomelo_qjs_session_get_id_number(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly Session.rttMs: number
+JSValue pomelo_qjs_session_get_rtt_ms(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly Session.index: number
+JSValue pomelo_qjs_session_get_index(JSContext * ctx, JSValue thiz);
+
+
 /// @brief Session.disconnect(): void
 JSValue pomelo_qjs_session_disconnect(
     JSContext * ctx, JSValue thiz, int argc, JSValue * argv
@@ -87,10 +361,36 @@ JSValue pomelo_qjs_session_rtt(
 );
 
 
+/// @brief Session.setRateLimit(limit: RateLimit | null): void
+JSValue pomelo_qjs_session_set_rate_limit(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Session.pipeTo(target: Session | Session[], options?: PipeOptions)
+JSValue pomelo_qjs_session_pipe_to(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Session.unpipe(target?: Session | Session[]): void
+JSValue pomelo_qjs_session_unpipe(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
 /// @brief Session.channels: Channel[]
 JSValue pomelo_qjs_session_get_channels(JSContext * ctx, JSValue thiz);
 
 
+/// @brief GC mark of session
+void pomelo_qjs_session_gc_mark(
+    JSRuntime * rt,
+    JSValue val,
+    JS_MarkFunc * mark_func
+);
+
+
 #ifdef __cplusplus
 }
 #endif
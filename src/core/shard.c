@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "shard.h"
+#include "context.h"
+#include "socket.h"
+
+
+size_t pomelo_qjs_shard_of(int64_t client_id, size_t nshards) {
+    if (nshards <= 1) return 0;
+    return (size_t) ((uint64_t) client_id % nshards);
+}
+
+
+bool pomelo_qjs_shard_admits(
+    pomelo_qjs_socket_t * qjs_socket,
+    int64_t client_id
+) {
+    assert(qjs_socket != NULL);
+    if (qjs_socket->nshards <= 1) return true; // Not sharded
+    return pomelo_qjs_shard_of(client_id, qjs_socket->nshards) ==
+        qjs_socket->context->shard_index;
+}
+
+
+int pomelo_qjs_shard_address(
+    const char * address,
+    size_t shard_index,
+    char * buffer,
+    size_t capacity
+) {
+    assert(address != NULL);
+    assert(buffer != NULL);
+
+    // The port is always the last component, IPv6 hosts are bracketed
+    const char * colon = strrchr(address, ':');
+    if (!colon || colon == address || colon[1] == '\0') return -1;
+
+    uint32_t port = 0;
+    for (const char * p = colon + 1; *p; p++) {
+        if (*p < '0' || *p > '9') return -1;
+        port = port * 10 + (uint32_t) (*p - '0');
+        if (port > UINT16_MAX) return -1;
+    }
+
+    port += (uint32_t) shard_index;
+    if (port > UINT16_MAX) return -1;
+
+    int host_length = (int) (colon - address);
+    int ret = snprintf(
+        buffer, capacity, "%.*s:%u", host_length, address, (unsigned) port
+    );
+    if (ret < 0 || (size_t) ret >= capacity) return -1;
+    return 0;
+}
+
+
+int pomelo_qjs_shard_parse_options(
+    JSContext * ctx,
+    JSValue value,
+    size_t * nshards
+) {
+    assert(ctx != NULL);
+    assert(nshards != NULL);
+
+    *nshards = 0;
+    if (JS_IsUndefined(value) || JS_IsNull(value)) return 0;
+    if (!JS_IsObject(value)) {
+        JS_ThrowTypeError(ctx, "Listen options must be an object");
+        return -1;
+    }
+
+    // Supervised processes may listen as their shard of the fleet
+    JSValue js_supervised = JS_GetPropertyStr(ctx, value, "supervised");
+    int supervised = JS_ToBool(ctx, js_supervised);
+    JS_FreeValue(ctx, js_supervised);
+    if (supervised < 0) return -1;
+
+    JSValue js_shards = JS_GetPropertyStr(ctx, value, "shards");
+    if (JS_IsUndefined(js_shards)) {
+        pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+        if (supervised && context->shard_count > 1) {
+            *nshards = context->shard_count;
+        }
+        return 0;
+    }
+
+    int32_t shards = 0;
+    int ret = JS_ToInt32(ctx, &shards, js_shards);
+    JS_FreeValue(ctx, js_shards);
+    if (ret != 0) return -1;
+
+    if (shards < 1 || shards > POMELO_QJS_SHARD_MAX_COUNT) {
+        JS_ThrowTypeError(
+            ctx, "Shards must be in [1, %d]", POMELO_QJS_SHARD_MAX_COUNT
+        );
+        return -1;
+    }
+
+    *nshards = (size_t) shards;
+    return 0;
+}
+
+
+int pomelo_qjs_shard_enter(JSContext * ctx, size_t nshards) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    if (context->shard_count > 0) {
+        // Shards (and the primary after its first listen) are already sharded
+        if (context->shard_count != nshards) {
+            JS_ThrowTypeError(ctx, "Shards mismatch the running shards");
+            return -1;
+        }
+        return 0;
+    }
+
+    // This is the primary, it runs shard 0 itself
+    if (!context->spawn_shards) {
+        JS_ThrowTypeError(ctx, "Sharding is not supported by the runtime");
+        return -1;
+    }
+    if (context->spawn_shards(context, nshards) < 0) {
+        JS_ThrowInternalError(ctx, "Failed to spawn shards");
+        return -1;
+    }
+
+    context->shard_index = 0;
+    context->shard_count = nshards;
+    return 0;
+}
+
+
+JSValue pomelo_qjs_token_shard_address(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) thiz;
+    if (argc < 3) return JS_ThrowTypeError(ctx, "Missing arguments");
+
+    int32_t shards = 0;
+    if (JS_ToInt32(ctx, &shards, argv[1]) != 0) return JS_EXCEPTION;
+    if (shards < 1 || shards > POMELO_QJS_SHARD_MAX_COUNT) {
+        return JS_ThrowTypeError(
+            ctx, "Shards must be in [1, %d]", POMELO_QJS_SHARD_MAX_COUNT
+        );
+    }
+
+    int64_t client_id = 0;
+    if (JS_IsBigInt(argv[2])) {
+        if (JS_ToBigInt64(ctx, &client_id, argv[2]) != 0) {
+            return JS_ThrowTypeError(ctx, "Invalid client ID");
+        }
+    } else {
+        if (JS_ToInt64(ctx, &client_id, argv[2]) != 0) {
+            return JS_ThrowTypeError(ctx, "Invalid client ID");
+        }
+    }
+
+    const char * address = JS_ToCString(ctx, argv[0]);
+    if (!address) return JS_ThrowTypeError(ctx, "Invalid address");
+
+    char buffer[POMELO_QJS_SHARD_ADDRESS_CAPACITY];
+    int ret = pomelo_qjs_shard_address(
+        address,
+        pomelo_qjs_shard_of(client_id, (size_t) shards),
+        buffer,
+        sizeof(buffer)
+    );
+    JS_FreeCString(ctx, address);
+    if (ret < 0) return JS_ThrowTypeError(ctx, "Invalid address");
+
+    return JS_NewString(ctx, buffer);
+}
@@ -0,0 +1,90 @@
+#ifndef POMELO_QUICKJS_SHARD_SRC_H
+#define POMELO_QUICKJS_SHARD_SRC_H
+#include "quickjs.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Session sharding.
+ *
+ * A sharded server runs N event loops in one process. Every loop has its own
+ * runtime which evaluates the same entry module, so JS handlers of a shard
+ * only see the sessions of that shard.
+ *
+ * Sharding does not share one port. Shard K listens on the base port plus K,
+ * and its sharded sockets only admit clients whose ID maps to K. Connect
+ * tokens are expected to carry the address of the shard of their client (see
+ * `Token.shardAddress`). The loops are spawned by the runtime through the
+ * spawn_shards hook of context.
+ */
+
+
+/// @brief The maximum number of shards
+#define POMELO_QJS_SHARD_MAX_COUNT 64
+
+
+/// @brief The capacity of shard address buffer
+#define POMELO_QJS_SHARD_ADDRESS_CAPACITY 64
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Get the shard of client
+size_t pomelo_qjs_shard_of(int64_t client_id, size_t nshards);
+
+
+/// @brief Check if the shard of socket admits the client. Sockets which do
+/// not listen sharded admit all clients.
+bool pomelo_qjs_shard_admits(
+    pomelo_qjs_socket_t * qjs_socket,
+    int64_t client_id
+);
+
+
+/// @brief Write the address of shard to buffer. The port of address is offset
+/// by the shard index.
+/// @return Returns 0 on success or -1 if the address is invalid
+int pomelo_qjs_shard_address(
+    const char * address,
+    size_t shard_index,
+    char * buffer,
+    size_t capacity
+);
+
+
+/// @brief Parse the number of shards from the listen options. Supervised
+/// listens of sharded contexts take the number of shards of context.
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_shard_parse_options(
+    JSContext * ctx,
+    JSValue value,
+    size_t * nshards
+);
+
+
+/// @brief Enter the sharded mode. The primary context spawns the other shards.
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+int pomelo_qjs_shard_enter(JSContext * ctx, size_t nshards);
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+
+/// @brief Token.shardAddress(
+///     address: string, shards: number, clientID: number | bigint
+/// ): string
+JSValue pomelo_qjs_token_shard_address(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_SHARD_SRC_H
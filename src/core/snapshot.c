@@ -0,0 +1,581 @@
+#include <assert.h>
+#include <string.h>
+#include "context.h"
+#include "snapshot.h"
+#include "message.h"
+#include "session.h"
+#include "socket.h"
+#include "frame.h"
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+/// Smoothing factor of jitter (RFC 3550 style)
+#define SNAPSHOT_JITTER_GAIN (1.0 / 16.0)
+
+/// Drift factor of baseline when snapshots arrive later than the baseline
+#define SNAPSHOT_BASELINE_DRIFT 0.01
+
+/// Smoothing factor of playout delay
+#define SNAPSHOT_DELAY_GAIN 0.1
+
+/// Check if the tick of snapshot a is before the tick of snapshot b
+#define SNAPSHOT_TICK_BEFORE(a, b) ((int32_t) ((a)->tick - (b)->tick) < 0)
+
+
+static JSCFunctionListEntry snapshot_buffer_funcs[] = {
+    JS_CFUNC_DEF("attach", 2, pomelo_qjs_snapshot_buffer_attach),
+    JS_CFUNC_DEF("detach", 0, pomelo_qjs_snapshot_buffer_detach_js),
+    JS_CFUNC_DEF("push", 1, pomelo_qjs_snapshot_buffer_push_js),
+    JS_CFUNC_DEF("sample", 2, pomelo_qjs_snapshot_buffer_sample),
+    JS_CFUNC_DEF("clear", 0, pomelo_qjs_snapshot_buffer_clear),
+    JS_CGETSET_DEF("delay", pomelo_qjs_snapshot_buffer_get_delay, NULL),
+    JS_CGETSET_DEF("jitter", pomelo_qjs_snapshot_buffer_get_jitter, NULL),
+};
+
+
+int pomelo_qjs_init_snapshot_module(JSContext * ctx, JSModuleDef * m) {
+    assert(ctx != NULL);
+    assert(m != NULL);
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    // Generate new class ID
+    JSClassID class_id = 0;
+    if (JS_NewClassID(context->rt, &class_id) < 0) {
+        return -1;
+    }
+    context->class_snapshot_buffer_id = class_id;
+
+    // Register the class
+    JSClassDef class_def = {
+        .class_name = "SnapshotBuffer",
+        .finalizer = pomelo_qjs_snapshot_buffer_finalizer
+    };
+    if (JS_NewClass(context->rt, class_id, &class_def) < 0) {
+        return -1;
+    }
+
+    // Create prototype for class
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(
+        ctx, proto, snapshot_buffer_funcs, countof(snapshot_buffer_funcs)
+    );
+
+    JSValue buffer_class = JS_NewCFunction2(
+        ctx,
+        pomelo_qjs_snapshot_buffer_constructor,
+        "SnapshotBuffer",
+        /* argc = */ 2,
+        JS_CFUNC_constructor,
+        0
+    );
+    JS_SetConstructor(ctx, buffer_class, proto);
+
+    // Set the class prototype
+    JS_SetClassProto(ctx, class_id, proto);
+    JS_SetModuleExport(ctx, m, "SnapshotBuffer", buffer_class);
+    return 0;
+}
+
+
+/// @brief Get the current time in milliseconds
+static double snapshot_now(pomelo_qjs_context_t * context) {
+    return (double) pomelo_platform_hrtime(context->platform) / 1000000.0;
+}
+
+
+/// @brief Reset all states of buffer
+static void snapshot_buffer_reset(pomelo_qjs_snapshot_buffer_t * buffer) {
+    for (size_t i = 0; i < buffer->capacity; i++) {
+        buffer->snapshots[i].used = false;
+        buffer->snapshots[i].size = 0;
+    }
+    buffer->has_tick = false;
+    buffer->latest_tick = 0;
+    buffer->latest_position = 0;
+    buffer->baseline = 0.0;
+    buffer->jitter = 0.0;
+    buffer->delay = buffer->tick_interval;
+}
+
+
+/// @brief Get the unwrapped position of a tick near the latest tick
+static int64_t snapshot_buffer_position(
+    pomelo_qjs_snapshot_buffer_t * buffer,
+    uint32_t tick
+) {
+    if (!buffer->has_tick) return (int64_t) tick;
+    return buffer->latest_position + (int32_t) (tick - buffer->latest_tick);
+}
+
+
+/// @brief Update the baseline, jitter and playout delay with new arrival
+static void snapshot_buffer_update_timing(
+    pomelo_qjs_snapshot_buffer_t * buffer,
+    int64_t position,
+    double arrival
+) {
+    double offset = arrival - (double) position * buffer->tick_interval;
+    if (!buffer->has_tick) {
+        buffer->baseline = offset;
+        return;
+    }
+
+    if (offset < buffer->baseline) {
+        buffer->baseline = offset; // Earliest arrival so far
+    } else {
+        // Follow the clock drift slowly
+        buffer->baseline += (offset - buffer->baseline) * SNAPSHOT_BASELINE_DRIFT;
+    }
+
+    double deviation = offset - buffer->baseline;
+    buffer->jitter += (deviation - buffer->jitter) * SNAPSHOT_JITTER_GAIN;
+
+    // Keep one tick to interpolate and cover twice of the jitter
+    double target = buffer->tick_interval + 2.0 * buffer->jitter;
+    buffer->delay += (target - buffer->delay) * SNAPSHOT_DELAY_GAIN;
+}
+
+
+/// @brief Store the payload of a snapshot
+static int snapshot_buffer_store(
+    pomelo_qjs_snapshot_buffer_t * buffer,
+    uint32_t tick,
+    int64_t position,
+    pomelo_message_t * message,
+    size_t size
+) {
+    // Index by position, so that neighbour ticks never share a slot when the
+    // tick wraps
+    int64_t capacity = (int64_t) buffer->capacity;
+    int64_t index = ((position % capacity) + capacity) % capacity;
+    pomelo_qjs_snapshot_t * snapshot = buffer->snapshots + index;
+    if (snapshot->used && (int32_t) (snapshot->tick - tick) >= 0) {
+        return -1; // Duplicated or older than the stored one
+    }
+
+    if (snapshot->capacity < size) {
+        uint8_t * data = pomelo_allocator_realloc(
+            buffer->context->allocator, snapshot->data, size
+        );
+        if (!data) return -1;
+        snapshot->data = data;
+        snapshot->capacity = size;
+    }
+
+    if (size > 0 && pomelo_message_read_buffer(message, snapshot->data, size) < 0) {
+        return -1;
+    }
+
+    snapshot->used = true;
+    snapshot->tick = tick;
+    snapshot->size = size;
+    return 0;
+}
+
+
+void pomelo_qjs_snapshot_buffer_push(
+    pomelo_qjs_snapshot_buffer_t * buffer,
+    pomelo_message_t * message
+) {
+    assert(buffer != NULL);
+    assert(message != NULL);
+
+    size_t size = pomelo_message_size(message);
+    uint32_t tick = 0;
+    if (
+        size < sizeof(uint32_t) ||
+        pomelo_message_read_uint32(message, &tick) < 0
+    ) {
+        return; // Malformed snapshot
+    }
+
+    if (
+        buffer->has_tick &&
+        (int32_t) (buffer->latest_tick - tick) >= (int32_t) buffer->capacity
+    ) {
+        return; // Too old
+    }
+
+    int64_t position = snapshot_buffer_position(buffer, tick);
+    if (snapshot_buffer_store(
+        buffer, tick, position, message, size - sizeof(uint32_t)
+    ) < 0) {
+        return;
+    }
+
+    snapshot_buffer_update_timing(
+        buffer, position, snapshot_now(buffer->context)
+    );
+    if (!buffer->has_tick || position > buffer->latest_position) {
+        buffer->latest_tick = tick;
+        buffer->latest_position = position;
+    }
+    buffer->has_tick = true;
+}
+
+
+void pomelo_qjs_snapshot_buffer_detach(pomelo_qjs_snapshot_buffer_t * buffer) {
+    assert(buffer != NULL);
+    pomelo_qjs_session_t * qjs_session = buffer->qjs_session;
+    if (!qjs_session) return; // Not attached
+
+    if (
+        qjs_session->frame_channels &&
+        buffer->channel_index < qjs_session->nframe_channels
+    ) {
+        pomelo_qjs_frame_channel_t * channel =
+            qjs_session->frame_channels + buffer->channel_index;
+        if (channel->snapshot_buffer == buffer) {
+            channel->snapshot_buffer = NULL;
+        }
+    }
+    buffer->qjs_session = NULL;
+    buffer->channel_index = 0;
+
+    // Release the reference which is held by the session
+    JSValue thiz = buffer->thiz;
+    buffer->thiz = JS_NULL;
+    JS_FreeValue(buffer->context->ctx, thiz);
+}
+
+
+/// @brief Write the snapshot to message
+static int snapshot_write(
+    pomelo_qjs_snapshot_t * snapshot,
+    pomelo_qjs_message_t * qjs_message
+) {
+    pomelo_message_t * message = qjs_message->message;
+    pomelo_message_reset(message);
+
+    int ret = pomelo_message_write_uint32(message, snapshot->tick);
+    if (ret == 0 && snapshot->size > 0) {
+        ret = pomelo_message_write_buffer(
+            message, snapshot->data, snapshot->size
+        );
+    }
+    return ret;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+JSValue pomelo_qjs_snapshot_buffer_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) new_target;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing tick interval");
+
+    double tick_interval = 0;
+    if (
+        !JS_IsNumber(argv[0]) ||
+        JS_ToFloat64(ctx, &tick_interval, argv[0]) != 0 ||
+        !(tick_interval > 0)
+    ) {
+        return JS_ThrowTypeError(ctx, "Tick interval must be a positive number");
+    }
+
+    uint32_t capacity = POMELO_QJS_SNAPSHOT_BUFFER_DEFAULT_CAPACITY;
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        if (
+            JS_ToUint32(ctx, &capacity, argv[1]) != 0 ||
+            capacity < 2 ||
+            capacity > POMELO_QJS_SNAPSHOT_BUFFER_MAX_CAPACITY
+        ) {
+            return JS_ThrowTypeError(ctx, "Invalid capacity");
+        }
+    }
+
+    // Create new js buffer object
+    JSValue thiz = JS_NewObjectClass(ctx, context->class_snapshot_buffer_id);
+    if (JS_IsException(thiz)) return thiz;
+
+    pomelo_qjs_snapshot_buffer_t * buffer = pomelo_allocator_malloc_t(
+        context->allocator, pomelo_qjs_snapshot_buffer_t
+    );
+    if (!buffer) {
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to allocate buffer");
+    }
+    memset(buffer, 0, sizeof(pomelo_qjs_snapshot_buffer_t));
+
+    buffer->snapshots = pomelo_allocator_malloc(
+        context->allocator, capacity * sizeof(pomelo_qjs_snapshot_t)
+    );
+    if (!buffer->snapshots) {
+        pomelo_allocator_free(context->allocator, buffer);
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to allocate buffer");
+    }
+    memset(buffer->snapshots, 0, capacity * sizeof(pomelo_qjs_snapshot_t));
+
+    buffer->context = context;
+    buffer->thiz = JS_NULL;
+    buffer->capacity = capacity;
+    buffer->tick_interval = tick_interval;
+    snapshot_buffer_reset(buffer);
+
+    if (JS_SetOpaque(thiz, buffer) < 0) {
+        pomelo_allocator_free(context->allocator, buffer->snapshots);
+        pomelo_allocator_free(context->allocator, buffer);
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowTypeError(ctx, "Failed to set opaque snapshot buffer");
+    }
+    return thiz;
+}
+
+
+void pomelo_qjs_snapshot_buffer_finalizer(JSRuntime * rt, JSValue val) {
+    assert(rt != NULL);
+    pomelo_qjs_context_t * context = JS_GetRuntimeOpaque(rt);
+    if (!context) return;
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(val, context->class_snapshot_buffer_id);
+    if (!buffer) return;
+
+    // Attached buffers are referenced by their sessions, they are never
+    // finalized while attached.
+    for (size_t i = 0; i < buffer->capacity; i++) {
+        if (buffer->snapshots[i].data) {
+            pomelo_allocator_free(
+                context->allocator, buffer->snapshots[i].data
+            );
+        }
+    }
+    pomelo_allocator_free(context->allocator, buffer->snapshots);
+    pomelo_allocator_free(context->allocator, buffer);
+}
+
+
+JSValue pomelo_qjs_snapshot_buffer_attach(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 2) return JS_ThrowTypeError(ctx, "Missing arguments");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(thiz, context->class_snapshot_buffer_id);
+    if (!buffer) return JS_ThrowTypeError(ctx, "Invalid snapshot buffer");
+
+    pomelo_qjs_session_t * qjs_session =
+        JS_GetOpaque(argv[0], context->class_session_id);
+    if (!qjs_session || !qjs_session->session) {
+        return JS_ThrowTypeError(ctx, "Invalid native session");
+    }
+
+    uint32_t channel_index = 0;
+    if (JS_ToUint32(ctx, &channel_index, argv[1]) != 0) {
+        return JS_ThrowTypeError(ctx, "Channel index must be a number");
+    }
+
+    pomelo_qjs_socket_t * qjs_socket = qjs_session->qjs_socket;
+    if (!qjs_socket || !qjs_socket->framed) {
+        return JS_ThrowTypeError(
+            ctx, "Snapshot buffer requires a framed socket"
+        );
+    }
+
+    pomelo_qjs_frame_channel_t * channel =
+        pomelo_qjs_frame_get_channel(qjs_session, channel_index);
+    if (!channel) return JS_ThrowTypeError(ctx, "Invalid channel index");
+
+    if (channel->snapshot_buffer) {
+        return JS_ThrowTypeError(ctx, "Channel already has a snapshot buffer");
+    }
+
+    pomelo_qjs_snapshot_buffer_detach(buffer);
+
+    // The session holds the buffer until it is detached
+    buffer->qjs_session = qjs_session;
+    buffer->channel_index = channel_index;
+    buffer->thiz = JS_DupValue(ctx, thiz);
+    channel->snapshot_buffer = buffer;
+
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_snapshot_buffer_detach_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) argc;
+    (void) argv;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(thiz, context->class_snapshot_buffer_id);
+    if (!buffer) return JS_ThrowTypeError(ctx, "Invalid snapshot buffer");
+
+    pomelo_qjs_snapshot_buffer_detach(buffer);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_snapshot_buffer_push_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing message");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(thiz, context->class_snapshot_buffer_id);
+    if (!buffer) return JS_ThrowTypeError(ctx, "Invalid snapshot buffer");
+
+    pomelo_qjs_message_t * qjs_message =
+        JS_GetOpaque(argv[0], context->class_message_id);
+    if (!qjs_message || !qjs_message->message) {
+        return JS_ThrowTypeError(ctx, "Invalid native message");
+    }
+
+    pomelo_qjs_snapshot_buffer_push(buffer, qjs_message->message);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_snapshot_buffer_sample(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 2) return JS_ThrowTypeError(ctx, "Missing arguments");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(thiz, context->class_snapshot_buffer_id);
+    if (!buffer) return JS_ThrowTypeError(ctx, "Invalid snapshot buffer");
+
+    pomelo_qjs_message_t * from =
+        JS_GetOpaque(argv[0], context->class_message_id);
+    pomelo_qjs_message_t * to =
+        JS_GetOpaque(argv[1], context->class_message_id);
+    if (!from || !from->message || !to || !to->message) {
+        return JS_ThrowTypeError(ctx, "Invalid native message");
+    }
+
+    if (!buffer->has_tick) return JS_NewFloat64(ctx, -1.0);
+
+    // The render time in ticks
+    double render_time = snapshot_now(context) - buffer->baseline - buffer->delay;
+    double render_tick = render_time / buffer->tick_interval;
+
+    // Find the latest snapshot before render time and the earliest one after
+    pomelo_qjs_snapshot_t * before = NULL;
+    pomelo_qjs_snapshot_t * after = NULL;
+    pomelo_qjs_snapshot_t * earliest = NULL;
+    pomelo_qjs_snapshot_t * latest = NULL;
+    for (size_t i = 0; i < buffer->capacity; i++) {
+        pomelo_qjs_snapshot_t * snapshot = buffer->snapshots + i;
+        if (!snapshot->used) continue;
+
+        // Snapshots which are too old are ignored
+        int32_t age = (int32_t) (buffer->latest_tick - snapshot->tick);
+        if (age < 0 || age >= (int32_t) buffer->capacity) continue;
+
+        if (!earliest || SNAPSHOT_TICK_BEFORE(snapshot, earliest)) {
+            earliest = snapshot;
+        }
+        if (!latest || SNAPSHOT_TICK_BEFORE(latest, snapshot)) {
+            latest = snapshot;
+        }
+        double position = (double) (buffer->latest_position - age);
+        if (position <= render_tick) {
+            if (!before || SNAPSHOT_TICK_BEFORE(before, snapshot)) {
+                before = snapshot;
+            }
+        } else {
+            if (!after || SNAPSHOT_TICK_BEFORE(snapshot, after)) {
+                after = snapshot;
+            }
+        }
+    }
+
+    if (!latest) return JS_NewFloat64(ctx, -1.0);
+
+    double alpha = 0.0;
+    if (!before) {
+        // Render time is before all snapshots, hold the earliest one
+        before = earliest;
+        after = earliest;
+    } else if (!after) {
+        // Render time is after all snapshots, hold the latest one
+        after = before;
+    } else {
+        // Ticks may wrap between the snapshots
+        double position =
+            (double) snapshot_buffer_position(buffer, before->tick);
+        double span = (double) (int32_t) (after->tick - before->tick);
+        alpha = (render_tick - position) / span;
+        if (alpha < 0.0) alpha = 0.0;
+        if (alpha > 1.0) alpha = 1.0;
+    }
+
+    if (snapshot_write(before, from) < 0 || snapshot_write(after, to) < 0) {
+        return JS_ThrowInternalError(ctx, "Failed to write snapshot");
+    }
+
+    return JS_NewFloat64(ctx, alpha);
+}
+
+
+JSValue pomelo_qjs_snapshot_buffer_clear(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) argc;
+    (void) argv;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(thiz, context->class_snapshot_buffer_id);
+    if (!buffer) return JS_ThrowTypeError(ctx, "Invalid snapshot buffer");
+
+    snapshot_buffer_reset(buffer);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_snapshot_buffer_get_delay(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(thiz, context->class_snapshot_buffer_id);
+    if (!buffer) return JS_ThrowTypeError(ctx, "Invalid snapshot buffer");
+
+    return JS_NewFloat64(ctx, buffer->delay);
+}
+
+
+JSValue pomelo_qjs_snapshot_buffer_get_jitter(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_snapshot_buffer_t * buffer =
+        JS_GetOpaque(thiz, context->class_snapshot_buffer_id);
+    if (!buffer) return JS_ThrowTypeError(ctx, "Invalid snapshot buffer");
+
+    return JS_NewFloat64(ctx, buffer->jitter);
+}
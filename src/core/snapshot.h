@@ -0,0 +1,164 @@
+#ifndef POMELO_QUICKJS_SNAPSHOT_SRC_H
+#define POMELO_QUICKJS_SNAPSHOT_SRC_H
+#include "quickjs.h"
+#include "pomelo/api.h"
+#include "core.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/// @brief The default number of snapshots in buffer
+#define POMELO_QJS_SNAPSHOT_BUFFER_DEFAULT_CAPACITY 32
+
+
+/// @brief The maximum number of snapshots in buffer
+#define POMELO_QJS_SNAPSHOT_BUFFER_MAX_CAPACITY 1024
+
+
+/// @brief A snapshot in buffer
+typedef struct pomelo_qjs_snapshot_s pomelo_qjs_snapshot_t;
+
+/// @brief The snapshot jitter buffer
+typedef struct pomelo_qjs_snapshot_buffer_s pomelo_qjs_snapshot_buffer_t;
+
+
+struct pomelo_qjs_snapshot_s {
+    /// @brief Whether this slot holds a snapshot
+    bool used;
+
+    /// @brief The tick of snapshot
+    uint32_t tick;
+
+    /// @brief The size of payload
+    size_t size;
+
+    /// @brief The capacity of payload data
+    size_t capacity;
+
+    /// @brief The payload data (without tick)
+    uint8_t * data;
+};
+
+
+struct pomelo_qjs_snapshot_buffer_s {
+    /// @brief The context
+    pomelo_qjs_context_t * context;
+
+    /// @brief The this of buffer. It is a strong reference while the buffer is
+    /// attached to a session.
+    JSValue thiz;
+
+    /// @brief The attached session
+    pomelo_qjs_session_t * qjs_session;
+
+    /// @brief The attached channel index
+    size_t channel_index;
+
+    /// @brief The ring of snapshots, indexed by tick
+    pomelo_qjs_snapshot_t * snapshots;
+
+    /// @brief The capacity of ring
+    size_t capacity;
+
+    /// @brief The duration of a tick in milliseconds
+    double tick_interval;
+
+    /// @brief Whether any snapshot has been pushed
+    bool has_tick;
+
+    /// @brief The latest tick
+    uint32_t latest_tick;
+
+    /// @brief The latest tick without wraparound. Other ticks are unwrapped
+    /// around it, so that they keep increasing after the uint32 tick wraps.
+    int64_t latest_position;
+
+    /// @brief The baseline of (arrival time - tick time) in milliseconds
+    double baseline;
+
+    /// @brief The smoothed jitter in milliseconds
+    double jitter;
+
+    /// @brief The current playout delay in milliseconds
+    double delay;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the snapshot buffer module
+int pomelo_qjs_init_snapshot_module(JSContext * ctx, JSModuleDef * m);
+
+
+/// @brief Push a received snapshot message to buffer. The message starts with
+/// the uint32 tick of snapshot.
+void pomelo_qjs_snapshot_buffer_push(
+    pomelo_qjs_snapshot_buffer_t * buffer,
+    pomelo_message_t * message
+);
+
+
+/// @brief Detach the buffer from its session
+void pomelo_qjs_snapshot_buffer_detach(pomelo_qjs_snapshot_buffer_t * buffer);
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+
+/// @brief SnapshotBuffer.constructor(tickInterval: number, capacity?: number)
+JSValue pomelo_qjs_snapshot_buffer_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+);
+
+
+/// @brief Finalizer of snapshot buffer
+void pomelo_qjs_snapshot_buffer_finalizer(JSRuntime * rt, JSValue val);
+
+
+/// @brief SnapshotBuffer.attach(session: Session, channelIndex: number)
+JSValue pomelo_qjs_snapshot_buffer_attach(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief SnapshotBuffer.detach(): void
+JSValue pomelo_qjs_snapshot_buffer_detach_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief SnapshotBuffer.push(message: Message): void
+JSValue pomelo_qjs_snapshot_buffer_push_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief SnapshotBuffer.sample(from: Message, to: Message): number
+JSValue pomelo_qjs_snapshot_buffer_sample(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief SnapshotBuffer.clear(): void
+JSValue pomelo_qjs_snapshot_buffer_clear(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief readonly SnapshotBuffer.delay: number
+JSValue pomelo_qjs_snapshot_buffer_get_delay(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly SnapshotBuffer.jitter: number
+JSValue pomelo_qjs_snapshot_buffer_get_jitter(JSContext * ctx, JSValue thiz);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_SNAPSHOT_SRC_H
@@ -6,6 +6,8 @@
 #include "message.h"
 #include "context.h"
 #include "session.h"
+#include "table.h"
+#include "shard.h"
 
 #define countof(x) (sizeof(x) / sizeof((x)[0]))
 
@@ -21,7 +23,22 @@ static JSCFunctionListEntry socket_funcs[] = {
     JS_CFUNC_DEF("connect", 1, pomelo_qjs_socket_connect),
     JS_CFUNC_DEF("stop", 0, pomelo_qjs_socket_stop),
     JS_CFUNC_DEF("send", 3, pomelo_qjs_socket_send),
+    JS_CFUNC_DEF("sendScatter", 5, pomelo_qjs_socket_send_scatter),
     JS_CFUNC_DEF("time", 0, pomelo_qjs_socket_time),
+    JS_CFUNC_DEF("timeMs", 0, pomelo_qjs_socket_time_ms),
+    JS_CFUNC_DEF("serverTime", 0, pomelo_qjs_socket_server_time),
+    JS_CFUNC_DEF("route", 3, pomelo_qjs_socket_route),
+    JS_CFUNC_DEF("getSession", 1, pomelo_qjs_socket_get_session),
+    JS_CGETSET_DEF("sessionCount", pomelo_qjs_socket_get_session_count, NULL),
+    JS_CFUNC_DEF("forEachSession", 1, pomelo_qjs_socket_for_each_session),
+    JS_CFUNC_DEF("disconnectAll", 1, pomelo_qjs_socket_disconnect_all),
+    JS_CFUNC_DEF(
+        "exportSessionMetrics", 2, pomelo_qjs_socket_export_session_metrics
+    ),
+    JS_CFUNC_DEF(
+        "setAdmissionPolicy", 1, pomelo_qjs_socket_set_admission_policy
+    ),
+    JS_CGETSET_DEF("loopLagMs", pomelo_qjs_socket_get_loop_lag_ms, NULL),
 };
 
 
@@ -83,6 +100,18 @@ int pomelo_qjs_socket_init(
     qjs_socket->connect_callback_funcs[0] = JS_NULL;
     qjs_socket->connect_callback_funcs[1] = JS_NULL;
     qjs_socket->thiz_entry = NULL;
+    qjs_socket->nchannels = 0;
+    qjs_socket->framed = false;
+    qjs_socket->max_in_flight = 0;
+    qjs_socket->server_time = 0.0;
+    qjs_socket->rate_limit.messages_per_second = 0;
+    qjs_socket->rate_limit.bytes_per_second = 0;
+    pomelo_qjs_router_init(&qjs_socket->router);
+    pomelo_qjs_registry_init(&qjs_socket->registry);
+    qjs_socket->session_tables = NULL;
+    pomelo_qjs_admission_init(&qjs_socket->admission, context);
+    qjs_socket->nshards = 0;
+    memset(qjs_socket->channel_options, 0, sizeof(qjs_socket->channel_options));
 
     return 0;
 }
@@ -91,7 +120,8 @@ int pomelo_qjs_socket_init(
 void pomelo_qjs_socket_cleanup(pomelo_qjs_socket_t * qjs_socket) {
     assert(qjs_socket != NULL);
 
-    JSContext * ctx = qjs_socket->context->ctx;
+    pomelo_qjs_context_t * context = qjs_socket->context;
+    JSContext * ctx = context->ctx;
     
     qjs_socket->context = NULL;
     if (qjs_socket->socket) {
@@ -119,8 +149,82 @@ void pomelo_qjs_socket_cleanup(pomelo_qjs_socket_t * qjs_socket) {
 
     JS_FreeValue(ctx, qjs_socket->connect_callback_funcs[1]);
     qjs_socket->connect_callback_funcs[1] = JS_NULL;
+
+    pomelo_qjs_router_cleanup(context, &qjs_socket->router);
+    pomelo_qjs_registry_cleanup(context, &qjs_socket->registry);
+    pomelo_qjs_admission_cleanup(&qjs_socket->admission);
+
+    // Detach the session tables, they are owned by JS
+    if (qjs_socket->session_tables) {
+        pomelo_qjs_session_table_t * table = NULL;
+        while (pomelo_list_pop_front(qjs_socket->session_tables, &table) == 0) {
+            table->entry = NULL;
+            table->qjs_socket = NULL;
+        }
+        pomelo_list_destroy(qjs_socket->session_tables);
+        qjs_socket->session_tables = NULL;
+    }
+}
+
+/// @brief Clear the rows of session tables at a session index
+static void socket_clear_rows(pomelo_qjs_socket_t * qjs_socket, int32_t index) {
+    if (index < 0 || !qjs_socket->session_tables) return;
+
+    pomelo_list_iterator_t it;
+    pomelo_list_iterator_init(&it, qjs_socket->session_tables);
+    pomelo_qjs_session_table_t * table = NULL;
+    while (pomelo_list_iterator_next(&it, &table) == 0) {
+        pomelo_qjs_session_table_clear_row(table, index);
+    }
+}
+
+
+int pomelo_qjs_socket_register_session(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session
+) {
+    assert(qjs_socket != NULL);
+    assert(qjs_session != NULL);
+
+    int32_t previous_index = qjs_session->index;
+    int ret = pomelo_qjs_registry_add(
+        qjs_socket->context,
+        &qjs_socket->registry,
+        qjs_session->client_id,
+        qjs_session
+    );
+    if (ret < 0) return ret;
+
+    // A replaced session of the same client ID releases its index without
+    // unregistering, and the new session may take it back. Start from clean
+    // rows either way.
+    if (qjs_session->index != previous_index) {
+        socket_clear_rows(qjs_socket, qjs_session->index);
+    }
+    return 0;
+}
+
+
+void pomelo_qjs_socket_unregister_session(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session
+) {
+    assert(qjs_socket != NULL);
+    assert(qjs_session != NULL);
+    if (!qjs_socket->context) return; // The socket has been cleaned up
+
+    int32_t index = pomelo_qjs_registry_remove(
+        qjs_socket->context,
+        &qjs_socket->registry,
+        qjs_session->client_id,
+        qjs_session
+    );
+
+    // Clean the rows for the next session of this index
+    socket_clear_rows(qjs_socket, index);
 }
 
+
 /*----------------------------------------------------------------------------*/
 /*                            Implementation APIs                             */
 /*----------------------------------------------------------------------------*/
@@ -135,17 +239,49 @@ void pomelo_socket_on_connected(
     pomelo_qjs_socket_t * qjs_socket = pomelo_socket_get_extra(socket);
     if (!qjs_socket) return; // No associated socket
 
+    // Clients of other shards are denied, their tokens are misrouted
+    int64_t client_id = pomelo_session_get_client_id(session);
+    if (!pomelo_qjs_shard_admits(qjs_socket, client_id)) {
+        qjs_socket->context->rejected_connections++;
+        pomelo_session_disconnect(session);
+        return;
+    }
+
+    // Overloaded servers deny new connections before they reach JS. The
+    // own connection of a client socket is never denied.
+    bool listening =
+        pomelo_socket_get_state(socket) == POMELO_SOCKET_STATE_RUNNING_SERVER;
+    if (listening && !pomelo_qjs_admission_check(
+        &qjs_socket->admission,
+        qjs_socket->registry.size
+    )) {
+        qjs_socket->context->rejected_connections++;
+        pomelo_session_disconnect(session);
+        return;
+    }
+
+    // The native part of session is always created, so that it is registered
+    // to socket. The JS session is created on demand.
+    pomelo_qjs_session_t * qjs_session =
+        pomelo_qjs_session_create(qjs_socket->context, session);
+    if (!qjs_session) {
+        // The session cannot be registered, deny it
+        qjs_socket->context->rejected_connections++;
+        pomelo_session_disconnect(session);
+        return;
+    }
+
     // Call the callback
     JSContext * ctx = qjs_socket->context->ctx;
     JSValue on_connected = qjs_socket->on_connected;
     JSValue listener = qjs_socket->listener;
     if (!JS_IsFunction(ctx, qjs_socket->on_connected)) return;
-    
-    JSValue js_session =
-        pomelo_qjs_session_new(qjs_socket->context, session);
+
+    JSValue js_session = pomelo_qjs_session_wrap(qjs_session);
+    if (JS_IsException(js_session)) return;
+
     JSValue ret = JS_Call(ctx, on_connected, listener, 1, &js_session);
     JS_FreeValue(ctx, ret);
-    JS_FreeValue(ctx, js_session);
 }
 
 
@@ -159,16 +295,21 @@ void pomelo_socket_on_disconnected(
     pomelo_qjs_socket_t * qjs_socket = pomelo_socket_get_extra(socket);
     if (!qjs_socket) return; // No associated socket
 
+    pomelo_qjs_session_t * qjs_session = pomelo_session_get_extra(session);
+    if (!qjs_session) return; // No associated session
+
+    // Disconnected sessions can no longer be found
+    pomelo_qjs_socket_unregister_session(qjs_socket, qjs_session);
+
     // Call the callback
     JSContext * ctx = qjs_socket->context->ctx;
     JSValue on_disconnected = qjs_socket->on_disconnected;
     JSValue listener = qjs_socket->listener;
     if (!JS_IsFunction(ctx, qjs_socket->on_disconnected)) return;
 
-    pomelo_qjs_session_t * qjs_session = pomelo_session_get_extra(session);
-    if (!qjs_session) return; // No associated session
+    JSValue js_session = pomelo_qjs_session_wrap(qjs_session);
+    if (JS_IsException(js_session)) return;
 
-    JSValue js_session = qjs_session->thiz;
     JSValue ret = JS_Call(ctx, on_disconnected, listener, 1, &js_session);
     JS_FreeValue(ctx, ret);
 }
@@ -186,17 +327,74 @@ void pomelo_socket_on_received(
     pomelo_qjs_socket_t * qjs_socket = pomelo_socket_get_extra(socket);
     if (!qjs_socket) return; // No associated socket
 
+    pomelo_qjs_session_t * qjs_session = pomelo_session_get_extra(session);
+    if (!qjs_session) return; // No associated session
+
+    qjs_session->messages_received++;
+    qjs_session->bytes_received += pomelo_message_size(message);
+
+    // Framed messages are limited after decoding, so that only the user
+    // messages consume the rate limit
+    if (qjs_socket->framed) {
+        pomelo_qjs_frame_decode(qjs_socket, qjs_session, message);
+        return;
+    }
+
+    // Drop flooding messages before any JS value is created
+    if (!pomelo_qjs_session_check_rate_limit(qjs_session, message)) return;
+
+    pomelo_qjs_socket_deliver(
+        qjs_socket,
+        qjs_session,
+        POMELO_QJS_ROUTER_ANY_CHANNEL,
+        message
+    );
+}
+
+
+void pomelo_qjs_socket_deliver(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+) {
+    assert(qjs_socket != NULL);
+    assert(qjs_session != NULL);
+    assert(message != NULL);
+
+    // Relayed messages never enter JS
+    if (pomelo_qjs_pipe_forward(qjs_session, channel_index, message)) return;
+
+    // Lockstep inputs are aggregated natively
+    if (
+        qjs_session->lockstep &&
+        pomelo_qjs_lockstep_capture(
+            qjs_session->lockstep, qjs_session, channel_index, message
+        )
+    ) {
+        return;
+    }
+
+    if (pomelo_qjs_router_enabled(&qjs_socket->router)) {
+        pomelo_qjs_router_dispatch(
+            qjs_socket->context,
+            &qjs_socket->router,
+            qjs_session,
+            channel_index,
+            message
+        );
+        return;
+    }
+
     // Call the callback
     JSContext * ctx = qjs_socket->context->ctx;
     JSValue on_received = qjs_socket->on_received;
     JSValue listener = qjs_socket->listener;
     if (!JS_IsFunction(ctx, qjs_socket->on_received)) return;
 
-    pomelo_qjs_session_t * qjs_session = pomelo_session_get_extra(session);
-    if (!qjs_session) return; // No associated session
+    JSValue js_session = pomelo_qjs_session_wrap(qjs_session);
+    if (JS_IsException(js_session)) return;
 
-    JSValue js_session = qjs_session->thiz;
-    
     // Wrap the native message to JS message
     JSValue js_message = pomelo_qjs_message_new(qjs_socket->context, message);
     JSValue args[] = { js_session, js_message };
@@ -245,15 +443,61 @@ void pomelo_socket_on_send_result(
     assert(socket != NULL);
     assert(message != NULL);
     pomelo_qjs_send_info_t * send_info = (pomelo_qjs_send_info_t *) data;
-    JSContext * ctx = send_info->context->ctx;
+    if (!send_info) return; // Binding internal message
+
+    pomelo_qjs_session_t * qjs_session = send_info->qjs_session;
+    if (send_info->batch_remaining > 0 && qjs_session) {
+        pomelo_qjs_session_on_batch_sent(qjs_session, send_info, send_count);
+        return;
+    }
+
+    if (send_info->ack && qjs_session) {
+        pomelo_qjs_session_on_ack_sent(qjs_session, send_info, send_count);
+        return;
+    }
+
+    // Release the sending slot of session
+    if (qjs_session) {
+        pomelo_qjs_session_on_sent(qjs_session, send_info);
+    }
+
+    if (send_info->internal) {
+        // Binding frames have no promise
+        pomelo_qjs_send_info_finalize(send_info);
+        return;
+    }
 
     // Call the callback
-    JSValue count = JS_NewUint32(ctx, (uint32_t) send_count);
-    JSValue ret = JS_Call(ctx, send_info->promise_funcs[0], JS_NULL, 1, &count);
-    JS_FreeValue(ctx, ret);
-    JS_FreeValue(ctx, count);
+    pomelo_qjs_send_info_resolve(send_info, send_count);
+}
+
 
-    pomelo_qjs_send_info_finalize(send_info);
+/// @brief Parse the maxInFlight option of socket
+static int socket_parse_max_in_flight(
+    JSContext * ctx,
+    JSValue js_options,
+    size_t * max_in_flight
+) {
+    *max_in_flight = 0;
+    if (!JS_IsObject(js_options)) return 0;
+
+    JSValue js_value = JS_GetPropertyStr(ctx, js_options, "maxInFlight");
+    if (JS_IsUndefined(js_value)) return 0;
+
+    double value = 0;
+    int ret = JS_ToFloat64(ctx, &value, js_value);
+    JS_FreeValue(ctx, js_value);
+    if (
+        ret != 0 ||
+        !(value >= 0 && value <= UINT32_MAX) ||
+        value != (double) (uint32_t) value
+    ) {
+        JS_ThrowTypeError(ctx, "maxInFlight must be a non-negative integer");
+        return -1;
+    }
+
+    *max_in_flight = (size_t) value;
+    return 0;
 }
 
 
@@ -281,6 +525,11 @@ JSValue pomelo_qjs_socket_constructor(
     if (JS_GetLength(ctx, argv[0], &nchannels) != 0) {
         return JS_ThrowTypeError(ctx, "Failed to get channel modes length");
     }
+
+    if (nchannels > POMELO_MAX_CHANNELS) {
+        return JS_ThrowTypeError(ctx, "Too many channels");
+    }
+
     pomelo_channel_mode modes[POMELO_MAX_CHANNELS];
 
     for (int64_t i = 0; i < nchannels; i++) {
@@ -294,6 +543,31 @@ JSValue pomelo_qjs_socket_constructor(
         JS_FreeValue(ctx, mode);
     }
 
+    // Parse the binding options of channels
+    pomelo_qjs_channel_options_t channel_options[POMELO_MAX_CHANNELS];
+    bool framed = false;
+    JSValue js_options = (argc > 1) ? argv[1] : JS_UNDEFINED;
+    if (pomelo_qjs_frame_parse_socket_options(
+        ctx, js_options, (size_t) nchannels, channel_options, &framed
+    ) < 0) {
+        return JS_EXCEPTION;
+    }
+
+    // Parse the default inbound rate limit of sessions
+    pomelo_qjs_rate_limit_t rate_limit;
+    JSValue js_rate_limit = JS_IsObject(js_options)
+        ? JS_GetPropertyStr(ctx, js_options, "rateLimit")
+        : JS_UNDEFINED;
+    int ret = pomelo_qjs_rate_limit_parse(ctx, js_rate_limit, &rate_limit);
+    JS_FreeValue(ctx, js_rate_limit);
+    if (ret < 0) return JS_EXCEPTION;
+
+    // Parse the sending limit of sessions
+    size_t max_in_flight = 0;
+    if (socket_parse_max_in_flight(ctx, js_options, &max_in_flight) < 0) {
+        return JS_EXCEPTION;
+    }
+
     // Create new js socket object
     JSValue thiz = JS_NewObjectClass(ctx, context->class_socket_id);
     if (JS_IsException(thiz)) return thiz;
@@ -331,6 +605,16 @@ JSValue pomelo_qjs_socket_constructor(
     qjs_socket->socket = socket;
     pomelo_socket_set_extra(socket, qjs_socket);
 
+    qjs_socket->nchannels = (size_t) nchannels;
+    qjs_socket->framed = framed;
+    qjs_socket->max_in_flight = max_in_flight;
+    qjs_socket->rate_limit = rate_limit;
+    memcpy(
+        qjs_socket->channel_options,
+        channel_options,
+        (size_t) nchannels * sizeof(pomelo_qjs_channel_options_t)
+    );
+
     // Just a weak ref
     qjs_socket->thiz = thiz;
 
@@ -445,12 +729,42 @@ JSValue pomelo_qjs_socket_listen(
         return JS_ThrowTypeError(ctx, "Invalid address");
     }
 
+    // Get the number of shards
+    size_t nshards = 0;
+    if (
+        argc > 4 &&
+        pomelo_qjs_shard_parse_options(ctx, argv[4], &nshards) < 0
+    ) {
+        JS_FreeCString(ctx, address_str);
+        return JS_EXCEPTION;
+    }
+
     pomelo_address_t address;
-    int parse_ret = pomelo_address_from_string(&address, address_str);
+    int parse_ret = -1;
+    if (nshards > 1) {
+        // Each shard listens on its own port
+        char shard_address[POMELO_QJS_SHARD_ADDRESS_CAPACITY];
+        if (pomelo_qjs_shard_address(
+            address_str,
+            context->shard_index,
+            shard_address,
+            sizeof(shard_address)
+        ) == 0) {
+            parse_ret = pomelo_address_from_string(&address, shard_address);
+        }
+    } else {
+        parse_ret = pomelo_address_from_string(&address, address_str);
+    }
     JS_FreeCString(ctx, address_str);
     if (parse_ret < 0) {
         return JS_ThrowTypeError(ctx, "Invalid address");
     }
+
+    // The primary spawns the other shards before listening
+    if (nshards > 1 && pomelo_qjs_shard_enter(ctx, nshards) < 0) {
+        return JS_EXCEPTION;
+    }
+    qjs_socket->nshards = (nshards > 1) ? nshards : 0;
     
     int ret = pomelo_socket_listen(
         qjs_socket->socket,
@@ -553,6 +867,12 @@ JSValue pomelo_qjs_socket_connect(
         memcpy(connect_token, data, POMELO_CONNECT_TOKEN_BYTES);
     }
 
+    // The new server has its own clock, do not clamp to the previous one
+    qjs_socket->server_time = 0.0;
+
+    // Clients admit their own connection, even after a sharded listen
+    qjs_socket->nshards = 0;
+
     int ret = pomelo_socket_connect(qjs_socket->socket, connect_token);
 
     // Create promise to return
@@ -688,19 +1008,215 @@ JSValue pomelo_qjs_socket_send(
         return promise;
     }
 
+    pomelo_message_t * message = qjs_message->message;
+    if (qjs_socket->framed) {
+        // Broadcast messages are framed once for all recipients
+        message = pomelo_qjs_frame_encode(
+            qjs_socket, NULL, channel_index, message, NULL
+        );
+        if (!message) {
+            pomelo_qjs_send_info_resolve(send_info, 0);
+            return promise;
+        }
+    }
+
+    // Count the message for every recipient
+    pomelo_session_t ** sessions = send_sessions->elements;
+    for (size_t i = 0; i < array_index; i++) {
+        pomelo_qjs_session_t * qjs_session =
+            pomelo_session_get_extra(sessions[i]);
+        if (qjs_session) pomelo_qjs_session_count_sent(qjs_session, message);
+    }
+
     pomelo_socket_send(
         qjs_socket->socket,
         channel_index,
-        qjs_message->message,
+        message,
         send_sessions->elements,
         send_sessions->size,
         send_info
     );
 
+    if (message != qjs_message->message) {
+        pomelo_message_unref(message);
+    }
+
     return promise;
 }
 
 
+/// @brief Get the elements of a typed array. Return NULL on failure.
+static void * socket_get_typed_array(
+    JSContext * ctx,
+    JSValue value,
+    int type,
+    size_t element_size,
+    size_t * length
+) {
+    if (JS_GetTypedArrayType(value) != type) return NULL;
+
+    size_t byte_offset = 0;
+    size_t byte_length = 0;
+    JSValue js_buffer = JS_GetTypedArrayBuffer(
+        ctx, value, &byte_offset, &byte_length, NULL
+    );
+    if (JS_IsException(js_buffer)) return NULL;
+
+    // The typed array keeps its buffer alive
+    size_t buffer_size = 0;
+    uint8_t * data = JS_GetArrayBuffer(ctx, &buffer_size, js_buffer);
+    JS_FreeValue(ctx, js_buffer);
+    if (!data) return NULL;
+
+    *length = byte_length / element_size;
+    return data + byte_offset;
+}
+
+
+/// @brief Send the slices of scatter send to the resolved sessions. No user
+/// code runs here, so the buffer pointers stay valid.
+static JSValue socket_send_scatter_slices(
+    JSContext * ctx,
+    pomelo_qjs_context_t * context,
+    uint32_t channel_index,
+    JSValue * js_sessions,
+    int64_t nsessions,
+    JSValue * argv
+) {
+    size_t buffer_length = 0;
+    uint8_t * buffer = JS_IsArrayBuffer(argv[2])
+        ? JS_GetArrayBuffer(ctx, &buffer_length, argv[2])
+        : JS_GetUint8Array(ctx, &buffer_length, argv[2]);
+    if (!buffer) {
+        return JS_ThrowTypeError(
+            ctx, "Buffer must be an ArrayBuffer or an Uint8Array"
+        );
+    }
+
+    size_t noffsets = 0;
+    uint32_t * offsets = socket_get_typed_array(
+        ctx, argv[3], JS_TYPED_ARRAY_UINT32, sizeof(uint32_t), &noffsets
+    );
+    if (!offsets) {
+        return JS_ThrowTypeError(ctx, "Offsets must be an Uint32Array");
+    }
+
+    size_t nlengths = 0;
+    uint32_t * lengths = socket_get_typed_array(
+        ctx, argv[4], JS_TYPED_ARRAY_UINT32, sizeof(uint32_t), &nlengths
+    );
+    if (!lengths) {
+        return JS_ThrowTypeError(ctx, "Lengths must be an Uint32Array");
+    }
+
+    if (noffsets < (size_t) nsessions || nlengths < (size_t) nsessions) {
+        return JS_ThrowTypeError(
+            ctx, "Offsets and lengths must cover all sessions"
+        );
+    }
+
+    // Validate all slices before sending anything
+    for (int64_t i = 0; i < nsessions; i++) {
+        if (
+            offsets[i] > buffer_length ||
+            lengths[i] > buffer_length - offsets[i]
+        ) {
+            return JS_ThrowRangeError(
+                ctx, "Slice %d is out of buffer", (int) i
+            );
+        }
+    }
+
+    int32_t sent = 0;
+    for (int64_t i = 0; i < nsessions; i++) {
+        pomelo_qjs_session_t * qjs_session =
+            JS_GetOpaque(js_sessions[i], context->class_session_id);
+        if (!qjs_session || !qjs_session->session) continue;
+
+        pomelo_message_t * message =
+            pomelo_context_acquire_message(context->context);
+        if (!message) break; // Out of messages
+
+        int ret = 0;
+        if (lengths[i] > 0) {
+            ret = pomelo_message_write_buffer(
+                message, buffer + offsets[i], lengths[i]
+            );
+        }
+        if (ret == 0) {
+            ret = pomelo_qjs_session_send_detached(
+                qjs_session, channel_index, message
+            );
+        }
+        pomelo_message_unref(message);
+        if (ret == 0) sent++;
+    }
+    return JS_NewInt32(ctx, sent);
+}
+
+
+JSValue pomelo_qjs_socket_send_scatter(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 5) return JS_ThrowTypeError(ctx, "Missing arguments");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) return JS_ThrowTypeError(ctx, "Invalid native socket");
+
+    uint32_t channel_index = 0;
+    if (JS_ToUint32(ctx, &channel_index, argv[0]) != 0) {
+        return JS_ThrowTypeError(ctx, "Channel index must be a number");
+    }
+    if (channel_index >= qjs_socket->nchannels) {
+        return JS_ThrowTypeError(ctx, "Invalid channel index");
+    }
+
+    if (!JS_IsArray(argv[1])) {
+        return JS_ThrowTypeError(ctx, "Sessions must be an array");
+    }
+    int64_t nsessions = 0;
+    if (JS_GetLength(ctx, argv[1], &nsessions) != 0) {
+        return JS_ThrowTypeError(ctx, "Failed to get sessions length");
+    }
+
+    // Resolve the sessions before taking any buffer pointer. Getters of the
+    // sessions array run user code, which may detach the buffers.
+    JSValue * js_sessions = NULL;
+    if (nsessions > 0) {
+        js_sessions = pomelo_allocator_malloc(
+            context->allocator, (size_t) nsessions * sizeof(JSValue)
+        );
+        if (!js_sessions) {
+            return JS_ThrowTypeError(ctx, "Failed to allocate sessions");
+        }
+    }
+
+    int64_t nresolved = 0;
+    for (; nresolved < nsessions; nresolved++) {
+        JSValue js_session = JS_GetPropertyInt64(ctx, argv[1], nresolved);
+        if (JS_IsException(js_session)) break;
+        js_sessions[nresolved] = js_session;
+    }
+
+    JSValue result = (nresolved < nsessions)
+        ? JS_EXCEPTION
+        : socket_send_scatter_slices(
+            ctx, context, channel_index, js_sessions, nsessions, argv
+        );
+
+    for (int64_t i = 0; i < nresolved; i++) {
+        JS_FreeValue(ctx, js_sessions[i]);
+    }
+    if (js_sessions) pomelo_allocator_free(context->allocator, js_sessions);
+    return result;
+}
+
+
 JSValue pomelo_qjs_socket_time(
     JSContext * ctx, JSValue thiz, int argc, JSValue * argv
 ) {
@@ -721,6 +1237,54 @@ JSValue pomelo_qjs_socket_time(
 }
 
 
+JSValue pomelo_qjs_socket_time_ms(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) argc;
+    (void) argv;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    uint64_t time = pomelo_socket_time(qjs_socket->socket);
+    return JS_NewFloat64(ctx, (double) time / 1000000.0);
+}
+
+
+JSValue pomelo_qjs_socket_server_time(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) argc;
+    (void) argv;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+    
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    // Socket time is in nanoseconds
+    double time = (double) pomelo_socket_time(qjs_socket->socket) / 1000000.0;
+    if (time < qjs_socket->server_time) {
+        time = qjs_socket->server_time;
+    }
+    qjs_socket->server_time = time;
+
+    return JS_NewFloat64(ctx, time);
+}
+
+
 void pomelo_qjs_socket_stop_impl(pomelo_qjs_socket_t * qjs_socket) {
     assert(qjs_socket != NULL);
     pomelo_qjs_context_t * context = qjs_socket->context;
@@ -732,6 +1296,9 @@ void pomelo_qjs_socket_stop_impl(pomelo_qjs_socket_t * qjs_socket) {
     // Stop the socket
     pomelo_socket_stop(socket);
 
+    // Stop the loop lag probe, it would keep the loop alive
+    pomelo_qjs_admission_cleanup(&qjs_socket->admission);
+
     // Free the thiz reference
     JS_FreeValue(context->ctx, qjs_socket->thiz);
 
@@ -740,3 +1307,458 @@ void pomelo_qjs_socket_stop_impl(pomelo_qjs_socket_t * qjs_socket) {
         qjs_socket->thiz_entry = NULL;
     }
 }
+
+
+JSValue pomelo_qjs_socket_route(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    if (argc < 2) {
+        return JS_ThrowTypeError(ctx, "Opcode and handler are required");
+    }
+
+    uint32_t opcode = 0;
+    if (JS_ToUint32(ctx, &opcode, argv[0]) != 0) {
+        return JS_ThrowTypeError(ctx, "Opcode must be a number");
+    }
+    if (opcode >= POMELO_QJS_ROUTER_NOPCODES) {
+        return JS_ThrowTypeError(ctx, "Opcode must be in range [0, 255]");
+    }
+
+    JSValue handler = argv[1];
+    if (
+        !JS_IsFunction(ctx, handler) &&
+        !JS_IsNull(handler) &&
+        !JS_IsUndefined(handler)
+    ) {
+        return JS_ThrowTypeError(ctx, "Handler must be a function or null");
+    }
+
+    size_t channel_index = POMELO_QJS_ROUTER_ANY_CHANNEL;
+    if (argc > 2 && JS_IsObject(argv[2])) {
+        JSValue js_channel = JS_GetPropertyStr(ctx, argv[2], "channel");
+        if (!JS_IsUndefined(js_channel)) {
+            uint32_t channel = 0;
+            int ret = JS_ToUint32(ctx, &channel, js_channel);
+            JS_FreeValue(ctx, js_channel);
+            if (ret != 0) {
+                return JS_ThrowTypeError(ctx, "Channel must be a number");
+            }
+            if (channel >= qjs_socket->nchannels) {
+                return JS_ThrowTypeError(ctx, "Invalid channel index");
+            }
+            if (!qjs_socket->framed) {
+                // Only framed messages carry their channel index
+                return JS_ThrowTypeError(
+                    ctx, "Channel routes require a framed socket"
+                );
+            }
+            channel_index = channel;
+        }
+    }
+
+    int ret = pomelo_qjs_router_set(
+        context,
+        &qjs_socket->router,
+        channel_index,
+        (uint8_t) opcode,
+        handler
+    );
+    if (ret < 0) return JS_ThrowTypeError(ctx, "Failed to set route");
+
+    return JS_UNDEFINED;
+}
+
+
+/// @brief Snapshot the registered sessions of socket, so that callbacks are
+/// free to connect or disconnect sessions. The returned values must be freed
+/// by socket_free_sessions.
+/// @param js_sessions Output the JS sessions, NULL if there is no session
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+static int socket_collect_sessions(
+    pomelo_qjs_socket_t * qjs_socket,
+    JSValue ** js_sessions,
+    size_t * count
+) {
+    pomelo_qjs_context_t * context = qjs_socket->context;
+    JSContext * ctx = context->ctx;
+    pomelo_qjs_registry_t * registry = &qjs_socket->registry;
+    *js_sessions = NULL;
+    *count = 0;
+    if (registry->size == 0) return 0;
+
+    pomelo_qjs_session_t ** sessions = pomelo_allocator_malloc(
+        context->allocator,
+        registry->size * sizeof(pomelo_qjs_session_t *)
+    );
+    JSValue * values = pomelo_allocator_malloc(
+        context->allocator,
+        registry->size * sizeof(JSValue)
+    );
+    if (!sessions || !values) {
+        if (sessions) pomelo_allocator_free(context->allocator, sessions);
+        if (values) pomelo_allocator_free(context->allocator, values);
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+
+    size_t n = pomelo_qjs_registry_collect(registry, sessions);
+    for (size_t i = 0; i < n; i++) {
+        JSValue js_session = pomelo_qjs_session_wrap(sessions[i]);
+        if (JS_IsException(js_session)) {
+            // Release the collected ones, the exception is kept
+            for (size_t j = 0; j < i; j++) {
+                JS_FreeValue(ctx, values[j]);
+            }
+            pomelo_allocator_free(context->allocator, values);
+            pomelo_allocator_free(context->allocator, sessions);
+            return -1;
+        }
+        values[i] = JS_DupValue(ctx, js_session);
+    }
+    pomelo_allocator_free(context->allocator, sessions);
+
+    *js_sessions = values;
+    *count = n;
+    return 0;
+}
+
+
+/// @brief Free the snapshot of sessions
+static void socket_free_sessions(
+    pomelo_qjs_context_t * context,
+    JSValue * js_sessions,
+    size_t count
+) {
+    if (!js_sessions) return;
+    for (size_t i = 0; i < count; i++) {
+        JS_FreeValue(context->ctx, js_sessions[i]);
+    }
+    pomelo_allocator_free(context->allocator, js_sessions);
+}
+
+
+JSValue pomelo_qjs_socket_get_session(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing session ID");
+
+    int64_t client_id = 0;
+    int ret = JS_IsNumber(argv[0])
+        ? JS_ToInt64(ctx, &client_id, argv[0])
+        : JS_ToBigInt64(ctx, &client_id, argv[0]);
+    if (ret < 0) {
+        return JS_ThrowTypeError(ctx, "Session ID must be a bigint or number");
+    }
+
+    pomelo_qjs_session_t * qjs_session =
+        pomelo_qjs_registry_get(&qjs_socket->registry, client_id);
+    if (!qjs_session) return JS_UNDEFINED;
+
+    return JS_DupValue(ctx, pomelo_qjs_session_wrap(qjs_session));
+}
+
+
+JSValue pomelo_qjs_socket_get_session_count(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    return JS_NewInt64(ctx, (int64_t) qjs_socket->registry.size);
+}
+
+
+JSValue pomelo_qjs_socket_for_each_session(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    if (argc < 1 || !JS_IsFunction(ctx, argv[0])) {
+        return JS_ThrowTypeError(ctx, "Callback must be a function");
+    }
+
+    size_t count = 0;
+    JSValue * js_sessions = NULL;
+    if (socket_collect_sessions(qjs_socket, &js_sessions, &count) < 0) {
+        return JS_EXCEPTION;
+    }
+    for (size_t i = 0; i < count; i++) {
+        JSValue ret = JS_Call(ctx, argv[0], JS_UNDEFINED, 1, js_sessions + i);
+        if (JS_IsException(ret)) {
+            socket_free_sessions(context, js_sessions, count);
+            return ret;
+        }
+        JS_FreeValue(ctx, ret);
+    }
+    socket_free_sessions(context, js_sessions, count);
+
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_socket_disconnect_all(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    JSValue filter = (argc > 0) ? argv[0] : JS_UNDEFINED;
+    if (!JS_IsUndefined(filter) && !JS_IsFunction(ctx, filter)) {
+        return JS_ThrowTypeError(ctx, "Filter must be a function");
+    }
+
+    size_t count = 0;
+    int32_t disconnected = 0;
+    JSValue * js_sessions = NULL;
+    if (socket_collect_sessions(qjs_socket, &js_sessions, &count) < 0) {
+        return JS_EXCEPTION;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!JS_IsUndefined(filter)) {
+            JSValue ret =
+                JS_Call(ctx, filter, JS_UNDEFINED, 1, js_sessions + i);
+            if (JS_IsException(ret)) {
+                socket_free_sessions(context, js_sessions, count);
+                return ret;
+            }
+            int matched = JS_ToBool(ctx, ret);
+            JS_FreeValue(ctx, ret);
+            if (matched <= 0) continue;
+        }
+
+        // The session may have been disconnected by the filter
+        pomelo_qjs_session_t * qjs_session =
+            JS_GetOpaque(js_sessions[i], context->class_session_id);
+        if (!qjs_session || !qjs_session->session) continue;
+
+        if (pomelo_session_disconnect(qjs_session->session) == 0) {
+            disconnected++;
+        }
+    }
+    socket_free_sessions(context, js_sessions, count);
+
+    return JS_NewInt32(ctx, disconnected);
+}
+
+
+/// @brief The session metrics
+typedef enum socket_metric {
+    SOCKET_METRIC_RTT_MEAN,
+    SOCKET_METRIC_RTT_VARIANCE,
+    SOCKET_METRIC_MESSAGES_IN,
+    SOCKET_METRIC_BYTES_IN,
+    SOCKET_METRIC_MESSAGES_OUT,
+    SOCKET_METRIC_BYTES_OUT,
+    SOCKET_METRIC_LOST,
+    SOCKET_METRIC_QUEUE_DEPTH,
+    SOCKET_METRIC_COUNT
+} socket_metric;
+
+
+/// @brief The names of session metrics, indexed by metric
+static const char * socket_metric_names[SOCKET_METRIC_COUNT] = {
+    [SOCKET_METRIC_RTT_MEAN] = "rttMean",
+    [SOCKET_METRIC_RTT_VARIANCE] = "rttVariance",
+    [SOCKET_METRIC_MESSAGES_IN] = "messagesIn",
+    [SOCKET_METRIC_BYTES_IN] = "bytesIn",
+    [SOCKET_METRIC_MESSAGES_OUT] = "messagesOut",
+    [SOCKET_METRIC_BYTES_OUT] = "bytesOut",
+    [SOCKET_METRIC_LOST] = "lost",
+    [SOCKET_METRIC_QUEUE_DEPTH] = "queueDepth"
+};
+
+
+/// @brief Get a metric of session. RTT metrics are in milliseconds.
+static double socket_session_metric(
+    pomelo_qjs_session_t * qjs_session,
+    socket_metric metric,
+    pomelo_rtt_t * rtt
+) {
+    switch (metric) {
+        case SOCKET_METRIC_RTT_MEAN:
+            return (double) rtt->mean / 1000000.0;
+        case SOCKET_METRIC_RTT_VARIANCE:
+            return (double) rtt->variance / 1000000.0;
+        case SOCKET_METRIC_MESSAGES_IN:
+            return (double) qjs_session->messages_received;
+        case SOCKET_METRIC_BYTES_IN:
+            return (double) qjs_session->bytes_received;
+        case SOCKET_METRIC_MESSAGES_OUT:
+            return (double) qjs_session->messages_sent;
+        case SOCKET_METRIC_BYTES_OUT:
+            return (double) qjs_session->bytes_sent;
+        case SOCKET_METRIC_LOST:
+            return (double) pomelo_qjs_session_lost_count(qjs_session);
+        case SOCKET_METRIC_QUEUE_DEPTH:
+            return (double) pomelo_qjs_session_queue_depth(qjs_session);
+        default:
+            return 0.0;
+    }
+}
+
+
+JSValue pomelo_qjs_socket_export_session_metrics(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing target");
+
+    // Parse the fields, all metrics by default
+    socket_metric fields[SOCKET_METRIC_COUNT];
+    size_t nfields = SOCKET_METRIC_COUNT;
+    for (size_t i = 0; i < nfields; i++) {
+        fields[i] = (socket_metric) i;
+    }
+
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        int64_t length = 0;
+        if (!JS_IsArray(argv[1]) || JS_GetLength(ctx, argv[1], &length) != 0) {
+            return JS_ThrowTypeError(ctx, "Fields must be an array");
+        }
+        if (length < 1 || length > SOCKET_METRIC_COUNT) {
+            return JS_ThrowTypeError(ctx, "Invalid number of fields");
+        }
+
+        nfields = (size_t) length;
+        for (size_t i = 0; i < nfields; i++) {
+            JSValue js_field = JS_GetPropertyInt64(ctx, argv[1], (int64_t) i);
+            const char * field = JS_ToCString(ctx, js_field);
+            JS_FreeValue(ctx, js_field);
+            if (!field) return JS_EXCEPTION;
+
+            size_t metric = 0;
+            while (
+                metric < SOCKET_METRIC_COUNT &&
+                strcmp(field, socket_metric_names[metric]) != 0
+            ) {
+                metric++;
+            }
+            JS_FreeCString(ctx, field);
+            if (metric == SOCKET_METRIC_COUNT) {
+                return JS_ThrowTypeError(ctx, "Unknown metric field");
+            }
+            fields[i] = (socket_metric) metric;
+        }
+    }
+
+    // The target is taken after parsing the fields, their getters and
+    // toString may detach its buffer
+    size_t target_length = 0;
+    double * target = socket_get_typed_array(
+        ctx, argv[0], JS_TYPED_ARRAY_FLOAT64, sizeof(double), &target_length
+    );
+    if (!target) {
+        return JS_ThrowTypeError(ctx, "Target must be a Float64Array");
+    }
+
+    // One row per session, at the index of session
+    int32_t exported = 0;
+    pomelo_qjs_registry_t * registry = &qjs_socket->registry;
+    for (size_t i = 0; i < registry->capacity; i++) {
+        pomelo_qjs_session_t * qjs_session = registry->entries[i].qjs_session;
+        if (!qjs_session || !qjs_session->session) continue;
+        if (qjs_session->index < 0) continue;
+
+        size_t offset = (size_t) qjs_session->index * nfields;
+        if (offset + nfields > target_length) continue; // No room
+
+        pomelo_rtt_t rtt = { 0 };
+        pomelo_session_get_rtt(qjs_session->session, &rtt);
+
+        double * row = target + offset;
+        for (size_t j = 0; j < nfields; j++) {
+            row[j] = socket_session_metric(qjs_session, fields[j], &rtt);
+        }
+        exported++;
+    }
+
+    return JS_NewInt32(ctx, exported);
+}
+
+
+JSValue pomelo_qjs_socket_set_admission_policy(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    JSValue js_policy = (argc > 0) ? argv[0] : JS_UNDEFINED;
+    if (pomelo_qjs_admission_configure(&qjs_socket->admission, js_policy) < 0) {
+        return JS_EXCEPTION;
+    }
+
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_socket_get_loop_lag_ms(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(thiz, context->class_socket_id);
+    if (!qjs_socket) {
+        return JS_ThrowTypeError(ctx, "Invalid native socket");
+    }
+
+    return JS_NewFloat64(
+        ctx, pomelo_qjs_admission_loop_lag(&qjs_socket->admission)
+    );
+}
@@ -5,6 +5,11 @@
 #include "core.h"
 #include "utils/array.h"
 #include "utils/list.h"
+#include "frame.h"
+#include "limiter.h"
+#include "router.h"
+#include "registry.h"
+#include "admission.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,6 +42,44 @@ struct pomelo_qjs_socket_s {
 
     /// @brief this value entry of this socket in context
     pomelo_list_entry_t * thiz_entry;
+
+    /// @brief The number of channels
+    size_t nchannels;
+
+    /// @brief Whether messages of this socket are framed by binding
+    bool framed;
+
+    /// @brief The maximum number of messages of a session which are handed to
+    /// the native socket but not completed yet. Zero means unlimited.
+    size_t max_in_flight;
+
+    /// @brief The binding options of channels
+    pomelo_qjs_channel_options_t channel_options[POMELO_MAX_CHANNELS];
+
+    /// @brief The last returned server time in milliseconds. Server time never
+    /// goes backward when the clock offset is adjusted. It is reset when the
+    /// socket connects again.
+    double server_time;
+
+    /// @brief The default inbound rate limit of sessions
+    pomelo_qjs_rate_limit_t rate_limit;
+
+    /// @brief The opcode router of received messages
+    pomelo_qjs_router_t router;
+
+    /// @brief The registry of connected sessions
+    pomelo_qjs_registry_t registry;
+
+    /// @brief The session tables of socket (weak references). It is created
+    /// on demand.
+    pomelo_list_t * session_tables;
+
+    /// @brief The admission policy of new connections
+    pomelo_qjs_admission_t admission;
+
+    /// @brief The number of shards of listening. Zero if the socket does not
+    /// listen sharded.
+    size_t nshards;
 };
 
 
@@ -59,12 +102,39 @@ int pomelo_qjs_socket_init(
 void pomelo_qjs_socket_cleanup(pomelo_qjs_socket_t * qjs_socket);
 
 
+/// @brief Deliver a received message to its route or the listener
+/// @param channel_index The channel index of message, or
+/// POMELO_QJS_ROUTER_ANY_CHANNEL if it is unknown
+void pomelo_qjs_socket_deliver(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session,
+    size_t channel_index,
+    pomelo_message_t * message
+);
+
+
+/// @brief Register a connected session to socket and assign its index
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_socket_register_session(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session
+);
+
+
+/// @brief Unregister a session from socket. The rows of its index in session
+/// tables are cleared.
+void pomelo_qjs_socket_unregister_session(
+    pomelo_qjs_socket_t * qjs_socket,
+    pomelo_qjs_session_t * qjs_session
+);
+
+
 /*----------------------------------------------------------------------------*/
 /*                               Private APIs                                 */
 /*----------------------------------------------------------------------------*/
 
 
-/// @brief Socket.constructor(listener: SocketListener): Socket
+/// @brief Socket.constructor(channelModes: ChannelMode[], options?: SocketOptions)
 JSValue pomelo_qjs_socket_constructor(
     JSContext * ctx, JSValue new_target, int argc, JSValue * argv
 );
@@ -104,12 +174,77 @@ JSValue pomelo_qjs_socket_send(
 );
 
 
+/// @brief Socket.sendScatter(channelIndex: number, sessions: Session[],
+/// buffer: Uint8Array, offsets: Uint32Array, lengths: Uint32Array): number
+JSValue pomelo_qjs_socket_send_scatter(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
 /// @brief Socket.time()
 JSValue pomelo_qjs_socket_time(
     JSContext * ctx, JSValue thiz, int argc, JSValue * argv
 );
 
 
+/// @brief Socket.setAdmissionPolicy(policy: AdmissionPolicy | null): void
+JSValue pomelo_qjs_socket_set_admission_policy(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief readonly Socket.loopLagMs: number
+JSValue pomelo_qjs_socket_get_loop_lag_ms(JSContext * ctx, JSValue thiz);
+
+
+/// @brief Socket.timeMs(): number
+JSValue pomelo_qjs_socket_time_ms(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Socket.serverTime(): number
+JSValue pomelo_qjs_socket_server_time(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Socket.route(opcode: number, handler: RouteHandler | null,
+/// options?: RouteOptions): void
+JSValue pomelo_qjs_socket_route(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Socket.getSession(id: bigint | number): Session | undefined
+JSValue pomelo_qjs_socket_get_session(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief readonly Socket.sessionCount: number
+JSValue pomelo_qjs_socket_get_session_count(JSContext * ctx, JSValue thiz);
+
+
+/// @brief Socket.forEachSession(callback: (session: Session) => void): void
+JSValue pomelo_qjs_socket_for_each_session(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Socket.disconnectAll(filter?: (session: Session) => boolean): number
+JSValue pomelo_qjs_socket_disconnect_all(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Socket.exportSessionMetrics(target: Float64Array,
+/// fields?: SessionMetric[]): number
+JSValue pomelo_qjs_socket_export_session_metrics(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
 /// @brief Stop the socket
 void pomelo_qjs_socket_stop_impl(pomelo_qjs_socket_t * qjs_socket);
 
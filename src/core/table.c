@@ -0,0 +1,367 @@
+#include <assert.h>
+#include <string.h>
+#include "context.h"
+#include "table.h"
+#include "socket.h"
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+/// The maximum number of rows of a table
+#define SESSION_TABLE_MAX_CAPACITY (1 << 20)
+
+
+static JSCFunctionListEntry session_table_funcs[] = {
+    JS_CFUNC_DEF("column", 2, pomelo_qjs_session_table_column),
+    JS_CFUNC_DEF("clearRow", 1, pomelo_qjs_session_table_clear_row_js),
+    JS_CGETSET_DEF("capacity", pomelo_qjs_session_table_get_capacity, NULL),
+};
+
+
+int pomelo_qjs_init_table_module(JSContext * ctx, JSModuleDef * m) {
+    assert(ctx != NULL);
+    assert(m != NULL);
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    // Generate new class ID
+    JSClassID class_id = 0;
+    if (JS_NewClassID(context->rt, &class_id) < 0) {
+        return -1;
+    }
+    context->class_session_table_id = class_id;
+
+    // Register the class
+    JSClassDef class_def = {
+        .class_name = "SessionTable",
+        .finalizer = pomelo_qjs_session_table_finalizer
+    };
+    if (JS_NewClass(context->rt, class_id, &class_def) < 0) {
+        return -1;
+    }
+
+    // Create prototype for class
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(
+        ctx, proto, session_table_funcs, countof(session_table_funcs)
+    );
+
+    JSValue table_class = JS_NewCFunction2(
+        ctx,
+        pomelo_qjs_session_table_constructor,
+        "SessionTable",
+        /* argc = */ 2,
+        JS_CFUNC_constructor,
+        0
+    );
+    JS_SetConstructor(ctx, table_class, proto);
+
+    // Set the class prototype
+    JS_SetClassProto(ctx, class_id, proto);
+    JS_SetModuleExport(ctx, m, "SessionTable", table_class);
+    return 0;
+}
+
+
+pomelo_qjs_session_column_t * pomelo_qjs_session_table_find_column(
+    pomelo_qjs_session_table_t * table,
+    const char * name
+) {
+    assert(table != NULL);
+    assert(name != NULL);
+
+    for (size_t i = 0; i < table->ncolumns; i++) {
+        if (strcmp(table->columns[i].name, name) == 0) {
+            return table->columns + i;
+        }
+    }
+    return NULL;
+}
+
+
+/// @brief Get the elements of column. Return NULL if the buffer of column
+/// has been detached.
+static uint8_t * session_column_data(
+    JSContext * ctx,
+    pomelo_qjs_session_column_t * column,
+    size_t * length
+) {
+    size_t byte_offset = 0;
+    size_t byte_length = 0;
+    JSValue js_buffer = JS_GetTypedArrayBuffer(
+        ctx, column->array, &byte_offset, &byte_length, NULL
+    );
+    if (JS_IsException(js_buffer)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return NULL;
+    }
+
+    size_t buffer_size = 0;
+    uint8_t * data = JS_GetArrayBuffer(ctx, &buffer_size, js_buffer);
+    JS_FreeValue(ctx, js_buffer);
+    if (!data) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return NULL;
+    }
+
+    *length = byte_length;
+    return data + byte_offset;
+}
+
+
+void pomelo_qjs_session_table_clear_row(
+    pomelo_qjs_session_table_t * table,
+    int32_t index
+) {
+    assert(table != NULL);
+    if (index < 0 || (size_t) index >= table->capacity) return;
+
+    JSContext * ctx = table->context->ctx;
+    for (size_t i = 0; i < table->ncolumns; i++) {
+        pomelo_qjs_session_column_t * column = table->columns + i;
+        size_t offset = (size_t) index * column->element_size;
+        size_t length = 0;
+        uint8_t * data = session_column_data(ctx, column, &length);
+        if (!data || offset + column->element_size > length) continue;
+
+        memset(data + offset, 0, column->element_size);
+    }
+}
+
+
+void pomelo_qjs_session_table_detach(pomelo_qjs_session_table_t * table) {
+    assert(table != NULL);
+    pomelo_qjs_socket_t * qjs_socket = table->qjs_socket;
+    if (!qjs_socket) return; // Not attached
+
+    if (table->entry && qjs_socket->session_tables) {
+        pomelo_list_remove(qjs_socket->session_tables, table->entry);
+    }
+    table->entry = NULL;
+    table->qjs_socket = NULL;
+}
+
+
+/// @brief Parse the column type
+static int session_table_parse_type(
+    const char * type,
+    int * array_type,
+    size_t * element_size
+) {
+    if (strcmp(type, "float32") == 0) {
+        *array_type = JS_TYPED_ARRAY_FLOAT32;
+        *element_size = sizeof(float);
+    } else if (strcmp(type, "int32") == 0) {
+        *array_type = JS_TYPED_ARRAY_INT32;
+        *element_size = sizeof(int32_t);
+    } else if (strcmp(type, "uint8") == 0) {
+        *array_type = JS_TYPED_ARRAY_UINT8;
+        *element_size = sizeof(uint8_t);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+JSValue pomelo_qjs_session_table_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) new_target;
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    if (argc < 2) return JS_ThrowTypeError(ctx, "Missing arguments");
+
+    pomelo_qjs_socket_t * qjs_socket =
+        JS_GetOpaque(argv[0], context->class_socket_id);
+    if (!qjs_socket) return JS_ThrowTypeError(ctx, "Invalid native socket");
+
+    uint32_t capacity = 0;
+    if (
+        JS_ToUint32(ctx, &capacity, argv[1]) != 0 ||
+        capacity == 0 ||
+        capacity > SESSION_TABLE_MAX_CAPACITY
+    ) {
+        return JS_ThrowTypeError(ctx, "Invalid capacity");
+    }
+
+    // The socket keeps a weak list of its tables
+    if (!qjs_socket->session_tables) {
+        pomelo_list_options_t list_options = {
+            .allocator = context->allocator,
+            .element_size = sizeof(pomelo_qjs_session_table_t *)
+        };
+        qjs_socket->session_tables = pomelo_list_create(&list_options);
+        if (!qjs_socket->session_tables) {
+            return JS_ThrowInternalError(ctx, "Failed to create table list");
+        }
+    }
+
+    // Create new js table object
+    JSValue thiz = JS_NewObjectClass(ctx, context->class_session_table_id);
+    if (JS_IsException(thiz)) return thiz;
+
+    pomelo_qjs_session_table_t * table = pomelo_allocator_malloc_t(
+        context->allocator, pomelo_qjs_session_table_t
+    );
+    if (!table) {
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to allocate table");
+    }
+    memset(table, 0, sizeof(pomelo_qjs_session_table_t));
+
+    table->entry = pomelo_list_push_back(qjs_socket->session_tables, table);
+    if (!table->entry) {
+        pomelo_allocator_free(context->allocator, table);
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to attach table");
+    }
+
+    table->context = context;
+    table->qjs_socket = qjs_socket;
+    table->capacity = capacity;
+    table->ncolumns = 0;
+
+    JS_SetOpaque(thiz, table);
+    return thiz;
+}
+
+
+void pomelo_qjs_session_table_finalizer(JSRuntime * rt, JSValue val) {
+    assert(rt != NULL);
+    pomelo_qjs_context_t * context = JS_GetRuntimeOpaque(rt);
+    if (!context) return;
+
+    pomelo_qjs_session_table_t * table =
+        JS_GetOpaque(val, context->class_session_table_id);
+    if (!table) return;
+
+    pomelo_qjs_session_table_detach(table);
+    for (size_t i = 0; i < table->ncolumns; i++) {
+        JS_FreeValueRT(rt, table->columns[i].array);
+    }
+    pomelo_allocator_free(context->allocator, table);
+}
+
+
+JSValue pomelo_qjs_session_table_column(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 2) return JS_ThrowTypeError(ctx, "Missing arguments");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_table_t * table =
+        JS_GetOpaque(thiz, context->class_session_table_id);
+    if (!table) return JS_ThrowTypeError(ctx, "Invalid native session table");
+
+    size_t name_length = 0;
+    const char * name = JS_ToCStringLen(ctx, &name_length, argv[0]);
+    if (!name) return JS_EXCEPTION;
+
+    const char * type_name = JS_ToCString(ctx, argv[1]);
+    if (!type_name) {
+        JS_FreeCString(ctx, name);
+        return JS_EXCEPTION;
+    }
+
+    int type = 0;
+    size_t element_size = 0;
+    int ret = session_table_parse_type(type_name, &type, &element_size);
+    JS_FreeCString(ctx, type_name);
+    if (ret < 0) {
+        JS_FreeCString(ctx, name);
+        return JS_ThrowTypeError(
+            ctx, "Column type must be float32, int32 or uint8"
+        );
+    }
+
+    if (
+        name_length == 0 ||
+        name_length > POMELO_QJS_SESSION_TABLE_MAX_NAME_LENGTH
+    ) {
+        JS_FreeCString(ctx, name);
+        return JS_ThrowTypeError(ctx, "Invalid column name");
+    }
+
+    // Return the existing column
+    pomelo_qjs_session_column_t * column =
+        pomelo_qjs_session_table_find_column(table, name);
+    if (column) {
+        JS_FreeCString(ctx, name);
+        if (column->type != type) {
+            return JS_ThrowTypeError(ctx, "Column type mismatched");
+        }
+        return JS_DupValue(ctx, column->array);
+    }
+
+    if (table->ncolumns >= POMELO_QJS_SESSION_TABLE_MAX_COLUMNS) {
+        JS_FreeCString(ctx, name);
+        return JS_ThrowTypeError(ctx, "Too many columns");
+    }
+
+    // Create new zeroed typed array
+    JSValue length = JS_NewInt64(ctx, (int64_t) table->capacity);
+    JSValue array = JS_NewTypedArray(ctx, 1, &length, type);
+    JS_FreeValue(ctx, length);
+    if (JS_IsException(array)) {
+        JS_FreeCString(ctx, name);
+        return array;
+    }
+
+    column = table->columns + table->ncolumns;
+    memcpy(column->name, name, name_length);
+    column->name[name_length] = '\0';
+    column->type = type;
+    column->element_size = element_size;
+    column->array = array;
+    table->ncolumns++;
+
+    JS_FreeCString(ctx, name);
+    return JS_DupValue(ctx, array);
+}
+
+
+JSValue pomelo_qjs_session_table_clear_row_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing row index");
+
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_table_t * table =
+        JS_GetOpaque(thiz, context->class_session_table_id);
+    if (!table) return JS_ThrowTypeError(ctx, "Invalid native session table");
+
+    int32_t index = 0;
+    if (JS_ToInt32(ctx, &index, argv[0]) != 0) {
+        return JS_ThrowTypeError(ctx, "Row index must be a number");
+    }
+
+    pomelo_qjs_session_table_clear_row(table, index);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_session_table_get_capacity(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    assert(context != NULL);
+
+    pomelo_qjs_session_table_t * table =
+        JS_GetOpaque(thiz, context->class_session_table_id);
+    if (!table) return JS_ThrowTypeError(ctx, "Invalid native session table");
+
+    return JS_NewInt64(ctx, (int64_t) table->capacity);
+}
@@ -0,0 +1,135 @@
+#ifndef POMELO_QUICKJS_TABLE_SRC_H
+#define POMELO_QUICKJS_TABLE_SRC_H
+#include "quickjs.h"
+#include "pomelo/api.h"
+#include "core.h"
+#include "utils/list.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Session table.
+ *
+ * A struct-of-arrays store of per-session attributes. Every column is a typed
+ * array indexed by session.index. Rows of disconnected sessions are zeroed, so
+ * that they are clean when the index is reused.
+ *
+ * JS may detach the buffer of a column, so the elements are looked up again
+ * before every native write instead of being cached.
+ */
+
+
+/// @brief The maximum number of columns of a table
+#define POMELO_QJS_SESSION_TABLE_MAX_COLUMNS 32
+
+
+/// @brief The maximum length of column name
+#define POMELO_QJS_SESSION_TABLE_MAX_NAME_LENGTH 63
+
+
+/// @brief A column of session table
+typedef struct pomelo_qjs_session_column_s pomelo_qjs_session_column_t;
+
+/// @brief The session table
+typedef struct pomelo_qjs_session_table_s pomelo_qjs_session_table_t;
+
+
+struct pomelo_qjs_session_column_s {
+    /// @brief The name of column
+    char name[POMELO_QJS_SESSION_TABLE_MAX_NAME_LENGTH + 1];
+
+    /// @brief The typed array type of column
+    int type;
+
+    /// @brief The size of an element
+    size_t element_size;
+
+    /// @brief The typed array of column
+    JSValue array;
+};
+
+
+struct pomelo_qjs_session_table_s {
+    /// @brief The context
+    pomelo_qjs_context_t * context;
+
+    /// @brief The socket which owns the sessions. NULL if the socket has been
+    /// cleaned up.
+    pomelo_qjs_socket_t * qjs_socket;
+
+    /// @brief The entry of table in the table list of socket
+    pomelo_list_entry_t * entry;
+
+    /// @brief The number of rows
+    size_t capacity;
+
+    /// @brief The columns
+    pomelo_qjs_session_column_t columns[POMELO_QJS_SESSION_TABLE_MAX_COLUMNS];
+
+    /// @brief The number of columns
+    size_t ncolumns;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the session table module
+int pomelo_qjs_init_table_module(JSContext * ctx, JSModuleDef * m);
+
+
+/// @brief Find a column of table by name. Return NULL if not found.
+pomelo_qjs_session_column_t * pomelo_qjs_session_table_find_column(
+    pomelo_qjs_session_table_t * table,
+    const char * name
+);
+
+
+/// @brief Zero a row of all columns of table
+void pomelo_qjs_session_table_clear_row(
+    pomelo_qjs_session_table_t * table,
+    int32_t index
+);
+
+
+/// @brief Detach the table from its socket
+void pomelo_qjs_session_table_detach(pomelo_qjs_session_table_t * table);
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+
+/// @brief SessionTable.constructor(socket: Socket, capacity: number)
+JSValue pomelo_qjs_session_table_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+);
+
+
+/// @brief Finalizer of session table
+void pomelo_qjs_session_table_finalizer(JSRuntime * rt, JSValue val);
+
+
+/// @brief SessionTable.column(name: string, type: ColumnType): TypedArray
+JSValue pomelo_qjs_session_table_column(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief SessionTable.clearRow(index: number): void
+JSValue pomelo_qjs_session_table_clear_row_js(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief readonly SessionTable.capacity: number
+JSValue pomelo_qjs_session_table_get_capacity(JSContext * ctx, JSValue thiz);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QUICKJS_TABLE_SRC_H
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "token.h"
 #include "context.h"
+#include "shard.h"
 #include "pomelo/random.h"
 #include "pomelo/constants.h"
 #include "pomelo/token.h"
@@ -30,6 +31,15 @@ int pomelo_qjs_init_token_module(JSContext * ctx, JSModuleDef * m) {
     );
     JS_SetPropertyStr(ctx, token, "randomBuffer", fn_random_buffer);
 
+    // Create static functions `shardAddress`
+    JSValue fn_shard_address = JS_NewCFunction(
+        ctx,
+        pomelo_qjs_token_shard_address,
+        "shardAddress",
+        /* argc = */ 3
+    );
+    JS_SetPropertyStr(ctx, token, "shardAddress", fn_shard_address);
+
     // Add constants
     JS_SetPropertyStr(
         ctx,
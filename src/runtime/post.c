@@ -0,0 +1,233 @@
+#include <assert.h>
+#include <string.h>
+#include "logger/logger.h"
+#include "post.h"
+
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+
+static JSCFunctionListEntry post_global_funcs[] = {
+    JS_CGETSET_DEF(
+        "onExternalEvent",
+        pomelo_qjs_post_get_on_external_event,
+        pomelo_qjs_post_set_on_external_event
+    ),
+};
+
+
+/// @brief Pop the front post. It is only called by the loop thread.
+/// @return Returns the post (owned by the caller) or NULL if empty
+static pomelo_qjs_post_t * post_pop(pomelo_qjs_runtime_uv_t * runtime) {
+    pomelo_qjs_post_t * stub = runtime->post_head;
+    pomelo_qjs_post_t * front =
+        atomic_load_explicit(&stub->next, memory_order_acquire);
+    if (!front) return NULL;
+
+    // The front becomes the new stub, its content moves to the old stub
+    stub->callback = front->callback;
+    stub->data = front->data;
+    front->callback = NULL;
+    front->data = NULL;
+
+    runtime->post_head = front;
+    return stub;
+}
+
+
+/// @brief Run the pending posts
+/// @return Returns true if some posts are left
+static bool post_drain(pomelo_qjs_runtime_uv_t * runtime, size_t limit) {
+    pomelo_allocator_t * allocator = runtime->base.allocator;
+    pomelo_qjs_post_t * post = NULL;
+    for (size_t i = 0; i < limit; i++) {
+        post = post_pop(runtime);
+        if (!post) return false;
+
+        pomelo_qjs_runtime_post_callback callback = post->callback;
+        void * data = post->data;
+        pomelo_allocator_free(allocator, post);
+        callback(&runtime->base, data);
+    }
+
+    return atomic_load_explicit(
+        &runtime->post_head->next, memory_order_acquire
+    ) != NULL;
+}
+
+
+/// @brief Wakeup callback of posts
+static void post_on_async(uv_async_t * handle) {
+    pomelo_qjs_runtime_uv_t * runtime = handle->data;
+    if (post_drain(runtime, POMELO_QJS_POST_BATCH_SIZE)) {
+        uv_async_send(handle); // Continue after polling IO
+    }
+}
+
+
+int pomelo_qjs_post_init(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    runtime->on_external_event = JS_NULL;
+    atomic_init(&runtime->post_open, false);
+    atomic_init(&runtime->post_signalers, 0);
+
+    pomelo_qjs_post_t * stub = pomelo_allocator_malloc_t(
+        runtime->base.allocator, pomelo_qjs_post_t
+    );
+    if (!stub) return -1;
+    memset(stub, 0, sizeof(pomelo_qjs_post_t));
+    atomic_init(&stub->next, NULL);
+    runtime->post_head = stub;
+    atomic_init(&runtime->post_tail, stub);
+
+    uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(runtime->platform);
+    if (uv_async_init(uv_loop, &runtime->post_async, post_on_async)) {
+        return -1;
+    }
+    runtime->post_async.data = runtime;
+    atomic_store(&runtime->post_open, true);
+
+    // Only the hook keeps the loop alive
+    uv_unref((uv_handle_t *) &runtime->post_async);
+
+    JSContext * ctx = runtime->base.ctx;
+    JSValue global = JS_GetGlobalObject(ctx);
+    JS_SetPropertyFunctionList(
+        ctx, global, post_global_funcs, countof(post_global_funcs)
+    );
+    JS_FreeValue(ctx, global);
+    return 0;
+}
+
+
+void pomelo_qjs_post_cleanup(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    if (!runtime->post_head) return;
+
+    // Refuse new posts, then wait for the posts which are being pushed
+    bool open = atomic_exchange(&runtime->post_open, false);
+    while (atomic_load(&runtime->post_signalers) > 0) {
+        // Spin, posting never blocks
+    }
+
+    // The queue is stable now
+    post_drain(runtime, SIZE_MAX);
+    pomelo_allocator_free(runtime->base.allocator, runtime->post_head);
+    runtime->post_head = NULL;
+    atomic_store(&runtime->post_tail, NULL);
+
+    if (open) {
+        uv_close((uv_handle_t *) &runtime->post_async, NULL);
+    }
+
+    if (runtime->base.ctx) {
+        JS_FreeValue(runtime->base.ctx, runtime->on_external_event);
+    }
+    runtime->on_external_event = JS_NULL;
+}
+
+
+int pomelo_qjs_runtime_post(
+    pomelo_qjs_runtime_t * runtime,
+    pomelo_qjs_runtime_post_callback callback,
+    void * data
+) {
+    assert(runtime != NULL);
+    assert(callback != NULL);
+    pomelo_qjs_runtime_uv_t * impl = (pomelo_qjs_runtime_uv_t *) runtime;
+
+    // The cleanup waits for the signalers before releasing the queue
+    atomic_fetch_add(&impl->post_signalers, 1);
+    if (!atomic_load(&impl->post_open)) {
+        atomic_fetch_sub(&impl->post_signalers, 1);
+        return -1;
+    }
+
+    pomelo_qjs_post_t * post =
+        pomelo_allocator_malloc_t(runtime->allocator, pomelo_qjs_post_t);
+    if (!post) {
+        atomic_fetch_sub(&impl->post_signalers, 1);
+        return -1;
+    }
+    atomic_init(&post->next, NULL);
+    post->callback = callback;
+    post->data = data;
+
+    pomelo_qjs_post_t * prev = atomic_exchange_explicit(
+        &impl->post_tail, post, memory_order_acq_rel
+    );
+    atomic_store_explicit(&prev->next, post, memory_order_release);
+
+    // Multiple sends are coalesced into a single wakeup
+    uv_async_send(&impl->post_async);
+    atomic_fetch_sub(&impl->post_signalers, 1);
+    return 0;
+}
+
+
+int pomelo_qjs_runtime_emit_external_event(
+    pomelo_qjs_runtime_t * runtime,
+    JSValue event
+) {
+    assert(runtime != NULL);
+    pomelo_qjs_runtime_uv_t * impl = (pomelo_qjs_runtime_uv_t *) runtime;
+    JSContext * ctx = runtime->ctx;
+    if (!JS_IsFunction(ctx, impl->on_external_event)) return -1;
+
+    // The hook may be replaced by itself
+    JSValue hook = JS_DupValue(ctx, impl->on_external_event);
+    JSValue ret = JS_Call(ctx, hook, JS_UNDEFINED, 1, &event);
+    JS_FreeValue(ctx, hook);
+
+    int result = 0;
+    if (JS_IsException(ret)) {
+        JSValue exception = JS_GetException(ctx);
+        const char * str = JS_ToCString(ctx, exception);
+        pomelo_qjs_logger_log(
+            runtime->context,
+            POMELO_QJS_LOGGER_LEVEL_ERROR,
+            "[onExternalEvent] %s",
+            str ? str : "[Exception]"
+        );
+        if (str) JS_FreeCString(ctx, str);
+        JS_FreeValue(ctx, exception);
+        result = -1;
+    }
+    JS_FreeValue(ctx, ret);
+    return result;
+}
+
+
+JSValue pomelo_qjs_post_get_on_external_event(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    (void) thiz;
+
+    pomelo_qjs_runtime_uv_t * runtime =
+        (pomelo_qjs_runtime_uv_t *) pomelo_qjs_runtime_from_js_context(ctx);
+    if (!runtime) return JS_NULL;
+    return JS_DupValue(ctx, runtime->on_external_event);
+}
+
+
+JSValue pomelo_qjs_post_set_on_external_event(
+    JSContext * ctx, JSValue thiz, JSValue value
+) {
+    assert(ctx != NULL);
+    (void) thiz;
+
+    pomelo_qjs_runtime_uv_t * runtime =
+        (pomelo_qjs_runtime_uv_t *) pomelo_qjs_runtime_from_js_context(ctx);
+    if (!runtime) return JS_ThrowTypeError(ctx, "Invalid runtime");
+
+    JS_FreeValue(ctx, runtime->on_external_event);
+    runtime->on_external_event = JS_DupValue(ctx, value);
+
+    // Listening scripts are kept alive for external events
+    uv_handle_t * handle = (uv_handle_t *) &runtime->post_async;
+    if (JS_IsFunction(ctx, value)) {
+        uv_ref(handle);
+    } else {
+        uv_unref(handle);
+    }
+    return JS_UNDEFINED;
+}
@@ -0,0 +1,53 @@
+#ifndef POMELO_QJS_POST_SRC_H
+#define POMELO_QJS_POST_SRC_H
+#include "quickjs.h"
+#include "runtime-uv.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Posted work.
+ *
+ * Any thread is able to post work to a runtime. Posts are pushed to a
+ * lock-free multi-producer single-consumer queue and the loop is woken up by
+ * a single uv_async handle, which drains the queue in batches.
+ */
+
+
+/// @brief The maximum number of posts which are run by a wakeup. The rest are
+/// run by the next wakeup, so that IO is not starved.
+#define POMELO_QJS_POST_BATCH_SIZE 256
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the posts and the `onExternalEvent` hook of runtime
+int pomelo_qjs_post_init(pomelo_qjs_runtime_uv_t * runtime);
+
+
+/// @brief Run the pending posts and release the posts of runtime
+void pomelo_qjs_post_cleanup(pomelo_qjs_runtime_uv_t * runtime);
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+
+/// @brief get onExternalEvent: ((event: any) => void) | null
+JSValue pomelo_qjs_post_get_on_external_event(JSContext * ctx, JSValue thiz);
+
+
+/// @brief set onExternalEvent: ((event: any) => void) | null
+JSValue pomelo_qjs_post_set_on_external_event(
+    JSContext * ctx, JSValue thiz, JSValue value
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QJS_POST_SRC_H
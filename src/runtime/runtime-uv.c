@@ -2,6 +2,10 @@
 #include <string.h>
 #include "core/core.h"
 #include "runtime-uv.h"
+#include "worker.h"
+#include "post.h"
+#include "shards.h"
+#include "task-pool.h"
 
 
 pomelo_qjs_runtime_t * pomelo_qjs_runtime_uv_create(
@@ -18,13 +22,17 @@ pomelo_qjs_runtime_t * pomelo_qjs_runtime_uv_create(
     if (!runtime) return NULL; // Failed to allocate new runtime
     memset(runtime, 0, sizeof(pomelo_qjs_runtime_uv_t));
 
-    // Initialize UV loop
-    uv_loop_init(&runtime->uv_loop);
+    // Initialize UV loop, unless the caller provides one
+    uv_loop_t * uv_loop = options->uv_loop;
+    if (!uv_loop) {
+        uv_loop = &runtime->uv_loop;
+        uv_loop_init(uv_loop);
+    }
 
     // Create new platform
     pomelo_platform_uv_options_t platform_options = {
         .allocator = allocator,
-        .uv_loop = &runtime->uv_loop
+        .uv_loop = uv_loop
     };
     pomelo_platform_t * platform = pomelo_platform_uv_create(&platform_options);
     if (!platform) {
@@ -43,16 +51,53 @@ pomelo_qjs_runtime_t * pomelo_qjs_runtime_uv_create(
         return NULL;
     }
 
+    // Install the Worker class
+    if (pomelo_qjs_worker_init(runtime) < 0) {
+        pomelo_qjs_runtime_uv_destroy((pomelo_qjs_runtime_t *) runtime);
+        return NULL;
+    }
+
+    // Install the TaskPool class
+    if (pomelo_qjs_task_pool_init(runtime) < 0) {
+        pomelo_qjs_runtime_uv_destroy((pomelo_qjs_runtime_t *) runtime);
+        return NULL;
+    }
+
+    // Install the shard spawner of Socket.listen
+    if (pomelo_qjs_shards_init(runtime) < 0) {
+        pomelo_qjs_runtime_uv_destroy((pomelo_qjs_runtime_t *) runtime);
+        return NULL;
+    }
+
+    // Install the posts and the onExternalEvent hook
+    if (pomelo_qjs_post_init(runtime) < 0) {
+        pomelo_qjs_runtime_uv_destroy((pomelo_qjs_runtime_t *) runtime);
+        return NULL;
+    }
+
     return &runtime->base;
 }
 
 
 void pomelo_qjs_runtime_uv_destroy(pomelo_qjs_runtime_t * runtime) {
     assert(runtime != NULL);
+    pomelo_qjs_runtime_uv_t * impl = (pomelo_qjs_runtime_uv_t *) runtime;
+
+    // Run the pending posts while scripts are still alive
+    pomelo_qjs_post_cleanup(impl);
+
+    // Join the shards, workers and task pools, then run the close callbacks
+    // of their handles
+    pomelo_qjs_shards_cleanup(impl);
+    pomelo_qjs_worker_cleanup(impl);
+    pomelo_qjs_task_pool_cleanup(impl);
+    if (impl->platform) {
+        uv_run(pomelo_platform_uv_get_uv_loop(impl->platform), UV_RUN_NOWAIT);
+    }
+
     // Cleanup base first
     pomelo_qjs_runtime_cleanup(runtime);
 
-    pomelo_qjs_runtime_uv_t * impl = (pomelo_qjs_runtime_uv_t *) runtime;
     // Destroy the platform
     if (impl->platform) {
         pomelo_platform_uv_destroy(impl->platform);
@@ -75,7 +120,7 @@ void pomelo_qjs_runtime_main_loop(pomelo_qjs_runtime_t * runtime) {
     assert(rt != NULL);
 
     bool running = true;
-    while (running) {
+    while (running && !impl->stopping) {
         // Execute all pending jobs first
         while (JS_IsJobPending(rt)) {
             JSContext * ctx;
@@ -89,6 +134,37 @@ void pomelo_qjs_runtime_main_loop(pomelo_qjs_runtime_t * runtime) {
 }
 
 
+int pomelo_qjs_runtime_poll(
+    pomelo_qjs_runtime_t * runtime,
+    uint64_t budget_us
+) {
+    assert(runtime != NULL);
+
+    pomelo_qjs_runtime_uv_t * impl = (pomelo_qjs_runtime_uv_t *) runtime;
+    if (impl->stopping) return 0;
+
+    uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(impl->platform);
+    assert(uv_loop != NULL);
+
+    JSRuntime * rt = runtime->rt;
+    assert(rt != NULL);
+
+    // Poll IO without blocking
+    bool running = (uv_run(uv_loop, UV_RUN_NOWAIT) > 0);
+
+    // Then execute the pending jobs within the budget
+    uint64_t deadline = uv_hrtime() + budget_us * 1000;
+    while (JS_IsJobPending(rt)) {
+        JSContext * ctx;
+        JS_ExecutePendingJob(rt, &ctx);
+        if (budget_us > 0 && uv_hrtime() >= deadline) break;
+    }
+
+    running |= JS_IsJobPending(rt);
+    return (running && !impl->stopping) ? 1 : 0;
+}
+
+
 JSValue pomelo_qjs_platform_statistic(
     JSContext * ctx, pomelo_platform_t * platform
 ) {
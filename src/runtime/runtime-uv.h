@@ -1,7 +1,9 @@
 #ifndef POMELO_QJS_RUNTIME_UV_SRC_H
 #define POMELO_QJS_RUNTIME_UV_SRC_H
+#include <stdatomic.h>
 #include "pomelo/platforms/platform-uv.h"
 #include "pomelo-qjs/runtimes/runtime-uv.h"
+#include "utils/list.h"
 #include "runtime.h"
 #ifdef __cplusplus
 extern "C" {
@@ -11,16 +13,77 @@ extern "C" {
 /// @brief Runtime with uv platform
 typedef struct pomelo_qjs_runtime_uv_s pomelo_qjs_runtime_uv_t;
 
+/// @brief A posted work
+typedef struct pomelo_qjs_post_s pomelo_qjs_post_t;
+
+
+struct pomelo_qjs_post_s {
+    /// @brief The next post in queue
+    _Atomic(pomelo_qjs_post_t *) next;
+
+    /// @brief The callback
+    pomelo_qjs_runtime_post_callback callback;
+
+    /// @brief The data of callback
+    void * data;
+};
+
 
 struct pomelo_qjs_runtime_uv_s {
     /// @brief Base runtime
     pomelo_qjs_runtime_t base;
 
-    /// @brief UV loop
+    /// @brief UV loop. It is unused if the loop is owned by the caller.
     uv_loop_t uv_loop;
 
     /// @brief Platform
     pomelo_platform_t * platform;
+
+    /// @brief Whether the main loop is requested to stop
+    bool stopping;
+
+    /// @brief The class of worker
+    JSClassID class_worker_id;
+
+    /// @brief Running workers which are created by this runtime
+    pomelo_list_t * workers;
+
+    /// @brief The worker which runs this runtime, or NULL for the main runtime
+    struct pomelo_qjs_worker_s * worker;
+
+    /// @brief The shards which are spawned by this runtime
+    struct pomelo_qjs_shard_s * shards;
+
+    /// @brief The number of spawned shards
+    size_t nshards;
+
+    /// @brief The class of task pool
+    JSClassID class_task_pool_id;
+
+    /// @brief Open task pools which are created by this runtime
+    pomelo_list_t * task_pools;
+
+    /* Posts */
+
+    /// @brief The stub post, only accessed by the loop thread. The next post
+    /// of stub is the front of queue.
+    pomelo_qjs_post_t * post_head;
+
+    /// @brief The last post, it is exchanged by the posting threads
+    _Atomic(pomelo_qjs_post_t *) post_tail;
+
+    /// @brief The wakeup handle of posts
+    uv_async_t post_async;
+
+    /// @brief Whether posts are accepted. It is set once the wakeup handle is
+    /// initialized and cleared by the loop thread before the cleanup.
+    _Atomic(bool) post_open;
+
+    /// @brief The number of posting threads which are using the queue
+    _Atomic(size_t) post_signalers;
+
+    /// @brief The external event hook of scripts
+    JSValue on_external_event;
 };
 
 
@@ -392,6 +392,11 @@ void pomelo_qjs_runtime_cleanup(pomelo_qjs_runtime_t * runtime) {
         runtime->rt = NULL;
     }
 
+    if (runtime->main_module) {
+        pomelo_allocator_free(runtime->allocator, runtime->main_module);
+        runtime->main_module = NULL;
+    }
+
     // Do not free runtime here
 }
 
@@ -449,6 +454,16 @@ JSValue pomelo_qjs_runtime_load_module(
 ) {
     assert(runtime != NULL);
     assert(module_name != NULL);
+
+    if (!runtime->main_module) {
+        size_t length = strlen(module_name);
+        runtime->main_module =
+            pomelo_allocator_malloc(runtime->allocator, length + 1);
+        if (runtime->main_module) {
+            memcpy(runtime->main_module, module_name, length + 1);
+        }
+    }
+
     return load_module(runtime, module_name);
 }
 
@@ -481,3 +496,18 @@ int pomelo_qjs_runtime_evaluate_module(
 
     return ret;
 }
+
+
+int pomelo_qjs_runtime_evaluate(
+    pomelo_qjs_runtime_t * runtime,
+    JSValue module_val
+) {
+    assert(runtime != NULL);
+    return eval_module(runtime, module_val);
+}
+
+
+void pomelo_qjs_runtime_run(pomelo_qjs_runtime_t * runtime) {
+    assert(runtime != NULL);
+    pomelo_qjs_runtime_main_loop(runtime);
+}
@@ -49,6 +49,10 @@ struct pomelo_qjs_runtime_s {
 
     /// @brief Flags which used internally
     uint32_t flags;
+
+    /// @brief The name of the first module loaded by user. Shards run it as
+    /// their entry module.
+    char * main_module;
 };
 
 
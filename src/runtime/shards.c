@@ -0,0 +1,173 @@
+#include <assert.h>
+#include <string.h>
+#include "core/context.h"
+#include "core/shard.h"
+#include "logger/logger.h"
+#include "shards.h"
+
+
+/// @brief Interrupt the shard JS code once it is stopping
+static int shard_interrupt_handler(JSRuntime * rt, void * opaque) {
+    (void) rt;
+    pomelo_qjs_shard_t * shard = opaque;
+    return atomic_load(&shard->stopping) ? 1 : 0;
+}
+
+
+/// @brief Wakeup callback of shard loop
+static void shard_on_async(uv_async_t * handle) {
+    pomelo_qjs_shard_t * shard = handle->data;
+    if (!atomic_load(&shard->stopping)) return;
+
+    shard->runtime->stopping = true;
+    uv_stop(handle->loop);
+}
+
+
+/// @brief Log the pending exception of shard
+static void shard_log_exception(pomelo_qjs_shard_t * shard, JSContext * ctx) {
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    JSValue exception = JS_GetException(ctx);
+    const char * str = JS_ToCString(ctx, exception);
+    pomelo_qjs_logger_log(
+        context,
+        POMELO_QJS_LOGGER_LEVEL_ERROR,
+        "[Shard %zu] %s",
+        shard->index,
+        str ? str : "[Exception]"
+    );
+    if (str) JS_FreeCString(ctx, str);
+    JS_FreeValue(ctx, exception);
+}
+
+
+/// @brief Run the entry module on the shard runtime
+static void shard_run(
+    pomelo_qjs_shard_t * shard,
+    pomelo_qjs_runtime_uv_t * runtime
+) {
+    pomelo_qjs_runtime_t * base = &runtime->base;
+    pomelo_qjs_runtime_set_extra(base, shard->extra);
+    base->context->shard_index = shard->index;
+    base->context->shard_count = shard->count;
+    JS_SetInterruptHandler(base->rt, shard_interrupt_handler, shard);
+
+    uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(runtime->platform);
+    if (uv_async_init(uv_loop, &shard->async, shard_on_async)) return;
+    shard->async.data = shard;
+    shard->runtime = runtime;
+
+    // Listening sockets keep the shard alive, not the wakeup handle
+    uv_unref((uv_handle_t *) &shard->async);
+    atomic_store(&shard->open, true);
+
+    // The shard may be stopped before the handle is open
+    uv_async_send(&shard->async);
+
+    JSValue module_val =
+        pomelo_qjs_runtime_load_module(base, shard->module_name);
+    if (JS_IsException(module_val)) {
+        shard_log_exception(shard, base->ctx);
+    } else {
+        pomelo_qjs_runtime_evaluate_module(base, module_val);
+    }
+
+    // Wait for the primary calls which are signaling the handle
+    atomic_store(&shard->open, false);
+    while (atomic_load(&shard->signalers) > 0) {
+        // Spin, signaling never blocks
+    }
+    uv_close((uv_handle_t *) &shard->async, NULL);
+    uv_run(uv_loop, UV_RUN_NOWAIT);
+    shard->runtime = NULL;
+}
+
+
+/// @brief Entry of shard thread
+static void shard_thread_main(void * arg) {
+    pomelo_qjs_shard_t * shard = arg;
+
+    pomelo_qjs_runtime_uv_options_t options = {
+        .allocator = shard->allocator
+    };
+    pomelo_qjs_runtime_t * runtime = pomelo_qjs_runtime_uv_create(&options);
+    if (!runtime) return;
+
+    shard_run(shard, (pomelo_qjs_runtime_uv_t *) runtime);
+    pomelo_qjs_runtime_uv_destroy(runtime);
+}
+
+
+/// @brief Spawn the loops of shards [1, nshards). This is the spawn_shards
+/// hook of the contexts of uv runtimes.
+static int shards_spawn(pomelo_qjs_context_t * context, size_t nshards) {
+    assert(context != NULL);
+    pomelo_qjs_runtime_uv_t * runtime = pomelo_qjs_context_get_extra(context);
+    assert(runtime != NULL);
+
+    if (nshards <= 1 || runtime->shards) return 0;
+    if (!runtime->base.main_module) return -1; // No entry module
+
+    pomelo_allocator_t * allocator = runtime->base.allocator;
+    size_t size = (nshards - 1) * sizeof(pomelo_qjs_shard_t);
+    pomelo_qjs_shard_t * shards = pomelo_allocator_malloc(allocator, size);
+    if (!shards) return -1;
+    memset(shards, 0, size);
+    runtime->shards = shards;
+    runtime->nshards = nshards - 1;
+
+    for (size_t i = 0; i < runtime->nshards; i++) {
+        pomelo_qjs_shard_t * shard = shards + i;
+        shard->allocator = allocator;
+        shard->module_name = runtime->base.main_module;
+        shard->extra = runtime->base.extra;
+        shard->index = i + 1; // The primary is shard 0
+        shard->count = nshards;
+        atomic_init(&shard->stopping, false);
+        atomic_init(&shard->open, false);
+        atomic_init(&shard->signalers, 0);
+
+        if (uv_thread_create(&shard->thread, shard_thread_main, shard)) {
+            return -1; // Started shards are stopped with the runtime
+        }
+        shard->started = true;
+    }
+
+    return 0;
+}
+
+
+int pomelo_qjs_shards_init(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    runtime->base.context->spawn_shards = shards_spawn;
+    return 0;
+}
+
+
+void pomelo_qjs_shards_cleanup(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    if (!runtime->shards) return;
+
+    for (size_t i = 0; i < runtime->nshards; i++) {
+        pomelo_qjs_shard_t * shard = runtime->shards + i;
+        if (!shard->started) continue;
+
+        atomic_store(&shard->stopping, true);
+        atomic_fetch_add(&shard->signalers, 1);
+        if (atomic_load(&shard->open)) {
+            uv_async_send(&shard->async);
+        }
+        atomic_fetch_sub(&shard->signalers, 1);
+    }
+
+    for (size_t i = 0; i < runtime->nshards; i++) {
+        pomelo_qjs_shard_t * shard = runtime->shards + i;
+        if (shard->started) {
+            uv_thread_join(&shard->thread);
+        }
+    }
+
+    pomelo_allocator_free(runtime->base.allocator, runtime->shards);
+    runtime->shards = NULL;
+    runtime->nshards = 0;
+}
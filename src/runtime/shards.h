@@ -0,0 +1,81 @@
+#ifndef POMELO_QJS_SHARDS_SRC_H
+#define POMELO_QJS_SHARDS_SRC_H
+#include <stdatomic.h>
+#include <uv.h>
+#include "runtime-uv.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Shard loops.
+ *
+ * The uv runtime installs the spawn_shards hook of its context, which the
+ * core calls on the first sharded listen. A sharded primary runtime spawns
+ * one thread per extra shard. Each thread creates its own uv runtime, marks
+ * its context with the shard index and evaluates the entry module of
+ * primary. The shards are stopped and joined when the primary runtime is
+ * destroyed.
+ */
+
+
+/// @brief A shard loop which is spawned by the primary runtime
+typedef struct pomelo_qjs_shard_s pomelo_qjs_shard_t;
+
+
+struct pomelo_qjs_shard_s {
+    /// @brief The allocator. It is shared by both threads.
+    pomelo_allocator_t * allocator;
+
+    /// @brief The entry module. It is owned by the primary runtime.
+    const char * module_name;
+
+    /// @brief The extra data of primary runtime
+    void * extra;
+
+    /// @brief The index of shard
+    size_t index;
+
+    /// @brief The number of shards
+    size_t count;
+
+    /// @brief The shard thread
+    uv_thread_t thread;
+
+    /// @brief Whether the thread has been started
+    bool started;
+
+    /// @brief Whether the shard is requested to stop
+    atomic_bool stopping;
+
+    /// @brief Whether the wakeup handle of shard can be signaled
+    atomic_bool open;
+
+    /// @brief The number of primary calls which are signaling the shard
+    atomic_int signalers;
+
+    /// @brief The wakeup handle of shard loop
+    uv_async_t async;
+
+    /// @brief The shard runtime
+    pomelo_qjs_runtime_uv_t * runtime;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Install the shard spawner of runtime
+/// @return Returns 0 on success or -1 on failure
+int pomelo_qjs_shards_init(pomelo_qjs_runtime_uv_t * runtime);
+
+
+/// @brief Stop and join all shards of runtime
+void pomelo_qjs_shards_cleanup(pomelo_qjs_runtime_uv_t * runtime);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QJS_SHARDS_SRC_H
@@ -0,0 +1,875 @@
+#include <assert.h>
+#include <string.h>
+#include "task-pool.h"
+
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+
+/// @brief The runner of tasks which is evaluated by every thread runtime
+static const char task_pool_runner[] =
+    "(async (moduleName, functionName, args) => {\n"
+    "    const module = await import(moduleName);\n"
+    "    return module[functionName](...args);\n"
+    "})";
+
+
+static JSCFunctionListEntry task_pool_funcs[] = {
+    JS_CFUNC_DEF("run", 3, pomelo_qjs_task_pool_run),
+    JS_CFUNC_DEF("close", 0, pomelo_qjs_task_pool_close),
+    JS_CGETSET_DEF("threads", pomelo_qjs_task_pool_get_threads, NULL),
+    JS_CGETSET_DEF("pending", pomelo_qjs_task_pool_get_pending, NULL),
+};
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   Deque                                    */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Push a task to the bottom of deque
+static void task_deque_push_bottom(
+    pomelo_qjs_task_deque_t * deque,
+    pomelo_qjs_task_t * task
+) {
+    uv_mutex_lock(&deque->mutex);
+    task->next = NULL;
+    task->prev = deque->bottom;
+    if (deque->bottom) {
+        deque->bottom->next = task;
+    } else {
+        deque->top = task;
+    }
+    deque->bottom = task;
+    uv_mutex_unlock(&deque->mutex);
+}
+
+
+/// @brief Pop a task from the bottom of deque. It is called by the owner.
+static pomelo_qjs_task_t * task_deque_pop_bottom(
+    pomelo_qjs_task_deque_t * deque
+) {
+    uv_mutex_lock(&deque->mutex);
+    pomelo_qjs_task_t * task = deque->bottom;
+    if (task) {
+        deque->bottom = task->prev;
+        if (deque->bottom) {
+            deque->bottom->next = NULL;
+        } else {
+            deque->top = NULL;
+        }
+        task->prev = NULL;
+    }
+    uv_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+
+/// @brief Steal a task from the top of deque. It is called by the thieves.
+static pomelo_qjs_task_t * task_deque_steal_top(
+    pomelo_qjs_task_deque_t * deque
+) {
+    uv_mutex_lock(&deque->mutex);
+    pomelo_qjs_task_t * task = deque->top;
+    if (task) {
+        deque->top = task->next;
+        if (deque->top) {
+            deque->top->prev = NULL;
+        } else {
+            deque->bottom = NULL;
+        }
+        task->next = NULL;
+    }
+    uv_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   Tasks                                    */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Copy a string with allocator
+static char * task_strdup(
+    pomelo_allocator_t * allocator,
+    const char * str,
+    size_t length
+) {
+    char * copy = pomelo_allocator_malloc(allocator, length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+
+/// @brief Replace the data of task with a copy of buffer
+/// @return Returns 0 on success or -1 on failure
+static int task_set_data(
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_task_t * task,
+    const uint8_t * data,
+    size_t size
+) {
+    if (task->data) {
+        pomelo_allocator_free(allocator, task->data);
+        task->data = NULL;
+        task->size = 0;
+    }
+
+    task->data = pomelo_allocator_malloc(allocator, size > 0 ? size : 1);
+    if (!task->data) return -1;
+    memcpy(task->data, data, size);
+    task->size = size;
+    return 0;
+}
+
+
+/// @brief Mark the task failed with message
+static void task_set_error(
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_task_t * task,
+    const char * message
+) {
+    task->failed = true;
+    if (task_set_data(
+        allocator,
+        task,
+        (const uint8_t *) message,
+        strlen(message) + 1
+    ) < 0) {
+        task->size = 0; // Rejected with the default message
+    }
+}
+
+
+/// @brief Mark the task failed with the pending exception of context
+static void task_set_exception(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_task_t * task
+) {
+    JSValue exception = JS_GetException(ctx);
+    const char * str = JS_ToCString(ctx, exception);
+    task_set_error(allocator, task, str ? str : "Task failed");
+    if (str) JS_FreeCString(ctx, str);
+    JS_FreeValue(ctx, exception);
+}
+
+
+/// @brief Free the task
+static void task_free(pomelo_qjs_task_pool_t * pool, pomelo_qjs_task_t * task) {
+    pomelo_allocator_t * allocator = pool->allocator;
+    JSContext * ctx = pool->runtime->base.ctx;
+
+    JS_FreeValue(ctx, task->resolving_funcs[0]);
+    JS_FreeValue(ctx, task->resolving_funcs[1]);
+    if (task->module_name) {
+        pomelo_allocator_free(allocator, task->module_name);
+    }
+    if (task->function_name) {
+        pomelo_allocator_free(allocator, task->function_name);
+    }
+    if (task->data) {
+        pomelo_allocator_free(allocator, task->data);
+    }
+    pomelo_allocator_free(allocator, task);
+}
+
+
+/// @brief Release the outstanding reference of a task. The pool object may be
+/// finalized here.
+static void task_pool_release_outstanding(pomelo_qjs_task_pool_t * pool) {
+    assert(pool->outstanding > 0);
+    if (--pool->outstanding > 0) return;
+
+    uv_unref((uv_handle_t *) &pool->async);
+    JS_FreeValue(pool->runtime->base.ctx, pool->thiz);
+}
+
+
+/// @brief Resolve or reject the promise of task, then free the task
+static void task_settle(
+    pomelo_qjs_task_pool_t * pool,
+    pomelo_qjs_task_t * task
+) {
+    JSContext * ctx = pool->runtime->base.ctx;
+    JSValue value = JS_UNDEFINED;
+    bool failed = task->failed;
+
+    if (failed) {
+        value = JS_NewError(ctx);
+        const char * message = (task->size > 0)
+            ? (const char *) task->data
+            : "Task failed";
+        JS_DefinePropertyValueStr(
+            ctx,
+            value,
+            "message",
+            JS_NewString(ctx, message),
+            JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE
+        );
+    } else {
+        value = JS_ReadObject(
+            ctx, task->data, task->size, JS_READ_OBJ_REFERENCE
+        );
+        if (JS_IsException(value)) {
+            value = JS_GetException(ctx);
+            failed = true;
+        }
+    }
+
+    JSValue ret = JS_Call(
+        ctx, task->resolving_funcs[failed ? 1 : 0], JS_UNDEFINED, 1, &value
+    );
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, value);
+
+    task_free(pool, task);
+    task_pool_release_outstanding(pool);
+}
+
+
+/// @brief Pop the first completed task
+static pomelo_qjs_task_t * task_pool_pop_completed(
+    pomelo_qjs_task_pool_t * pool
+) {
+    uv_mutex_lock(&pool->completed_mutex);
+    pomelo_qjs_task_t * task = pool->completed_head;
+    if (task) {
+        pool->completed_head = task->next;
+        if (!pool->completed_head) {
+            pool->completed_tail = NULL;
+        }
+        task->next = NULL;
+    }
+    uv_mutex_unlock(&pool->completed_mutex);
+    return task;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  Threads                                   */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Interrupt the running task once the pool is closing
+static int task_thread_interrupt_handler(JSRuntime * rt, void * opaque) {
+    (void) rt;
+    pomelo_qjs_task_pool_t * pool = opaque;
+    return atomic_load(&pool->closing) ? 1 : 0;
+}
+
+
+/// @brief Take a task for thread. Its own deque is preferred, otherwise a task
+/// is stolen from the other deques.
+/// @return Returns the task or NULL if the pool is closing
+static pomelo_qjs_task_t * task_thread_take(pomelo_qjs_task_thread_t * thread) {
+    pomelo_qjs_task_pool_t * pool = thread->pool;
+    size_t nthreads = pool->nthreads;
+
+    while (!atomic_load(&pool->closing)) {
+        pomelo_qjs_task_t * task = task_deque_pop_bottom(&thread->deque);
+        for (size_t i = 1; !task && i < nthreads; i++) {
+            pomelo_qjs_task_thread_t * victim =
+                pool->threads + (thread->index + i) % nthreads;
+            task = task_deque_steal_top(&victim->deque);
+        }
+
+        uv_mutex_lock(&pool->mutex);
+        if (task) {
+            pool->queued--;
+            uv_mutex_unlock(&pool->mutex);
+            return task;
+        }
+
+        // Sleep until new tasks are queued
+        while (pool->queued == 0 && !atomic_load(&pool->closing)) {
+            uv_cond_wait(&pool->cond, &pool->mutex);
+        }
+        uv_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+
+/// @brief Run a task on thread runtime. The data of task is replaced with
+/// the result.
+static void task_thread_execute(
+    pomelo_qjs_task_pool_t * pool,
+    pomelo_qjs_runtime_uv_t * runtime,
+    JSValue runner,
+    pomelo_qjs_task_t * task
+) {
+    pomelo_allocator_t * allocator = pool->allocator;
+    JSContext * ctx = runtime->base.ctx;
+    JSRuntime * rt = runtime->base.rt;
+
+    JSValue args = JS_ReadObject(
+        ctx, task->data, task->size, JS_READ_OBJ_REFERENCE
+    );
+    if (JS_IsException(args)) {
+        task_set_exception(ctx, allocator, task);
+        return;
+    }
+
+    JSValue argv[3] = {
+        JS_NewString(ctx, task->module_name),
+        JS_NewString(ctx, task->function_name),
+        args
+    };
+    JSValue promise = JS_Call(ctx, runner, JS_UNDEFINED, countof(argv), argv);
+    for (size_t i = 0; i < countof(argv); i++) {
+        JS_FreeValue(ctx, argv[i]);
+    }
+    if (JS_IsException(promise)) {
+        task_set_exception(ctx, allocator, task);
+        return;
+    }
+
+    // Drive the jobs and the loop of thread until the task settles
+    uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(runtime->platform);
+    while (JS_PromiseState(ctx, promise) == JS_PROMISE_PENDING) {
+        while (JS_IsJobPending(rt)) {
+            JSContext * job_ctx;
+            JS_ExecutePendingJob(rt, &job_ctx);
+        }
+
+        if (JS_PromiseState(ctx, promise) != JS_PROMISE_PENDING) break;
+        if (atomic_load(&pool->closing)) break;
+        if (uv_run(uv_loop, UV_RUN_ONCE) == 0 && !JS_IsJobPending(rt)) break;
+    }
+
+    int state = JS_PromiseState(ctx, promise);
+    if (state == JS_PROMISE_PENDING) {
+        task_set_error(allocator, task, "Task did not settle");
+        JS_FreeValue(ctx, promise);
+        return;
+    }
+
+    JSValue result = JS_PromiseResult(ctx, promise);
+    JS_FreeValue(ctx, promise);
+
+    if (state == JS_PROMISE_REJECTED) {
+        const char * str = JS_ToCString(ctx, result);
+        task_set_error(allocator, task, str ? str : "Task failed");
+        if (str) JS_FreeCString(ctx, str);
+        JS_FreeValue(ctx, result);
+        return;
+    }
+
+    size_t size = 0;
+    uint8_t * data =
+        JS_WriteObject(ctx, &size, result, JS_WRITE_OBJ_REFERENCE);
+    JS_FreeValue(ctx, result);
+    if (!data) {
+        task_set_exception(ctx, allocator, task);
+        return;
+    }
+
+    task->failed = false;
+    if (task_set_data(allocator, task, data, size) < 0) {
+        task_set_error(allocator, task, "Failed to allocate result");
+    }
+    js_free(ctx, data);
+}
+
+
+/// @brief Deliver a completed task to the owner loop
+static void task_pool_complete(
+    pomelo_qjs_task_pool_t * pool,
+    pomelo_qjs_task_t * task
+) {
+    uv_mutex_lock(&pool->completed_mutex);
+    task->next = NULL;
+    if (pool->completed_tail) {
+        pool->completed_tail->next = task;
+    } else {
+        pool->completed_head = task;
+    }
+    pool->completed_tail = task;
+    uv_mutex_unlock(&pool->completed_mutex);
+
+    // The handle is open until all threads are joined
+    uv_async_send(&pool->async);
+}
+
+
+/// @brief Entry of pool thread
+static void task_thread_main(void * arg) {
+    pomelo_qjs_task_thread_t * thread = arg;
+    pomelo_qjs_task_pool_t * pool = thread->pool;
+
+    pomelo_qjs_runtime_uv_options_t options = {
+        .allocator = pool->allocator
+    };
+    pomelo_qjs_runtime_t * runtime = pomelo_qjs_runtime_uv_create(&options);
+    JSValue runner = JS_UNDEFINED;
+    if (runtime) {
+        pomelo_qjs_runtime_set_extra(runtime, pool->extra);
+        JS_SetInterruptHandler(
+            runtime->rt, task_thread_interrupt_handler, pool
+        );
+        runner = JS_Eval(
+            runtime->ctx,
+            task_pool_runner,
+            sizeof(task_pool_runner) - 1,
+            "<task-pool>",
+            JS_EVAL_TYPE_GLOBAL
+        );
+    }
+
+    pomelo_qjs_task_t * task = NULL;
+    while ((task = task_thread_take(thread))) {
+        if (runtime && !JS_IsException(runner)) {
+            task_thread_execute(
+                pool, (pomelo_qjs_runtime_uv_t *) runtime, runner, task
+            );
+        } else {
+            task_set_error(pool->allocator, task, "Task runtime is broken");
+        }
+        task_pool_complete(pool, task);
+    }
+
+    if (runtime) {
+        JS_FreeValue(runtime->ctx, runner);
+        pomelo_qjs_runtime_uv_destroy(runtime);
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   Owner                                    */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Release a reference of pool, free it after the last one
+static void task_pool_unref(pomelo_qjs_task_pool_t * pool) {
+    if (--pool->refs > 0) return;
+
+    pomelo_allocator_t * allocator = pool->allocator;
+    if (pool->threads) {
+        pomelo_allocator_free(allocator, pool->threads);
+    }
+    pomelo_allocator_free(allocator, pool);
+}
+
+
+/// @brief Close callback of wakeup handle
+static void task_pool_on_closed(uv_handle_t * handle) {
+    task_pool_unref(handle->data);
+}
+
+
+/// @brief Wakeup callback of owner loop
+static void task_pool_on_async(uv_async_t * handle) {
+    pomelo_qjs_task_pool_t * pool = handle->data;
+    pomelo_qjs_task_t * task = NULL;
+    while (!pool->closed && (task = task_pool_pop_completed(pool))) {
+        task_settle(pool, task);
+    }
+}
+
+
+/// @brief Stop and join the threads of pool. Unsettled tasks are rejected if
+/// settle is set, otherwise they are dropped.
+static void task_pool_shutdown(pomelo_qjs_task_pool_t * pool, bool settle) {
+    if (pool->closed) return;
+    pool->closed = true;
+
+    uv_mutex_lock(&pool->mutex);
+    atomic_store(&pool->closing, true);
+    uv_cond_broadcast(&pool->cond);
+    uv_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->nthreads; i++) {
+        if (pool->threads[i].started) {
+            uv_thread_join(&pool->threads[i].thread);
+        }
+    }
+
+    // Completed tasks are settled with their results
+    pomelo_qjs_task_t * task = NULL;
+    while ((task = task_pool_pop_completed(pool))) {
+        if (settle) {
+            task_settle(pool, task);
+        } else {
+            task_free(pool, task);
+        }
+    }
+
+    for (size_t i = 0; i < pool->nthreads; i++) {
+        pomelo_qjs_task_deque_t * deque = &pool->threads[i].deque;
+        while ((task = task_deque_pop_bottom(deque))) {
+            if (settle) {
+                task_set_error(pool->allocator, task, "Task pool is closed");
+                task_settle(pool, task);
+            } else {
+                task_free(pool, task);
+            }
+        }
+        uv_mutex_destroy(&deque->mutex);
+    }
+
+    uv_mutex_destroy(&pool->mutex);
+    uv_mutex_destroy(&pool->completed_mutex);
+    uv_cond_destroy(&pool->cond);
+
+    // Dropped tasks release their references together
+    if (!settle) {
+        pool->outstanding = 0;
+    }
+    uv_close((uv_handle_t *) &pool->async, task_pool_on_closed);
+}
+
+
+/// @brief Initialize the locks of pool
+/// @return Returns 0 on success or -1 on failure
+static int task_pool_init_locks(pomelo_qjs_task_pool_t * pool) {
+    if (uv_mutex_init(&pool->mutex)) return -1;
+    if (uv_mutex_init(&pool->completed_mutex)) {
+        uv_mutex_destroy(&pool->mutex);
+        return -1;
+    }
+    if (uv_cond_init(&pool->cond)) {
+        uv_mutex_destroy(&pool->completed_mutex);
+        uv_mutex_destroy(&pool->mutex);
+        return -1;
+    }
+
+    for (size_t i = 0; i < pool->nthreads; i++) {
+        if (uv_mutex_init(&pool->threads[i].deque.mutex) == 0) continue;
+
+        while (i-- > 0) {
+            uv_mutex_destroy(&pool->threads[i].deque.mutex);
+        }
+        uv_cond_destroy(&pool->cond);
+        uv_mutex_destroy(&pool->completed_mutex);
+        uv_mutex_destroy(&pool->mutex);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/// @brief Get the task pool of JS object
+static pomelo_qjs_task_pool_t * task_pool_get(JSContext * ctx, JSValue thiz) {
+    pomelo_qjs_runtime_uv_t * runtime =
+        (pomelo_qjs_runtime_uv_t *) pomelo_qjs_runtime_from_js_context(ctx);
+    if (!runtime) return NULL;
+    return JS_GetOpaque(thiz, runtime->class_task_pool_id);
+}
+
+
+int pomelo_qjs_task_pool_init(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    JSContext * ctx = runtime->base.ctx;
+    JSRuntime * rt = runtime->base.rt;
+
+    pomelo_list_options_t list_options = {
+        .allocator = runtime->base.allocator,
+        .element_size = sizeof(pomelo_qjs_task_pool_t *)
+    };
+    runtime->task_pools = pomelo_list_create(&list_options);
+    if (!runtime->task_pools) return -1;
+
+    // Generate new class ID
+    JSClassID class_id = 0;
+    if (JS_NewClassID(rt, &class_id) < 0) {
+        return -1;
+    }
+    runtime->class_task_pool_id = class_id;
+
+    // Register the class
+    JSClassDef class_def = {
+        .class_name = "TaskPool",
+        .finalizer = pomelo_qjs_task_pool_finalizer
+    };
+    if (JS_NewClass(rt, class_id, &class_def) < 0) {
+        return -1;
+    }
+
+    // Create prototype for class
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(
+        ctx, proto, task_pool_funcs, countof(task_pool_funcs)
+    );
+
+    JSValue task_pool_class = JS_NewCFunction2(
+        ctx,
+        pomelo_qjs_task_pool_constructor,
+        "TaskPool",
+        /* argc = */ 1,
+        JS_CFUNC_constructor,
+        0
+    );
+    JS_SetConstructor(ctx, task_pool_class, proto);
+
+    // Set the class prototype
+    JS_SetClassProto(ctx, class_id, proto);
+
+    JSValue global = JS_GetGlobalObject(ctx);
+    int ret = JS_SetPropertyStr(ctx, global, "TaskPool", task_pool_class);
+    JS_FreeValue(ctx, global);
+    return (ret < 0) ? -1 : 0;
+}
+
+
+void pomelo_qjs_task_pool_cleanup(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    if (!runtime->task_pools) return;
+
+    JSContext * ctx = runtime->base.ctx;
+    pomelo_qjs_task_pool_t * pool = NULL;
+    while (pomelo_list_pop_front(runtime->task_pools, &pool) == 0) {
+        pool->entry = NULL;
+
+        // Detach the object, it is finalized later by the JS runtime
+        JS_SetOpaque(pool->thiz, NULL);
+        bool outstanding = pool->outstanding > 0;
+        task_pool_shutdown(pool, false);
+        if (outstanding) {
+            JS_FreeValue(ctx, pool->thiz);
+        }
+        task_pool_unref(pool);
+    }
+
+    pomelo_list_destroy(runtime->task_pools);
+    runtime->task_pools = NULL;
+}
+
+
+JSValue pomelo_qjs_task_pool_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) new_target;
+
+    pomelo_qjs_runtime_uv_t * runtime =
+        (pomelo_qjs_runtime_uv_t *) pomelo_qjs_runtime_from_js_context(ctx);
+    assert(runtime != NULL);
+
+    // Leave a core for the loop of owner by default
+    int32_t nthreads = (int32_t) uv_available_parallelism() - 1;
+    if (argc > 0 && !JS_IsUndefined(argv[0])) {
+        if (JS_ToInt32(ctx, &nthreads, argv[0]) != 0) {
+            return JS_ThrowTypeError(ctx, "Invalid number of threads");
+        }
+        if (nthreads < 1 || nthreads > POMELO_QJS_TASK_POOL_MAX_THREADS) {
+            return JS_ThrowTypeError(
+                ctx,
+                "Threads must be in [1, %d]",
+                POMELO_QJS_TASK_POOL_MAX_THREADS
+            );
+        }
+    }
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > POMELO_QJS_TASK_POOL_MAX_THREADS) {
+        nthreads = POMELO_QJS_TASK_POOL_MAX_THREADS;
+    }
+
+    pomelo_allocator_t * allocator = runtime->base.allocator;
+    pomelo_qjs_task_pool_t * pool =
+        pomelo_allocator_malloc_t(allocator, pomelo_qjs_task_pool_t);
+    if (!pool) return JS_ThrowInternalError(ctx, "Failed to allocate pool");
+    memset(pool, 0, sizeof(pomelo_qjs_task_pool_t));
+
+    size_t threads_size = (size_t) nthreads * sizeof(pomelo_qjs_task_thread_t);
+    pool->threads = pomelo_allocator_malloc(allocator, threads_size);
+    if (!pool->threads) {
+        pomelo_allocator_free(allocator, pool);
+        return JS_ThrowInternalError(ctx, "Failed to allocate pool");
+    }
+    memset(pool->threads, 0, threads_size);
+    pool->allocator = allocator;
+    pool->extra = runtime->base.extra;
+    pool->runtime = runtime;
+    pool->nthreads = (size_t) nthreads;
+    pool->thiz = JS_NULL;
+    pool->refs = 1; // The object
+    atomic_init(&pool->closing, false);
+
+    uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(runtime->platform);
+    if (task_pool_init_locks(pool) < 0) {
+        task_pool_unref(pool);
+        return JS_ThrowInternalError(ctx, "Failed to initialize pool");
+    }
+    if (uv_async_init(uv_loop, &pool->async, task_pool_on_async)) {
+        pool->closed = true; // Nothing to shutdown but the locks
+        for (size_t i = 0; i < pool->nthreads; i++) {
+            uv_mutex_destroy(&pool->threads[i].deque.mutex);
+        }
+        uv_cond_destroy(&pool->cond);
+        uv_mutex_destroy(&pool->completed_mutex);
+        uv_mutex_destroy(&pool->mutex);
+        task_pool_unref(pool);
+        return JS_ThrowInternalError(ctx, "Failed to initialize pool");
+    }
+    pool->async.data = pool;
+    pool->refs++; // The wakeup handle
+
+    // Only outstanding tasks keep the loop alive
+    uv_unref((uv_handle_t *) &pool->async);
+
+    // Create new js task pool object
+    JSValue thiz = JS_NewObjectClass(ctx, runtime->class_task_pool_id);
+    if (JS_IsException(thiz)) {
+        task_pool_shutdown(pool, false);
+        task_pool_unref(pool);
+        return thiz;
+    }
+    pool->thiz = thiz;
+    JS_SetOpaque(thiz, pool);
+
+    for (size_t i = 0; i < pool->nthreads; i++) {
+        pomelo_qjs_task_thread_t * thread = pool->threads + i;
+        thread->pool = pool;
+        thread->index = i;
+        if (uv_thread_create(&thread->thread, task_thread_main, thread)) {
+            JS_FreeValue(ctx, thiz); // The threads are joined by finalizer
+            return JS_ThrowInternalError(ctx, "Failed to start pool thread");
+        }
+        thread->started = true;
+    }
+
+    pool->entry = pomelo_list_push_back(runtime->task_pools, pool);
+    return thiz;
+}
+
+
+void pomelo_qjs_task_pool_finalizer(JSRuntime * rt, JSValue val) {
+    assert(rt != NULL);
+
+    // The runtime may be cleaning up, so the class ID is not looked up
+    JSClassID class_id = 0;
+    pomelo_qjs_task_pool_t * pool = JS_GetAnyOpaque(val, &class_id);
+    if (!pool) return; // Detached
+
+    // Outstanding tasks hold the object, so no task is left here
+    assert(pool->outstanding == 0);
+    if (pool->entry) {
+        pomelo_list_remove(pool->runtime->task_pools, pool->entry);
+        pool->entry = NULL;
+    }
+
+    task_pool_shutdown(pool, false);
+    task_pool_unref(pool);
+}
+
+
+JSValue pomelo_qjs_task_pool_run(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_task_pool_t * pool = task_pool_get(ctx, thiz);
+    if (!pool) return JS_ThrowTypeError(ctx, "Invalid task pool");
+    if (pool->closed) return JS_ThrowTypeError(ctx, "Task pool is closed");
+    if (argc < 2) return JS_ThrowTypeError(ctx, "Missing arguments");
+
+    JSValue args = (argc > 2) ? argv[2] : JS_UNDEFINED;
+    if (!JS_IsUndefined(args) && !JS_IsArray(args)) {
+        return JS_ThrowTypeError(ctx, "Arguments must be an array");
+    }
+
+    pomelo_allocator_t * allocator = pool->allocator;
+    pomelo_qjs_task_t * task =
+        pomelo_allocator_malloc_t(allocator, pomelo_qjs_task_t);
+    if (!task) return JS_ThrowInternalError(ctx, "Failed to allocate task");
+    memset(task, 0, sizeof(pomelo_qjs_task_t));
+    task->resolving_funcs[0] = JS_UNDEFINED;
+    task->resolving_funcs[1] = JS_UNDEFINED;
+
+    // Copy the names
+    size_t length = 0;
+    const char * str = JS_ToCStringLen(ctx, &length, argv[0]);
+    if (str) {
+        task->module_name = task_strdup(allocator, str, length);
+        JS_FreeCString(ctx, str);
+    }
+    str = JS_ToCStringLen(ctx, &length, argv[1]);
+    if (str) {
+        task->function_name = task_strdup(allocator, str, length);
+        JS_FreeCString(ctx, str);
+    }
+    if (!task->module_name || !task->function_name) {
+        task_free(pool, task);
+        return JS_ThrowTypeError(ctx, "Invalid module or function name");
+    }
+
+    // Serialize the arguments
+    JSValue js_args = JS_IsUndefined(args)
+        ? JS_NewArray(ctx)
+        : JS_DupValue(ctx, args);
+    size_t size = 0;
+    uint8_t * data =
+        JS_WriteObject(ctx, &size, js_args, JS_WRITE_OBJ_REFERENCE);
+    JS_FreeValue(ctx, js_args);
+    if (!data) {
+        task_free(pool, task);
+        return JS_EXCEPTION;
+    }
+    int ret = task_set_data(allocator, task, data, size);
+    js_free(ctx, data);
+    if (ret < 0) {
+        task_free(pool, task);
+        return JS_ThrowInternalError(ctx, "Failed to allocate task");
+    }
+
+    JSValue promise = JS_NewPromiseCapability(ctx, task->resolving_funcs);
+    if (JS_IsException(promise)) {
+        task_free(pool, task);
+        return promise;
+    }
+
+    // Outstanding tasks keep the object and the loop alive
+    if (pool->outstanding++ == 0) {
+        JS_DupValue(ctx, pool->thiz);
+        uv_ref((uv_handle_t *) &pool->async);
+    }
+
+    // The task is counted before any thread is able to take it
+    pomelo_qjs_task_thread_t * thread =
+        pool->threads + (pool->next_thread++ % pool->nthreads);
+    uv_mutex_lock(&pool->mutex);
+    task_deque_push_bottom(&thread->deque, task);
+    pool->queued++;
+    uv_cond_signal(&pool->cond);
+    uv_mutex_unlock(&pool->mutex);
+
+    return promise;
+}
+
+
+JSValue pomelo_qjs_task_pool_close(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) argc;
+    (void) argv;
+
+    pomelo_qjs_task_pool_t * pool = task_pool_get(ctx, thiz);
+    if (!pool) return JS_ThrowTypeError(ctx, "Invalid task pool");
+
+    // Completed tasks are resolved, queued tasks are rejected
+    task_pool_shutdown(pool, true);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_task_pool_get_threads(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_task_pool_t * pool = task_pool_get(ctx, thiz);
+    if (!pool) return JS_ThrowTypeError(ctx, "Invalid task pool");
+    return JS_NewUint32(ctx, (uint32_t) pool->nthreads);
+}
+
+
+JSValue pomelo_qjs_task_pool_get_pending(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_task_pool_t * pool = task_pool_get(ctx, thiz);
+    if (!pool) return JS_ThrowTypeError(ctx, "Invalid task pool");
+    return JS_NewUint32(ctx, (uint32_t) pool->outstanding);
+}
@@ -0,0 +1,216 @@
+#ifndef POMELO_QJS_TASK_POOL_SRC_H
+#define POMELO_QJS_TASK_POOL_SRC_H
+#include <stdatomic.h>
+#include <uv.h>
+#include "quickjs.h"
+#include "utils/list.h"
+#include "runtime-uv.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Task pool.
+ *
+ * A task pool owns a fixed set of threads, each with its own runtime. A task
+ * calls an exported function of a module with serialized arguments. The
+ * result is serialized back and resolves the promise of task on the loop of
+ * pool owner.
+ *
+ * Every thread has a deque of tasks. New tasks are pushed to the bottom of
+ * deques in round robin. A thread pops its own deque from the bottom, and
+ * steals from the top of other deques once its deque is empty.
+ */
+
+
+/// @brief The maximum number of threads of a pool
+#define POMELO_QJS_TASK_POOL_MAX_THREADS 64
+
+
+/// @brief A task
+typedef struct pomelo_qjs_task_s pomelo_qjs_task_t;
+
+/// @brief The deque of tasks of a thread
+typedef struct pomelo_qjs_task_deque_s pomelo_qjs_task_deque_t;
+
+/// @brief A thread of task pool
+typedef struct pomelo_qjs_task_thread_s pomelo_qjs_task_thread_t;
+
+/// @brief The task pool
+typedef struct pomelo_qjs_task_pool_s pomelo_qjs_task_pool_t;
+
+
+struct pomelo_qjs_task_s {
+    /// @brief The previous task in deque or list
+    pomelo_qjs_task_t * prev;
+
+    /// @brief The next task in deque or list
+    pomelo_qjs_task_t * next;
+
+    /// @brief The name of module
+    char * module_name;
+
+    /// @brief The name of exported function
+    char * function_name;
+
+    /// @brief The serialized arguments before running, then the serialized
+    /// result (or the error message if the task fails)
+    uint8_t * data;
+
+    /// @brief The size of data
+    size_t size;
+
+    /// @brief Whether the task fails
+    bool failed;
+
+    /// @brief The resolving functions of promise. They are only accessed by
+    /// the owner thread.
+    JSValue resolving_funcs[2];
+};
+
+
+struct pomelo_qjs_task_deque_s {
+    /// @brief The lock of deque
+    uv_mutex_t mutex;
+
+    /// @brief The top of deque, thieves take tasks from here
+    pomelo_qjs_task_t * top;
+
+    /// @brief The bottom of deque, new tasks are pushed here
+    pomelo_qjs_task_t * bottom;
+};
+
+
+struct pomelo_qjs_task_thread_s {
+    /// @brief The pool
+    pomelo_qjs_task_pool_t * pool;
+
+    /// @brief The index of thread
+    size_t index;
+
+    /// @brief The thread
+    uv_thread_t thread;
+
+    /// @brief Whether the thread has been started
+    bool started;
+
+    /// @brief The deque of thread
+    pomelo_qjs_task_deque_t deque;
+};
+
+
+struct pomelo_qjs_task_pool_s {
+    /// @brief The allocator. It is shared by all threads.
+    pomelo_allocator_t * allocator;
+
+    /// @brief The extra data of owner runtime, it is passed to thread runtimes
+    void * extra;
+
+    /// @brief The owner runtime
+    pomelo_qjs_runtime_uv_t * runtime;
+
+    /// @brief The this of pool. It is always a weak reference, an extra
+    /// reference is held while any task is outstanding.
+    JSValue thiz;
+
+    /// @brief The entry of pool in the list of owner runtime
+    pomelo_list_entry_t * entry;
+
+    /// @brief The threads
+    pomelo_qjs_task_thread_t * threads;
+
+    /// @brief The number of threads
+    size_t nthreads;
+
+    /// @brief The thread which receives the next task
+    size_t next_thread;
+
+    /// @brief Whether the pool is closing
+    atomic_bool closing;
+
+    /// @brief Whether the pool has been closed
+    bool closed;
+
+    /// @brief The lock of idle threads
+    uv_mutex_t mutex;
+
+    /// @brief The condition of idle threads
+    uv_cond_t cond;
+
+    /// @brief The number of tasks in deques. It is protected by mutex.
+    size_t queued;
+
+    /// @brief The lock of completed tasks
+    uv_mutex_t completed_mutex;
+
+    /// @brief The first completed task
+    pomelo_qjs_task_t * completed_head;
+
+    /// @brief The last completed task
+    pomelo_qjs_task_t * completed_tail;
+
+    /// @brief The wakeup handle of owner loop
+    uv_async_t async;
+
+    /// @brief The number of unsettled tasks. It is only accessed by the owner.
+    size_t outstanding;
+
+    /// @brief The number of references which are held by the JS object and
+    /// the wakeup handle
+    int refs;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the TaskPool class of runtime
+int pomelo_qjs_task_pool_init(pomelo_qjs_runtime_uv_t * runtime);
+
+
+/// @brief Close all task pools of runtime. Unsettled tasks are dropped.
+void pomelo_qjs_task_pool_cleanup(pomelo_qjs_runtime_uv_t * runtime);
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+
+/// @brief TaskPool.constructor(threads?: number)
+JSValue pomelo_qjs_task_pool_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+);
+
+
+/// @brief Finalizer of task pool
+void pomelo_qjs_task_pool_finalizer(JSRuntime * rt, JSValue val);
+
+
+/// @brief TaskPool.run(
+///     moduleName: string, functionName: string, args?: any[]
+/// ): Promise<any>
+JSValue pomelo_qjs_task_pool_run(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief TaskPool.close(): void
+JSValue pomelo_qjs_task_pool_close(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief readonly TaskPool.threads: number
+JSValue pomelo_qjs_task_pool_get_threads(JSContext * ctx, JSValue thiz);
+
+
+/// @brief readonly TaskPool.pending: number
+JSValue pomelo_qjs_task_pool_get_pending(JSContext * ctx, JSValue thiz);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QJS_TASK_POOL_SRC_H
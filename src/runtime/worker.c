@@ -0,0 +1,1203 @@
+#include <assert.h>
+#include <string.h>
+#include "core/context.h"
+#include "core/message.h"
+#include "logger/logger.h"
+#include "worker.h"
+
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+
+/// @brief The maximum depth of values which are checked against the transfer
+/// list
+#define WORKER_MAX_VALUE_DEPTH 64
+
+
+static JSCFunctionListEntry worker_funcs[] = {
+    JS_CFUNC_DEF("postMessage", 2, pomelo_qjs_worker_post_message),
+    JS_CFUNC_DEF("terminate", 0, pomelo_qjs_worker_terminate),
+    JS_CGETSET_DEF(
+        "onmessage",
+        pomelo_qjs_worker_get_on_message,
+        pomelo_qjs_worker_set_on_message
+    ),
+    JS_CGETSET_DEF(
+        "onexit",
+        pomelo_qjs_worker_get_on_exit,
+        pomelo_qjs_worker_set_on_exit
+    ),
+};
+
+
+static JSCFunctionListEntry port_funcs[] = {
+    JS_CFUNC_DEF("postMessage", 2, pomelo_qjs_worker_port_post_message),
+    JS_CGETSET_DEF(
+        "onmessage",
+        pomelo_qjs_worker_port_get_on_message,
+        pomelo_qjs_worker_port_set_on_message
+    ),
+};
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   Queue                                    */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Free a message and its transferred objects
+static void worker_message_free(
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_worker_message_t * message
+) {
+    if (message->data) {
+        pomelo_allocator_free(allocator, message->data);
+    }
+
+    if (message->transfers) {
+        for (size_t i = 0; i < message->ntransfers; i++) {
+            if (message->transfers[i].data) {
+                pomelo_allocator_free(allocator, message->transfers[i].data);
+            }
+        }
+        pomelo_allocator_free(allocator, message->transfers);
+    }
+
+    pomelo_allocator_free(allocator, message);
+}
+
+
+/// @brief Initialize the queue with a stub message
+static int worker_queue_init(
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_worker_queue_t * queue
+) {
+    pomelo_qjs_worker_message_t * stub =
+        pomelo_allocator_malloc_t(allocator, pomelo_qjs_worker_message_t);
+    if (!stub) return -1;
+
+    memset(stub, 0, sizeof(pomelo_qjs_worker_message_t));
+    atomic_init(&stub->next, NULL);
+    queue->head = stub;
+    queue->tail = stub;
+    return 0;
+}
+
+
+/// @brief Append a message to queue. It is only called by the producer.
+static void worker_queue_push(
+    pomelo_qjs_worker_queue_t * queue,
+    pomelo_qjs_worker_message_t * message
+) {
+    atomic_store_explicit(&message->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail->next, message, memory_order_release);
+    queue->tail = message;
+}
+
+
+/// @brief Pop the front message of queue. It is only called by the consumer.
+/// @return Returns the message (owned by the caller) or NULL if empty
+static pomelo_qjs_worker_message_t * worker_queue_pop(
+    pomelo_qjs_worker_queue_t * queue
+) {
+    pomelo_qjs_worker_message_t * stub = queue->head;
+    pomelo_qjs_worker_message_t * front =
+        atomic_load_explicit(&stub->next, memory_order_acquire);
+    if (!front) return NULL;
+
+    // The front becomes the new stub, its content moves to the old stub which
+    // is no longer touched by the producer.
+    stub->data = front->data;
+    stub->size = front->size;
+    stub->transfers = front->transfers;
+    stub->ntransfers = front->ntransfers;
+    front->data = NULL;
+    front->size = 0;
+    front->transfers = NULL;
+    front->ntransfers = 0;
+
+    queue->head = front;
+    return stub;
+}
+
+
+/// @brief Free all messages of queue. No thread may use the queue anymore.
+static void worker_queue_cleanup(
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_worker_queue_t * queue
+) {
+    if (!queue->head) return;
+
+    pomelo_qjs_worker_message_t * message = NULL;
+    while ((message = worker_queue_pop(queue))) {
+        worker_message_free(allocator, message);
+    }
+    worker_message_free(allocator, queue->head);
+    queue->head = NULL;
+    queue->tail = NULL;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                               Serialization                                */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Free function of adopted ArrayBuffers
+static void worker_free_array_buffer(
+    JSRuntime * rt,
+    void * opaque,
+    void * ptr
+) {
+    (void) rt;
+    pomelo_allocator_free(opaque, ptr);
+}
+
+
+/// @brief Log the pending exception of context
+static void worker_log_exception(JSContext * ctx) {
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    JSValue exception = JS_GetException(ctx);
+    const char * str = JS_ToCString(ctx, exception);
+    pomelo_qjs_logger_log(
+        context,
+        POMELO_QJS_LOGGER_LEVEL_ERROR,
+        "[Worker] %s",
+        str ? str : "[Exception]"
+    );
+    if (str) JS_FreeCString(ctx, str);
+    JS_FreeValue(ctx, exception);
+}
+
+
+/// @brief Check if a value can be transferred
+static bool worker_is_transferable(
+    pomelo_qjs_context_t * context,
+    JSValue value
+) {
+    return JS_IsArrayBuffer(value) ||
+        JS_GetOpaque(value, context->class_message_id) != NULL;
+}
+
+
+/// @brief The walk of a value which looks for transferred objects
+typedef struct worker_value_walk_s {
+    /// @brief The JS context
+    JSContext * ctx;
+
+    /// @brief The allocator
+    pomelo_allocator_t * allocator;
+
+    /// @brief The transferred objects
+    JSValue * transfers;
+
+    /// @brief The number of transferred objects
+    size_t ntransfers;
+
+    /// @brief The visited objects
+    void ** visited;
+
+    /// @brief The number of visited objects
+    size_t nvisited;
+
+    /// @brief The capacity of visited objects
+    size_t visited_capacity;
+} worker_value_walk_t;
+
+
+/// @brief Check if a value refers to any transferred object. Objects, arrays
+/// and the buffers of typed arrays are walked, like they are serialized.
+/// @return Returns 1 if it does, 0 if it does not or -1 on failure (an
+/// exception is thrown)
+static int worker_value_refers(
+    worker_value_walk_t * walk,
+    JSValue value,
+    size_t depth
+) {
+    JSContext * ctx = walk->ctx;
+    if (!JS_IsObject(value)) return 0;
+
+    void * ptr = JS_VALUE_GET_PTR(value);
+    for (size_t i = 0; i < walk->ntransfers; i++) {
+        if (JS_VALUE_GET_PTR(walk->transfers[i]) == ptr) return 1;
+    }
+
+    if (JS_GetTypedArrayType(value) >= 0) {
+        size_t byte_offset = 0;
+        size_t byte_length = 0;
+        JSValue buffer = JS_GetTypedArrayBuffer(
+            ctx, value, &byte_offset, &byte_length, NULL
+        );
+        if (JS_IsException(buffer)) return -1;
+
+        int ret = worker_value_refers(walk, buffer, depth);
+        JS_FreeValue(ctx, buffer);
+        return ret;
+    }
+
+    if (depth >= WORKER_MAX_VALUE_DEPTH) {
+        JS_ThrowRangeError(ctx, "Message is too deep to transfer objects");
+        return -1;
+    }
+
+    for (size_t i = 0; i < walk->nvisited; i++) {
+        if (walk->visited[i] == ptr) return 0; // Shared or circular
+    }
+    if (walk->nvisited == walk->visited_capacity) {
+        size_t capacity = walk->visited_capacity * 2;
+        if (capacity == 0) capacity = 16;
+
+        void ** visited = pomelo_allocator_realloc(
+            walk->allocator,
+            walk->visited,
+            capacity * sizeof(void *)
+        );
+        if (!visited) {
+            JS_ThrowOutOfMemory(ctx);
+            return -1;
+        }
+        walk->visited = visited;
+        walk->visited_capacity = capacity;
+    }
+    walk->visited[walk->nvisited++] = ptr;
+
+    JSPropertyEnum * props = NULL;
+    uint32_t prop_count = 0;
+    if (JS_GetOwnPropertyNames(
+        ctx, &props, &prop_count, value,
+        JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY
+    ) < 0) {
+        return -1;
+    }
+
+    int ret = 0;
+    for (uint32_t i = 0; i < prop_count && ret == 0; i++) {
+        JSValue item = JS_GetProperty(ctx, value, props[i].atom);
+        if (JS_IsException(item)) {
+            ret = -1;
+            break;
+        }
+        ret = worker_value_refers(walk, item, depth + 1);
+        JS_FreeValue(ctx, item);
+    }
+
+    JS_FreePropertyEnum(ctx, props, prop_count);
+    return ret;
+}
+
+
+/// @brief Copy the content of a transferable object into transfer. The
+/// object is not detached yet.
+/// @return Returns 0 on success or -1 on failure (an exception is thrown)
+static int worker_transfer_read(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    JSValue value,
+    pomelo_qjs_worker_transfer_t * transfer
+) {
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    uint8_t * content = NULL;
+    size_t size = 0;
+
+    pomelo_qjs_message_t * qjs_message =
+        JS_GetOpaque(value, context->class_message_id);
+    pomelo_message_t * message = qjs_message ? qjs_message->message : NULL;
+    if (qjs_message) {
+        transfer->type = POMELO_QJS_WORKER_TRANSFER_MESSAGE;
+        if (message) size = pomelo_message_size(message);
+    } else {
+        transfer->type = POMELO_QJS_WORKER_TRANSFER_ARRAY_BUFFER;
+        content = JS_GetArrayBuffer(ctx, &size, value);
+        if (!content && size > 0) return -1;
+    }
+
+    transfer->size = size;
+    if (size == 0) return 0;
+
+    transfer->data = pomelo_allocator_malloc(allocator, size);
+    if (!transfer->data) {
+        JS_ThrowInternalError(ctx, "Failed to allocate transfer");
+        return -1;
+    }
+
+    if (!message) {
+        memcpy(transfer->data, content, size);
+        return 0;
+    }
+
+    // Native messages belong to the pools of this runtime. They are only
+    // read, never rewound or rewritten, since they may still be in flight.
+    // A partly read message cannot be transferred.
+    if (pomelo_message_read_buffer(message, transfer->data, size) < 0) {
+        JS_ThrowInternalError(ctx, "Failed to read message");
+        return -1;
+    }
+    return 0;
+}
+
+
+/// @brief Detach a transferred object from the sender
+static void worker_transfer_detach(JSContext * ctx, JSValue value) {
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    pomelo_qjs_message_t * qjs_message =
+        JS_GetOpaque(value, context->class_message_id);
+    if (!qjs_message) {
+        JS_DetachArrayBuffer(ctx, value);
+        return;
+    }
+
+    pomelo_message_t * message = qjs_message->message;
+    qjs_message->message = NULL;
+    if (message) pomelo_message_unref(message);
+}
+
+
+/// @brief Create a JS object from transfer. The content is adopted if
+/// possible.
+static JSValue worker_transfer_decode(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_worker_transfer_t * transfer
+) {
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+
+    if (transfer->type == POMELO_QJS_WORKER_TRANSFER_ARRAY_BUFFER) {
+        if (!transfer->data) return JS_NewArrayBufferCopy(ctx, NULL, 0);
+
+        JSValue buffer = JS_NewArrayBuffer(
+            ctx,
+            transfer->data,
+            transfer->size,
+            worker_free_array_buffer,
+            allocator,
+            false
+        );
+        if (!JS_IsException(buffer)) {
+            transfer->data = NULL; // Adopted by the buffer
+        }
+        return buffer;
+    }
+
+    pomelo_message_t * message =
+        pomelo_context_acquire_message(context->context);
+    if (!message) {
+        return JS_ThrowInternalError(ctx, "Failed to acquire message");
+    }
+
+    if (
+        transfer->size > 0 &&
+        pomelo_message_write_buffer(message, transfer->data, transfer->size) < 0
+    ) {
+        pomelo_message_unref(message);
+        return JS_ThrowInternalError(ctx, "Failed to write message");
+    }
+
+    JSValue js_message = pomelo_qjs_message_new(context, message);
+    pomelo_message_unref(message);
+    return js_message;
+}
+
+
+/// @brief Free the collected objects of transfer list
+static void worker_free_transfers(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    JSValue * transfers,
+    size_t count
+) {
+    if (!transfers) return;
+    for (size_t i = 0; i < count; i++) {
+        JS_FreeValue(ctx, transfers[i]);
+    }
+    pomelo_allocator_free(allocator, transfers);
+}
+
+
+/// @brief Collect and validate the objects of transfer list
+/// @param transfers Output the objects, NULL if the list is empty
+/// @return Returns the number of objects or -1 on failure (an exception is
+/// thrown)
+static int64_t worker_collect_transfers(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    JSValue transfer_list,
+    JSValue ** transfers
+) {
+    pomelo_qjs_context_t * context = JS_GetContextOpaque(ctx);
+    *transfers = NULL;
+    if (JS_IsUndefined(transfer_list) || JS_IsNull(transfer_list)) return 0;
+
+    if (!JS_IsArray(transfer_list)) {
+        JS_ThrowTypeError(ctx, "Transfer list must be an array");
+        return -1;
+    }
+
+    int64_t count = 0;
+    if (JS_GetLength(ctx, transfer_list, &count) != 0) return -1;
+    if (count == 0) return 0;
+
+    JSValue * items =
+        pomelo_allocator_malloc(allocator, (size_t) count * sizeof(JSValue));
+    if (!items) {
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+
+    for (int64_t i = 0; i < count; i++) {
+        JSValue item = JS_GetPropertyInt64(ctx, transfer_list, i);
+        if (JS_IsException(item)) {
+            worker_free_transfers(ctx, allocator, items, (size_t) i);
+            return -1;
+        }
+        items[i] = item;
+
+        const char * error = NULL;
+        if (!worker_is_transferable(context, item)) {
+            error = "Only ArrayBuffer and Message can be transferred";
+        }
+        for (int64_t j = 0; j < i && !error; j++) {
+            if (JS_VALUE_GET_PTR(items[j]) == JS_VALUE_GET_PTR(item)) {
+                error = "Transfer list contains duplicates";
+            }
+        }
+        if (error) {
+            worker_free_transfers(ctx, allocator, items, (size_t) i + 1);
+            JS_ThrowTypeError(ctx, "%s", error);
+            return -1;
+        }
+    }
+
+    *transfers = items;
+    return count;
+}
+
+
+/// @brief Serialize a value and its transferred objects into new message.
+/// Transferred objects are detached only after the whole message has been
+/// built, so a failure leaves all of them attached. Read positions of the
+/// transferred messages may have moved though.
+/// @return Returns new message or NULL on failure (an exception is thrown)
+static pomelo_qjs_worker_message_t * worker_message_encode(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    JSValue value,
+    JSValue transfer_list
+) {
+    JSValue * transfers = NULL;
+    int64_t ntransfers =
+        worker_collect_transfers(ctx, allocator, transfer_list, &transfers);
+    if (ntransfers < 0) return NULL;
+
+    // The value would carry copies of transferred objects, so the receiver
+    // could not tell them apart. Such values are rejected.
+    if (ntransfers > 0) {
+        worker_value_walk_t walk = {
+            .ctx = ctx,
+            .allocator = allocator,
+            .transfers = transfers,
+            .ntransfers = (size_t) ntransfers,
+            .visited = NULL,
+            .nvisited = 0,
+            .visited_capacity = 0
+        };
+        int ret = worker_value_refers(&walk, value, 0);
+        if (walk.visited) pomelo_allocator_free(allocator, walk.visited);
+        if (ret != 0) {
+            if (ret > 0) {
+                JS_ThrowTypeError(
+                    ctx,
+                    "Transferred objects must be passed by the transfer list "
+                    "only"
+                );
+            }
+            worker_free_transfers(
+                ctx, allocator, transfers, (size_t) ntransfers
+            );
+            return NULL;
+        }
+    }
+
+    size_t size = 0;
+    uint8_t * data =
+        JS_WriteObject(ctx, &size, value, JS_WRITE_OBJ_REFERENCE);
+    pomelo_qjs_worker_message_t * message = data
+        ? pomelo_allocator_malloc_t(allocator, pomelo_qjs_worker_message_t)
+        : NULL;
+    if (!message) {
+        if (data) {
+            js_free(ctx, data);
+            JS_ThrowInternalError(ctx, "Failed to allocate message");
+        }
+        worker_free_transfers(ctx, allocator, transfers, (size_t) ntransfers);
+        return NULL;
+    }
+    memset(message, 0, sizeof(pomelo_qjs_worker_message_t));
+
+    // The serialized data must be freed by the receiver thread
+    message->data = pomelo_allocator_malloc(allocator, size > 0 ? size : 1);
+    if (message->data) {
+        memcpy(message->data, data, size);
+        message->size = size;
+    }
+    js_free(ctx, data);
+
+    size_t transfers_size =
+        (size_t) ntransfers * sizeof(pomelo_qjs_worker_transfer_t);
+    if (message->data && ntransfers > 0) {
+        message->transfers = pomelo_allocator_malloc(allocator, transfers_size);
+        if (message->transfers) {
+            memset(message->transfers, 0, transfers_size);
+            message->ntransfers = (size_t) ntransfers;
+        }
+    }
+    if (!message->data || (ntransfers > 0 && !message->transfers)) {
+        worker_message_free(allocator, message);
+        worker_free_transfers(ctx, allocator, transfers, (size_t) ntransfers);
+        JS_ThrowInternalError(ctx, "Failed to allocate message");
+        return NULL;
+    }
+
+    // Read every object before detaching any of them
+    for (int64_t i = 0; i < ntransfers; i++) {
+        if (worker_transfer_read(
+            ctx, allocator, transfers[i], message->transfers + i
+        ) < 0) {
+            worker_message_free(allocator, message);
+            worker_free_transfers(
+                ctx, allocator, transfers, (size_t) ntransfers
+            );
+            return NULL;
+        }
+    }
+
+    for (int64_t i = 0; i < ntransfers; i++) {
+        worker_transfer_detach(ctx, transfers[i]);
+    }
+    worker_free_transfers(ctx, allocator, transfers, (size_t) ntransfers);
+    return message;
+}
+
+
+/// @brief Create the event of message
+static JSValue worker_message_decode(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_worker_message_t * message
+) {
+    JSValue data = JS_ReadObject(
+        ctx, message->data, message->size, JS_READ_OBJ_REFERENCE
+    );
+    if (JS_IsException(data)) return data;
+
+    JSValue event = JS_NewObject(ctx);
+    if (JS_IsException(event)) {
+        JS_FreeValue(ctx, data);
+        return event;
+    }
+    JS_SetPropertyStr(ctx, event, "data", data);
+
+    JSValue transfer = JS_NewArray(ctx);
+    if (JS_IsException(transfer)) {
+        JS_FreeValue(ctx, event);
+        return transfer;
+    }
+    JS_SetPropertyStr(ctx, event, "transfer", transfer);
+
+    for (size_t i = 0; i < message->ntransfers; i++) {
+        JSValue item =
+            worker_transfer_decode(ctx, allocator, message->transfers + i);
+        if (JS_IsException(item)) {
+            JS_FreeValue(ctx, event);
+            return item;
+        }
+        JS_SetPropertyUint32(ctx, transfer, (uint32_t) i, item);
+    }
+
+    return event;
+}
+
+
+/// @brief Deliver all messages of queue to the callback
+static void worker_dispatch(
+    JSContext * ctx,
+    pomelo_allocator_t * allocator,
+    pomelo_qjs_worker_queue_t * queue,
+    JSValue * callback
+) {
+    pomelo_qjs_worker_message_t * message = NULL;
+    while ((message = worker_queue_pop(queue))) {
+        if (!JS_IsFunction(ctx, *callback)) {
+            worker_message_free(allocator, message);
+            continue; // Nobody is listening
+        }
+
+        JSValue event = worker_message_decode(ctx, allocator, message);
+        worker_message_free(allocator, message);
+        if (JS_IsException(event)) {
+            worker_log_exception(ctx);
+            continue;
+        }
+
+        // The callback may be replaced by itself
+        JSValue func = JS_DupValue(ctx, *callback);
+        JSValue ret = JS_Call(ctx, func, JS_UNDEFINED, 1, &event);
+        if (JS_IsException(ret)) {
+            worker_log_exception(ctx);
+        }
+        JS_FreeValue(ctx, ret);
+        JS_FreeValue(ctx, func);
+        JS_FreeValue(ctx, event);
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                                Worker side                                 */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Interrupt the worker JS code once it is terminating
+static int worker_interrupt_handler(JSRuntime * rt, void * opaque) {
+    (void) rt;
+    pomelo_qjs_worker_t * worker = opaque;
+    return atomic_load(&worker->terminating) ? 1 : 0;
+}
+
+
+/// @brief Wakeup callback of worker loop
+static void worker_on_worker_async(uv_async_t * handle) {
+    pomelo_qjs_worker_t * worker = handle->data;
+    pomelo_qjs_runtime_uv_t * runtime = worker->runtime;
+    assert(runtime != NULL);
+
+    if (atomic_load(&worker->terminating)) {
+        runtime->stopping = true;
+        uv_stop(handle->loop);
+        return;
+    }
+
+    worker_dispatch(
+        runtime->base.ctx,
+        worker->allocator,
+        &worker->to_worker,
+        &worker->port_on_message
+    );
+}
+
+
+/// @brief Create the parentPort global object
+static int worker_init_port(JSContext * ctx) {
+    JSValue port = JS_NewObject(ctx);
+    if (JS_IsException(port)) return -1;
+    JS_SetPropertyFunctionList(ctx, port, port_funcs, countof(port_funcs));
+
+    JSValue global = JS_GetGlobalObject(ctx);
+    int ret = JS_SetPropertyStr(ctx, global, "parentPort", port);
+    JS_FreeValue(ctx, global);
+    return (ret < 0) ? -1 : 0;
+}
+
+
+/// @brief Run the worker module on the worker runtime
+/// @return Returns the exit code
+static int worker_run(
+    pomelo_qjs_worker_t * worker,
+    pomelo_qjs_runtime_uv_t * runtime
+) {
+    pomelo_qjs_runtime_t * base = &runtime->base;
+    JSContext * ctx = base->ctx;
+    pomelo_qjs_runtime_set_extra(base, worker->extra);
+
+    runtime->worker = worker;
+    worker->runtime = runtime;
+    worker->port_on_message = JS_NULL;
+    JS_SetInterruptHandler(base->rt, worker_interrupt_handler, worker);
+
+    uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(runtime->platform);
+    if (uv_async_init(uv_loop, &worker->worker_async, worker_on_worker_async)) {
+        return 1;
+    }
+    worker->worker_async.data = worker;
+
+    // Only parentPort.onmessage keeps the worker alive
+    uv_unref((uv_handle_t *) &worker->worker_async);
+    atomic_store(&worker->worker_open, true);
+
+    // Deliver the messages which are posted before the handle is open
+    uv_async_send(&worker->worker_async);
+
+    int ret = worker_init_port(ctx);
+    if (ret == 0) {
+        JSValue module_val =
+            pomelo_qjs_runtime_load_module(base, worker->module_name);
+        if (JS_IsException(module_val)) {
+            worker_log_exception(ctx);
+            ret = -1;
+        } else {
+            ret = pomelo_qjs_runtime_evaluate_module(base, module_val);
+        }
+    }
+
+    // Wait for the parent calls which are signaling the handle
+    atomic_store(&worker->worker_open, false);
+    while (atomic_load(&worker->worker_signalers) > 0) {
+        // Spin, signaling never blocks
+    }
+    uv_close((uv_handle_t *) &worker->worker_async, NULL);
+    uv_run(uv_loop, UV_RUN_NOWAIT);
+
+    JS_FreeValue(ctx, worker->port_on_message);
+    worker->port_on_message = JS_NULL;
+    runtime->worker = NULL;
+    worker->runtime = NULL;
+
+    if (ret < 0 || atomic_load(&worker->terminating)) return 1;
+    return 0;
+}
+
+
+/// @brief Entry of worker thread
+static void worker_thread_main(void * arg) {
+    pomelo_qjs_worker_t * worker = arg;
+
+    pomelo_qjs_runtime_uv_options_t options = {
+        .allocator = worker->allocator
+    };
+    pomelo_qjs_runtime_t * runtime = pomelo_qjs_runtime_uv_create(&options);
+
+    int exit_code = 1;
+    if (runtime) {
+        exit_code = worker_run(worker, (pomelo_qjs_runtime_uv_t *) runtime);
+        pomelo_qjs_runtime_uv_destroy(runtime);
+    }
+
+    // The parent handle stays open until this thread is joined
+    worker->exit_code = exit_code;
+    atomic_store(&worker->exited, true);
+    uv_async_send(&worker->parent_async);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                                Parent side                                 */
+/* -------------------------------------------------------------------------- */
+
+
+/// @brief Release a reference of worker, free it after the last one
+static void worker_unref(pomelo_qjs_worker_t * worker) {
+    if (--worker->refs > 0) return;
+
+    pomelo_allocator_t * allocator = worker->allocator;
+    worker_queue_cleanup(allocator, &worker->to_worker);
+    worker_queue_cleanup(allocator, &worker->to_parent);
+    if (worker->module_name) {
+        pomelo_allocator_free(allocator, worker->module_name);
+    }
+    pomelo_allocator_free(allocator, worker);
+}
+
+
+/// @brief Close callback of parent handle
+static void worker_on_parent_closed(uv_handle_t * handle) {
+    worker_unref(handle->data);
+}
+
+
+/// @brief Wake the worker thread up
+static void worker_signal(pomelo_qjs_worker_t * worker) {
+    atomic_fetch_add(&worker->worker_signalers, 1);
+    if (atomic_load(&worker->worker_open)) {
+        uv_async_send(&worker->worker_async);
+    }
+    atomic_fetch_sub(&worker->worker_signalers, 1);
+}
+
+
+/// @brief Join the worker thread and close the parent handle
+static void worker_join(pomelo_qjs_worker_t * worker) {
+    uv_thread_join(&worker->thread);
+    worker->running = false;
+    uv_close((uv_handle_t *) &worker->parent_async, worker_on_parent_closed);
+}
+
+
+/// @brief Release the reference of worker object which is held while running.
+/// The object may be finalized here.
+static void worker_release_thiz(pomelo_qjs_worker_t * worker) {
+    JS_FreeValue(worker->parent->base.ctx, worker->thiz);
+}
+
+
+/// @brief Wakeup callback of parent loop
+static void worker_on_parent_async(uv_async_t * handle) {
+    pomelo_qjs_worker_t * worker = handle->data;
+    if (!worker->running) return;
+
+    // Messages are pushed before the worker exits
+    bool exited = atomic_load(&worker->exited);
+    JSContext * ctx = worker->parent->base.ctx;
+    worker_dispatch(
+        ctx, worker->allocator, &worker->to_parent, &worker->on_message
+    );
+    if (!exited || !worker->running) return;
+
+    worker_join(worker);
+    if (JS_IsFunction(ctx, worker->on_exit)) {
+        JSValue func = JS_DupValue(ctx, worker->on_exit);
+        JSValue code = JS_NewInt32(ctx, worker->exit_code);
+        JSValue ret = JS_Call(ctx, func, JS_UNDEFINED, 1, &code);
+        if (JS_IsException(ret)) {
+            worker_log_exception(ctx);
+        }
+        JS_FreeValue(ctx, ret);
+        JS_FreeValue(ctx, func);
+    }
+
+    worker_release_thiz(worker);
+}
+
+
+/// @brief Get the worker of JS object
+static pomelo_qjs_worker_t * worker_get(JSContext * ctx, JSValue thiz) {
+    pomelo_qjs_runtime_uv_t * runtime =
+        (pomelo_qjs_runtime_uv_t *) pomelo_qjs_runtime_from_js_context(ctx);
+    if (!runtime) return NULL;
+    return JS_GetOpaque(thiz, runtime->class_worker_id);
+}
+
+
+int pomelo_qjs_worker_init(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    JSContext * ctx = runtime->base.ctx;
+    JSRuntime * rt = runtime->base.rt;
+
+    pomelo_list_options_t list_options = {
+        .allocator = runtime->base.allocator,
+        .element_size = sizeof(pomelo_qjs_worker_t *)
+    };
+    runtime->workers = pomelo_list_create(&list_options);
+    if (!runtime->workers) return -1;
+
+    // Generate new class ID
+    JSClassID class_id = 0;
+    if (JS_NewClassID(rt, &class_id) < 0) {
+        return -1;
+    }
+    runtime->class_worker_id = class_id;
+
+    // Register the class
+    JSClassDef class_def = {
+        .class_name = "Worker",
+        .finalizer = pomelo_qjs_worker_finalizer
+    };
+    if (JS_NewClass(rt, class_id, &class_def) < 0) {
+        return -1;
+    }
+
+    // Create prototype for class
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, worker_funcs, countof(worker_funcs));
+
+    JSValue worker_class = JS_NewCFunction2(
+        ctx,
+        pomelo_qjs_worker_constructor,
+        "Worker",
+        /* argc = */ 1,
+        JS_CFUNC_constructor,
+        0
+    );
+    JS_SetConstructor(ctx, worker_class, proto);
+
+    // Set the class prototype
+    JS_SetClassProto(ctx, class_id, proto);
+
+    JSValue global = JS_GetGlobalObject(ctx);
+    int ret = JS_SetPropertyStr(ctx, global, "Worker", worker_class);
+    JS_FreeValue(ctx, global);
+    return (ret < 0) ? -1 : 0;
+}
+
+
+void pomelo_qjs_worker_cleanup(pomelo_qjs_runtime_uv_t * runtime) {
+    assert(runtime != NULL);
+    if (!runtime->workers) return;
+
+    JSContext * ctx = runtime->base.ctx;
+    pomelo_qjs_worker_t * worker = NULL;
+    while (pomelo_list_pop_front(runtime->workers, &worker) == 0) {
+        worker->entry = NULL;
+        bool running = worker->running;
+        if (running) {
+            atomic_store(&worker->terminating, true);
+            worker_signal(worker);
+            worker_join(worker);
+        }
+
+        // Detach the object, it is finalized later by the JS runtime
+        JS_SetOpaque(worker->thiz, NULL);
+        JS_FreeValue(ctx, worker->on_message);
+        worker->on_message = JS_NULL;
+        JS_FreeValue(ctx, worker->on_exit);
+        worker->on_exit = JS_NULL;
+        if (running) {
+            worker_release_thiz(worker);
+        }
+        worker_unref(worker);
+    }
+
+    pomelo_list_destroy(runtime->workers);
+    runtime->workers = NULL;
+}
+
+
+JSValue pomelo_qjs_worker_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) new_target;
+
+    pomelo_qjs_runtime_uv_t * runtime =
+        (pomelo_qjs_runtime_uv_t *) pomelo_qjs_runtime_from_js_context(ctx);
+    assert(runtime != NULL);
+
+    if (argc < 1) return JS_ThrowTypeError(ctx, "Missing module name");
+
+    size_t length = 0;
+    const char * module_name = JS_ToCStringLen(ctx, &length, argv[0]);
+    if (!module_name) return JS_EXCEPTION;
+
+    // Create new js worker object
+    JSValue thiz = JS_NewObjectClass(ctx, runtime->class_worker_id);
+    if (JS_IsException(thiz)) {
+        JS_FreeCString(ctx, module_name);
+        return thiz;
+    }
+
+    pomelo_allocator_t * allocator = runtime->base.allocator;
+    pomelo_qjs_worker_t * worker =
+        pomelo_allocator_malloc_t(allocator, pomelo_qjs_worker_t);
+    if (!worker) {
+        JS_FreeCString(ctx, module_name);
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to allocate worker");
+    }
+    memset(worker, 0, sizeof(pomelo_qjs_worker_t));
+    worker->allocator = allocator;
+    worker->refs = 1; // The object
+    worker->thiz = thiz;
+    worker->on_message = JS_NULL;
+    worker->on_exit = JS_NULL;
+    worker->port_on_message = JS_NULL;
+    worker->parent = runtime;
+    worker->extra = runtime->base.extra;
+    atomic_init(&worker->terminating, false);
+    atomic_init(&worker->exited, false);
+    atomic_init(&worker->worker_open, false);
+    atomic_init(&worker->worker_signalers, 0);
+    JS_SetOpaque(thiz, worker);
+
+    worker->module_name = pomelo_allocator_malloc(allocator, length + 1);
+    if (worker->module_name) {
+        memcpy(worker->module_name, module_name, length + 1);
+    }
+    JS_FreeCString(ctx, module_name);
+
+    if (
+        !worker->module_name ||
+        worker_queue_init(allocator, &worker->to_worker) < 0 ||
+        worker_queue_init(allocator, &worker->to_parent) < 0
+    ) {
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to allocate worker");
+    }
+
+    uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(runtime->platform);
+    if (uv_async_init(uv_loop, &worker->parent_async, worker_on_parent_async)) {
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to initialize worker");
+    }
+    worker->parent_async.data = worker;
+    worker->refs++; // The parent handle
+
+    if (uv_thread_create(&worker->thread, worker_thread_main, worker)) {
+        uv_close(
+            (uv_handle_t *) &worker->parent_async,
+            worker_on_parent_closed
+        );
+        JS_FreeValue(ctx, thiz);
+        return JS_ThrowInternalError(ctx, "Failed to start worker thread");
+    }
+    worker->running = true;
+    worker->entry = pomelo_list_push_back(runtime->workers, worker);
+
+    // The worker holds its object while running
+    return JS_DupValue(ctx, thiz);
+}
+
+
+void pomelo_qjs_worker_finalizer(JSRuntime * rt, JSValue val) {
+    assert(rt != NULL);
+
+    // The runtime may be cleaning up, so the class ID is not looked up
+    JSClassID class_id = 0;
+    pomelo_qjs_worker_t * worker = JS_GetAnyOpaque(val, &class_id);
+    if (!worker) return; // Detached
+
+    // Running workers hold their objects, so the thread has been joined
+    assert(!worker->running);
+    if (worker->entry) {
+        pomelo_list_remove(worker->parent->workers, worker->entry);
+        worker->entry = NULL;
+    }
+
+    JS_FreeValueRT(rt, worker->on_message);
+    JS_FreeValueRT(rt, worker->on_exit);
+    worker_unref(worker);
+}
+
+
+JSValue pomelo_qjs_worker_post_message(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_worker_t * worker = worker_get(ctx, thiz);
+    if (!worker) return JS_ThrowTypeError(ctx, "Invalid worker");
+    if (!worker->running) return JS_UNDEFINED; // Exited
+
+    pomelo_qjs_worker_message_t * message = worker_message_encode(
+        ctx,
+        worker->allocator,
+        (argc > 0) ? argv[0] : JS_UNDEFINED,
+        (argc > 1) ? argv[1] : JS_UNDEFINED
+    );
+    if (!message) return JS_EXCEPTION;
+
+    worker_queue_push(&worker->to_worker, message);
+    worker_signal(worker);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_worker_terminate(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) argc;
+    (void) argv;
+
+    pomelo_qjs_worker_t * worker = worker_get(ctx, thiz);
+    if (!worker) return JS_ThrowTypeError(ctx, "Invalid worker");
+    if (!worker->running) return JS_UNDEFINED;
+
+    // The exit is reported by onexit
+    atomic_store(&worker->terminating, true);
+    worker_signal(worker);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_worker_get_on_message(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_worker_t * worker = worker_get(ctx, thiz);
+    if (!worker) return JS_ThrowTypeError(ctx, "Invalid worker");
+    return JS_DupValue(ctx, worker->on_message);
+}
+
+
+JSValue pomelo_qjs_worker_set_on_message(
+    JSContext * ctx, JSValue thiz, JSValue value
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_worker_t * worker = worker_get(ctx, thiz);
+    if (!worker) return JS_ThrowTypeError(ctx, "Invalid worker");
+
+    JS_FreeValue(ctx, worker->on_message);
+    worker->on_message = JS_DupValue(ctx, value);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_worker_get_on_exit(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    pomelo_qjs_worker_t * worker = worker_get(ctx, thiz);
+    if (!worker) return JS_ThrowTypeError(ctx, "Invalid worker");
+    return JS_DupValue(ctx, worker->on_exit);
+}
+
+
+JSValue pomelo_qjs_worker_set_on_exit(
+    JSContext * ctx, JSValue thiz, JSValue value
+) {
+    assert(ctx != NULL);
+    pomelo_qjs_worker_t * worker = worker_get(ctx, thiz);
+    if (!worker) return JS_ThrowTypeError(ctx, "Invalid worker");
+
+    JS_FreeValue(ctx, worker->on_exit);
+    worker->on_exit = JS_DupValue(ctx, value);
+    return JS_UNDEFINED;
+}
+
+
+/// @brief Get the worker which runs the runtime of context
+static pomelo_qjs_worker_t * worker_get_current(JSContext * ctx) {
+    pomelo_qjs_runtime_uv_t * runtime =
+        (pomelo_qjs_runtime_uv_t *) pomelo_qjs_runtime_from_js_context(ctx);
+    return runtime ? runtime->worker : NULL;
+}
+
+
+JSValue pomelo_qjs_worker_port_post_message(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+) {
+    assert(ctx != NULL);
+    (void) thiz;
+
+    pomelo_qjs_worker_t * worker = worker_get_current(ctx);
+    if (!worker) return JS_ThrowTypeError(ctx, "Not running in a worker");
+
+    pomelo_qjs_worker_message_t * message = worker_message_encode(
+        ctx,
+        worker->allocator,
+        (argc > 0) ? argv[0] : JS_UNDEFINED,
+        (argc > 1) ? argv[1] : JS_UNDEFINED
+    );
+    if (!message) return JS_EXCEPTION;
+
+    // The parent handle is open until this thread is joined
+    worker_queue_push(&worker->to_parent, message);
+    uv_async_send(&worker->parent_async);
+    return JS_UNDEFINED;
+}
+
+
+JSValue pomelo_qjs_worker_port_get_on_message(JSContext * ctx, JSValue thiz) {
+    assert(ctx != NULL);
+    (void) thiz;
+
+    pomelo_qjs_worker_t * worker = worker_get_current(ctx);
+    if (!worker) return JS_ThrowTypeError(ctx, "Not running in a worker");
+    return JS_DupValue(ctx, worker->port_on_message);
+}
+
+
+JSValue pomelo_qjs_worker_port_set_on_message(
+    JSContext * ctx, JSValue thiz, JSValue value
+) {
+    assert(ctx != NULL);
+    (void) thiz;
+
+    pomelo_qjs_worker_t * worker = worker_get_current(ctx);
+    if (!worker) return JS_ThrowTypeError(ctx, "Not running in a worker");
+
+    JS_FreeValue(ctx, worker->port_on_message);
+    worker->port_on_message = JS_DupValue(ctx, value);
+
+    // Listening workers are kept alive
+    uv_handle_t * handle = (uv_handle_t *) &worker->worker_async;
+    if (JS_IsFunction(ctx, value)) {
+        uv_ref(handle);
+    } else {
+        uv_unref(handle);
+    }
+    return JS_UNDEFINED;
+}
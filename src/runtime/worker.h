@@ -0,0 +1,238 @@
+#ifndef POMELO_QJS_WORKER_SRC_H
+#define POMELO_QJS_WORKER_SRC_H
+#include <stdatomic.h>
+#include <uv.h>
+#include "quickjs.h"
+#include "utils/list.h"
+#include "runtime-uv.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Worker threads.
+ *
+ * Every worker runs a module on its own thread with its own runtime, uv loop
+ * and platform. Messages are serialized with the QuickJS object format and
+ * passed through two lock-free single-producer single-consumer queues, one for
+ * each direction. Each side is woken up by an uv_async handle of its loop.
+ *
+ * Transferred objects are copied out of band and detached from the sender.
+ * The receiver adopts the copy of an ArrayBuffer as its backing store. Native
+ * messages belong to the pools of their runtime, so a transferred message is
+ * released by the sender after its payload has been read, and the receiver
+ * writes the copy into a message of its own. Objects are detached only after
+ * all of them have been copied. A posted value must not refer to transferred
+ * objects, since it would carry separate copies of them.
+ */
+
+
+/// @brief The transferable types
+typedef enum pomelo_qjs_worker_transfer_type {
+    /// @brief An ArrayBuffer
+    POMELO_QJS_WORKER_TRANSFER_ARRAY_BUFFER,
+
+    /// @brief A message
+    POMELO_QJS_WORKER_TRANSFER_MESSAGE
+} pomelo_qjs_worker_transfer_type;
+
+
+/// @brief A transferred object
+typedef struct pomelo_qjs_worker_transfer_s pomelo_qjs_worker_transfer_t;
+
+/// @brief A message between a worker and its parent
+typedef struct pomelo_qjs_worker_message_s pomelo_qjs_worker_message_t;
+
+/// @brief The lock-free SPSC queue of messages
+typedef struct pomelo_qjs_worker_queue_s pomelo_qjs_worker_queue_t;
+
+/// @brief The worker
+typedef struct pomelo_qjs_worker_s pomelo_qjs_worker_t;
+
+
+struct pomelo_qjs_worker_transfer_s {
+    /// @brief The type of object
+    pomelo_qjs_worker_transfer_type type;
+
+    /// @brief The content of object. It is owned by the message until the
+    /// object is adopted.
+    uint8_t * data;
+
+    /// @brief The size of content
+    size_t size;
+};
+
+
+struct pomelo_qjs_worker_message_s {
+    /// @brief The next message in queue
+    _Atomic(pomelo_qjs_worker_message_t *) next;
+
+    /// @brief The serialized value
+    uint8_t * data;
+
+    /// @brief The size of serialized value
+    size_t size;
+
+    /// @brief The transferred objects
+    pomelo_qjs_worker_transfer_t * transfers;
+
+    /// @brief The number of transferred objects
+    size_t ntransfers;
+};
+
+
+struct pomelo_qjs_worker_queue_s {
+    /// @brief The stub message, only accessed by the consumer. The next
+    /// message of stub is the front of queue.
+    pomelo_qjs_worker_message_t * head;
+
+    /// @brief The last message, only accessed by the producer
+    pomelo_qjs_worker_message_t * tail;
+};
+
+
+struct pomelo_qjs_worker_s {
+    /// @brief The allocator. It is shared by both threads.
+    pomelo_allocator_t * allocator;
+
+    /// @brief The name of worker module
+    char * module_name;
+
+    /// @brief The extra data of parent runtime, it is passed to worker runtime
+    void * extra;
+
+    /// @brief The worker thread
+    uv_thread_t thread;
+
+    /// @brief Messages from parent to worker
+    pomelo_qjs_worker_queue_t to_worker;
+
+    /// @brief Messages from worker to parent
+    pomelo_qjs_worker_queue_t to_parent;
+
+    /// @brief Whether the worker is requested to terminate
+    atomic_bool terminating;
+
+    /// @brief Whether the worker thread has finished
+    atomic_bool exited;
+
+    /// @brief Whether the wakeup handle of worker can be signaled
+    atomic_bool worker_open;
+
+    /// @brief The number of parent calls which are signaling the worker
+    atomic_int worker_signalers;
+
+    /// @brief The exit code of worker. It is valid once the worker exits.
+    int exit_code;
+
+    /* Parent side */
+
+    /// @brief The parent runtime
+    pomelo_qjs_runtime_uv_t * parent;
+
+    /// @brief The this of worker. It is always a weak reference, an extra
+    /// reference is held while the worker is running.
+    JSValue thiz;
+
+    /// @brief The message callback of parent
+    JSValue on_message;
+
+    /// @brief The exit callback of parent
+    JSValue on_exit;
+
+    /// @brief The wakeup handle of parent loop
+    uv_async_t parent_async;
+
+    /// @brief Whether the worker thread is running (or not joined yet)
+    bool running;
+
+    /// @brief The entry of worker in the list of parent runtime
+    pomelo_list_entry_t * entry;
+
+    /// @brief The number of references which are held by the JS object and
+    /// the wakeup handle of parent
+    int refs;
+
+    /* Worker side */
+
+    /// @brief The worker runtime
+    pomelo_qjs_runtime_uv_t * runtime;
+
+    /// @brief The message callback of worker (parentPort.onmessage)
+    JSValue port_on_message;
+
+    /// @brief The wakeup handle of worker loop
+    uv_async_t worker_async;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Initialize the Worker class of runtime
+int pomelo_qjs_worker_init(pomelo_qjs_runtime_uv_t * runtime);
+
+
+/// @brief Terminate and join all workers of runtime
+void pomelo_qjs_worker_cleanup(pomelo_qjs_runtime_uv_t * runtime);
+
+
+/*----------------------------------------------------------------------------*/
+/*                               Private APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+
+/// @brief Worker.constructor(moduleName: string)
+JSValue pomelo_qjs_worker_constructor(
+    JSContext * ctx, JSValue new_target, int argc, JSValue * argv
+);
+
+
+/// @brief Finalizer of worker
+void pomelo_qjs_worker_finalizer(JSRuntime * rt, JSValue val);
+
+
+/// @brief Worker.postMessage(value: any, transfer?: Transferable[]): void
+JSValue pomelo_qjs_worker_post_message(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Worker.terminate(): void
+JSValue pomelo_qjs_worker_terminate(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief Worker.onmessage: ((event: WorkerMessageEvent) => void) | null
+JSValue pomelo_qjs_worker_get_on_message(JSContext * ctx, JSValue thiz);
+JSValue pomelo_qjs_worker_set_on_message(
+    JSContext * ctx, JSValue thiz, JSValue value
+);
+
+
+/// @brief Worker.onexit: ((exitCode: number) => void) | null
+JSValue pomelo_qjs_worker_get_on_exit(JSContext * ctx, JSValue thiz);
+JSValue pomelo_qjs_worker_set_on_exit(
+    JSContext * ctx, JSValue thiz, JSValue value
+);
+
+
+/// @brief parentPort.postMessage(value: any, transfer?: Transferable[])
+JSValue pomelo_qjs_worker_port_post_message(
+    JSContext * ctx, JSValue thiz, int argc, JSValue * argv
+);
+
+
+/// @brief parentPort.onmessage: ((event: WorkerMessageEvent) => void) | null
+JSValue pomelo_qjs_worker_port_get_on_message(JSContext * ctx, JSValue thiz);
+JSValue pomelo_qjs_worker_port_set_on_message(
+    JSContext * ctx, JSValue thiz, JSValue value
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QJS_WORKER_SRC_H
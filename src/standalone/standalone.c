@@ -1,19 +1,45 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include "quickjs.h"
 #include "logger/logger.h"
+#include "core/context.h"
 #include "runtime/runtime.h"
 #include "runtime/runtime-uv.h"
+#include "supervisor.h"
 
 
-int main(int argc, char * argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <index.js>\n", argv[0]);
-        return -1;
-    }
+#ifndef _WIN32
+/// @brief The publisher of child counters
+typedef struct standalone_publisher_s {
+    /// @brief The timer
+    uv_timer_t timer;
+
+    /// @brief The runtime
+    pomelo_qjs_runtime_t * runtime;
+
+    /// @brief The slot of child
+    pomelo_qjs_fleet_slot_t * slot;
+} standalone_publisher_t;
+
+
+/// @brief Publish callback of child counters
+static void standalone_on_publish(uv_timer_t * timer) {
+    standalone_publisher_t * publisher = timer->data;
+    pomelo_qjs_supervisor_publish(publisher->runtime, publisher->slot);
+}
+#endif
 
-    const char * filename = argv[1];
+
+int pomelo_qjs_standalone_run(
+    const char * filename,
+    size_t shard_index,
+    size_t shard_count,
+    pomelo_qjs_fleet_slot_t * slot
+) {
+    assert(filename != NULL);
     pomelo_allocator_t * allocator = pomelo_allocator_default();
 #ifndef NDEBUG
     size_t allocated_bytes = pomelo_allocator_allocated_bytes(allocator);
@@ -30,16 +56,52 @@ int main(int argc, char * argv[]) {
     pomelo_qjs_runtime_set_extra(runtime, allocator);
     JSContext * ctx = pomelo_qjs_runtime_get_js_context(runtime);
 
+    // Supervised children run as shards of the fleet
+    if (shard_count > 1) {
+        runtime->context->shard_index = shard_index;
+        runtime->context->shard_count = shard_count;
+    }
+
+#ifndef _WIN32
+    // Publish the counters without keeping the loop alive
+    standalone_publisher_t publisher = {
+        .runtime = runtime,
+        .slot = slot
+    };
+    if (slot) {
+        pomelo_qjs_runtime_uv_t * impl = (pomelo_qjs_runtime_uv_t *) runtime;
+        uv_loop_t * uv_loop = pomelo_platform_uv_get_uv_loop(impl->platform);
+        uv_timer_init(uv_loop, &publisher.timer);
+        publisher.timer.data = &publisher;
+        uv_timer_start(
+            &publisher.timer,
+            standalone_on_publish,
+            POMELO_QJS_SUPERVISOR_PUBLISH_INTERVAL_MS,
+            POMELO_QJS_SUPERVISOR_PUBLISH_INTERVAL_MS
+        );
+        uv_unref((uv_handle_t *) &publisher.timer);
+    }
+#else
+    (void) slot; // Processes are never supervised
+#endif
+
+    int ret = -1;
     JSValue module_val = pomelo_qjs_runtime_load_module(runtime, filename);
-    if (JS_IsException(module_val)) {
+    if (!JS_IsException(module_val)) {
+        // Run the file
+        ret = pomelo_qjs_runtime_evaluate_module(runtime, module_val);
+        // No need to free module_val
+    } else {
         JS_FreeValue(ctx, module_val);
-        return -1;
     }
 
-    // Run the file
-    int ret = pomelo_qjs_runtime_evaluate_module(runtime, module_val);
-
-    // No need to free module_val
+#ifndef _WIN32
+    if (slot) {
+        pomelo_qjs_supervisor_publish(runtime, slot);
+        // The close callback is run by destroying the runtime
+        uv_close((uv_handle_t *) &publisher.timer, NULL);
+    }
+#endif
 
     // Destroy the runtime
     pomelo_qjs_runtime_uv_destroy(runtime);
@@ -51,6 +113,41 @@ int main(int argc, char * argv[]) {
 }
 
 
+int main(int argc, char * argv[]) {
+    const char * filename = NULL;
+    long nprocesses = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            char * end = NULL;
+            nprocesses = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || nprocesses < 1) {
+                fprintf(stderr, "Invalid number of processes\n");
+                return -1;
+            }
+        } else if (!filename) {
+            filename = argv[i];
+        }
+    }
+
+    if (!filename) {
+        fprintf(
+            stderr, "Usage: %s [--processes <N>] <index.js>\n", argv[0]
+        );
+        return -1;
+    }
+
+    if (nprocesses > 0) {
+#ifndef _WIN32
+        return pomelo_qjs_supervisor_run(filename, (size_t) nprocesses);
+#else
+        fprintf(stderr, "--processes is not supported on this platform\n");
+        return -1;
+#endif
+    }
+    return pomelo_qjs_standalone_run(filename, 0, 0, NULL);
+}
+
+
 int pomelo_qjs_runtime_load_source(
     pomelo_qjs_runtime_t * runtime,
     pomelo_qjs_source_t * source,
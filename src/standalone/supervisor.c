@@ -0,0 +1,306 @@
+#ifdef _WIN32
+#error "The supervisor requires fork() and is not supported on Windows"
+#endif
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "core/context.h"
+#include "core/shard.h"
+#include "supervisor.h"
+
+
+/// @brief Whether the supervisor is requested to stop
+static volatile sig_atomic_t supervisor_stopping = 0;
+
+/// @brief Whether the fleet totals are requested
+static volatile sig_atomic_t supervisor_report = 0;
+
+
+/// @brief Signal handler of supervisor. SIGCHLD only wakes the supervisor up.
+static void supervisor_on_signal(int signum) {
+    if (signum == SIGUSR1) {
+        supervisor_report = 1;
+    } else if (signum != SIGCHLD) {
+        supervisor_stopping = 1;
+    }
+}
+
+
+/// @brief Get the signals which are handled by supervisor
+static void supervisor_get_signals(sigset_t * signals) {
+    sigemptyset(signals);
+    sigaddset(signals, SIGINT);
+    sigaddset(signals, SIGTERM);
+    sigaddset(signals, SIGUSR1);
+    sigaddset(signals, SIGCHLD);
+}
+
+
+/// @brief Install or reset the signal handlers of supervisor
+static void supervisor_set_signals(void (*handler)(int)) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    action.sa_flags = SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGUSR1, &action, NULL);
+    sigaction(SIGCHLD, &action, NULL);
+}
+
+
+/// @brief Print the fleet totals as a JSON line
+static void supervisor_print_totals(pomelo_qjs_fleet_t * fleet) {
+    uint64_t running = 0;
+    uint64_t restarts = 0;
+    uint64_t allocated_bytes = 0;
+    uint64_t messages = 0;
+    uint64_t sessions = 0;
+    uint64_t expired_messages = 0;
+    uint64_t superseded_messages = 0;
+    uint64_t fec_recovered_messages = 0;
+    uint64_t rate_limited_messages = 0;
+    uint64_t unrouted_messages = 0;
+    uint64_t rejected_connections = 0;
+
+    for (size_t i = 0; i < fleet->nslots; i++) {
+        pomelo_qjs_fleet_slot_t * slot = fleet->slots + i;
+        if (atomic_load(&slot->pid) != 0) running++;
+        restarts += atomic_load(&slot->restarts);
+        allocated_bytes += atomic_load(&slot->allocated_bytes);
+        messages += atomic_load(&slot->messages);
+        sessions += atomic_load(&slot->sessions);
+        expired_messages += atomic_load(&slot->expired_messages);
+        superseded_messages += atomic_load(&slot->superseded_messages);
+        fec_recovered_messages += atomic_load(&slot->fec_recovered_messages);
+        rate_limited_messages += atomic_load(&slot->rate_limited_messages);
+        unrouted_messages += atomic_load(&slot->unrouted_messages);
+        rejected_connections += atomic_load(&slot->rejected_connections);
+    }
+
+    printf(
+        "{\"processes\":%zu,\"running\":%llu,\"restarts\":%llu,"
+        "\"allocatedBytes\":%llu,\"messages\":%llu,\"sessions\":%llu,"
+        "\"expiredMessages\":%llu,\"supersededMessages\":%llu,"
+        "\"fecRecoveredMessages\":%llu,\"rateLimitedMessages\":%llu,"
+        "\"unroutedMessages\":%llu,\"rejectedConnections\":%llu}\n",
+        fleet->nslots,
+        (unsigned long long) running,
+        (unsigned long long) restarts,
+        (unsigned long long) allocated_bytes,
+        (unsigned long long) messages,
+        (unsigned long long) sessions,
+        (unsigned long long) expired_messages,
+        (unsigned long long) superseded_messages,
+        (unsigned long long) fec_recovered_messages,
+        (unsigned long long) rate_limited_messages,
+        (unsigned long long) unrouted_messages,
+        (unsigned long long) rejected_connections
+    );
+    fflush(stdout);
+}
+
+
+/// @brief Fork a child running shard index
+/// @param mask The signal mask of child
+/// @return Returns the process ID of child or -1 on failure
+static pid_t supervisor_spawn(
+    const char * filename,
+    pomelo_qjs_fleet_t * fleet,
+    size_t index,
+    const sigset_t * mask
+) {
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid != 0) return pid; // Supervisor or failure
+
+    // Child process
+    supervisor_set_signals(SIG_DFL);
+    sigprocmask(SIG_SETMASK, mask, NULL);
+    pomelo_qjs_fleet_slot_t * slot = fleet->slots + index;
+    int ret = pomelo_qjs_standalone_run(filename, index, fleet->nslots, slot);
+    _exit(ret == 0 ? 0 : 1);
+}
+
+
+/// @brief Find the slot of child
+static size_t supervisor_find_slot(pomelo_qjs_fleet_t * fleet, pid_t pid) {
+    for (size_t i = 0; i < fleet->nslots; i++) {
+        if (atomic_load(&fleet->slots[i].pid) == (int64_t) pid) return i;
+    }
+    return fleet->nslots;
+}
+
+
+/// @brief Send a signal to all running children
+static void supervisor_kill_all(pomelo_qjs_fleet_t * fleet, int signum) {
+    for (size_t i = 0; i < fleet->nslots; i++) {
+        int64_t pid = atomic_load(&fleet->slots[i].pid);
+        if (pid > 0) kill((pid_t) pid, signum);
+    }
+}
+
+
+int pomelo_qjs_supervisor_run(const char * filename, size_t nprocesses) {
+    assert(filename != NULL);
+    if (nprocesses < 1 || nprocesses > POMELO_QJS_SHARD_MAX_COUNT) {
+        fprintf(
+            stderr,
+            "Processes must be in [1, %d]\n",
+            POMELO_QJS_SHARD_MAX_COUNT
+        );
+        return -1;
+    }
+
+    // The segment is inherited by all children
+    size_t size = sizeof(pomelo_qjs_fleet_t) +
+        nprocesses * sizeof(pomelo_qjs_fleet_slot_t);
+    pomelo_qjs_fleet_t * fleet = mmap(
+        NULL,
+        size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (fleet == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the shared statistic\n");
+        return -1;
+    }
+    memset(fleet, 0, size);
+    fleet->nslots = nprocesses;
+
+    // The signals are only delivered while waiting in sigsuspend, so none of
+    // them arrives between checking the flags and waiting
+    sigset_t signals;
+    sigset_t old_mask;
+    supervisor_get_signals(&signals);
+    sigprocmask(SIG_BLOCK, &signals, &old_mask);
+    supervisor_set_signals(supervisor_on_signal);
+
+    sigset_t wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+    sigdelset(&wait_mask, SIGUSR1);
+    sigdelset(&wait_mask, SIGCHLD);
+
+    time_t started_at[POMELO_QJS_SHARD_MAX_COUNT] = {0};
+    size_t nrunning = 0;
+    for (size_t i = 0; i < nprocesses; i++) {
+        pid_t pid = supervisor_spawn(filename, fleet, i, &old_mask);
+        if (pid < 0) {
+            fprintf(stderr, "Failed to fork process %zu\n", i);
+            continue;
+        }
+        atomic_store(&fleet->slots[i].pid, (int64_t) pid);
+        started_at[i] = time(NULL);
+        nrunning++;
+    }
+
+    int exit_code = 0;
+    bool stopping = false;
+    while (nrunning > 0) {
+        if (supervisor_stopping && !stopping) {
+            stopping = true;
+            supervisor_kill_all(fleet, SIGTERM);
+        }
+        if (supervisor_report) {
+            supervisor_report = 0;
+            supervisor_print_totals(fleet);
+        }
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid == 0) {
+            // No child has exited, wait for the next signal
+            sigsuspend(&wait_mask);
+            continue;
+        }
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break; // No children anymore
+        }
+
+        size_t index = supervisor_find_slot(fleet, pid);
+        if (index == nprocesses) continue; // Not a supervised child
+        pomelo_qjs_fleet_slot_t * slot = fleet->slots + index;
+        atomic_store(&slot->pid, 0);
+        nrunning--;
+
+        bool crashed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        if (!crashed || stopping) continue;
+
+        fprintf(stderr, "Process %zu (%d) crashed, restarting\n", index, pid);
+        exit_code = 1;
+
+        // Avoid busy restarting of children which crash on startup
+        time_t lifetime = time(NULL) - started_at[index];
+        if (lifetime < POMELO_QJS_SUPERVISOR_RESTART_DELAY) {
+            // Stop requests interrupt the delay, exits of other children
+            // are collected after it
+            sigset_t sleep_mask = wait_mask;
+            sigaddset(&sleep_mask, SIGCHLD);
+            sigprocmask(SIG_SETMASK, &sleep_mask, NULL);
+            time_t until = time(NULL) + POMELO_QJS_SUPERVISOR_RESTART_DELAY;
+            while (!supervisor_stopping && time(NULL) < until) {
+                sleep((unsigned int) (until - time(NULL)));
+            }
+            sigprocmask(SIG_BLOCK, &signals, NULL);
+        }
+        if (supervisor_stopping) continue;
+
+        pid = supervisor_spawn(filename, fleet, index, &old_mask);
+        if (pid < 0) {
+            fprintf(stderr, "Failed to fork process %zu\n", index);
+            continue;
+        }
+        atomic_store(&slot->pid, (int64_t) pid);
+        atomic_fetch_add(&slot->restarts, 1);
+        started_at[index] = time(NULL);
+        nrunning++;
+    }
+
+    supervisor_set_signals(SIG_DFL);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    supervisor_print_totals(fleet);
+    munmap(fleet, size);
+    return exit_code;
+}
+
+
+void pomelo_qjs_supervisor_publish(
+    pomelo_qjs_runtime_t * runtime,
+    pomelo_qjs_fleet_slot_t * slot
+) {
+    assert(runtime != NULL);
+    assert(slot != NULL);
+
+    pomelo_qjs_context_t * context = runtime->context;
+    pomelo_statistic_t statistic = {0};
+    pomelo_context_statistic(context->context, &statistic);
+
+    atomic_store(&slot->allocated_bytes, statistic.allocator.allocated_bytes);
+    atomic_store(&slot->messages, statistic.api.messages);
+    atomic_store(
+        &slot->sessions,
+        statistic.api.builtin_sessions + statistic.api.plugin_sessions
+    );
+    atomic_store(&slot->expired_messages, context->expired_messages);
+    atomic_store(&slot->superseded_messages, context->superseded_messages);
+    atomic_store(
+        &slot->fec_recovered_messages, context->fec_recovered_messages
+    );
+    atomic_store(&slot->rate_limited_messages, context->rate_limited_messages);
+    atomic_store(&slot->unrouted_messages, context->unrouted_messages);
+    atomic_store(&slot->rejected_connections, context->rejected_connections);
+}
@@ -0,0 +1,111 @@
+#ifndef POMELO_QJS_SUPERVISOR_SRC_H
+#define POMELO_QJS_SUPERVISOR_SRC_H
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "runtime/runtime.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Multi-process supervisor.
+ *
+ * The supervisor forks N children, each child runs the entry module as shard
+ * K of N (see `core/shard.h`). Sockets of children listen as their shard
+ * only with the `supervised` listen option. Crashed children are restarted
+ * with the same shard index, so their clients are routed to the same port
+ * again.
+ *
+ * The supervisor is only available on POSIX platforms, the host reports an
+ * error for `--processes` on Windows.
+ *
+ * Every child publishes its counters to its slot of a shared memory segment
+ * which is mapped before forking. The supervisor prints the fleet totals on
+ * SIGUSR1 and when it exits.
+ */
+
+
+/// @brief The interval of publishing child counters in milliseconds
+#define POMELO_QJS_SUPERVISOR_PUBLISH_INTERVAL_MS 1000
+
+
+/// @brief The minimum lifetime of a child in seconds. Children crashing
+/// earlier are restarted after this delay.
+#define POMELO_QJS_SUPERVISOR_RESTART_DELAY 1
+
+
+/// @brief The counters of a child process
+typedef struct pomelo_qjs_fleet_slot_s pomelo_qjs_fleet_slot_t;
+
+/// @brief The shared memory segment of all children
+typedef struct pomelo_qjs_fleet_s pomelo_qjs_fleet_t;
+
+
+struct pomelo_qjs_fleet_slot_s {
+    /// @brief The process ID of child. Zero if the child is not running.
+    _Atomic(int64_t) pid;
+
+    /// @brief The number of restarts of this slot
+    _Atomic(uint64_t) restarts;
+
+    /// @brief The allocated bytes of child
+    _Atomic(uint64_t) allocated_bytes;
+
+    /// @brief The number of native messages of child
+    _Atomic(uint64_t) messages;
+
+    /// @brief The number of sessions of child
+    _Atomic(uint64_t) sessions;
+
+    /// @brief The binding counters of child, see `statistic()`
+    _Atomic(uint64_t) expired_messages;
+    _Atomic(uint64_t) superseded_messages;
+    _Atomic(uint64_t) fec_recovered_messages;
+    _Atomic(uint64_t) rate_limited_messages;
+    _Atomic(uint64_t) unrouted_messages;
+    _Atomic(uint64_t) rejected_connections;
+};
+
+
+struct pomelo_qjs_fleet_s {
+    /// @brief The number of slots
+    size_t nslots;
+
+    /// @brief The slots, one per child
+    pomelo_qjs_fleet_slot_t slots[];
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*                                Public APIs                                 */
+/*----------------------------------------------------------------------------*/
+
+/// @brief Run the entry module in N supervised child processes. It returns
+/// once every child has exited normally or the supervisor is terminated.
+/// @return Returns the exit code of supervisor
+int pomelo_qjs_supervisor_run(const char * filename, size_t nprocesses);
+
+
+/// @brief Publish the counters of runtime to slot
+void pomelo_qjs_supervisor_publish(
+    pomelo_qjs_runtime_t * runtime,
+    pomelo_qjs_fleet_slot_t * slot
+);
+
+
+/// @brief Run the entry module as shard K of N (it is defined by standalone).
+/// The counters are published to slot periodically if it is not NULL.
+/// @return Returns the exit code of module
+int pomelo_qjs_standalone_run(
+    const char * filename,
+    size_t shard_index,
+    size_t shard_count,
+    pomelo_qjs_fleet_slot_t * slot
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // POMELO_QJS_SUPERVISOR_SRC_H
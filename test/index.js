@@ -2,6 +2,8 @@ import testToken from "./token-test.js";
 import testMessage from "./message-test.js";
 import testSocket from "./socket-test.js";
 import testSTD from "./std-test.js";
+import testSnapshotBuffer from "./snapshot-test.js";
+import testLoopback from "./loopback-test.js";
 import { statistic } from "pomelo";
 
 
@@ -16,9 +18,15 @@ async function test() {
     ret = testSocket();
     console.log(`Test socket: ${ret ? "OK" : "Failed"}`);
 
+    ret = testSnapshotBuffer();
+    console.log(`Test snapshot buffer: ${ret ? "OK" : "Failed"}`);
+
     ret = await testSTD();
     console.log(`Test std: ${ret ? "OK" : "Failed"}`);
 
+    ret = await testLoopback();
+    console.log(`Test loopback: ${ret ? "OK" : "Failed"}`);
+
     // Check statistic
     const stat = convertBigInt(statistic());
     console.log(JSON.stringify(stat, null, 2));
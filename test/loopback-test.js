@@ -0,0 +1,945 @@
+import {
+    Token, Socket, Message, ChannelMode, SessionTable, LockstepAggregator,
+    statistic
+} from "pomelo";
+
+/// Loopback tests of binding features. Every test connects its own client and
+/// server sockets on a dedicated port.
+
+const HOST = "127.0.0.1";
+const BASE_PORT = 8890;
+const PROTOCOL_ID = 129;
+const CLIENT_ID = 456;
+const TIMEOUT_MS = 5000;
+
+
+function createPrivateKey() {
+    const privateKey = new Uint8Array(Token.KEY_BYTES);
+    for (let i = 0; i < Token.KEY_BYTES; i++) privateKey[i] = i;
+    return privateKey;
+}
+
+
+function createConnectToken(privateKey, address, clientId) {
+    const nonce = new Uint8Array(Token.CONNECT_TOKEN_NONCE_BYTES);
+    const clientToServerKey = new Uint8Array(Token.KEY_BYTES);
+    const serverToClientKey = new Uint8Array(Token.KEY_BYTES);
+    for (let i = 0; i < Token.KEY_BYTES; i++) {
+        clientToServerKey[i] = (i * 5) % 128;
+        serverToClientKey[i] = (i * 7) % 128;
+    }
+    nonce.fill(3);
+
+    return Token.encode(
+        privateKey,
+        PROTOCOL_ID,
+        Date.now(),
+        Date.now() + 3600 * 1000000000,
+        nonce,
+        -1,
+        [ address ],
+        clientToServerKey,
+        serverToClientKey,
+        clientId,
+        new Uint8Array(Token.USER_DATA_BYTES)
+    );
+}
+
+
+/// Connect a client socket to a server socket. The returned pair forwards
+/// received messages to its onServerReceived and onClientReceived handlers.
+function connectPair(
+    port,
+    channels,
+    options,
+    clientOptions = options,
+    clientId = CLIENT_ID
+) {
+    const address = `${HOST}:${port}`;
+    const privateKey = createPrivateKey();
+
+    const pair = {
+        client: new Socket(channels, clientOptions),
+        server: new Socket(channels, options),
+        clientSession: null,
+        serverSession: null,
+        onServerReceived: null,
+        onClientReceived: null,
+        onServerDisconnected: null,
+        stop() {
+            this.client.stop();
+            this.server.stop();
+        }
+    };
+
+    return new Promise((resolve, reject) => {
+        const check = () => {
+            if (pair.clientSession && pair.serverSession) resolve(pair);
+        };
+
+        pair.server.setListener({
+            onConnected(session) {
+                pair.serverSession = session;
+                check();
+            },
+            onDisconnected(session) {
+                if (pair.onServerDisconnected) {
+                    pair.onServerDisconnected(session);
+                }
+            },
+            onReceived(session, message) {
+                if (pair.onServerReceived) {
+                    pair.onServerReceived(session, message);
+                }
+            }
+        });
+
+        pair.client.setListener({
+            onConnected(session) {
+                pair.clientSession = session;
+                check();
+            },
+            onDisconnected() {},
+            onReceived(session, message) {
+                if (pair.onClientReceived) {
+                    pair.onClientReceived(session, message);
+                }
+            }
+        });
+
+        pair.server.listen(privateKey, PROTOCOL_ID, 4, address)
+            .then(() => pair.client.connect(
+                createConnectToken(privateKey, address, clientId)
+            ))
+            .catch(reject);
+    });
+}
+
+
+/// Reject if the promise does not settle in time
+function withTimeout(promise) {
+    return new Promise((resolve, reject) => {
+        const timer = setTimeout(
+            () => reject(new Error("Timed out")),
+            TIMEOUT_MS
+        );
+        promise.then((value) => {
+            clearTimeout(timer);
+            resolve(value);
+        }, (error) => {
+            clearTimeout(timer);
+            reject(error);
+        });
+    });
+}
+
+
+/// Collect the first uint32 of the next count messages received by server
+function collectServer(pair, count) {
+    return withTimeout(new Promise((resolve) => {
+        const values = [];
+        pair.onServerReceived = (session, message) => {
+            values.push(message.readUint32());
+            if (values.length === count) resolve(values);
+        };
+    }));
+}
+
+
+function createMessage(value) {
+    const message = new Message();
+    message.writeUint32(value);
+    return message;
+}
+
+
+function sameValues(a, b) {
+    return a.length === b.length && a.every((value, i) => value === b[i]);
+}
+
+
+/// Messages behind queued ones keep their order, keyed and scattered ones
+/// included
+async function testSendOrder(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        maxInFlight: 1
+    });
+
+    const expected = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9];
+    const received = collectServer(pair, expected.length);
+    for (const value of expected.slice(0, 8)) {
+        const options = (value % 2 === 0) ? { maxAge: 10000 } : undefined;
+        pair.clientSession.send(0, createMessage(value), options);
+    }
+    pair.clientSession.sendLatest(0, 7, createMessage(8));
+
+    const bytes = createMessage(9).read(4);
+    pair.client.sendScatter(
+        0, [ pair.clientSession ], bytes, Uint32Array.of(0), Uint32Array.of(4)
+    );
+
+    const values = await received;
+    pair.stop();
+    return sameValues(values, expected);
+}
+
+
+/// Queued messages are dropped once they exceed their max age
+async function testSendExpiry(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        maxInFlight: 1
+    });
+
+    const received = collectServer(pair, 2);
+    const session = pair.clientSession;
+    const first = session.send(0, createMessage(0));
+    const stale = session.send(0, createMessage(1), { maxAge: 1 });
+    const last = session.send(0, createMessage(2));
+
+    // Let the queued message become stale before the first one completes
+    const start = Date.now();
+    while (Date.now() - start < 5);
+
+    const results = await withTimeout(Promise.all([first, stale, last]));
+    const values = await received;
+    pair.stop();
+    return sameValues(results, [1, 0, 1]) && sameValues(values, [0, 2]);
+}
+
+
+/// Keyed messages supersede waiting ones of the same key and channel only
+async function testSendLatest(port) {
+    const channels = [ ChannelMode.RELIABLE, ChannelMode.RELIABLE ];
+    const pair = await connectPair(port, channels);
+
+    const received = collectServer(pair, 3);
+    const session = pair.clientSession;
+    const sending = [
+        session.sendLatest(0, 7, createMessage(0)),
+        session.sendLatest(0, 7, createMessage(1)),
+        session.sendLatest(0, 7, createMessage(2)),
+        session.sendLatest(1, 7, createMessage(3))
+    ];
+
+    const results = await withTimeout(Promise.all(sending));
+    const values = await received;
+    values.sort((a, b) => a - b);
+    pair.stop();
+    return sameValues(results, [1, 0, 1, 1]) && sameValues(values, [0, 2, 3]);
+}
+
+
+/// On framed sockets, a key stays busy until the peer acknowledges it, and
+/// keys must be integers in [0, 2^32)
+async function testSendLatestAcked(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        framed: true
+    });
+
+    const session = pair.clientSession;
+    const invalid = [1.5, -1, NaN, 2 ** 32].filter((key) => {
+        try {
+            session.sendLatest(0, key, createMessage(0));
+            return false;
+        } catch (error) {
+            return true;
+        }
+    });
+
+    const received = collectServer(pair, 2);
+    const sending = [0, 1, 2, 3].map(
+        (value) => session.sendLatest(0, 7, createMessage(value))
+    );
+
+    const results = await withTimeout(Promise.all(sending));
+    const values = await received;
+    pair.stop();
+    return (
+        invalid.length === 4 &&
+        sameValues(results, [1, 0, 0, 1]) &&
+        sameValues(values, [0, 3])
+    );
+}
+
+
+/// Framed messages are delivered without their frame headers
+async function testFramedPayload(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        framed: true
+    });
+
+    const received = withTimeout(new Promise((resolve) => {
+        const sizes = [];
+        pair.onServerReceived = (session, message) => {
+            sizes.push(message.size());
+            if (sizes.length === 2) resolve(sizes);
+        };
+    }));
+
+    pair.clientSession.send(0, createMessage(1));
+    pair.clientSession.send(0, new Message());
+
+    const sizes = await received;
+    pair.stop();
+    return sameValues(sizes, [4, 0]);
+}
+
+
+/// A lost message of FEC group is rebuilt from the parity. The client is not
+/// framed, so it writes the frames of a group by hand and skips the second
+/// data frame.
+async function testFecRecovery(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        channels: [ { fec: 2 } ]
+    }, {});
+
+    const first = [1, 2, 3, 4];
+    const lost = [9, 8, 7, 6];
+    const received = withTimeout(new Promise((resolve) => {
+        const payloads = [];
+        pair.onServerReceived = (session, message) => {
+            payloads.push(Array.from(message.read(message.size())));
+            if (payloads.length === 2) resolve(payloads);
+        };
+    }));
+
+    // FEC data frame: type, channel, group, index and payload
+    const data = new Message();
+    data.writeUint8(2);
+    data.writeUint8(0);
+    data.writeUint32(0);
+    data.writeUint8(0);
+    data.write(Uint8Array.from(first));
+
+    // FEC parity frame: type, channel, group, group size, XOR of payload
+    // sizes and XOR of payloads
+    const parity = new Message();
+    parity.writeUint8(3);
+    parity.writeUint8(0);
+    parity.writeUint32(0);
+    parity.writeUint8(2);
+    parity.writeUint16(first.length ^ lost.length);
+    parity.write(Uint8Array.from(first.map((value, i) => value ^ lost[i])));
+
+    const recovered = statistic().binding.fecRecoveredMessages;
+    pair.clientSession.send(0, data);
+    pair.clientSession.send(0, parity);
+
+    const payloads = await received;
+    const count = statistic().binding.fecRecoveredMessages - recovered;
+    pair.stop();
+    return (
+        count === 1 &&
+        sameValues(payloads[0], first) &&
+        sameValues(payloads[1], lost)
+    );
+}
+
+
+/// Timed frames which arrive later than their remaining age are dropped by
+/// the receiver. The client is not framed, so it writes the frames by hand
+/// with a clock of its own and backdates the second one.
+async function testSendLate(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        framed: true
+    }, {});
+
+    // Timed data frame: type, channel, sending time, remaining age, payload
+    const createTimed = (sentTime, maxAge, value) => {
+        const message = new Message();
+        message.writeUint8(6);
+        message.writeUint8(0);
+        message.writeUint32(sentTime);
+        message.writeUint32(maxAge);
+        message.writeUint32(value);
+        return message;
+    };
+
+    const received = collectServer(pair, 2);
+    const expired = statistic().binding.expiredMessages;
+    pair.clientSession.send(0, createTimed(100000, 1000, 0));
+    pair.clientSession.send(0, createTimed(90000, 1000, 1));
+    pair.clientSession.send(0, createTimed(100000, 1000, 2));
+
+    const values = await received;
+    const count = statistic().binding.expiredMessages - expired;
+    pair.stop();
+    return count === 1 && sameValues(values, [0, 2]);
+}
+
+
+/// Acknowledged messages complete when the peer acknowledges them
+async function testAckSettlement(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        framed: true
+    });
+
+    const expected = [0, 1, 2, 3, 4];
+    const received = collectServer(pair, expected.length);
+    const sending = expected.map((value) => (
+        pair.clientSession.send(0, createMessage(value), { ack: true })
+    ));
+
+    const results = await withTimeout(Promise.all(sending));
+    const values = await received;
+    pair.stop();
+    return (
+        results.every((result) => result === 1) &&
+        sameValues(values, expected)
+    );
+}
+
+
+/// Only user messages consume the rate limit, acknowledgements never do
+async function testRateLimit(port) {
+    const options = { framed: true, rateLimit: { messagesPerSecond: 2 } };
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], options);
+
+    const values = [];
+    pair.onServerReceived = (session, message) => {
+        values.push(message.readUint32());
+    };
+
+    // Both messages fit the burst and their acks reach the limited client
+    const session = pair.clientSession;
+    const acked = await withTimeout(Promise.all([
+        session.send(0, createMessage(0), { ack: true }),
+        session.send(0, createMessage(1), { ack: true })
+    ]));
+
+    const limited = statistic().binding.rateLimitedMessages;
+    await withTimeout(Promise.all([
+        session.send(0, createMessage(2)),
+        session.send(0, createMessage(3)),
+        session.send(0, createMessage(4))
+    ]));
+
+    // Give the dropped messages time to arrive
+    await new Promise((resolve) => setTimeout(resolve, 100));
+    const count = statistic().binding.rateLimitedMessages - limited;
+    pair.stop();
+    return (
+        sameValues(acked, [1, 1]) &&
+        sameValues(values, [0, 1]) &&
+        count === 3
+    );
+}
+
+
+/// Routed messages reach their handler past the opcode, unknown opcodes are
+/// dropped natively
+async function testRoute(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ]);
+
+    const received = withTimeout(new Promise((resolve) => {
+        const values = [];
+        pair.server.route(1, (session, message) => {
+            values.push(message.readUint32());
+            if (values.length === 2) resolve(values);
+        });
+    }));
+
+    const unrouted = statistic().binding.unroutedMessages;
+    for (const [opcode, value] of [[1, 7], [9, 8], [1, 9]]) {
+        const message = new Message();
+        message.writeUint8(opcode);
+        message.writeUint32(value);
+        pair.clientSession.send(0, message);
+    }
+
+    const values = await received;
+    const count = statistic().binding.unroutedMessages - unrouted;
+    pair.stop();
+    return sameValues(values, [7, 9]) && count === 1;
+}
+
+
+/// Every session receives its own slice of a shared buffer
+async function testSendScatter(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ]);
+
+    const received = withTimeout(new Promise((resolve) => {
+        const values = [];
+        pair.onClientReceived = (session, message) => {
+            values.push(message.readUint8());
+            if (values.length === 4) resolve(values);
+        };
+    }));
+
+    // Both buffer types are accepted
+    const bytes = Uint8Array.of(10, 11, 12, 13);
+    const sessions = [ pair.serverSession, pair.serverSession ];
+    const offsets = Uint32Array.of(0, 1);
+    const lengths = Uint32Array.of(1, 1);
+    const sent = [
+        pair.server.sendScatter(0, sessions, bytes, offsets, lengths),
+        pair.server.sendScatter(
+            0, sessions, bytes.slice(2).buffer, offsets, lengths
+        )
+    ];
+
+    const values = await received;
+    pair.stop();
+    return sameValues(sent, [2, 2]) && sameValues(values, [10, 11, 12, 13]);
+}
+
+
+/// A batch is validated as a whole and sends each message on its channel
+async function testSendMany(port) {
+    const channels = [ ChannelMode.RELIABLE, ChannelMode.RELIABLE ];
+    const pair = await connectPair(port, channels);
+
+    const received = collectServer(pair, 3);
+    const session = pair.clientSession;
+
+    // An invalid element rejects the whole batch
+    let rejected = false;
+    try {
+        session.sendMany([0, 5], [createMessage(8), createMessage(9)]);
+    } catch (error) {
+        rejected = true;
+    }
+
+    const messages = [createMessage(0), createMessage(1), createMessage(2)];
+    const sent = await withTimeout(session.sendMany([0, 1, 0], messages));
+    const values = await received;
+    values.sort((a, b) => a - b);
+    pair.stop();
+    return rejected && sent === 3 && sameValues(values, [0, 1, 2]);
+}
+
+
+/// Rows of disconnected sessions are cleared, even if JS detached the buffer
+/// of another column
+async function testSessionTable(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ]);
+    const table = new SessionTable(pair.server, 16);
+    const health = table.column("health", "float32");
+    const team = table.column("team", "uint8");
+
+    const index = pair.serverSession.index;
+    health[index] = 5;
+    team[index] = 2;
+    if (team.buffer.transfer) team.buffer.transfer();
+
+    const disconnected = withTimeout(new Promise((resolve) => {
+        pair.onServerDisconnected = resolve;
+    }));
+    pair.clientSession.disconnect();
+    await disconnected;
+
+    pair.stop();
+    return table.column("health", "float32") === health && health[index] === 0;
+}
+
+
+/// Every sent and received message is counted once
+async function testSessionMetrics(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ]);
+
+    const received = collectServer(pair, 3);
+    const session = pair.clientSession;
+    session.send(0, createMessage(0));
+    session.sendMany([0, 0], [createMessage(1), createMessage(2)]);
+    await received;
+
+    const fields = [ "messagesOut", "bytesOut" ];
+    const sent = new Float64Array(16 * fields.length);
+    pair.client.exportSessionMetrics(sent, fields);
+    const sentRow = session.index * fields.length;
+
+    const inbound = new Float64Array(16);
+    pair.server.exportSessionMetrics(inbound, [ "messagesIn" ]);
+    const receivedCount = inbound[pair.serverSession.index];
+
+    pair.stop();
+    return (
+        sent[sentRow] === 3 &&
+        sent[sentRow + 1] === 12 &&
+        receivedCount === 3
+    );
+}
+
+
+/// Session IDs beyond the safe integer range are only exposed as bigint
+async function testIdNumber(port) {
+    const small = await connectPair(port, [ ChannelMode.RELIABLE ]);
+    const exact = small.serverSession.idNumber === CLIENT_ID;
+    small.stop();
+
+    const bigId = 2n ** 53n + 1n;
+    const big = await connectPair(
+        port + 100, [ ChannelMode.RELIABLE ], {}, {}, bigId
+    );
+    let rejected = false;
+    try {
+        big.serverSession.idNumber;
+    } catch (error) {
+        rejected = error instanceof RangeError;
+    }
+    const id = big.serverSession.id;
+    big.stop();
+    return exact && rejected && id === bigId;
+}
+
+
+/// A socket without onConnected still receives messages, its sessions are
+/// wrapped when they first reach JS
+async function testReceiveWithoutConnected(port) {
+    const channels = [ ChannelMode.RELIABLE ];
+    const privateKey = createPrivateKey();
+    const address = `${HOST}:${port}`;
+    const server = new Socket(channels);
+    const client = new Socket(channels);
+
+    const received = withTimeout(new Promise((resolve) => {
+        server.setListener({
+            onDisconnected() {},
+            onReceived(session, message) {
+                resolve([ session.id, message.readUint32() ]);
+            }
+        });
+    }));
+    client.setListener({
+        onConnected(session) {
+            session.send(0, createMessage(42));
+        },
+        onDisconnected() {},
+        onReceived() {}
+    });
+
+    await server.listen(privateKey, PROTOCOL_ID, 4, address);
+    await client.connect(createConnectToken(privateKey, address, CLIENT_ID));
+
+    const [ id, value ] = await received;
+    client.stop();
+    server.stop();
+    return id === BigInt(CLIENT_ID) && value === 42;
+}
+
+
+/// Servers look sessions up by client ID, visit them and disconnect them
+async function testSessionLookup(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ]);
+    const server = pair.server;
+    const session = pair.serverSession;
+
+    const visited = [];
+    server.forEachSession((item) => visited.push(item));
+    const found = (
+        server.sessionCount === 1 &&
+        server.getSession(CLIENT_ID) === session &&
+        server.getSession(BigInt(CLIENT_ID)) === session &&
+        server.getSession(CLIENT_ID + 1) === undefined &&
+        visited.length === 1 &&
+        visited[0] === session
+    );
+
+    const disconnected = withTimeout(new Promise((resolve) => {
+        pair.onServerDisconnected = resolve;
+    }));
+    const filtered = server.disconnectAll(() => false);
+    const all = server.disconnectAll();
+    await disconnected;
+
+    const count = server.sessionCount;
+    pair.stop();
+    return found && filtered === 0 && all === 1 && count === 0;
+}
+
+
+/// serverTime() moves forward, and after connecting again it follows the
+/// new server instead of staying clamped to the previous one
+async function testServerTime(port) {
+    const channels = [ ChannelMode.RELIABLE ];
+    const pair = await connectPair(port, channels);
+    const first = pair.client.serverTime();
+    await new Promise((resolve) => setTimeout(resolve, 20));
+    const second = pair.client.serverTime();
+    pair.stop();
+
+    // Another server which starts later
+    const privateKey = createPrivateKey();
+    const address = `${HOST}:${port + 100}`;
+    const server = new Socket(channels);
+    const connected = withTimeout(new Promise((resolve) => {
+        server.setListener({
+            onConnected: resolve,
+            onDisconnected() {},
+            onReceived() {}
+        });
+    }));
+
+    await server.listen(privateKey, PROTOCOL_ID, 4, address);
+    await pair.client.connect(
+        createConnectToken(privateKey, address, CLIENT_ID)
+    );
+    await connected;
+
+    const third = pair.client.serverTime();
+    const expected = server.serverTime();
+    pair.client.stop();
+    server.stop();
+    return second > first && Math.abs(third - expected) < 1000;
+}
+
+
+/// Invalid thresholds are rejected, and full servers deny new clients
+async function testAdmission(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ]);
+
+    let rejected = false;
+    try {
+        pair.server.setAdmissionPolicy({ maxSessions: Infinity });
+    } catch (error) {
+        rejected = error instanceof RangeError;
+    }
+    pair.server.setAdmissionPolicy({ maxSessions: 1 });
+
+    const rejectedConnections = statistic().binding.rejectedConnections;
+    const extra = new Socket([ ChannelMode.RELIABLE ]);
+    extra.setListener({
+        onConnected() {},
+        onDisconnected() {},
+        onReceived() {}
+    });
+    const address = `${HOST}:${port}`;
+    extra.connect(createConnectToken(
+        createPrivateKey(), address, CLIENT_ID + 1
+    ));
+
+    const denied = await withTimeout(new Promise((resolve) => {
+        const poll = () => {
+            const binding = statistic().binding;
+            if (binding.rejectedConnections > rejectedConnections) {
+                resolve(binding.rejectedConnections - rejectedConnections);
+            } else {
+                setTimeout(poll, 10);
+            }
+        };
+        poll();
+    }));
+
+    extra.stop();
+    pair.stop();
+    return rejected && denied === 1;
+}
+
+
+/// Shard K of a sharded server serves the clients of K on its own port, and
+/// misrouted clients are denied. The server runs in a worker with its own
+/// entry module, since shards run the entry module again. Its address is
+/// fixed in shard-server.js.
+async function testShards() {
+    const base = `${HOST}:8880`;
+    const path = import.meta.url.replace(/[^/]*$/, "shard-server.js");
+    const worker = new Worker(path);
+    const replies = [];
+    const exited = new Promise((resolve) => {
+        worker.onexit = resolve;
+    });
+    worker.onmessage = (event) => replies.shift()(event.data);
+    const reply = () => withTimeout(new Promise((resolve) => {
+        replies.push(resolve);
+    }));
+
+    const clients = [];
+    const greet = (clientId, address) => {
+        const client = new Socket([ ChannelMode.RELIABLE ]);
+        clients.push(client);
+        const greeted = new Promise((resolve) => {
+            client.setListener({
+                onConnected() {},
+                onDisconnected() {},
+                onReceived() {
+                    resolve(true);
+                }
+            });
+        });
+        client.connect(
+            createConnectToken(createPrivateKey(), address, clientId)
+        );
+        return greeted;
+    };
+
+    let ok = false;
+    try {
+        ok = await reply() === "listening";
+
+        // Client 456 belongs to shard 0 and 457 to shard 1
+        const greeted = await withTimeout(Promise.all([
+            greet(456, Token.shardAddress(base, 2, 456)),
+            greet(457, Token.shardAddress(base, 2, 457))
+        ]));
+        ok = ok && greeted.every((value) => value);
+
+        // Client 459 belongs to shard 1, its token has the base address
+        greet(459, base);
+        const denied = await withTimeout(new Promise((resolve) => {
+            const poll = () => {
+                worker.postMessage("statistic");
+                reply().then((count) => {
+                    if (count > 0) {
+                        resolve(count);
+                    } else {
+                        setTimeout(poll, 10);
+                    }
+                });
+            };
+            poll();
+        }));
+        ok = ok && denied === 1;
+    } finally {
+        for (const client of clients) client.stop();
+        worker.postMessage("exit");
+    }
+
+    const code = await withTimeout(exited);
+    return ok && code === 0;
+}
+
+
+/// Whole and ranged targets both receive every relayed message
+async function testPipeRelay(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ]);
+    const source = pair.serverSession;
+
+    // Connect a second client to the same server
+    const other = new Socket([ ChannelMode.RELIABLE ]);
+    const otherValues = [];
+    const otherReceived = withTimeout(new Promise((resolve) => {
+        other.setListener({
+            onConnected() {},
+            onDisconnected() {},
+            onReceived(session, message) {
+                otherValues.push(message.readUint32());
+                if (otherValues.length === 2) resolve(otherValues);
+            }
+        });
+    }));
+    const connected = withTimeout(new Promise((resolve) => {
+        const poll = () => {
+            if (pair.serverSession !== source) {
+                resolve(pair.serverSession);
+            } else {
+                setTimeout(poll, 10);
+            }
+        };
+        poll();
+    }));
+    other.connect(createConnectToken(
+        createPrivateKey(), `${HOST}:${port}`, CLIENT_ID + 1
+    ));
+    const target = await connected;
+
+    // The source echoes whole messages and relays them without the opcode
+    source.pipeTo(source);
+    source.pipeTo(target, { offset: 1 });
+
+    const echoed = withTimeout(new Promise((resolve) => {
+        const sizes = [];
+        pair.onClientReceived = (session, message) => {
+            sizes.push(message.size());
+            if (sizes.length === 2) resolve(sizes);
+        };
+    }));
+
+    for (const value of [21, 22]) {
+        const message = new Message();
+        message.writeUint8(1);
+        message.writeUint32(value);
+        pair.clientSession.send(0, message);
+    }
+
+    const values = await otherReceived;
+    const sizes = await echoed;
+    other.stop();
+    pair.stop();
+    return sameValues(values, [21, 22]) && sameValues(sizes, [5, 5]);
+}
+
+
+
+/// Inputs of a member are aggregated into a frame. Members of unframed
+/// sockets are refused.
+async function testLockstep(port) {
+    const pair = await connectPair(port, [ ChannelMode.RELIABLE ], {
+        framed: true
+    });
+
+    const unframed = await connectPair(port + 100, [ ChannelMode.RELIABLE ]);
+    let refused = false;
+    try {
+        new LockstepAggregator({ timeoutMs: 50 }).add(unframed.serverSession);
+    } catch (error) {
+        refused = error instanceof TypeError;
+    }
+    unframed.stop();
+
+    const aggregator = new LockstepAggregator({ timeoutMs: 50, channel: 0 });
+    const slot = aggregator.add(pair.serverSession);
+
+    const received = withTimeout(new Promise((resolve) => {
+        pair.onClientReceived = (session, message) => {
+            resolve([
+                message.readUint32(),
+                message.readUint8(),
+                message.readUint8(),
+                message.readUint16(),
+                message.readUint8()
+            ]);
+        };
+    }));
+
+    const input = new Message();
+    input.writeUint32(0);
+    input.writeUint8(7);
+    pair.clientSession.send(0, input);
+
+    const frame = await received;
+    aggregator.remove(pair.serverSession);
+    pair.stop();
+    return refused && sameValues(frame, [0, 1, slot, 1, 7]);
+}
+
+const TESTS = [
+    testSendOrder,
+    testSendExpiry,
+    testSendLatest,
+    testSendLatestAcked,
+    testFramedPayload,
+    testSendLate,
+    testFecRecovery,
+    testAckSettlement,
+    testRateLimit,
+    testRoute,
+    testSendScatter,
+    testSendMany,
+    testSessionTable,
+    testSessionMetrics,
+    testIdNumber,
+    testReceiveWithoutConnected,
+    testSessionLookup,
+    testServerTime,
+    testAdmission,
+    testPipeRelay,
+    testShards,
+    testLockstep
+];
+
+
+export default async function testLoopback() {
+    let port = BASE_PORT;
+    for (const test of TESTS) {
+        let ok = false;
+        try {
+            ok = await test(port++);
+        } catch (error) {
+            console.error(error);
+        }
+
+        console.log(`Loopback ${test.name}: ${ok ? "OK" : "Failed"}`);
+        if (!ok) return false;
+    }
+    return true;
+}
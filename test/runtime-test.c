@@ -0,0 +1,229 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "quickjs.h"
+#include "logger/logger.h"
+#include "runtime/runtime.h"
+#include "pomelo-qjs/runtimes/runtime-uv.h"
+
+/// Native tests of the uv runtime APIs which are called by hosts
+
+
+/// @brief The number of posts of post test
+#define POST_TEST_COUNT 100
+
+
+/// @brief The number of ticks of poll test
+#define POLL_TEST_COUNT 5
+
+
+/// @brief The time limit of poll test in nanoseconds
+#define POLL_TEST_TIMEOUT_NS 5000000000ULL
+
+
+/// @brief The state of post test
+typedef struct post_test_s {
+    /// @brief The runtime
+    pomelo_qjs_runtime_t * runtime;
+
+    /// @brief The number of failed posts
+    int failures;
+} post_test_t;
+
+
+/// @brief The module of post test. It stops listening after the last event.
+static const char * post_test_source =
+    "globalThis.received = [];\n"
+    "globalThis.onExternalEvent = (event) => {\n"
+    "    received.push(event);\n"
+    "    if (received.length === 100) globalThis.onExternalEvent = null;\n"
+    "};\n";
+
+
+/// @brief The module of poll test. The interval is driven by the host polls.
+static const char * poll_test_source =
+    "globalThis.ticks = [];\n"
+    "const interval = setInterval(() => {\n"
+    "    ticks.push(ticks.length);\n"
+    "    if (ticks.length === 5) clearInterval(interval);\n"
+    "}, 1);\n";
+
+
+/// @brief Evaluate a module from source without running the loop
+static bool evaluate_source(
+    pomelo_qjs_runtime_t * runtime,
+    const char * module_name,
+    const char * source
+) {
+    JSValue module_val =
+        pomelo_qjs_runtime_compile_module(runtime, module_name, source);
+    if (JS_IsException(module_val)) return false;
+    return pomelo_qjs_runtime_evaluate(runtime, module_val) == 0;
+}
+
+
+/// @brief Check that the global array holds [0, count) in order
+static bool check_sequence(
+    pomelo_qjs_runtime_t * runtime,
+    const char * name,
+    int64_t count
+) {
+    JSContext * ctx = pomelo_qjs_runtime_get_js_context(runtime);
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue array = JS_GetPropertyStr(ctx, global, name);
+    JS_FreeValue(ctx, global);
+
+    int64_t length = 0;
+    bool ok = JS_GetLength(ctx, array, &length) == 0 && length == count;
+    for (int64_t i = 0; ok && i < length; i++) {
+        JSValue item = JS_GetPropertyInt64(ctx, array, i);
+        int32_t value = -1;
+        ok = JS_ToInt32(ctx, &value, item) == 0 && value == i;
+        JS_FreeValue(ctx, item);
+    }
+
+    JS_FreeValue(ctx, array);
+    return ok;
+}
+
+
+/// @brief Posted work of post test
+static void post_test_on_post(pomelo_qjs_runtime_t * runtime, void * data) {
+    JSContext * ctx = pomelo_qjs_runtime_get_js_context(runtime);
+    JSValue event = JS_NewInt32(ctx, (int32_t) (intptr_t) data);
+    pomelo_qjs_runtime_emit_external_event(runtime, event);
+    JS_FreeValue(ctx, event);
+}
+
+
+/// @brief Entry of the posting thread
+static void post_test_thread_main(void * arg) {
+    post_test_t * test = arg;
+    for (intptr_t i = 0; i < POST_TEST_COUNT; i++) {
+        if (pomelo_qjs_runtime_post(
+            test->runtime, post_test_on_post, (void *) i
+        ) < 0) {
+            test->failures++;
+        }
+    }
+}
+
+
+/// @brief Posts of another thread reach the hook in order
+static bool test_post(void) {
+    pomelo_qjs_runtime_uv_options_t options = { .allocator = NULL };
+    pomelo_qjs_runtime_t * runtime = pomelo_qjs_runtime_uv_create(&options);
+    if (!runtime) return false;
+
+    post_test_t test = { .runtime = runtime, .failures = 0 };
+    bool ok = evaluate_source(runtime, "post-test.js", post_test_source);
+
+    uv_thread_t thread;
+    if (ok) ok = uv_thread_create(&thread, post_test_thread_main, &test) == 0;
+    if (ok) {
+        // The hook keeps the loop alive until the last event
+        pomelo_qjs_runtime_run(runtime);
+        uv_thread_join(&thread);
+        ok = test.failures == 0 &&
+            check_sequence(runtime, "received", POST_TEST_COUNT);
+    }
+
+    pomelo_qjs_runtime_uv_destroy(runtime);
+    return ok;
+}
+
+
+/// @brief A host which owns the loop drives the runtime by polling
+static bool test_poll(void) {
+    uv_loop_t uv_loop;
+    if (uv_loop_init(&uv_loop)) return false;
+
+    pomelo_qjs_runtime_uv_options_t options = {
+        .allocator = NULL,
+        .uv_loop = &uv_loop
+    };
+    pomelo_qjs_runtime_t * runtime = pomelo_qjs_runtime_uv_create(&options);
+    if (!runtime) {
+        uv_loop_close(&uv_loop);
+        return false;
+    }
+
+    bool ok = evaluate_source(runtime, "poll-test.js", poll_test_source);
+
+    // Polls never block, the host spins like a frame loop
+    uint64_t deadline = uv_hrtime() + POLL_TEST_TIMEOUT_NS;
+    while (ok && pomelo_qjs_runtime_poll(runtime, 1000)) {
+        ok = uv_hrtime() < deadline;
+    }
+    ok = ok && check_sequence(runtime, "ticks", POLL_TEST_COUNT);
+
+    // The loop of host outlives the runtime
+    pomelo_qjs_runtime_uv_destroy(runtime);
+    uv_run(&uv_loop, UV_RUN_NOWAIT);
+    return uv_loop_close(&uv_loop) == 0 && ok;
+}
+
+
+int main(void) {
+    bool ok = test_post();
+    printf("Test post: %s\n", ok ? "OK" : "Failed");
+    if (!ok) return 1;
+
+    ok = test_poll();
+    printf("Test poll: %s\n", ok ? "OK" : "Failed");
+    return ok ? 0 : 1;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                              Host functions                                */
+/* -------------------------------------------------------------------------- */
+
+int pomelo_qjs_runtime_load_source(
+    pomelo_qjs_runtime_t * runtime,
+    pomelo_qjs_source_t * source,
+    const char * module_name
+) {
+    (void) runtime;
+    (void) source;
+    (void) module_name;
+    return -1; // Tests only compile modules from source
+}
+
+
+void pomelo_qjs_runtime_unload_source(
+    pomelo_qjs_runtime_t * runtime,
+    pomelo_qjs_source_t * source
+) {
+    (void) runtime;
+    (void) source;
+}
+
+
+int pomelo_qjs_logger_init(pomelo_qjs_context_t * context) {
+    (void) context;
+    return 0;
+}
+
+
+void pomelo_qjs_logger_cleanup(pomelo_qjs_context_t * context) {
+    (void) context;
+}
+
+
+void pomelo_qjs_logger_log(
+    pomelo_qjs_context_t * context,
+    pomelo_qjs_logger_level level,
+    const char * fmt,
+    ...
+) {
+    (void) context;
+    (void) level;
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
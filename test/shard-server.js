@@ -0,0 +1,45 @@
+import { Token, Socket, Message, ChannelMode, statistic } from "pomelo";
+
+/// Sharded server of the loopback shard test. The test runs it in a worker,
+/// and the worker runtime runs it again as shard 1 on its own thread. Only
+/// shard 0 has the parent port, it reports its denied connections.
+
+const ADDRESS = "127.0.0.1:8880";
+const PROTOCOL_ID = 129;
+const SHARDS = 2;
+
+
+function createPrivateKey() {
+    const privateKey = new Uint8Array(Token.KEY_BYTES);
+    for (let i = 0; i < Token.KEY_BYTES; i++) privateKey[i] = i;
+    return privateKey;
+}
+
+
+const server = new Socket([ ChannelMode.RELIABLE ]);
+server.setListener({
+    onConnected(session) {
+        // Only admitted clients are greeted
+        const message = new Message();
+        message.writeUint32(1);
+        session.send(0, message);
+    },
+    onDisconnected() {},
+    onReceived() {}
+});
+
+await server.listen(createPrivateKey(), PROTOCOL_ID, 4, ADDRESS, {
+    shards: SHARDS
+});
+
+if (globalThis.parentPort) {
+    parentPort.onmessage = (event) => {
+        if (event.data === "exit") {
+            server.stop();
+            parentPort.onmessage = null;
+            return;
+        }
+        parentPort.postMessage(statistic().binding.rejectedConnections);
+    };
+    parentPort.postMessage("listening");
+}
@@ -0,0 +1,75 @@
+import { Message, SnapshotBuffer } from "pomelo";
+
+
+/**
+ * Test snapshot buffer
+ * @returns {boolean}
+ */
+export default function testSnapshotBuffer() {
+    const buffer = new SnapshotBuffer(50);
+
+    // Empty buffer has nothing to sample
+    const from = new Message();
+    const to = new Message();
+    if (buffer.sample(from, to) !== -1) {
+        return false;
+    }
+
+    for (let tick = 1; tick <= 3; tick++) {
+        const snapshot = new Message();
+        snapshot.writeUint32(tick);
+        snapshot.writeFloat64(tick * 10);
+        buffer.push(snapshot);
+    }
+
+    const alpha = buffer.sample(from, to);
+    if (alpha < 0 || alpha > 1) {
+        return false;
+    }
+
+    // Sampled snapshots keep their ticks
+    const fromTick = from.readUint32();
+    const toTick = to.readUint32();
+    if (fromTick < 1 || toTick > 3 || fromTick > toTick) {
+        return false;
+    }
+
+    buffer.clear();
+    if (buffer.sample(from, to) !== -1) {
+        return false;
+    }
+
+    return testTickWraparound();
+}
+
+
+/**
+ * Snapshots keep their order when the uint32 tick wraps
+ * @returns {boolean}
+ */
+function testTickWraparound() {
+    const buffer = new SnapshotBuffer(50);
+    const ticks = [0xFFFFFFFE, 0xFFFFFFFF, 0, 1];
+    for (const tick of ticks) {
+        const snapshot = new Message();
+        snapshot.writeUint32(tick);
+        snapshot.writeFloat64(1);
+        buffer.push(snapshot);
+    }
+
+    const from = new Message();
+    const to = new Message();
+    const alpha = buffer.sample(from, to);
+    if (alpha < 0 || alpha > 1) {
+        return false;
+    }
+
+    const fromTick = from.readUint32();
+    const toTick = to.readUint32();
+    if (!ticks.includes(fromTick) || !ticks.includes(toTick)) {
+        return false;
+    }
+
+    // The sampled snapshots are at most the whole pushed range apart
+    return ((toTick - fromTick) >>> 0) < ticks.length;
+}
@@ -1,3 +1,6 @@
+import { Message } from "pomelo";
+
+
 
 
 function testSetTimeout() {
@@ -29,8 +32,115 @@ function testSetInterval() {
 }
 
 
+function testWorker() {
+    const path = import.meta.url.replace(/[^/]*$/, "worker-echo.js");
+    return new Promise((resolve) => {
+        const worker = new Worker(path);
+        const buffer = new Uint8Array([1, 2, 3]).buffer;
+        let echoed = false;
+        worker.onmessage = (event) => {
+            const [received] = event.transfer;
+            echoed = (
+                event.data.value === 42 &&
+                received.byteLength === 3 &&
+                new Uint8Array(received)[2] === 3
+            );
+            worker.postMessage("exit");
+        };
+        worker.onexit = (code) => {
+            resolve(echoed && code === 0);
+        };
+
+        worker.postMessage({ value: 42 }, [buffer]);
+        if (buffer.byteLength !== 0) {
+            resolve(false); // Not detached
+        }
+    });
+}
+
+
+/// A transferred message is detached from the sender and its payload is
+/// copied into a message of the worker
+function testWorkerMessage() {
+    const path = import.meta.url.replace(/[^/]*$/, "worker-echo.js");
+    return new Promise((resolve) => {
+        const worker = new Worker(path);
+        const message = new Message();
+        message.writeUint32(7);
+        let echoed = false;
+        worker.onmessage = (event) => {
+            const [received] = event.transfer;
+            echoed = received.size() === 4 && received.readUint32() === 7;
+            worker.postMessage("exit");
+        };
+        worker.onexit = (code) => {
+            resolve(echoed && code === 0);
+        };
+
+        // Rejected posts leave every transferred object attached
+        const buffer = new ArrayBuffer(8);
+        const first = new Message();
+        first.writeUint32(1);
+        const partial = new Message();
+        partial.writeUint32(2);
+        partial.writeUint32(3);
+        partial.readUint32();
+        const rejected = [
+            () => worker.postMessage({ buffer }, [buffer]),
+            () => worker.postMessage(new Uint8Array(buffer), [buffer]),
+            () => worker.postMessage({}, [buffer, buffer]),
+            () => worker.postMessage({}, [buffer, first, partial])
+        ].every((post) => {
+            try {
+                post();
+                return false;
+            } catch (error) {
+                return true;
+            }
+        });
+        if (!rejected || buffer.byteLength !== 8 || first.size() !== 4) {
+            resolve(false);
+        }
+
+        worker.postMessage({}, [message]);
+        if (message.size() !== 0) {
+            resolve(false); // Not detached
+        }
+    });
+}
+
+
+async function testTaskPool() {
+    const path = import.meta.url.replace(/[^/]*$/, "task-module.js");
+    const pool = new TaskPool(2);
+    const results = await Promise.all([
+        pool.run(path, "fibonacci", [30]),
+        pool.run(path, "fibonacci", [10]),
+        pool.run(path, "sum", [[1, 2, 3]])
+    ]);
+
+    let rejected = false;
+    try {
+        await pool.run(path, "missing");
+    } catch (error) {
+        rejected = true;
+    }
+
+    pool.close();
+    return (
+        rejected &&
+        results[0] === 832040 &&
+        results[1] === 55 &&
+        results[2] === 6
+    );
+}
+
+
 export default async function testSTD() {
     await testSetTimeout();
     await testSetInterval();
+    if (!await testWorker()) return false;
+    if (!await testWorkerMessage()) return false;
+    if (!await testTaskPool()) return false;
     return true;
 }
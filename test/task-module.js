@@ -0,0 +1,12 @@
+export function fibonacci(n) {
+    let [a, b] = [0, 1];
+    for (let i = 0; i < n; i++) {
+        [a, b] = [b, a + b];
+    }
+    return a;
+}
+
+
+export async function sum(values) {
+    return values.reduce((total, value) => total + value, 0);
+}
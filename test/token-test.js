@@ -39,5 +39,8 @@ export default function testToken() {
         Uint8Array.from(userDataArray)
     );
 
-    return token != null;
+    // Shard K of a sharded server listens on the base port plus K
+    const shardAddress = Token.shardAddress("127.0.0.1:8888", 4, 6);
+
+    return token != null && shardAddress === "127.0.0.1:8890";
 }
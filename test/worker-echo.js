@@ -0,0 +1,10 @@
+parentPort.onmessage = (event) => {
+    const { data } = event;
+    if (data === "exit") {
+        parentPort.onmessage = null;
+        return;
+    }
+
+    // Transfer the received objects back
+    parentPort.postMessage(data, event.transfer || []);
+};